@@ -66,6 +66,8 @@ static inline bool not_sched(struct Fiber* fib) { return fib != sched; }
 	enum {WAKE_VALUE=1, WAKE_ERROR} wake_flag;
 	int   ushard;
 	void *txn;
+	int   wal_sync_mode; /* enum wal_sync_mode requested by current txn */
+	u64   wal_wait; /* TSC ticks current request spent waiting for WAL */
 
 #if CFG_lua_path
 	struct lua_State *L;
@@ -84,6 +84,12 @@ static inline bool index_type_is_hash(enum index_type tp) {
 static inline bool index_type_is_tree(enum index_type tp) {
 	return tp == SPTREE || tp == FASTTREE || tp == COMPACTTREE || tp == POSTREE;
 }
+/* slot layout of HASH and NUMHASH indexes */
+enum index_hash_layout {
+	HASH_LAYOUT_DEFAULT, /* neighborhood bitmap, probing slot by slot */
+	HASH_LAYOUT_GROUP,   /* control byte per slot, probing 16 slots at once */
+	MAX_HASH_LAYOUT
+};
 
 struct index_conf {
 	char min_tuple_cardinality /* minimum required tuple cardinality */,
@@ -91,6 +97,7 @@ struct index_conf {
 	char type;
 	bool unique;
 	char n;
+	char hash_layout;
 	char fill_order[8]; /* indexes of field[] ordered as they appear in tuple,
 			       used by sequential scan in box_tuple_gen_dtor */
 	struct index_field_desc field[8]; /* key fields ordered as they appear in index */
@@ -136,6 +143,7 @@ typedef struct tnt_object* tnt_ptr;
 - (struct tnt_object *)find_obj:(struct tnt_object *)obj;
 - (struct tnt_object *)find_node:(const struct index_node *)obj;
 - (struct tnt_object *) find_key:(struct tbuf *)key_data cardinalty:(u32)key_cardinality;
+- (u32) find_keys:(struct tbuf *)key_data count:(u32)count result:(struct tnt_object **)obj;
 - (int) remove: (struct tnt_object *)obj;
 - (void) replace: (struct tnt_object *)obj;
 - (void) valid_object: (struct tnt_object *)obj;
@@ -180,9 +188,26 @@ typedef struct tnt_object* tnt_ptr;
 /* common method */
 - (int)eq:(struct tnt_object *)a :(struct tnt_object*)b;
 - (struct tnt_object *)find:(const char *)key;
+/* batched find_key: looks up at most count keys, each prefixed by its
+   cardinality, stops before first key which is not a full one.
+   returns number of consumed keys, obj[i] is NULL if key is not found */
+- (u32)find_keys:(struct tbuf *)key_data count:(u32)count result:(struct tnt_object **)obj;
 - (u32)size;
 - (const char *)info;
 @end
+
+#define INDEX_FIND_BATCH 32
+
+/* cardinality of next key in key_data or -1 if key_data is too short */
+static inline int
+index_peek_cardinality(const struct tbuf *key_data)
+{
+	u32 c;
+	if (tbuf_len(key_data) < sizeof(c))
+		return -1;
+	memcpy(&c, key_data->ptr, sizeof(c));
+	return c;
+}
 static inline bool index_is_hash(const Index* index) {
 	return index_type_is_hash(index->conf.type);
 }
@@ -196,7 +221,12 @@ static inline bool index_is_tree(const Index* index) {
 - (struct tnt_object *) get:(u32)i;
 - (u32)  cur_iter;
 - (void) iterator_init_pos: (u32)i;
+/* changes whenever existing entries move to other positions (rehash) */
+- (u32)  generation;
 - (void) ordered_iterator_init; /* WARNING! after this the index become corrupt! */
+/* insert object whose key is known to be absent (e.g. snapshot load of PK),
+   skips key comparisons. call resize: with expected size first */
+- (void) bulk_insert:(struct tnt_object *)obj;
 @end
 
 @interface Hash: Index {
@@ -223,6 +253,18 @@ static inline bool index_is_tree(const Index* index) {
 	struct mh_gen_t *h;
 }
 @end
+@interface Int32GroupHash: Hash <HashIndex> {
+	struct mh_i32g_t *h;
+}
+@end
+@interface Int64GroupHash: Hash <HashIndex> {
+	struct mh_i64g_t *h;
+}
+@end
+@interface GenGroupHash: Hash <HashIndex> {
+	struct mh_geng_t *h;
+}
+@end
 
 /* must be same as sptree_direction_t */
 enum iterator_direction {
@@ -245,6 +287,10 @@ typedef void (*ixsort_on_duplicate)(void* arg, struct index_node* a, struct inde
 @interface Tree: Index <BasicIndex, IterIndex>
 - (void)set_sorted_nodes:(void *)nodes_ count:(size_t)count;
 - (bool)sort_nodes:(void *)nodes_ count:(size_t)count onduplicate:(ixsort_on_duplicate)ondup arg:(void*)arg;
+/* number of entries between (partial) keys from and to inclusive,
+   zero cardinality means unbounded. linear unless overridden */
+- (u32)count_from:(struct tbuf *)from cardinalty:(u32)from_cardinality
+	       to:(struct tbuf *)to cardinalty:(u32)to_cardinality;
 @end
 
 @interface SPTree: Tree {
@@ -278,6 +324,11 @@ typedef void (*ixsort_on_duplicate)(void* arg, struct index_node* a, struct inde
 }
 - (uint32_t) position_with_node:(const struct index_node *)key;
 - (uint32_t) position_with_object:(struct tnt_object*)obj;
+/* same as iterator_init_with_key:cardinalty: followed by skipping of
+   at most n entries matching key, returns number of skipped entries */
+- (u32) iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality skip:(u32)n;
+/* from or to == NULL means unbounded */
+- (u32) count_from_node:(const struct index_node *)from to_node:(const struct index_node *)to;
 @end
 
 @interface NIHCompactTree : NIHTree
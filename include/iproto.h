@@ -84,6 +84,7 @@ LIST_HEAD(iproto_future_list, iproto_future);
 - (void)packet_ready:(struct iproto *)msg;
 @end
 
+struct iproto_io_conn;
 @interface iproto_ingress_svc: iproto_ingress {
 @public
 	LIST_ENTRY(iproto_ingress_svc) link, prepare_link;
@@ -91,8 +92,10 @@ LIST_HEAD(iproto_future_list, iproto_future);
 	struct iproto_service *service;
 	int batch;
 	ev_tstamp input_overflow_warn;
+	struct iproto_io_conn *io_conn; /* socket is owned by io thread */
 }
 - (void)init:(int)fd_ service:(struct iproto_service *)service_;
+- (void)init:(int)fd_ service:(struct iproto_service *)service_ io_conn:(struct iproto_io_conn *)conn;
 @end
 
 @interface iproto_egress: netmsg_io {
@@ -139,10 +142,14 @@ struct iproto_service {
 	Class ingress_class;
 	void (*on_bind)(int fd);
 	const char *addr;
+
+	struct iproto_io_threads *io_threads;
 };
 void iproto_service(struct iproto_service *service, const char *addr);
 void iproto_service_info(struct tbuf *out, struct iproto_service *service);
 void iproto_worker(va_list ap);
+/* account WAL wait of current request, see stat base "iproto_lat" */
+void iproto_wal_latency(int shard_id, u64 ticks);
 #define SERVICE_DEFAULT_CAPA 0x100
 void service_set_handler(struct iproto_service *s, struct iproto_handler h);
 static inline struct iproto_handler *service_find_code(struct iproto_service *s, int code)
@@ -201,6 +208,13 @@ struct iproto *iproto_mbox_get(struct iproto_mbox *mbox);
 struct iproto *iproto_mbox_peek(struct iproto_mbox *mbox);
 void iproto_mbox_put(struct iproto_mbox *mbox, struct iproto *msg);
 
+/* network io threads: each accepts on own SO_REUSEPORT socket, frames
+   requests and writes replies, requests are executed by main thread */
+int iproto_io_threads_start(struct iproto_service *service, int count);
+ssize_t iproto_io_conn_flush(struct iproto_ingress_svc *io);
+void iproto_io_conn_close(struct iproto_ingress_svc *io);
+void iproto_ingress_feed(struct iproto_ingress_svc *io, const void *data, int len);
+
 void iproto_pinger(va_list ap);
 struct iproto *iproto_rbuf_req(struct netmsg_io *io);
 
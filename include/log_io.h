@@ -127,8 +127,10 @@ extern int xlog_dir_fd(struct XLogDirRS *);
 - (XLog *) find_with_lsn:(i64)lsn;
 - (XLog *) find_with_scn:(i64)scn shard:(int)shard_id;
 - (i64) greatest_lsn;
+- (i64) next_file_lsn:(i64)lsn; /* first file after one starting at lsn, 0 if none */
 - (int) lock;
 - (int) sync;
+- (void) set_xlog_class:(Class)class;
 @end
 
 @interface SnapDir: XLogDir
@@ -166,6 +168,7 @@ typedef struct marker_desc {
 	off_t size, eof_size;
 } marker_desc_t;
 
+struct xlog_verifier;
 @interface XLog: Object <XLogPuller> {
 	size_t rows, wet_rows;
 	bool eof, header_written;
@@ -180,6 +183,8 @@ typedef struct marker_desc {
 	FILE *fd;
 	i64 last_read_lsn;
 	u16 tag_mask;
+	off_t row_offset; /* offset of the row being read */
+	struct xlog_verifier *verifier;
 @public
 	char *filename;
 
@@ -200,28 +205,73 @@ typedef struct marker_desc {
 			      dir:(XLogDir *)dir;
 
 - (void) follow:(follow_cb *)cb data:(void *)data;
+/* read and crc check rows ahead of reader in separate thread */
+- (void) verify_ahead;
 - (int) inprogress_rename;
 - (int) read_header;
 - (void) write_header;
 - (int) flush;
+- (int) datasync;
 - (void) fadvise_dont_need;
 - (size_t) rows;
 - (i64) last_read_lsn;
+- (off_t) row_offset; /* file offset of last fetched row (after marker) */
 - (const struct row_v12 *) append_row:(const void *)data len:(u32)data_len scn:(i64)scn tag:(u16)tag;
 - (const struct row_v12 *) append_row:(const void *)data len:(u32)data_len shard:(Shard *)shard tag:(u16)tag;
 - (const struct row_v12 *) append_row:(struct row_v12 *)row data:(const void *)data;
 
 - (i64) confirm_write;
 - (void) append_successful:(size_t)bytes;
+/* start writing of appended rows without waiting for completion,
+   returns false if write is already done (or can't be done asynchronously).
+   completion is reaped by [confirm_write] */
+- (bool) submit_write:(bool)sync;
+- (int) completion_fd;
 - (int) fileno;
 - (int) write_eof_marker;
 - (marker_desc_t) marker_desc;
+/* append len bytes of already serialized rows from src fd */
+- (int) append_raw:(int)src len:(off_t)len rows:(size_t)count;
 @end
 
 @interface XLog12: XLog
 - (void) write_header_scn:(const i64 *)scn;
+- (int) write_row:(const struct row_v12 *)row data:(const void *)data;
 @end
 
+@interface Snap12: XLog12 {
+	size_t bytes;
+	ev_tstamp step_ts, last_ts;
+}
+@end
+
+/* v12 rows packed into LZ4 compressed blocks, each block is protected by crc32c.
+   rows may span block boundary */
+@interface SnapLZ4: Snap12 {
+	char *raw, *zbuf;
+	size_t raw_len, raw_pos, raw_size, zbuf_size;
+}
+@end
+
+#if HAVE_LIBURING
+/* XLog12 which writes rows with io_uring: whole batch is submitted as single
+   write (optionally linked with fdatasync) and reaped by [confirm_write] */
+struct xlog_uring;
+@interface XLogUring: XLog12 {
+	struct xlog_uring *uring;
+}
++ (bool) available;
+@end
+#endif
+
+/* WAL acknowledgement policy, larger value means stronger guarantee */
+enum wal_sync_mode {
+	WAL_SYNC_ASYNC = 0,	/* ack after write(2), fsync according to wal_fsync_delay */
+	WAL_SYNC_WRITE = 1,	/* ack after write(2), fdatasync at the end of group commit window */
+	WAL_SYNC_FSYNC = 2	/* ack only after group fdatasync succeeds */
+};
+int wal_sync_mode_parse(const char *str);
+
 struct wal_pack {
 	struct netmsg_head *netmsg;
 	struct row_v12 *row;
@@ -239,12 +289,16 @@ struct wal_request {
 	u32 magic;
 	i64 seq;
 	i64 epoch;
+	u32 sync_mode;
 } __attribute__((packed));
 
 struct wal_reply {
 	u32 packet_len;
 	u32 row_count;
 	i64 seq, epoch, lsn;
+	/* group commit stat: filled on first reply after fdatasync */
+	u32 group_rows, group_bytes;
+	float sync_time;
 } __attribute__((packed));
 
 
@@ -283,6 +337,8 @@ bool our_shard(const struct shard_op *sop);
 
 @protocol RecoverRow
 - (void) recover_row:(struct row_v12 *)row;
+/* optional: - (void) recover_row_cutoff;
+   called by XLogReader before memory of recovered rows is released */
 @end
 
 @interface XLogReader : Object {
@@ -309,6 +365,34 @@ bool our_shard(const struct shard_op *sop);
 }
 - (id) init_state:(id<RecoveryState>)state;
 - (int) snapshot_write;
+/* in-process snapshot: read views of all shards are frozen under lock
+   and dumped by a thread, calling fiber waits without blocking the loop */
+- (int) snapshot_write_nofork:(struct rwlock *)lock;
+@end
+
+/* parallel snapshot: worker threads serialize independent parts of a snapshot
+   (e.g. object spaces) into temporary chunk files. Chunks are stitched into
+   the snapshot in submission order, so result is identical to serial dump.
+   callback runs outside of fiber context: no palloc, no ev, no title() */
+struct snap_chunk;
+typedef int (snap_chunk_cb)(struct snap_chunk *chunk, void *arg);
+int snap_chunk_append(struct snap_chunk *chunk, u16 tag, const struct iovec *iov, int iovcnt);
+int snapshot_write_parallel(XLog *snap, Shard *shard, int count, snap_chunk_cb *cb, void **args);
+/* same, but with explicit row header fields. safe to call outside of fiber context */
+int snapshot_write_chunks(XLog *snap, i64 scn, u16 shard_id, double tm,
+			  int count, snap_chunk_cb *cb, void **args);
+
+/* optional executor methods for fork-free snapshot (cfg.snap_no_fork) */
+@protocol SnapshotView
+/* main thread: capture consistent read view, objects in it must be kept alive */
+- (void *) snapshot_freeze;
+/* main thread: called repeatedly while view is dumped, moves next part of
+   state into view. returns 0 when view can't take more yet, -1 when done */
+- (int) snapshot_feed:(void *)view;
+/* snapshot thread: dump view, same restrictions as snap_chunk_cb */
+- (int) snapshot_write_view:(void *)view to:(XLog *)snap;
+/* main thread: view is no longer needed */
+- (void) snapshot_release:(void *)view;
 @end
 
 @protocol XLogWriter
@@ -324,6 +408,7 @@ bool our_shard(const struct shard_op *sop);
 	struct netmsg_io *io;
 	ev_prepare prepare;
 	struct netmsg_pool_ctx ctx;
+	int stat_base;
 @public
 	i64 epoch, seq;
 	TAILQ_HEAD(wal_pack_tailq, wal_pack) wal_queue;
@@ -345,6 +430,8 @@ bool our_shard(const struct shard_op *sop);
 	bool abort;
 	struct Fiber *in_recv;
 	struct feeder_param *feeder;
+	u32 flags; /* REPLICATION_* flags accepted by feeder */
+	struct tbuf zbuf;
 	char errbuf[64];
 }
 
@@ -372,6 +459,8 @@ struct replication_handshake_base {
 
 #define replication_handshake_v1 replication_handshake_base
 
+/* upper bits of filter_type carry REPLICATION_* flags. Feeder replies
+   with accepted flags right after version */
 struct replication_handshake_v2 {
 	replication_handshake_base_fields;
 	u32 filter_type;
@@ -379,9 +468,19 @@ struct replication_handshake_v2 {
 	char filter_arg[];
 } __attribute__((packed));
 
+#define REPLICATION_FILTER_TYPE_MASK 0xffff
+#define REPLICATION_LZ4 0x10000 /* rows are sent in LZ4 compressed frames */
+#define REPLICATION_MARKERS 0x20000 /* rows are prefixed with marker, as in WAL files */
+
+struct replication_lz4_frame {
+	u32 len, raw_len;
+	char data[];
+} __attribute__((packed));
+
 struct feeder_param {
 	struct sockaddr_in addr;
 	u32 ver;
+	u32 flags;
 	struct feeder_filter {
 		u32 type;
 		u32 arglen;
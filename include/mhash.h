@@ -228,8 +228,28 @@ typedef typeof(mh_slot_val((mh_slot_t *)0)) _mh(val_t);
 #ifndef mh_byte_map
 # define mh_byte_map 0
 #endif
+#ifndef mh_group_map
+# define mh_group_map 0
+#endif
 #ifndef mh_custom_map
-#if mh_byte_map
+#if mh_group_map
+/* Swiss table style layout: control byte per slot, lookup compares
+   aligned group of 16 control bytes at once (single SSE2 compare).
+   control byte: 0 - empty, 1 - deleted, 0x80|h2 - occupied,
+   where h2 is upper 7 bits of 64 bit mixed hash, slot comes from low bits */
+# define mh_map_t		uint8_t
+# define mh_divider		1
+# define mh_get_hashik(k)	((mh_map_t)(0x80 | ((k) >> 57)))
+# define mh_exist(h, i)		(h->map[i] & 0x80)
+# define mh_setfree(h, i)	h->map[i] = 1
+# define mh_mayequal(h, i, hk)	(h->map[i] == (hk))
+# define mh_setexist(h, i, hk)	h->map[i] = 0x80 | (hk)
+# define mh_dirty(h, i)		(h->map[i] != 0)
+# define mh_setdirty(h, i)	(void)0
+# define mh_prefetch_map(h, i)	__builtin_prefetch(&h->map[i])
+# undef mh_neighbors
+# define mh_neighbors		4 /* smallest table is exactly one group */
+#elif mh_byte_map
 # if mh_byte_map == 1
 #  define mh_map_t		uint8_t
 #  define mh_divider		125
@@ -246,6 +266,7 @@ typedef typeof(mh_slot_val((mh_slot_t *)0)) _mh(val_t);
 # define mh_setexist(h, i, hk)	h->map[i] |= hk
 # define mh_dirty(h, i)		(h->map[i] & 1)
 # define mh_setdirty(h, i)	h->map[i] |= 1
+# define mh_prefetch_map(h, i)	__builtin_prefetch(&h->map[i])
 #else
 # define mh_divider		1
 # define mh_map_t		uint32_t
@@ -256,7 +277,12 @@ typedef typeof(mh_slot_val((mh_slot_t *)0)) _mh(val_t);
 # define mh_setexist(h, i, hk)	({ (void)(hk); h->map[(i) >> 4] |= (1u << ((i) & 0xf)); })
 # define mh_dirty(h, i)		(h->map[(i) >> 4] & (1u << (((i) & 0xf) + 0x10)))
 # define mh_setdirty(h, i)	h->map[(i) >> 4] |= (0x10000u << ((i) & 0xf))
+# define mh_prefetch_map(h, i)	__builtin_prefetch(&h->map[(i) >> 4])
+#endif
 #endif
+#ifndef mh_prefetch_map
+/* custom map lives in slot */
+# define mh_prefetch_map(h, i)	(void)0
 #endif
 
 #define mhash_t _mh(t)
@@ -269,6 +295,7 @@ struct _mh(t) {
 	uint32_t n_mask, n_occupied, size, upper_bound;
 
 	uint32_t resize_position, resize_batch;
+	uint32_t generation; /* bumped whenever slots are rehashed */
 	struct mhash_t *shadow;
 	void *(*realloc)(void *, size_t);
 #ifdef mh_arg_t
@@ -290,6 +317,13 @@ MH_DECL size_t _mh(bytes)(struct mhash_t *h);
 
 /* basic */
 static inline uint32_t _mh(get)(const struct mhash_t *h, mh_key_t const key);
+/* batched lookup: hash all keys and prefetch their buckets first,
+   then probe each one with get_hashed():
+   for (i = 0; i < n; i++) k[i] = mh_name_prefetch(h, key[i]);
+   for (i = 0; i < n; i++) x[i] = mh_name_get_hashed(h, key[i], k[i]);
+ */
+static inline unsigned _mh(prefetch)(const struct mhash_t *h, mh_key_t const key);
+static inline uint32_t _mh(get_hashed)(const struct mhash_t *h, mh_key_t const key, unsigned k);
 /* it's safe (and fast) to set value via pvalue() pointer right after iput():
    uint32_t x = mh_name_iput(h, new_key, NULL);
    *mh_pvalue(h, x) = new_value;
@@ -304,6 +338,9 @@ static inline uint32_t _mh(sget_by_key)(const struct mhash_t *h, mh_key_t key);
 static inline int _mh(sremove)(struct mhash_t *h, mh_slot_t const *slot, mh_slot_t *prev_slot);
 static inline int _mh(sremove_by_key)(struct mhash_t *h, mh_key_t key, mh_slot_t *prev_slot);
 static inline int _mh(sput)(struct mhash_t *h, mh_slot_t const *slot, mh_slot_t *prev_slot);
+/* bulk load: key of slot MUST NOT be in hash. No key comparisons are done;
+   pre-size hash with start_resize() to avoid resizes during load */
+static inline void _mh(sput_new)(struct mhash_t *h, mh_slot_t const *slot);
 
 /* kv */
 static inline mh_key_t _mh(key)(struct mhash_t *h, uint32_t x);
@@ -479,6 +516,57 @@ static inline unsigned mh_str_hash(const char *kk) { return  mh_MurmurHash2(kk,
 #  define mh_occupied_as_dirty_opt(h, i) 0
 #endif
 
+#if mh_group_map && !defined(MH_GROUP_HELPER)
+#define MH_GROUP_HELPER
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#define MH_GROUP 16
+/* identity hash of int keys would put neighbour keys into one group.
+   murmur3 fmix64: all bits depend on all key bits, so slot (low bits)
+   and control byte (top 7 bits) never overlap */
+static inline uint64_t
+mh_group_mix(uint32_t k)
+{
+	uint64_t x = k;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+/* bitmask of slots in group having control byte equal to c */
+static inline unsigned
+mh_group_match(const uint8_t *ctrl, uint8_t c)
+{
+#ifdef __SSE2__
+	__m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c)));
+#else
+	unsigned m = 0;
+	for (int i = 0; i < MH_GROUP; i++)
+		m |= (unsigned)(ctrl[i] == c) << i;
+	return m;
+#endif
+}
+
+/* bitmask of empty or deleted slots in group */
+static inline unsigned
+mh_group_match_free(const uint8_t *ctrl)
+{
+#ifdef __SSE2__
+	__m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+	return ~_mm_movemask_epi8(g) & 0xffff;
+#else
+	unsigned m = 0;
+	for (int i = 0; i < MH_GROUP; i++)
+		m |= (unsigned)((ctrl[i] & 0x80) == 0) << i;
+	return m;
+#endif
+}
+#endif
+
 struct _mh(find_loop) {
 	unsigned i, inc, dlt, step;
 };
@@ -535,10 +623,115 @@ static inline void _mh(find_loop_step)(struct _mh(find_loop) *l, unsigned mask)
 	l->i &= mask;
 }
 
+static inline unsigned
+_mh(prefetch)(const struct mhash_t *h, mh_key_t key)
+{
+	unsigned k = mh_hash(h, key);
+#if mh_group_map
+	unsigned i = (uint32_t)mh_group_mix(k) & h->n_mask & ~(MH_GROUP - 1);
+#else
+	unsigned i = k & h->n_mask;
+#endif
+	__builtin_prefetch(mh_slot(h, i));
+	mh_prefetch_map(h, i);
+	return k;
+}
+
 static inline uint32_t
 _mh(get)(const struct mhash_t *h, mh_key_t key)
 {
-	unsigned k = mh_hash(h, key);
+	return _mh(get_hashed)(h, key, mh_hash(h, key));
+}
+
+#if mh_group_map
+/* groups are probed quadratically, probe stops at group with empty slot.
+   insert prefers home slot (mix & n_mask) of the first group, so it's
+   loaded in parallel with control bytes */
+static inline uint32_t
+_mh(get_hashed)(const struct mhash_t *h, mh_key_t key, unsigned k)
+{
+	uint64_t mix = mh_group_mix(k);
+	mh_map_t hk = mh_get_hashik(mix);
+	uint32_t i = mix & h->n_mask & ~(MH_GROUP - 1), step = 0;
+	__builtin_prefetch(mh_slot(h, (mix & h->n_mask)));
+	for (;;) {
+		const uint8_t *ctrl = h->map + i;
+		for (unsigned m = mh_group_match(ctrl, hk); m; m &= m - 1) {
+			uint32_t x = i + __builtin_ctz(m);
+			if (mh_slot_key_eq(h, x, key))
+				return x;
+		}
+		if (mh_group_match(ctrl, 0))
+			return mh_end(h);
+
+		step += MH_GROUP;
+		i = (i + step) & h->n_mask;
+	}
+}
+
+static inline uint32_t
+_mh(short_mark)(struct mhash_t *h, mh_key_t key)
+{
+	uint64_t mix = mh_group_mix(mh_hash(h, key));
+	uint32_t i = mix & h->n_mask & ~(MH_GROUP - 1), step = 0;
+	for (;;) {
+		unsigned m = mh_group_match_free(h->map + i);
+		if (m) {
+			uint32_t x = i + __builtin_ctz(m);
+			if (step == 0 && !mh_exist(h, (mix & h->n_mask)))
+				x = mix & h->n_mask;
+			if (h->map[x] == 0)
+				h->n_occupied++;
+			mh_setexist(h, x, mh_get_hashik(mix));
+			h->size++;
+			return x;
+		}
+
+		step += MH_GROUP;
+		i = (i + step) & h->n_mask;
+	}
+}
+
+static inline uint32_t
+_mh(mark)(struct mhash_t *h, mh_key_t key, int *exist)
+{
+	uint64_t mix = mh_group_mix(mh_hash(h, key));
+	mh_map_t hk = mh_get_hashik(mix);
+	uint32_t i = mix & h->n_mask & ~(MH_GROUP - 1), step = 0, x = mh_end(h);
+	for (;;) {
+		const uint8_t *ctrl = h->map + i;
+		for (unsigned m = mh_group_match(ctrl, hk); m; m &= m - 1) {
+			uint32_t y = i + __builtin_ctz(m);
+			if (mh_slot_key_eq(h, y, key)) {
+				*exist = 1;
+				return y;
+			}
+		}
+		if (x == mh_end(h)) {
+			unsigned f = mh_group_match_free(ctrl);
+			if (step == 0 && !mh_exist(h, (mix & h->n_mask)))
+				x = mix & h->n_mask;
+			else if (f)
+				x = i + __builtin_ctz(f);
+		}
+		if (mh_group_match(ctrl, 0))
+			break;
+
+		step += MH_GROUP;
+		i = (i + step) & h->n_mask;
+	}
+
+	if (h->map[x] == 0)
+		h->n_occupied++;
+	mh_setexist(h, x, hk);
+	h->size++;
+	*exist = 0;
+	return x;
+}
+#else
+static inline uint32_t
+_mh(get_hashed)(const struct mhash_t *h, mh_key_t key, unsigned k)
+{
 	mh_map_t hk = mh_get_hashik(k);
 	struct _mh(find_loop) l;
 	_mh(find_loop_init)(&l, k, h->n_mask);
@@ -627,6 +820,8 @@ _mh(mark)(struct mhash_t *h, mh_key_t key, int *exist)
 	}
 }
 
+#endif
+
 static inline void
 _mh(resize_if_need)(struct mhash_t *h)
 {
@@ -663,10 +858,21 @@ _mh(iput)(struct mhash_t *h, mh_key_t key, int *ret)
 static inline void
 _mh(del)(struct mhash_t *h, uint32_t x)
 {
+#if mh_group_map
+	/* no probe went past group with empty slot: slot may become empty */
+	if (mh_group_match(h->map + (x & ~(MH_GROUP - 1)), 0)) {
+		h->map[x] = 0;
+		h->n_occupied--;
+	} else {
+		mh_setfree(h, x);
+	}
+	h->size--;
+#else
 	mh_setfree(h, x);
 	h->size--;
 	if (!mh_occupied_as_dirty(h, x))
 		h->n_occupied--;
+#endif
 
 #if MH_INCREMENTAL_RESIZE
 	if (mh_unlikely(h->resize_position)) {
@@ -715,6 +921,17 @@ _mh(sput)(struct mhash_t *h, mh_slot_t const *slot, mh_slot_t *prev_slot)
 	return !exist;
 }
 
+static inline void
+_mh(sput_new)(struct mhash_t *h, mh_slot_t const *slot)
+{
+	if (mh_unlikely(h->resize_position || h->n_occupied >= h->upper_bound)) {
+		_mh(sput)(h, slot, NULL);
+		return;
+	}
+	uint32_t x = _mh(short_mark)(h, mh_slot_key(h, slot));
+	_mh(slot_copy)(h, x, slot);
+}
+
 static inline int
 _mh(sremove_by_key)(struct mhash_t *h, mh_key_t key, mh_slot_t *prev_slot)
 {
@@ -874,7 +1091,7 @@ _mh(initialize)(struct mhash_t *h)
 
 	h->slots = mh_calloc(h, mh_end(h), mh_slot_size(h));
 #ifndef mh_custom_map
-#if mh_byte_map
+#if mh_byte_map || mh_group_map
 	h->map = mh_calloc(h, mh_end(h), sizeof(mh_map_t)); /* 4 maps per char */
 #else
 	h->map = mh_calloc(h, (mh_end(h) + 15) / 16, 4); /* 4 maps per char */
@@ -926,6 +1143,7 @@ _mh(resize_step)(struct mhash_t *h)
 #endif
 		memcpy(h, s, sizeof(*h));
 		memset(s, 0, sizeof(*s));
+		h->generation++;
 	}
 }
 
@@ -979,7 +1197,7 @@ _mh(start_resize)(struct mhash_t *h, uint32_t want_size)
 	s->size = 0;
 	s->slots = mh_calloc(h, (size_t)mh_end(s), mh_slot_size(h));
 #ifndef mh_custom_map
-#if mh_byte_map
+#if mh_byte_map || mh_group_map
 	s->map = mh_calloc(h, mh_end(s), sizeof(mh_map_t)); /* 4 maps per char */
 #else
 	s->map = mh_calloc(h, (mh_end(s) + 15) / 16, 4); /* 4 maps per char */
@@ -996,7 +1214,9 @@ _mh(bytes)(struct mhash_t *h)
 		sizeof(*h) +
 		((size_t)mh_end(h)) * mh_slot_size(h) +
 #ifndef mh_custom_map
-#if mh_byte_map == 0
+#if mh_group_map
+		(size_t)mh_end(h)
+#elif mh_byte_map == 0
 		((size_t)h->n_mask / 16 + 1) *  sizeof(uint32_t)
 #elif mh_byte_map == 1
 		(size_t)h->n_mask
@@ -1015,6 +1235,7 @@ _mh(clear)(struct mhash_t *h)
 {
 	_mh(destruct)(h);
 	_mh(initialize)(h);
+	h->generation++;
 }
 
 MH_DECL void
@@ -1084,6 +1305,7 @@ _mh(dump)(struct mhash_t *h)
 #undef mh_arg_t
 
 #undef mh_byte_map
+#undef mh_group_map
 #undef mh_may_skip
 #undef mh_need_dirty
 #undef mh_occupied_as_dirty
@@ -1098,6 +1320,7 @@ _mh(dump)(struct mhash_t *h)
 #undef mh_setexist
 #undef mh_dirty
 #undef mh_setdirty
+#undef mh_prefetch_map
 
 #undef mh_malloc
 #undef mh_calloc
@@ -96,6 +96,8 @@ void net_add_ref_iov(struct netmsg_head *o, uintptr_t ref, const void *buf, size
 void net_add_obj_iov(struct netmsg_head *o, struct tnt_object *obj, const void *buf, size_t len);
 
 ssize_t netmsg_writev(int fd, struct netmsg_head *head);
+/* copy whole message into dst (at least head->bytes long) and reset it */
+size_t netmsg_copyout(struct netmsg_head *head, void *dst);
 
 void netmsg_io_init(struct netmsg_io *io, struct netmsg_pool_ctx *ctx, int fd);
 
@@ -119,6 +121,7 @@ static inline void netmsg_io_release(struct netmsg_io *io)
 int rbuf_len(const struct netmsg_io *io);
 void rbuf_ltrim(struct netmsg_io *io, int size);
 ssize_t rbuf_recv(struct netmsg_io *io, int size);
+void rbuf_append(struct netmsg_io *io, const void *data, int size);
 
 enum tac_result {
 	tac_error = -1,
@@ -55,8 +55,10 @@ enum raft_msg_code ENUM_INITIALIZER(RAFT_CODE);
 	i64 last_wal_commit, last_wal_append ;
 	ev_tstamp election_deadline;
 	int voted_for, nop_commited;
+	int append_inflight;
 	struct Fiber *catchup[5];
 	struct iproto_egress *egress[5];
+	u16 peer_version[5]; /* proto_version learned from peer replies */
 	struct iproto_mbox mbox;
 }
 
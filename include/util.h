@@ -50,6 +50,7 @@ void *alloca (size_t);
 
 #include <unistd.h>
 #include <stddef.h>
+#include <time.h>
 
 void *xcalloc(size_t nmemb, size_t size);
 void *xmalloc(size_t size);
@@ -188,6 +189,22 @@ void wait_gdb(void);
 
 double drand(double top);
 
+/* cheap timestamp for latency accounting: TSC on x86, monotonic ns elsewhere.
+   tsc_ms is length of a tick in milliseconds, set by tsc_calibrate() */
+extern double tsc_ms;
+void tsc_calibrate(void);
+static inline u64
+tsc_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 const char *tnt_backtrace(void);
 
 #ifdef HAVE_LIBELF
@@ -38,6 +38,7 @@ struct index;
 
 /* if you change this struct also change definition in box.lua */
 #define MAX_IDX 10
+LIST_HEAD(box_phi_list, box_phi);
 struct object_space {
 	int n;
 	bool ignored, snap, wal;
@@ -46,6 +47,16 @@ struct object_space {
 	size_t obj_bytes;
 	size_t slab_bytes;
 	Index<BasicIndex> *index[MAX_IDX];
+	/* fields above are mirrored by struct object_space in src-lua/box.lua */
+	bool bulk_load; /* PK is presized hash, snapshot rows go through bulk_insert: */
+	bool field_offsets; /* tuples are BOX_TUPLE_OFT */
+	u64 dict_fields; /* bitmap of dictionary encoded fields, see dict.m */
+	u32 dict_max_entries; /* codes space may use, zero means default */
+	ssize_t dict_saved_bytes;
+	struct box_dict_space *dict; /* codes used by space, see dict.m */
+	u32 snap_epoch; /* advanced by each in-process snapshot, see box.m */
+	struct snap_frozen *snap_frozen; /* PK walk of running in-process snapshot */
+	struct box_phi_list phi; /* phi in indexes: uncommitted changes, see op.m */
 };
 
 #define foreach_index(ivar, obj_space)					\
@@ -57,7 +68,8 @@ struct object_space {
 enum object_type {
 	BOX_TUPLE = 1,
 	BOX_SMALL_TUPLE = 2,
-	BOX_PHI = 3
+	BOX_PHI = 3,
+	BOX_TUPLE_OFT = 4
 };
 
 struct box_tuple {
@@ -66,12 +78,63 @@ struct box_tuple {
 	u8 data[0];
 } __attribute__((packed));
 
+/* BOX_TUPLE_OFT is BOX_TUPLE followed by table of field offsets
+   (relative to data[]): u16 per field if bsize fits, u32 otherwise */
+static inline size_t
+box_tuple_oft_size(u32 cardinality, u32 bsize)
+{
+	return cardinality * (bsize <= UINT16_MAX ? sizeof(u16) : sizeof(u32));
+}
+
 struct box_small_tuple {
 	uint8_t bsize;
 	uint8_t cardinality;
 	uint8_t data[0];
 };
 
+/* tuple has dictionary encoded fields: value of such field is replaced
+   by overlong length 0x80, <n> followed by n bytes of varint code.
+   any reader walking fields sees it as ordinary n byte field.
+   data (and offset table) of such tuple is followed by u16 count of
+   bytes saved by encoding, see tuple_dict_saved() in op.m.
+   flag bits 0x1 - 0x4 are used by octopus.h */
+enum { TUPLE_DICT = 0x8 };
+/* low bit of object_space->snap_epoch at the moment tuple was committed
+   or written by in-process snapshot. box tuples are never GHOST, bit is reused */
+enum { TUPLE_SNAP = GHOST };
+
+#define BOX_DICT_PAGE_BITS 10
+#define BOX_DICT_MAX (1 << 20)
+extern const u8 **box_dict_page[BOX_DICT_MAX >> BOX_DICT_PAGE_BITS];
+
+/* return dictionary value (varint prefixed) of field f */
+static inline const void *
+box_dict_field(const void *f)
+{
+	const u8 *data = f;
+	if (*data != 0x80)
+		return f;
+	data += 2;
+	u32 code = LOAD_VARINT32(data);
+	return box_dict_page[code >> BOX_DICT_PAGE_BITS][code & ((1 << BOX_DICT_PAGE_BITS) - 1)];
+}
+#define tuple_field_value(obj, f) ((obj)->flags & TUPLE_DICT ? box_dict_field(f) : (f))
+
+const void *box_dict_encode(struct object_space *o, u32 cardinality, const void *data,
+			    u32 *bsize, bool *coded, u32 *saved);
+size_t box_dict_decoded_size(u32 cardinality, const void *data);
+void *box_dict_decode(u32 cardinality, const void *data, void *out);
+void box_dict_account(struct object_space *o, ssize_t saved);
+struct box_dict_space;
+u32 box_dict_count(void);
+u32 box_dict_space_entries(const struct box_dict_space *d);
+struct box_dict_space *box_dict_space_retain(struct box_dict_space *d);
+void box_dict_space_release(struct box_dict_space *d);
+int box_dict_snap_write(struct box_dict_space *d, int n, u32 count,
+			int (*cb)(const void *row, u32 len, void *arg), void *arg);
+void box_dict_load(struct object_space *o, struct tbuf *data);
+void box_dict_load_done(struct object_space *o);
+
 TAILQ_HEAD(phi_tailq, box_phi_cell);
 struct box_phi {
 	struct tnt_object header;
@@ -79,6 +142,7 @@ struct box_phi {
 	struct phi_tailq tailq;
 	struct box_op *bop; /* for debug purposes */
 	Index<BasicIndex> *index;
+	LIST_ENTRY(box_phi) space_link;
 };
 
 struct box_phi_cell {
@@ -99,6 +163,10 @@ struct tnt_object *phi_obj(const struct tnt_object *obj);
 
 struct tnt_object *tuple_visible_left(struct tnt_object *obj);
 struct tnt_object *tuple_visible_right(struct tnt_object *obj);
+/* lua index:count(): entries of POSTREE index between from and to,
+   as seen by tuple_visible_right() */
+u32 box_index_count(struct object_space *o, NIHTree *index,
+		    const struct index_node *from, const struct index_node *to);
 
 
 struct box_snap_row {
@@ -182,6 +250,7 @@ void box_service_ro(struct iproto_service *s);
 #define BOX_RETURN_TUPLE 1
 #define BOX_ADD 2
 #define BOX_REPLACE 4
+#define BOX_WAL_FSYNC 8
 
 /*
     deprecated commands:
@@ -207,10 +276,12 @@ void box_service_ro(struct iproto_service *s);
         _(INSERT, 13)				\
         _(SELECT_LIMIT, 15)			\
 	_(SELECT, 17)				\
+	_(COUNT, 18)				\
 	_(UPDATE_FIELDS, 19)			\
 	_(DELETE_1_3, 20)			\
 	_(DELETE, 21)				\
 	_(EXEC_LUA, 22)				\
+	_(SELECT_PROJECT, 23)			\
 	_(PAXOS_LEADER, 90)			\
 	_(SELECT_KEYS, 99)			\
 	_(SELECT_TUPLES, 100)			\
@@ -220,7 +291,8 @@ void box_service_ro(struct iproto_service *s);
 	_(CREATE_INDEX, 241)			\
 	_(DROP_OBJECT_SPACE, 242)		\
 	_(DROP_INDEX, 243)			\
-	_(TRUNCATE, 244)
+	_(TRUNCATE, 244)			\
+	_(DICT_ENTRIES, 245) /* snapshot only */
 
 enum messages ENUM_INITIALIZER(MESSAGES);
 extern char const * const box_ops[];
@@ -239,7 +311,7 @@ void object_space_fill_stat_names(struct object_space* space);
 void object_space_clear_stat_names(struct object_space* space);
 
 #define OBJECT_SPACE_MAX (256)
-@interface Box : DefaultExecutor <Executor> {
+@interface Box : DefaultExecutor <Executor, SnapshotView> {
 @public
 	struct object_space *object_space_registry[OBJECT_SPACE_MAX];
 	const int object_space_max_idx;
@@ -258,6 +330,7 @@ static inline int tuple_bsize(const struct tnt_object *obj)
 {
 	switch (obj->type) {
 	case BOX_TUPLE:
+	case BOX_TUPLE_OFT:
 		return box_tuple(obj)->bsize;
 	case BOX_SMALL_TUPLE:
 		return box_small_tuple(obj)->bsize;
@@ -269,6 +342,7 @@ static inline int tuple_cardinality(const struct tnt_object *obj)
 {
 	switch (obj->type) {
 	case BOX_TUPLE:
+	case BOX_TUPLE_OFT:
 		return box_tuple(obj)->cardinality;
 	case BOX_SMALL_TUPLE:
 		return box_small_tuple(obj)->cardinality;
@@ -282,6 +356,7 @@ static inline void * tuple_data(struct tnt_object *obj)
 {
 	switch (obj->type) {
 	case BOX_TUPLE:
+	case BOX_TUPLE_OFT:
 		return box_tuple(obj)->data;
 	case BOX_SMALL_TUPLE:
 		return box_small_tuple(obj)->data;
@@ -291,10 +366,33 @@ static inline void * tuple_data(struct tnt_object *obj)
 		bad_object_type();
 	}
 }
+static inline u32 box_tuple_field_offset(struct tnt_object *obj, size_t i)
+{
+	struct box_tuple *tuple = box_tuple(obj);
+	const void *oft = tuple->data + tuple->bsize;
+	if (tuple->bsize <= UINT16_MAX)
+		return ((const u16 *)oft)[i];
+	return ((const u32 *)oft)[i];
+}
 void * tuple_field(struct tnt_object *obj, size_t i);
 int tuple_valid(struct tnt_object *obj);
 void tuple_free(struct tnt_object *obj);
+/* tuple_free() is deferred while there are live snapshot views */
+void box_snap_view_acquire(void);
+void box_snap_view_release(void);
+static inline void
+tuple_snap_stamp(struct object_space *o, struct tnt_object *obj)
+{
+	obj->flags = (obj->flags & ~TUPLE_SNAP) | (o->snap_epoch & 1 ? TUPLE_SNAP : 0);
+}
+/* committed tuple is going to leave PK: keep it for running snapshot */
+void box_snap_displace(struct object_space *o, struct tnt_object *obj);
+/* object space is dropped, running snapshot must not walk it any more */
+void box_snap_drop(struct object_space *o);
+bool tuple_relocate(struct object_space *o, struct tnt_object *obj);
 void net_tuple_add(struct netmsg_head *h, struct tnt_object *obj);
+/* plain BOX_TUPLE copy of TUPLE_DICT tuple, refcount is zero */
+struct tnt_object *tuple_dict_decode(struct tnt_object *obj);
 
 int box_cat_scn(i64 stop_scn);
 int box_cat(const char *filename);
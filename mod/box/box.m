@@ -37,6 +37,7 @@
 #import <index.h>
 #import <spawn_child.h>
 #import <shard.h>
+#import <salloc.h>
 
 #import <mod/box/box.h>
 #import <mod/box/src-lua/moonbox.h>
@@ -48,6 +49,7 @@
 #endif
 
 #include <third_party/crc32.h>
+#include <third_party/qsort_arg.h>
 
 #include <stdarg.h>
 #include <stdint.h>
@@ -56,6 +58,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sysexits.h>
+#include <pthread.h>
 
 static struct iproto_service box_primary, box_secondary;
 static void initialize_primary_service();
@@ -127,6 +130,16 @@ configure_pk(Box *box)
 		obj_spc->snap = !!cfg.object_space[i]->snap;
 		obj_spc->wal = obj_spc->snap && !!cfg.object_space[i]->wal;
 		obj_spc->cardinality = cfg.object_space[i]->cardinality;
+		obj_spc->field_offsets = !!cfg.object_space[i]->field_offsets;
+		for (int j = 0; cfg.object_space[i]->dict_field && cfg.object_space[i]->dict_field[j]; j++) {
+			if (!CNF_STRUCT_DEFINED(cfg.object_space[i]->dict_field[j]))
+				continue;
+			int fieldno = cfg.object_space[i]->dict_field[j]->fieldno;
+			if (fieldno < 0 || fieldno >= 64)
+				panic("(object_space = %" PRIu32 ") dict_field fieldno must be in 0..63", i);
+			obj_spc->dict_fields |= 1ULL << fieldno;
+		}
+		obj_spc->dict_max_entries = cfg.object_space[i]->dict_max_entries;
 		object_space_fill_stat_names(obj_spc);
 
 		if (cfg.object_space[i]->index == NULL)
@@ -198,6 +211,105 @@ delete_duplicates(struct object_space* object_space, size_t node_size, uint32_t
 	}
 }
 
+/* parallel build: one thread per secondary index.
+   tree nodes are extracted and sorted, hashes are filled.
+   duplicate handling is left to the caller: resorting of sorted nodes is cheap */
+struct build_job {
+	Tree *tree;
+	id<HashIndex> hash;
+	struct tnt_object **objs;
+	size_t n_tuples;
+	void *nodes;
+	Error *error;
+};
+
+struct build_pool {
+	pthread_mutex_t mtx;
+	struct build_job *jobs;
+	int count, next;
+};
+
+static void *
+build_worker(void *arg)
+{
+	struct build_pool *pool = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->mtx);
+		struct build_job *job = pool->next < pool->count ? &pool->jobs[pool->next++] : NULL;
+		pthread_mutex_unlock(&pool->mtx);
+		if (job == NULL)
+			return NULL;
+
+		@try {
+			if (job->tree) {
+				Tree *tree = job->tree;
+				job->nodes = xmalloc(job->n_tuples * tree->node_size);
+				for (size_t t = 0; t < job->n_tuples; t++)
+					tree->dtor(job->objs[t], job->nodes + t * tree->node_size,
+						   tree->dtor_arg);
+				qsort_arg(job->nodes, job->n_tuples, tree->node_size,
+					  tree->compare, tree->dtor_arg);
+			} else {
+				for (size_t t = 0; t < job->n_tuples; t++)
+					[job->hash replace:job->objs[t]];
+			}
+		}
+		@catch (Error *e) {
+			job->error = e;
+		}
+	}
+}
+
+static void
+build_parallel(Index<BasicIndex> *pk, size_t n_tuples,
+	       Tree **tree, int tree_count, id<HashIndex> *hash, int hash_count,
+	       void **sorted_nodes)
+{
+	struct build_job jobs[MAX_IDX];
+	struct build_pool pool = { .jobs = jobs };
+	struct tnt_object **objs = xmalloc(n_tuples * sizeof(*objs));
+	struct tnt_object *obj;
+	pthread_t tid[MAX_IDX];
+	int started = 0;
+	size_t n = 0;
+
+	[pk iterator_init];
+	while ((obj = [pk iterator_next]))
+		objs[n++] = obj;
+	assert(n == n_tuples);
+
+	for (int i = 0; i < tree_count; i++)
+		jobs[pool.count++] = (struct build_job){ .tree = tree[i], .objs = objs, .n_tuples = n };
+	for (int i = 0; i < hash_count; i++)
+		jobs[pool.count++] = (struct build_job){ .hash = hash[i], .objs = objs, .n_tuples = n };
+
+	pthread_mutex_init(&pool.mtx, NULL);
+	for (; started < MIN(cfg.snap_load_threads, pool.count) - 1; started++) {
+		int err = pthread_create(&tid[started], NULL, build_worker, &pool);
+		if (err != 0) {
+			errno = err;
+			say_syserror("pthread_create");
+			break;
+		}
+	}
+	build_worker(&pool);
+	for (int i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	pthread_mutex_destroy(&pool.mtx);
+	free(objs);
+
+	for (int i = 0; i < pool.count; i++) {
+		if (jobs[i].error == nil)
+			continue;
+		for (int j = 0; j < tree_count; j++)
+			free(jobs[j].nodes);
+		@throw jobs[i].error;
+	}
+	for (int i = 0; i < tree_count; i++)
+		sorted_nodes[i] = jobs[i].nodes;
+}
+
 static void
 build_secondary(struct object_space *object_space)
 {
@@ -255,20 +367,28 @@ build_secondary(struct object_space *object_space)
         if (n_tuples > 0) {
 		title("building_indexes/object_space:%i ", object_space->n);
 		struct tnt_object *obj;
-		[pk iterator_init];
-		while ((obj = [pk iterator_next])) {
-			for (int i = 0; i < hash_count; i++)
-				[hash[i] replace:obj];
+		void *sorted_nodes[MAX_IDX] = { NULL, };
+		if (cfg.snap_load_threads > 1 && tree_count + hash_count > 1) {
+			build_parallel(pk, n_tuples, tree, tree_count, hash, hash_count, sorted_nodes);
+		} else {
+			[pk iterator_init];
+			while ((obj = [pk iterator_next])) {
+				for (int i = 0; i < hash_count; i++)
+					[hash[i] replace:obj];
+			}
 		}
 		for (int i = 0; i < tree_count; i++) {
 			say_info("  %i:%s", tree[i]->conf.n, [[tree[i] class] name]);
-			void *nodes = xmalloc(n_tuples * tree[i]->node_size);
-			u32 t = 0;
-			[pk iterator_init];
-			while ((obj = [pk iterator_next])) {
-				struct index_node *node = nodes + t * tree[i]->node_size;
-				tree[i]->dtor(obj, node, tree[i]->dtor_arg);
-				t++;
+			void *nodes = sorted_nodes[i];
+			if (nodes == NULL) {
+				nodes = xmalloc(n_tuples * tree[i]->node_size);
+				u32 t = 0;
+				[pk iterator_init];
+				while ((obj = [pk iterator_next])) {
+					struct index_node *node = nodes + t * tree[i]->node_size;
+					tree[i]->dtor(obj, node, tree[i]->dtor_arg);
+					t++;
+				}
 			}
 			struct print_dups_arg arg = {
 				.space = object_space->n,
@@ -469,6 +589,8 @@ wal_final_row
 		if (obj_spc == NULL)
 			continue;
 
+		obj_spc->bulk_load = false;
+		box_dict_load_done(obj_spc);
 		say_info("Object space %i", n);
 		foreach_index(index, obj_spc)
 			say_info("\tindex[%i]: %s", index->conf.n, [index info]);
@@ -512,6 +634,8 @@ snapshot_fold
 	struct tnt_object *obj;
 
 	u32 crc = 0;
+	void *dict_buf = NULL;
+	size_t dict_buf_size = 0;
 #ifdef FOLD_DEBUG
 	int count = 0;
 #endif
@@ -532,11 +656,22 @@ snapshot_fold
 			tuple_print(b, tuple->cardinality, tuple->data);
 			say_info("row %i: %.*s", count++, tbuf_len(b), (char *)b->ptr);
 #endif
+			void *data = tuple_data(obj);
 			u32 header[2] = { tuple_bsize(obj) ,tuple_cardinality(obj) };
+			if (obj->flags & TUPLE_DICT) {
+				header[0] = box_dict_decoded_size(header[1], data);
+				if (dict_buf_size < header[0]) {
+					dict_buf_size = header[0];
+					dict_buf = xrealloc(dict_buf, dict_buf_size);
+				}
+				box_dict_decode(header[1], data, dict_buf);
+				data = dict_buf;
+			}
 			crc = crc32c(crc, (unsigned char *)header, 8);
-			crc = crc32c(crc, tuple_data(obj), header[0] /* bsize */);
+			crc = crc32c(crc, data, header[0] /* bsize */);
 		}
 	}
+	free(dict_buf);
 	printf("CRC: 0x%08x\n", crc);
 	return 0;
 }
@@ -551,14 +686,15 @@ snapshot_estimate
 	return total_rows;
 }
 
-static int verify_indexes(struct object_space *o, size_t pk_rows)
+static int verify_indexes(struct object_space *o, size_t pk_rows, bool progress)
 {
 	struct tnt_object *obj;
 	foreach_index(index, o) {
 		if (index->conf.n == 0)
 			continue;
 
-		title("snap_dump/check index:%i", index->conf.n);
+		if (progress)
+			title("snap_dump/check index:%i", index->conf.n);
 
 		size_t index_rows = 0;
 		[index iterator_init];
@@ -576,117 +712,545 @@ static int verify_indexes(struct object_space *o, size_t pk_rows)
 	}
 	return 0;
 }
-- (int)
-snapshot_write_rows:(XLog *)l
+
+/* in-process snapshot of object space.
+   -snapshot_freeze advances o->snap_epoch: every committed tuple carries stamp
+   (TUPLE_SNAP) of previous epoch and becomes pending. tuples committed after
+   freeze are stamped with new epoch and skipped. the snapshot fiber walks PK in
+   batches (snap_frozen_feed), stamps pending tuples and passes them through ring
+   to the dump thread. pending tuple which leaves PK before the walk reaches it
+   is stamped and queued by box_snap_displace(). tuple_free() is deferred while
+   view is alive, so queued tuples stay valid.
+   memory overhead is bounded by ring size plus tuples displaced during dump */
+#define SNAP_RING 4096
+#define SNAP_FEED_BATCH 512
+
+struct snap_frozen {
+	int n;
+	/* main thread only */
+	struct object_space *o; /* NULL when walk is finished or space is dropped */
+	struct tnt_object *last; /* walk position: last seen tuple or hash slot */
+	u32 pos, generation;
+	struct tnt_object **displaced;
+	size_t displaced_count, displaced_size;
+	/* shared with dump thread */
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	u32 head, tail;
+	bool eof, closed;
+	struct tnt_object *ring[SNAP_RING];
+
+	int nmeta;
+	struct {
+		u32 len;
+		char buf[256];
+	} meta[MAX_IDX + 1];
+};
+
+/* object space dump: either serial into XLog or into chunk of parallel snapshot */
+struct snap_space {
+	struct object_space *o;
+	Shard<Shard> *shard;
+	XLog *l;
+	struct tbuf *row;
+	struct snap_chunk *chunk;
+	struct snap_frozen *frozen;
+	size_t *rows, total_rows;
+	struct box_dict_space *dict; /* NULL: rows hold plain values */
+	u32 dict_count; /* dictionary size when dump started */
+	void *dict_buf; /* decoded TUPLE_DICT tuple, malloc'ed */
+	size_t dict_buf_size;
+};
+
+static int
+snap_space_append(struct snap_space *s, u16 tag,
+		  const void *head, u32 head_len, const void *data, u32 data_len)
+{
+	if (s->chunk != NULL) {
+		struct iovec iov[2] = { { .iov_base = (void *)head, .iov_len = head_len },
+					{ .iov_base = (void *)data, .iov_len = data_len } };
+		return snap_chunk_append(s->chunk, tag, iov, data_len > 0 ? 2 : 1);
+	}
+
+	tbuf_reset(s->row);
+	tbuf_append(s->row, head, head_len);
+	if (data_len > 0)
+		tbuf_append(s->row, data, data_len);
+	if ([s->l append_row:s->row->ptr len:tbuf_len(s->row)
+		       shard:s->shard tag:tag] == NULL)
+		return -1;
+	return 0;
+}
+
+static void
+snap_space_meta(struct tbuf *meta, struct object_space *o)
+{
+	Index<BasicIndex> *pk = o->index[0];
+	write_i32(meta, o->n);
+	int flags = (o->snap ? 1 : 0) | (o->wal ? 2 : 0) | (o->field_offsets ? 4 : 0) |
+		    (o->dict_fields ? 8 : 0) | 16 /* rows */;
+	write_i32(meta, flags);
+	write_i8(meta, o->cardinality);
+	index_conf_write(meta, &pk->conf);
+	write_i32(meta, [pk size]); /* used by loader to presize PK */
+	if (o->dict_fields)
+		write_i64(meta, o->dict_fields);
+}
+
+static void
+snap_index_meta(struct tbuf *meta, struct object_space *o, Index<BasicIndex> *index)
+{
+	write_i32(meta, o->n);
+	write_i32(meta, 16); // flags: rows
+	write_i8(meta, index->conf.n);
+	index_conf_write(meta, &index->conf);
+	write_i32(meta, [index size]);
+}
+
+static int
+snap_tuple_write(struct snap_space *s, int n, struct tnt_object *obj)
 {
 	struct box_snap_row header;
+
+	if ((obj->type == BOX_TUPLE || obj->type == BOX_TUPLE_OFT) &&
+	    container_of(obj, struct gc_oct_object, obj)->refs <= 0) {
+		say_error("heap invariant violation: n:%i obj->refs == %i", n,
+			  container_of(obj, struct gc_oct_object, obj)->refs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!tuple_valid(obj)) {
+		say_error("heap invariant violation: n:%i invalid tuple %p", n, obj);
+		errno = EINVAL;
+		return -1;
+	}
+
+	header.object_space = n;
+	header.tuple_size = tuple_cardinality(obj);
+	header.data_size = tuple_bsize(obj);
+
+	/* codes are written as is, their entries precede rows of space.
+	   legacy (dummy shard) snapshot has no meta, values are decoded */
+	const void *data = tuple_data(obj);
+	if (obj->flags & TUPLE_DICT && s->dict == NULL) {
+		header.data_size = box_dict_decoded_size(header.tuple_size, data);
+		if (s->dict_buf_size < header.data_size) {
+			s->dict_buf_size = header.data_size;
+			s->dict_buf = xrealloc(s->dict_buf, s->dict_buf_size);
+		}
+		box_dict_decode(header.tuple_size, data, s->dict_buf);
+		data = s->dict_buf;
+	}
+
+	return snap_space_append(s, snap_data|TAG_SNAP, &header, sizeof(header),
+				 data, header.data_size);
+}
+
+static int
+snap_dict_row(const void *row, u32 len, void *arg)
+{
+	return snap_space_append(arg, (DICT_ENTRIES << 5)|TAG_SNAP, row, len, NULL, 0);
+}
+
+/* dump thread side of frozen object space */
+static int
+snap_frozen_write_rows(struct snap_space *s)
+{
+	struct snap_frozen *f = s->frozen;
+	struct tnt_object *batch[SNAP_FEED_BATCH];
+
+	if (f->nmeta > 0 &&
+	    snap_space_append(s, (CREATE_OBJECT_SPACE << 5)|TAG_SNAP,
+			      f->meta[0].buf, f->meta[0].len, NULL, 0) < 0)
+		return -1;
+	if (box_dict_snap_write(s->dict, f->n, s->dict_count, snap_dict_row, s) < 0)
+		return -1;
+
+	for (;;) {
+		int count = 0;
+		pthread_mutex_lock(&f->mtx);
+		while (f->head == f->tail && !f->eof)
+			pthread_cond_wait(&f->cond, &f->mtx);
+		while (f->tail != f->head && count < nelem(batch))
+			batch[count++] = f->ring[f->tail++ % SNAP_RING];
+		pthread_mutex_unlock(&f->mtx);
+		if (count == 0)
+			break;
+
+		for (int i = 0; i < count; i++)
+			if (snap_tuple_write(s, f->n, batch[i]) < 0)
+				return -1;
+	}
+
+	for (int i = 1; i < f->nmeta; i++)
+		if (snap_space_append(s, (CREATE_INDEX << 5)|TAG_SNAP,
+				      f->meta[i].buf, f->meta[i].len, NULL, 0) < 0)
+			return -1;
+	return 0;
+}
+
+/* nothing will be read from ring any more, feeder must not wait for it */
+static void
+snap_frozen_close(struct snap_frozen *f)
+{
+	pthread_mutex_lock(&f->mtx);
+	f->closed = true;
+	f->tail = f->head;
+	pthread_mutex_unlock(&f->mtx);
+}
+
+static int
+snap_frozen_write(struct snap_space *s)
+{
+	int ret = snap_frozen_write_rows(s);
+	snap_frozen_close(s->frozen);
+	return ret;
+}
+
+static bool
+snap_pending(struct object_space *o, struct tnt_object *obj)
+{
+	return !(obj->flags & TUPLE_SNAP) != !(o->snap_epoch & 1);
+}
+
+static void
+snap_frozen_queue(struct snap_frozen *f, struct tnt_object *obj)
+{
+	if (f->displaced_count == f->displaced_size) {
+		f->displaced_size = f->displaced_size ? f->displaced_size * 2 : 1024;
+		f->displaced = xrealloc(f->displaced, f->displaced_size * sizeof(*f->displaced));
+	}
+	f->displaced[f->displaced_count++] = obj;
+}
+
+void
+box_snap_displace(struct object_space *o, struct tnt_object *obj)
+{
+	struct snap_frozen *f = o->snap_frozen;
+	if (!snap_pending(o, obj))
+		return;
+
+	tuple_snap_stamp(o, obj);
+	snap_frozen_queue(f, obj);
+}
+
+void
+box_snap_drop(struct object_space *o)
+{
+	if (o->snap_frozen == NULL)
+		return;
+	o->snap_frozen->o = NULL;
+	o->snap_frozen = NULL;
+}
+
+/* collect up to max pending tuples from PK, position is kept across calls
+   as in slab_defrag_space. hash walk restarts when slots are rehashed: tuples
+   already passed are stamped, so it costs rescan only.
+   PHASH moves entries on insert, its pending tuples are queued in one go */
+static int
+snap_frozen_walk(struct snap_frozen *f, struct tnt_object **batch, int max)
+{
+	struct object_space *o = f->o;
+	Index<BasicIndex> *pk = o->index[0];
+	struct tnt_object *obj, *tail;
+	bool positional = [pk respondsTo:@selector(generation)],
+	     ordered = [pk isKindOf:[Tree class]];
+	int count = 0, scanned = 0;
+
+	if (positional) {
+		u32 generation = [(id<HashIndex>)pk generation];
+		if (generation != f->generation)
+			f->pos = 0;
+		f->generation = generation;
+		[(id<HashIndex>)pk iterator_init_pos:f->pos];
+	} else if (ordered && f->last) {
+		[pk iterator_init_with_object:f->last];
+	} else {
+		[pk iterator_init];
+	}
+
+	while ((tail = [pk iterator_next])) {
+		obj = tuple_visible_left(tail);
+		if (obj != NULL && snap_pending(o, obj)) {
+			tuple_snap_stamp(o, obj);
+			if (positional || ordered)
+				batch[count++] = obj;
+			else
+				snap_frozen_queue(f, obj);
+		}
+		if ((positional || ordered) && (count == max || ++scanned == max * 4))
+			break;
+	}
+
+	if (tail == NULL) {
+		o->snap_frozen = NULL;
+		f->o = NULL;
+	} else if (positional) {
+		f->pos = [(id<HashIndex>)pk cur_iter];
+	} else {
+		/* uncommitted tuple stays valid: tuple_free() is deferred */
+		f->last = tuple_visible_left(tail) ?: tuple_visible_right(tail);
+	}
+	return count;
+}
+
+/* main thread side: move displaced and walked tuples into ring.
+   returns 0 when ring is full, -1 when everything is passed */
+static int
+snap_frozen_feed(struct snap_frozen *f)
+{
+	struct tnt_object *batch[SNAP_FEED_BATCH];
+	int count = 0;
+
+	pthread_mutex_lock(&f->mtx);
+	bool closed = f->closed;
+	u32 room = SNAP_RING - (f->head - f->tail);
+	pthread_mutex_unlock(&f->mtx);
+	if (!closed && room < nelem(batch))
+		return 0;
+
+	while (f->displaced_count > 0 && count < nelem(batch))
+		batch[count++] = f->displaced[--f->displaced_count];
+	if (count < nelem(batch) && f->o)
+		count += snap_frozen_walk(f, batch + count, nelem(batch) - count);
+	bool eof = f->o == NULL && f->displaced_count == 0;
+
+	pthread_mutex_lock(&f->mtx);
+	if (!f->closed)
+		for (int i = 0; i < count; i++)
+			f->ring[f->head++ % SNAP_RING] = batch[i];
+	f->eof = eof;
+	pthread_cond_signal(&f->cond);
+	pthread_mutex_unlock(&f->mtx);
+	return eof ? -1 : 1;
+}
+
+static int
+snap_space_write(struct snap_space *s)
+{
+	if (s->frozen)
+		return snap_frozen_write(s);
+
+	struct object_space *o = s->o;
+	Index<BasicIndex> *pk = o->index[0];
 	struct tnt_object *obj;
+	char buf[256];
+	struct tbuf meta = TBUF_BUF(buf); /* no palloc: may run in snapshot worker thread */
+	size_t pk_rows = 0;
+	int n = o->n;
+
+	if (!s->shard->dummy) {
+		snap_space_meta(&meta, o);
+		if (snap_space_append(s, (CREATE_OBJECT_SPACE << 5)|TAG_SNAP,
+				      meta.ptr, tbuf_len(&meta), NULL, 0) < 0)
+			return -1;
+		if (box_dict_snap_write(s->dict, n, s->dict_count, snap_dict_row, s) < 0)
+			return -1;
+	}
+
+	[pk iterator_init];
+	while ((obj = [pk iterator_next])) {
+		obj = tuple_visible_left(obj);
+		if (obj == NULL)
+			continue;
+
+		if (snap_tuple_write(s, n, obj) < 0)
+			return -1;
+
+		pk_rows++;
+		if (s->chunk == NULL && ++*s->rows % 100000 == 0) {
+			float pct = (float)*s->rows / s->total_rows * 100.;
+			say_info("%.1fM/%.2f%% rows written", *s->rows / 1000000., pct);
+			title("snap_dump %.2f%%", pct);
+		}
+	}
+
+	if (!s->shard->dummy) {
+		foreach_index(index, o) {
+			if (index->conf.n == 0)
+				continue;
+			tbuf_reset(&meta);
+			snap_index_meta(&meta, o, index);
+
+			if (snap_space_append(s, (CREATE_INDEX << 5)|TAG_SNAP,
+					      meta.ptr, tbuf_len(&meta), NULL, 0) < 0)
+				return -1;
+		}
+	}
+
+	if (verify_indexes(o, pk_rows, s->chunk == NULL) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+static int
+snap_space_write_chunk(struct snap_chunk *chunk, void *arg)
+{
+	struct snap_space *s = arg;
+	s->chunk = chunk;
+	return snap_space_write(s);
+}
+
+- (int)
+snapshot_write_rows:(XLog *)l
+{
 	struct palloc_pool *pool = palloc_create_pool((struct palloc_config){.name = __func__});
+	struct snap_space *spaces = palloc(pool, sizeof(*spaces) * nelem(object_space_registry));
+	void **args = palloc(pool, sizeof(*args) * nelem(object_space_registry));
 	struct tbuf *row = tbuf_alloc(pool);
-	int ret = 0;
-	size_t rows = 0, pk_rows, total_rows = [self snapshot_estimate];
+	int count = 0, ret = 0;
+	size_t rows = 0, total_rows = [self snapshot_estimate];
 
 	for (int n = 0; n < nelem(object_space_registry); n++) {
 		if (object_space_registry[n] == NULL || !object_space_registry[n]->snap)
 			continue;
 
-		struct object_space *o = object_space_registry[n];
-		Index<BasicIndex> *pk = o->index[0];
-
-		assert(n == o->n);
-
-		if (!shard->dummy) {
-			tbuf_reset(row);
-			write_i32(row, n);
-			int flags = (o->snap ? 1 : 0) | (o->wal ? 2 : 0);
-			write_i32(row, flags);
-			write_i8(row, o->cardinality);
-			index_conf_write(row, &pk->conf);
-
-			if ([l append_row:row->ptr len:tbuf_len(row)
-				    shard:shard tag:(CREATE_OBJECT_SPACE << 5)|TAG_SNAP] == NULL)
-			{
-				ret = -1;
-				goto out;
-			}
-		}
+		assert(n == object_space_registry[n]->n);
+		spaces[count] = (struct snap_space){ .o = object_space_registry[n],
+						     .shard = shard,
+						     .l = l,
+						     .row = row,
+						     .rows = &rows,
+						     .total_rows = total_rows,
+						     .dict = shard->dummy ? NULL : object_space_registry[n]->dict,
+						     .dict_count = box_dict_count() };
+		args[count] = &spaces[count];
+		count++;
+	}
 
-		pk_rows = 0;
-		[pk iterator_init];
-		while ((obj = [pk iterator_next])) {
-			obj = tuple_visible_left(obj);
-			if (obj == NULL)
-				continue;
+	if (cfg.snap_dump_threads > 1 && count > 1) {
+		ret = snapshot_write_parallel(l, shard, count, snap_space_write_chunk, args);
+	} else {
+		for (int i = 0; i < count && ret == 0; i++)
+			ret = snap_space_write(&spaces[i]);
+	}
 
-			if (obj->type == BOX_TUPLE && container_of(obj, struct gc_oct_object, obj)->refs <= 0) {
-				say_error("heap invariant violation: n:%i obj->refs == %i", n,
-					  container_of(obj, struct gc_oct_object, obj)->refs);
-				errno = EINVAL;
-				ret = -1;
-				goto out;
-			}
+	for (int i = 0; i < count; i++)
+		free(spaces[i].dict_buf);
+	palloc_destroy_pool(pool);
+	return ret;
+}
 
-			if (!tuple_valid(obj)) {
-				say_error("heap invariant violation: n:%i invalid tuple %p", n, obj);
-				errno = EINVAL;
-				ret = -1;
-				goto out;
-			}
+struct box_snap_view {
+	i64 scn;
+	u16 shard_id;
+	double tm;
+	int count;
+	struct snap_space *spaces;
+	void **args;
+};
 
-			header.object_space = n;
-			header.tuple_size = tuple_cardinality(obj);
-			header.data_size = tuple_bsize(obj);
+- (void *)
+snapshot_freeze
+{
+	struct box_snap_view *v = xcalloc(1, sizeof(*v));
 
-			tbuf_reset(row);
-			tbuf_append(row, &header, sizeof(header));
-			tbuf_append(row, tuple_data(obj), header.data_size);
+	ev_now_update();
+	v->scn = shard->scn;
+	v->shard_id = shard->id;
+	v->tm = ev_now();
+	v->spaces = xcalloc(nelem(object_space_registry), sizeof(*v->spaces));
+	v->args = xcalloc(nelem(object_space_registry), sizeof(*v->args));
 
-			if ([l append_row:row->ptr len:tbuf_len(row)
-				    shard:shard tag:snap_data|TAG_SNAP] == NULL)
-			{
-				ret = -1;
-				goto out;
-			}
+	for (int n = 0; n < nelem(object_space_registry); n++) {
+		struct object_space *o = object_space_registry[n];
+		if (o == NULL || !o->snap)
+			continue;
 
-			pk_rows++;
-			if (++rows % 100000 == 0) {
-				float pct = (float)rows / total_rows * 100.;
-				say_info("%.1fM/%.2f%% rows written", rows / 1000000., pct);
-				title("snap_dump %.2f%%", pct);
-			}
-		}
+		assert(o->snap_frozen == NULL);
+		struct snap_frozen *f = xcalloc(1, sizeof(*f));
+		f->n = n;
+		pthread_mutex_init(&f->mtx, NULL);
+		pthread_cond_init(&f->cond, NULL);
+		/* every committed tuple becomes pending */
+		o->snap_epoch++;
+		o->snap_frozen = f;
+		f->o = o;
 
 		if (!shard->dummy) {
+			struct tbuf meta = TBUF_BUF(f->meta[0].buf);
+			snap_space_meta(&meta, o);
+			f->meta[f->nmeta++].len = tbuf_len(&meta);
 			foreach_index(index, o) {
 				if (index->conf.n == 0)
 					continue;
-				tbuf_reset(row);
-				write_i32(row, n);
-				write_i32(row, 0); // flags
-				write_i8(row, index->conf.n);
-				index_conf_write(row, &index->conf);
-
-				if ([l append_row:row->ptr len:tbuf_len(row)
-					    shard:shard tag:(CREATE_INDEX << 5)|TAG_SNAP] == NULL)
-				{
-					ret = -1;
-					goto out;
-				}
+				meta = TBUF_BUF(f->meta[f->nmeta].buf);
+				snap_index_meta(&meta, o, index);
+				f->meta[f->nmeta++].len = tbuf_len(&meta);
 			}
 		}
 
-		if (verify_indexes(o, pk_rows) < 0) {
-			errno = EINVAL;
-			ret = -1;
-			goto out;
-		}
+		v->spaces[v->count] = (struct snap_space){ .o = o,
+							   .shard = shard,
+							   .frozen = f,
+							   .dict = shard->dummy ? NULL :
+								   box_dict_space_retain(o->dict),
+							   .dict_count = box_dict_count() };
+		v->args[v->count] = &v->spaces[v->count];
+		v->count++;
 	}
 
-out:
-	palloc_destroy_pool(pool);
+	box_snap_view_acquire();
+	return v;
+}
+
+- (int)
+snapshot_feed:(void *)view
+{
+	struct box_snap_view *v = view;
+	int ret = -1;
+
+	for (int i = 0; i < v->count; i++) {
+		int r = snap_frozen_feed(v->spaces[i].frozen);
+		if (r >= 0)
+			ret = MAX(ret, r);
+	}
 	return ret;
 }
 
+- (int)
+snapshot_write_view:(void *)view to:(XLog *)snap
+{
+	struct box_snap_view *v = view;
+	int ret = 0;
+
+	if (v->count > 0)
+		ret = snapshot_write_chunks(snap, v->scn, v->shard_id, v->tm,
+					    v->count, snap_space_write_chunk, v->args);
+	/* spaces not reached because of error */
+	for (int i = 0; i < v->count; i++)
+		snap_frozen_close(v->spaces[i].frozen);
+	return ret;
+}
+
+- (void)
+snapshot_release:(void *)view
+{
+	struct box_snap_view *v = view;
+	for (int i = 0; i < v->count; i++) {
+		struct snap_frozen *f = v->spaces[i].frozen;
+
+		/* stamps must be consistent before next freeze: finish the walk */
+		snap_frozen_close(f);
+		while (snap_frozen_feed(f) >= 0);
+		assert(f->o == NULL);
+
+		free(f->displaced);
+		pthread_cond_destroy(&f->cond);
+		pthread_mutex_destroy(&f->mtx);
+		free(f);
+		box_dict_space_release(v->spaces[i].dict);
+		free(v->spaces[i].dict_buf);
+	}
+	free(v->spaces);
+	free(v->args);
+	free(v);
+	box_snap_view_release();
+}
+
 @end
 
 static void
@@ -732,6 +1296,110 @@ init_second_stage(va_list ap __attribute__((unused)))
 }
 
 
+static Box *
+box_of_shard(int i)
+{
+	id<Shard> shard = [recovery shard:i];
+	if (shard == nil || ((Shard *)shard)->loading)
+		return nil;
+	id exe = [shard executor];
+	return [exe isKindOf:[Box class]] ? exe : nil;
+}
+
+/* move tuples out of evacuating slabs of single object space.
+   PK is scanned in batches, position is kept across fiber_sleep()
+   as hash slot or (copy of) last seen tuple */
+static size_t
+slab_defrag_space(int shard_id, int n)
+{
+	struct tnt_object *move[128], *obj;
+	char *last = NULL;
+	size_t last_size = 0, moved = 0;
+	u32 pos = 0;
+
+	for (;;) {
+		Box *box = box_of_shard(shard_id);
+		struct object_space *o = box ? box->object_space_registry[n] : NULL;
+		if (o == NULL)
+			break;
+
+		Index<BasicIndex> *pk = o->index[0];
+		bool positional = [pk respondsTo:@selector(cur_iter)];
+		if (positional)
+			[(id<HashIndex>)pk iterator_init_pos:pos];
+		else if (last)
+			[pk iterator_init_with_object:(struct tnt_object *)last];
+		else
+			[pk iterator_init];
+
+		int scanned = 0, count = 0;
+		struct tnt_object *tail = NULL;
+		while (scanned < nelem(move) && (obj = [pk iterator_next])) {
+			scanned++;
+			tail = obj;
+			if (obj->type != BOX_PHI && salloc_evacuating(obj))
+				move[count++] = obj;
+		}
+		if (positional) {
+			pos = [(id<HashIndex>)pk cur_iter];
+		} else if (tail) {
+			tail = tuple_visible_left(tail) ?: tuple_visible_right(tail);
+			size_t size = sizeof(*tail) + tuple_bsize(tail) +
+				(tail->type == BOX_SMALL_TUPLE ? sizeof(struct box_small_tuple) :
+								 sizeof(struct box_tuple));
+			if (tail->type == BOX_TUPLE_OFT)
+				size += box_tuple_oft_size(tuple_cardinality(tail), tuple_bsize(tail));
+			if (size > last_size)
+				last = xrealloc(last, last_size = size);
+			memcpy(last, tail, size);
+		}
+
+		for (int i = 0; i < count; i++) {
+			@try {
+				moved += tuple_relocate(o, move[i]);
+			}
+			@catch (Error *e) {
+				say_warn("slab defrag: n:%i %s", n, e->reason);
+				[e release];
+				goto out;
+			}
+		}
+
+		if (scanned < nelem(move))
+			break;
+		fiber_sleep((double)scanned / MAX(cfg.slab_defrag_rate, 1));
+	}
+out:
+	free(last);
+	return moved;
+}
+
+static void
+slab_defrag(va_list ap __attribute__((unused)))
+{
+	for (;;) {
+		fiber_sleep(cfg.slab_defrag_delay > 0 ? cfg.slab_defrag_delay : 1.);
+		if (cfg.slab_defrag_delay <= 0)
+			continue;
+
+		int slabs = salloc_defrag_begin(cfg.slab_defrag_max_fill);
+		if (slabs == 0) {
+			salloc_defrag_end();
+			continue;
+		}
+
+		size_t moved = 0;
+		for (int i = 0; i < MAX_SHARD; i++)
+			for (int n = 0; n < OBJECT_SPACE_MAX; n++)
+				if (box_of_shard(i))
+					moved += slab_defrag_space(i, n);
+
+		int released = salloc_defrag_end();
+		say_info("slab defrag: %zu tuples moved, %i/%i slabs released",
+			 moved, released, slabs);
+	}
+}
+
 static void stat_mem_callback(int base _unused_);
 
 static void
@@ -758,6 +1426,7 @@ init(void)
 
 	/* fiber is required to successfully pull from remote */
 	fiber_create("box_init", init_second_stage);
+	fiber_create("slab_defrag", slab_defrag);
 }
 
 static void
@@ -792,6 +1461,11 @@ stat_mem_callback(int base _unused_)
 			tbuf_append_lit(&buf, "_slab_bytes");
 			stat_report_gauge(buf.ptr, tbuf_len(&buf), sp->slab_bytes);
 			tbuf_reset_to(&buf, len);
+			if (sp->dict_fields) {
+				tbuf_append_lit(&buf, "_dict_saved_bytes");
+				stat_report_gauge(buf.ptr, tbuf_len(&buf), sp->dict_saved_bytes);
+				tbuf_reset_to(&buf, len);
+			}
 			tbuf_append_lit(&buf, "_ix_");
 			len = tbuf_len(&buf);
 			foreach_index(index, sp) {
@@ -841,6 +1515,10 @@ info(struct tbuf *out, const char *what)
 				tbuf_printf(out, "      objects: %i"CRLF, [sp->index[0] size]);
 				tbuf_printf(out, "      obj_bytes: %zi"CRLF, sp->obj_bytes);
 				tbuf_printf(out, "      slab_bytes: %zi"CRLF, sp->slab_bytes);
+				if (sp->dict_fields) {
+					tbuf_printf(out, "      dict_entries: %u"CRLF, box_dict_space_entries(sp->dict));
+					tbuf_printf(out, "      dict_saved_bytes: %zi"CRLF, sp->dict_saved_bytes);
+				}
 				tbuf_printf(out, "      indexes:"CRLF);
 				foreach_index(index, sp)
 					tbuf_printf(out, "      - { index: %i, slots: %i, bytes: %zi }" CRLF,
@@ -42,6 +42,11 @@ end
 
 class SilverBox < IProtoRetCode
   BOX_RETURN_TUPLE = 0x01
+  BOX_WAL_FSYNC = 0x08
+  PRED_OPS = { :eq => 0, :ne => 1, :lt => 2, :le => 3, :gt => 4, :ge => 5 }
+  # predicate field type (enum index_field_type) and value packing
+  PRED_TYPES = { :u16 => [1, 'S'], :i16 => [2, 's'], :u32 => [3, 'L'], :i32 => [4, 'l'],
+                 :u64 => [5, 'Q'], :i64 => [6, 'q'], :str => [7, nil], :u8 => [8, 'C'], :i8 => [9, 'c'] }
 
   def initialize(host = '0:33013', param = {})
     @object_space = param[:object_space] || 0
@@ -150,6 +155,7 @@ class SilverBox < IProtoRetCode
     shard = param[:shard] || 0
     flags = 0
     flags |= BOX_RETURN_TUPLE if param[:return_tuple]
+    flags |= BOX_WAL_FSYNC if param[:wal_fsync]
 
     tuple = [tuple] if tuple.is_a?(Integer)
     reply = msg :code => 13, :shard => shard, :raw => pack([object_space, flags, tuple], 'L L L/ field*')
@@ -172,10 +178,37 @@ class SilverBox < IProtoRetCode
     limit = param[:limit] || 4294967295
     index = param[:index] || 0
 
-    reply = msg :code => 17, :shard => shard, :raw => pack([object_space, index, offset, limit, keys], 'L L L L L/ key*')
+    if param[:fields] or param[:where]
+      fields = param[:fields] || fail("projection required")
+      where = (param[:where] || []).map do |field_no, op, value, type|
+        pred_op = PRED_OPS[op] || fail("unknown predicate op: '#{op}'")
+        type ||= case value
+                 when Quad then :u64
+                 when Integer then :u32
+                 else :str
+                 end
+        pred_type, fmt = PRED_TYPES[type] || fail("unknown predicate type: '#{type}'")
+        packed = fmt ? [[value.to_i].pack(fmt).bytesize, value.to_i].pack('w' + fmt) : pack_field(value)
+        [field_no, pred_op, pred_type].pack('LCC') + packed
+      end
+      raw = [object_space, index, offset, limit, fields.length, *fields, where.length].pack('L*') +
+        where.join('') + pack([keys], 'L/ key*')
+      reply = msg :code => 23, :shard => shard, :raw => raw
+    else
+      reply = msg :code => 17, :shard => shard, :raw => pack([object_space, index, offset, limit, keys], 'L L L L L/ key*')
+    end
     unpack_reply!(reply, :return_tuple => true)
   end
 
+  def count(from = [], to = [], param = {})
+    object_space = param[:object_space] || @object_space
+    shard = param[:shard] || 0
+    index = param[:index] || 0
+
+    reply = msg :code => 18, :shard => shard, :raw => pack([object_space, index, from || [], to || []], 'L L key key')
+    reply.unpack('L')[0]
+  end
+
   def update_fields(key, *ops)
     return [] if ops.length == 0
     param = ops[-1].is_a?(Hash) ? ops.pop : {}
@@ -183,6 +216,7 @@ class SilverBox < IProtoRetCode
     shard = param[:shard] || 0
     flags = 0
     flags |= BOX_RETURN_TUPLE if param[:return_tuple]
+    flags |= BOX_WAL_FSYNC if param[:wal_fsync]
     ops.map! do |op|
       fail "op must be Array" unless op.is_a? Array
       case op[1]
@@ -266,10 +300,17 @@ class SilverBox < IProtoRetCode
     cardinalty = conf[:cardinalty] || 0
     flags |= 1 unless conf[:no_snap]
     flags |= 2 unless conf[:no_wal]
+    flags |= 4 if conf[:field_offsets]
+    flags |= 8 if conf[:dict_fields]
     shard = conf[:shard] || 0
     fail ":shard missing" unless conf[:shard]
     fail ":index missing" unless conf[:index]
-    msg :code => 240, :shard => shard, :raw => [n, flags, cardinalty, *pack_index_conf(conf[:index])].pack("LLC*")
+    raw = [n, flags, cardinalty, *pack_index_conf(conf[:index])].pack("LLC*")
+    if conf[:dict_fields]
+      mask = conf[:dict_fields].inject(0) {|m, fieldno| m | (1 << fieldno) }
+      raw << [mask].pack("Q") # bitmap of dictionary fields
+    end
+    msg :code => 240, :shard => shard, :raw => raw
     :success
   end
 
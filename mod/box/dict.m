@@ -0,0 +1,449 @@
+/*
+ * Copyright (C) 2026 octopus contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#import <util.h>
+#import <say.h>
+#import <tbuf.h>
+#import <fiber.h>
+#import <pickle.h>
+#import <iproto.h>
+#import <salloc.h>
+
+#include <third_party/murmur_hash2.c>
+
+#import <mod/box/box.h>
+
+/* Process wide dictionary of field values. Entries are never removed:
+   codes stay valid for the lifetime of the process, so tuples reference
+   them without refcounting and index nodes may point into entries.
+   Entry is published before any tuple referring it, snapshot threads
+   read entries without locking.
+
+   Snapshot keeps codes in rows. Each object space remembers codes its
+   tuples got, they are written as DICT_ENTRIES rows right after space
+   meta. Codes are process local: on load entries are interned again and
+   codes of following rows are translated.
+
+   Each space gets new codes until it uses dict_max_entries of them.
+   Field is checked once it brought DICT_PROBE codes new to the space: if
+   its values were reused less than DICT_PAYOFF times each on average,
+   entries cost more than they save and the field is frozen: it only reuses
+   codes space already has, other values are stored as is. */
+
+#define DICT_PAGE (1 << BOX_DICT_PAGE_BITS)
+#define DICT_ARENA (64 * 1024)
+#define DICT_MAX_VALUE 255 /* longer values are stored as is */
+#define DICT_SPACE_MAX 65536 /* object space dict_max_entries default */
+#define DICT_PROBE 1024
+#define DICT_PAYOFF 3
+
+const u8 **box_dict_page[BOX_DICT_MAX >> BOX_DICT_PAGE_BITS];
+static u32 dict_count;
+static size_t dict_bytes;
+static ssize_t dict_saved_bytes;
+static u8 *arena;
+static size_t arena_free;
+
+#define mh_name _dict
+#define mh_key_t const u8 *
+#define mh_val_t u32
+#define mh_hash(h, key) ({ const u8 *_k = (key); u32 _l = LOAD_VARINT32(_k); MurmurHash2(_k, _l, 13); })
+#define mh_eq(h, a, b) ({ const u8 *_a = (a), *_b = (b);			\
+			  u32 _al = LOAD_VARINT32(_a), _bl = LOAD_VARINT32(_b);	\
+			  _al == _bl && memcmp(_a, _b, _al) == 0; })
+#define MH_STATIC 1
+#include <mhash.h>
+
+static struct mh_dict_t *dict;
+
+struct box_dict_space {
+	int refs; /* object space and running snapshots */
+	u32 entries; /* codes used by space */
+	u64 frozen; /* fields which don't get new codes */
+	u32 field_new[64]; /* codes new to space brought by field */
+	u64 field_hits[64]; /* codes reused by field */
+	u64 *used[BOX_DICT_MAX >> BOX_DICT_PAGE_BITS]; /* bitmap of codes */
+	u32 *remap; /* snapshot code -> code, while snapshot is loaded */
+	u32 remap_size;
+};
+
+#define DICT_ROW (32 * 1024)
+
+static void
+dict_stat(struct tbuf *out)
+{
+	tbuf_printf(out, "  dict: { entries: %u, bytes: %zu, saved_bytes: %zi }" CRLF,
+		    dict_count, dict_bytes, dict_saved_bytes);
+}
+
+static u32
+dict_lookup(const u8 *field)
+{
+	if (dict == NULL)
+		return UINT32_MAX;
+	u32 k = mh_dict_get(dict, field);
+	return k != mh_end(dict) ? mh_dict_value(dict, k) : UINT32_MAX;
+}
+
+static u32
+dict_intern(const u8 *field, u32 size)
+{
+	if (dict == NULL) {
+		dict = mh_dict_init(xrealloc);
+		slab_stat_hook = dict_stat;
+	}
+
+	u32 k = mh_dict_get(dict, field);
+	if (k != mh_end(dict))
+		return mh_dict_value(dict, k);
+
+	if (dict_count == BOX_DICT_MAX)
+		return UINT32_MAX;
+
+	if (arena_free < size) {
+		arena = xmalloc(DICT_ARENA);
+		arena_free = DICT_ARENA;
+		dict_bytes += DICT_ARENA;
+	}
+	u8 *entry = memcpy(arena, field, size);
+	arena += size;
+	arena_free -= size;
+
+	u32 code = dict_count;
+	const u8 ***page = &box_dict_page[code >> BOX_DICT_PAGE_BITS];
+	if (*page == NULL) {
+		*page = xcalloc(DICT_PAGE, sizeof(**page));
+		dict_bytes += DICT_PAGE * sizeof(**page);
+	}
+	(*page)[code & (DICT_PAGE - 1)] = entry;
+	dict_count++;
+	mh_dict_put(dict, entry, code, NULL);
+	return code;
+}
+
+static struct box_dict_space *
+dict_space(struct object_space *o)
+{
+	if (o->dict == NULL) {
+		o->dict = xcalloc(1, sizeof(*o->dict));
+		o->dict->refs = 1;
+	}
+	return o->dict;
+}
+
+static void
+dict_mark(struct box_dict_space *d, u32 code)
+{
+	u64 **page = &d->used[code >> BOX_DICT_PAGE_BITS];
+	if (unlikely(*page == NULL))
+		*page = xcalloc(DICT_PAGE / 64, sizeof(u64));
+	u64 *word = &(*page)[(code & (DICT_PAGE - 1)) / 64];
+	if ((*word & (1ULL << (code % 64))) == 0) {
+		*word |= 1ULL << (code % 64);
+		d->entries++;
+	}
+}
+
+static bool
+dict_used(const struct box_dict_space *d, u32 code)
+{
+	const u64 *page = d->used[code >> BOX_DICT_PAGE_BITS];
+	return page && page[(code & (DICT_PAGE - 1)) / 64] & (1ULL << (code % 64));
+}
+
+/* code for value of field i or UINT32_MAX, see comment at top */
+static u32
+dict_field_code(struct object_space *o, struct box_dict_space *d, int i,
+		const u8 *f, u32 size)
+{
+	u32 code, max = o->dict_max_entries ?: DICT_SPACE_MAX;
+	if (d->frozen & (1ULL << i) || d->entries >= max) {
+		code = dict_lookup(f);
+		return code != UINT32_MAX && dict_used(d, code) ? code : UINT32_MAX;
+	}
+
+	code = dict_intern(f, size);
+	if (code == UINT32_MAX)
+		return code;
+	if (dict_used(d, code)) {
+		d->field_hits[i]++;
+		return code;
+	}
+	if (++d->field_new[i] == DICT_PROBE &&
+	    d->field_hits[i] < (u64)DICT_PROBE * (DICT_PAYOFF - 1)) {
+		say_info("object_space %i: field %i has too many distinct values, "
+			 "dictionary encoding of new values is off", o->n, i);
+		d->frozen |= 1ULL << i;
+	}
+	return code;
+}
+
+static u32
+dict_code(const u8 *f)
+{
+	f += 2;
+	return LOAD_VARINT32(f);
+}
+
+/* translated code of snapshot row field, or UINT32_MAX */
+static u32
+dict_remap(const struct box_dict_space *d, const u8 *f)
+{
+	u32 code = dict_code(f);
+	if (code >= d->remap_size)
+		return UINT32_MAX;
+	return d->remap[code];
+}
+
+u32
+box_dict_count(void)
+{
+	return dict_count;
+}
+
+u32
+box_dict_space_entries(const struct box_dict_space *d)
+{
+	return d ? d->entries : 0;
+}
+
+struct box_dict_space *
+box_dict_space_retain(struct box_dict_space *d)
+{
+	if (d)
+		d->refs++;
+	return d;
+}
+
+void
+box_dict_space_release(struct box_dict_space *d)
+{
+	if (d == NULL || --d->refs > 0)
+		return;
+	for (int i = 0; i < nelem(d->used); i++)
+		free(d->used[i]);
+	free(d->remap);
+	free(d);
+}
+
+/* DICT_ENTRIES row: i32 n, u32 flags, u32 count, count * { u32 code, field }.
+   entries with codes below count used by space d are split into rows of
+   about DICT_ROW bytes. runs in snapshot thread: no palloc */
+int
+box_dict_snap_write(struct box_dict_space *d, int n, u32 count,
+		    int (*cb)(const void *row, u32 len, void *arg), void *arg)
+{
+	if (d == NULL)
+		return 0;
+
+	u8 *row = xmalloc(DICT_ROW + 12 + 4 + DICT_MAX_VALUE + 5);
+	u32 len = 12, entries = 0;
+	int ret = 0;
+
+	for (u32 code = 0; code <= count && ret == 0; code++) {
+		if ((code == count || len >= DICT_ROW) && entries > 0) {
+			memcpy(row, &(i32){ n }, 4);
+			memcpy(row + 4, &(u32){ 0 }, 4);
+			memcpy(row + 8, &entries, 4);
+			ret = cb(row, len, arg);
+			len = 12;
+			entries = 0;
+		}
+		if (code == count || !dict_used(d, code))
+			continue;
+
+		const u8 *entry = box_dict_page[code >> BOX_DICT_PAGE_BITS][code & (DICT_PAGE - 1)],
+			 *value = entry;
+		u32 size = LOAD_VARINT32(value);
+		size += value - entry;
+		memcpy(row + len, &code, 4);
+		memcpy(row + len + 4, entry, size);
+		len += 4 + size;
+		entries++;
+	}
+	free(row);
+	return ret;
+}
+
+/* DICT_ENTRIES row of snapshot: intern entries, remember their new codes */
+void
+box_dict_load(struct object_space *o, struct tbuf *data)
+{
+	struct box_dict_space *d = dict_space(o);
+	u32 count = read_u32(data);
+
+	for (u32 i = 0; i < count; i++) {
+		u32 code = read_u32(data);
+		const u8 *field = data->ptr;
+		u32 len = read_varint32(data);
+		read_bytes(data, len);
+		u32 size = (const u8 *)data->ptr - field;
+
+		if (code >= BOX_DICT_MAX || len > DICT_MAX_VALUE)
+			iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "bad dictionary entry");
+		if (code >= d->remap_size) {
+			u32 old = d->remap_size;
+			d->remap_size = MAX(code + 1, MAX(old * 2, 1024));
+			d->remap = xrealloc(d->remap, d->remap_size * sizeof(*d->remap));
+			memset(d->remap + old, 0xff, (d->remap_size - old) * sizeof(*d->remap));
+		}
+		d->remap[code] = dict_intern(field, size);
+		if (d->remap[code] == UINT32_MAX)
+			iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "dictionary is full");
+		dict_mark(d, d->remap[code]);
+	}
+}
+
+/* snapshot is loaded: codes of following rows are ours */
+void
+box_dict_load_done(struct object_space *o)
+{
+	if (o->dict == NULL)
+		return;
+	free(o->dict->remap);
+	o->dict->remap = NULL;
+	o->dict->remap_size = 0;
+}
+
+/* replace values of o->dict_fields with codes. returns data itself if
+   nothing was encoded, palloc'ed copy otherwise.
+   on input *coded tells if data may already contain codes (it's built
+   from TUPLE_DICT tuple), raw client data must not: leading 0x80 is
+   non canonical varint and would be taken for code. while snapshot is
+   loaded codes of its rows are translated, plain values stay plain:
+   space cap and frozen fields decided so when snapshot was written.
+   on output *coded tells if result contains codes and *saved is
+   decoded size of result less its size */
+const void *
+box_dict_encode(struct object_space *o, u32 cardinality, const void *data,
+		u32 *bsize, bool *coded, u32 *saved)
+{
+	struct box_dict_space *d = dict_space(o);
+	const u8 *f = data;
+	u8 *out = NULL, *p = NULL;
+	bool trusted = *coded, remap = !trusted && d->remap != NULL;
+
+	*coded = false;
+	*saved = 0;
+	for (u32 i = 0; i < cardinality; i++) {
+		const u8 *next = f, *value = f;
+		u32 len = LOAD_VARINT32(next);
+		next += len;
+		u32 size = next - f, code = UINT32_MAX;
+
+		if (*f == 0x80 && remap) {
+			if (i >= 64 || !(o->dict_fields & (1ULL << i)))
+				iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "tuple encoding error");
+			code = dict_remap(d, f);
+			if (code == UINT32_MAX)
+				iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "unknown dictionary code");
+			value = box_dict_page[code >> BOX_DICT_PAGE_BITS][code & (DICT_PAGE - 1)];
+			const u8 *v = value;
+			size = LOAD_VARINT32(v);
+			size += v - value;
+			if (2 + varint32_sizeof(code) >= size)
+				code = UINT32_MAX;
+		} else if (*f == 0x80) {
+			if (!trusted)
+				iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "tuple encoding error");
+			dict_mark(d, dict_code(f));
+			*coded = true;
+			const u8 *v = box_dict_field(f), *vdata = v;
+			u32 vlen = LOAD_VARINT32(vdata);
+			*saved += vdata - v + vlen - size;
+		} else if (!remap && i < 64 && o->dict_fields & (1ULL << i) &&
+			   len <= DICT_MAX_VALUE && size > 3) {
+			code = dict_field_code(o, d, i, f, size);
+			if (code != UINT32_MAX && 2 + varint32_sizeof(code) >= size)
+				code = UINT32_MAX;
+		}
+
+		if (code != UINT32_MAX || value != f) {
+			if (out == NULL) {
+				/* translated codes may be longer than snapshot ones */
+				u32 max = *bsize + (remap ? 64 * (DICT_MAX_VALUE + 2) : 0);
+				out = p = palloc(fiber->pool, max);
+				memcpy(p, data, f - (const u8 *)data);
+				p += f - (const u8 *)data;
+			}
+		}
+		if (code != UINT32_MAX) {
+			dict_mark(d, code);
+			*p++ = 0x80;
+			*p++ = varint32_sizeof(code);
+			p = save_varint32(p, code);
+			*coded = true;
+			*saved += size - 2 - varint32_sizeof(code);
+		} else if (out != NULL) {
+			memcpy(p, value, size);
+			p += size;
+		}
+		f = next;
+	}
+
+	if (out == NULL)
+		return data;
+	*bsize = p - out;
+	return out;
+}
+
+size_t
+box_dict_decoded_size(u32 cardinality, const void *data)
+{
+	const u8 *f = data;
+	size_t size = 0;
+	for (u32 i = 0; i < cardinality; i++) {
+		const u8 *value = box_dict_field(f), *data = value;
+		u32 len = LOAD_VARINT32(data);
+		size += data - value + len;
+		f = next_field((void *)f);
+	}
+	return size;
+}
+
+void *
+box_dict_decode(u32 cardinality, const void *data, void *out)
+{
+	const u8 *f = data;
+	u8 *o = out;
+	for (u32 i = 0; i < cardinality; i++) {
+		const u8 *value = box_dict_field(f), *data = value;
+		u32 len = LOAD_VARINT32(data);
+		memcpy(o, value, data - value + len);
+		o += data - value + len;
+		f = next_field((void *)f);
+	}
+	return o;
+}
+
+void
+box_dict_account(struct object_space *o, ssize_t saved)
+{
+	o->dict_saved_bytes += saved;
+	dict_saved_bytes += saved;
+}
+
+register_source();
@@ -39,6 +39,10 @@ prepare_create_object_space(struct box_meta_txn *txn, int n, struct tbuf *data)
 	struct index_conf ic = { .n = 0 };
 	index_conf_read(data, &ic);
 	index_conf_validate(&ic);
+	/* number of rows, written by snapshot since format change */
+	u32 rows = txn->flags & 16 ? read_u32(data) : 0;
+	/* bitmap of dictionary encoded fields follows rows */
+	u64 dict_fields = txn->flags & 8 ? read_u64(data) : 0;
 
 	if (ic.unique == false)
 		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "index must be unique");
@@ -57,7 +61,13 @@ prepare_create_object_space(struct box_meta_txn *txn, int n, struct tbuf *data)
 	txn->object_space->cardinality = cardinalty;
 	txn->object_space->snap = txn->flags & 1;
 	txn->object_space->wal = txn->flags & 2;
+	txn->object_space->field_offsets = txn->flags & 4;
+	txn->object_space->dict_fields = dict_fields;
 	txn->object_space->index[0] = txn->index;
+	if (rows > 0 && [txn->index respondsTo:@selector(bulk_insert:)]) {
+		[(id<HashIndex>)txn->index resize:rows];
+		txn->object_space->bulk_load = true;
+	}
 	object_space_fill_stat_names(txn->object_space);
 	assert(txn->object_space->snap);
 	assert(txn->object_space->wal);
@@ -70,6 +80,7 @@ prepare_create_index(struct box_meta_txn *txn, struct tbuf *data)
 	struct index_conf ic = { .n = read_i8(data) };
 	index_conf_read(data, &ic);
 	index_conf_validate(&ic);
+	u32 rows = txn->flags & 16 ? read_u32(data) : 0;
 
 	if (txn->object_space->index[(int)ic.n])
 		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "index already exists");
@@ -114,10 +125,16 @@ prepare_create_index(struct box_meta_txn *txn, struct tbuf *data)
 		}
 		[(Tree*)txn->index set_sorted_nodes:nodes count:n_tuples];
 	} else {
+		if ([txn->index respondsTo:@selector(resize:)])
+			[(id<HashIndex>)txn->index resize:[pk size]];
 		[pk iterator_init];
 		while ((obj = [pk iterator_next]))
 			[txn->index replace:obj];
 	}
+
+	if (rows > 0 && rows != [txn->index size])
+		say_warn("object_space %i index %i: %u rows, snapshot says %u",
+			 txn->object_space->n, ic.n, [txn->index size], rows);
 }
 
 static void __attribute__((noinline))
@@ -155,6 +172,11 @@ box_prepare_meta(struct box_meta_txn *txn, struct tbuf *data)
 		txn->object_space = object_space(txn->box, n);
 		prepare_drop_index(txn, data);
 		break;
+	case DICT_ENTRIES:
+		/* entries are never removed: nothing to rollback */
+		txn->object_space = object_space(txn->box, n);
+		box_dict_load(txn->object_space, data);
+		break;
 	default:
 		raise_fmt("unknown op");
 	}
@@ -191,6 +213,7 @@ box_commit_meta(struct box_meta_txn *txn)
 		say_info("CREATE index n:%i %i:%s",
 			 txn->object_space->n, txn->index->conf.n, [txn->index info]);
 		txn->object_space->index[(int)txn->index->conf.n] = txn->index;
+		txn->object_space->bulk_load = false; /* PK rows are loaded */
 		link_index(txn->object_space);
 		break;
 	case DROP_INDEX:
@@ -204,12 +227,16 @@ box_commit_meta(struct box_meta_txn *txn)
 		[pk iterator_init];
 		while ((obj = [pk iterator_next]) != NULL) {
 			assert(tuple_visible_left(obj) == obj);
-			object_decr_ref(obj);
+			if (txn->object_space->snap_frozen)
+				box_snap_displace(txn->object_space, obj);
+			tuple_free(obj);
 		}
+		box_snap_drop(txn->object_space);
 		foreach_index(index, txn->object_space)
 			[txn->index free];
 		txn->box->object_space_registry[txn->object_space->n] = NULL;
 		object_space_clear_stat_names(txn->object_space);
+		box_dict_space_release(txn->object_space->dict);
 		free(txn->object_space);
 		break;
 	case TRUNCATE:
@@ -217,11 +244,15 @@ box_commit_meta(struct box_meta_txn *txn)
 		[pk iterator_init];
 		while ((obj = [pk iterator_next]) != NULL) {
 			assert(tuple_visible_left(obj) == obj);
+			if (txn->object_space->snap_frozen)
+				box_snap_displace(txn->object_space, obj);
 			tuple_free(obj);
 		}
 		foreach_index(index, txn->object_space)
 			[index clear];
 		break;
+	case DICT_ENTRIES:
+		return;
 	default:
 		assert(0);
 	}
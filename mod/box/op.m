@@ -76,38 +76,109 @@ tuple_field(struct tnt_object *obj, size_t i)
 	if (i >= tuple_cardinality(obj))
 		return NULL;
 
+	if (obj->type == BOX_TUPLE_OFT)
+		return field + box_tuple_field_offset(obj, i);
+
 	while (i-- > 0)
 		field = next_field(field);
 
 	return field;
 }
 
+/* coded: tuple is TUPLE_DICT, room for its trailer is reserved */
 static struct tnt_object *
-tuple_alloc(unsigned cardinality, unsigned size)
+tuple_alloc(struct object_space *o, unsigned cardinality, unsigned size, bool coded)
 {
 	struct tnt_object *obj;
+	unsigned trailer = coded ? sizeof(u16) : 0;
 	if (cardinality < 256 && size < 256) {
-		obj = object_alloc(BOX_SMALL_TUPLE, 0, sizeof(struct box_small_tuple) + size);
+		obj = object_alloc(BOX_SMALL_TUPLE, 0, sizeof(struct box_small_tuple) + size + trailer);
 		struct box_small_tuple *tuple = box_small_tuple(obj);
 		tuple->bsize = size;
 		tuple->cardinality = cardinality;
+	} else if (o->field_offsets) {
+		obj = object_alloc(BOX_TUPLE_OFT, 1, sizeof(struct box_tuple) + size +
+				   box_tuple_oft_size(cardinality, size) + trailer);
+		object_incr_ref(obj);
+		struct box_tuple *tuple = box_tuple(obj);
+		tuple->bsize = size;
+		tuple->cardinality = cardinality;
 	} else {
-		obj = object_alloc(BOX_TUPLE, 1, sizeof(struct box_tuple) + size);
+		obj = object_alloc(BOX_TUPLE, 1, sizeof(struct box_tuple) + size + trailer);
 		object_incr_ref(obj);
 		struct box_tuple *tuple = box_tuple(obj);
 		tuple->bsize = size;
 		tuple->cardinality = cardinality;
 	}
 
+	if (coded)
+		obj->flags |= TUPLE_DICT;
+	tuple_snap_stamp(o, obj);
 	say_trace("tuple_alloc(%u, %u) = %p", cardinality, size, obj + 1);
 	return obj;
 }
 
-void
-tuple_free(struct tnt_object *obj)
+/* TUPLE_DICT trailer: bytes saved by dictionary encoding, as computed
+   by box_dict_encode(). lets bytes_usage() skip walking fields */
+static void *
+tuple_dict_trailer(struct tnt_object *obj)
+{
+	u32 bsize = tuple_bsize(obj);
+	u8 *end = (u8 *)tuple_data(obj) + bsize;
+	if (obj->type == BOX_TUPLE_OFT)
+		end += box_tuple_oft_size(tuple_cardinality(obj), bsize);
+	return end;
+}
+
+static u16
+tuple_dict_saved(struct tnt_object *obj)
+{
+	u16 saved;
+	memcpy(&saved, tuple_dict_trailer(obj), sizeof(saved));
+	return saved;
+}
+
+static void
+tuple_dict_set_saved(struct tnt_object *obj, u32 saved)
+{
+	assert(obj->flags & TUPLE_DICT && saved <= UINT16_MAX);
+	memcpy(tuple_dict_trailer(obj), &(u16){ saved }, sizeof(u16));
+}
+
+/* must be called once tuple data is filled */
+static void
+tuple_build_offsets(struct tnt_object *obj)
+{
+	if (obj->type != BOX_TUPLE_OFT)
+		return;
+
+	struct box_tuple *tuple = box_tuple(obj);
+	void *oft = tuple->data + tuple->bsize;
+	const u8 *field = tuple->data;
+	for (u32 i = 0; i < tuple->cardinality; i++) {
+		u32 offset = field - tuple->data;
+		if (tuple->bsize <= UINT16_MAX)
+			((u16 *)oft)[i] = offset;
+		else
+			((u32 *)oft)[i] = offset;
+		u32 len = LOAD_VARINT32(field);
+		field += len;
+	}
+}
+
+/* while in-process snapshot views are alive tuples can't be freed:
+   snapshot thread may still read them. they are queued and released
+   when last view is gone */
+static int snap_views;
+static struct tnt_object **snap_deferred;
+static size_t snap_deferred_count, snap_deferred_size;
+
+static void
+tuple_free_now(struct tnt_object *obj)
 {
 	switch (obj->type) {
 	case BOX_TUPLE:
+	case BOX_TUPLE_OFT:
 		object_decr_ref(obj);
 		break;
 	case BOX_SMALL_TUPLE:
@@ -119,6 +190,91 @@ tuple_free(struct tnt_object *obj)
 	}
 }
 
+void
+tuple_free(struct tnt_object *obj)
+{
+	if (snap_views == 0) {
+		tuple_free_now(obj);
+		return;
+	}
+
+	if (snap_deferred_count == snap_deferred_size) {
+		snap_deferred_size = snap_deferred_size ? snap_deferred_size * 2 : 1024;
+		snap_deferred = xrealloc(snap_deferred, snap_deferred_size * sizeof(*snap_deferred));
+	}
+	snap_deferred[snap_deferred_count++] = obj;
+}
+
+void
+box_snap_view_acquire(void)
+{
+	snap_views++;
+}
+
+void
+box_snap_view_release(void)
+{
+	assert(snap_views > 0);
+	if (--snap_views > 0)
+		return;
+
+	say_debug("%s: freeing %zu deferred tuples", __func__, snap_deferred_count);
+	for (size_t i = 0; i < snap_deferred_count; i++)
+		tuple_free_now(snap_deferred[i]);
+	free(snap_deferred);
+	snap_deferred = NULL;
+	snap_deferred_count = snap_deferred_size = 0;
+}
+
+static void
+tuple_relink(struct object_space *o, int count, struct tnt_object *from, struct tnt_object *to)
+{
+	foreach_index(index, o) {
+		if (count-- == 0)
+			break;
+		[index replace:to];
+		if (!index->conf.unique)
+			[index remove:from];
+	}
+}
+
+/* slab defragmentation: move tuple into fresh memory and repoint indexes.
+   tuples referenced from outside of indexes and uncommitted ones are skipped */
+bool
+tuple_relocate(struct object_space *o, struct tnt_object *obj)
+{
+	if (obj->type == BOX_PHI || (obj->flags & ~(TUPLE_DICT|TUPLE_SNAP)) != 0)
+		return false;
+	if ((obj->type == BOX_TUPLE || obj->type == BOX_TUPLE_OFT) &&
+	    container_of(obj, struct gc_oct_object, obj)->refs != 1)
+		return false;
+
+	struct tnt_object *copy = tuple_alloc(o, tuple_cardinality(obj), tuple_bsize(obj),
+					      obj->flags & TUPLE_DICT);
+	memcpy(tuple_data(copy), tuple_data(obj), tuple_bsize(obj));
+	copy->flags = obj->flags;
+	if (obj->flags & TUPLE_DICT)
+		tuple_dict_set_saved(copy, tuple_dict_saved(obj));
+	tuple_build_offsets(copy);
+
+	int count = 0;
+	@try {
+		foreach_index(index, o) {
+			[index replace:copy];
+			if (!index->conf.unique)
+				[index remove:obj];
+			count++;
+		}
+	}
+	@catch (id e) {
+		tuple_relink(o, count, copy, obj);
+		tuple_free(copy);
+		@throw;
+	}
+	tuple_free(obj);
+	return true;
+}
+
 ssize_t
 fields_bsize(u32 cardinality, const void *data, u32 max_len)
 {
@@ -142,11 +298,40 @@ tuple_valid(struct tnt_object *obj)
 	}
 }
 
+static void
+net_tuple_add_dict(struct netmsg_head *h, struct tnt_object *obj)
+{
+	u32 cardinality = tuple_cardinality(obj);
+	size_t bsize = box_dict_decoded_size(cardinality, tuple_data(obj));
+	struct box_tuple *reply = net_add_alloc(h, sizeof(*reply) + bsize);
+	reply->bsize = bsize;
+	reply->cardinality = cardinality;
+	box_dict_decode(cardinality, tuple_data(obj), reply->data);
+}
+
+struct tnt_object *
+tuple_dict_decode(struct tnt_object *obj)
+{
+	u32 cardinality = tuple_cardinality(obj);
+	size_t bsize = box_dict_decoded_size(cardinality, tuple_data(obj));
+	struct tnt_object *copy = object_alloc(BOX_TUPLE, 1, sizeof(struct box_tuple) + bsize);
+	box_tuple(copy)->bsize = bsize;
+	box_tuple(copy)->cardinality = cardinality;
+	box_dict_decode(cardinality, tuple_data(obj), box_tuple(copy)->data);
+	return copy;
+}
+
 void
 net_tuple_add(struct netmsg_head *h, struct tnt_object *obj)
 {
+	if (unlikely(obj->flags & TUPLE_DICT)) {
+		net_tuple_add_dict(h, obj);
+		return;
+	}
+
 	switch (obj->type) {
-	case BOX_TUPLE: {
+	case BOX_TUPLE:
+	case BOX_TUPLE_OFT: {
 		struct box_tuple *tuple = box_tuple(obj);
 		size_t size = tuple->bsize + 8;
 		net_add_obj_iov(h, obj, &tuple->bsize, size);
@@ -251,6 +436,7 @@ phi_insert(struct box_op *bop, id<BasicIndex> index,
 			sfree(cell);
 			@throw;
 		}
+		LIST_INSERT_HEAD(&bop->object_space->phi, phi, space_link);
 	}
 
 	TAILQ_INSERT_TAIL(bop_tailq, cell, bop_link);
@@ -271,6 +457,7 @@ phi_commit(struct box_phi_cell *cell)
 			[phi->index remove:&phi->header];
 		else
 			[phi->index replace:cell->obj];
+		LIST_REMOVE(phi, space_link);
 		sfree(phi);
 	} else {
 		assert(cell->obj != NULL || TAILQ_NEXT(cell, link)->obj != NULL);
@@ -298,6 +485,7 @@ phi_rollback(struct box_phi_cell *cell)
 			[phi->index remove:&phi->header];
 		else
 			[phi->index replace:phi->obj];
+		LIST_REMOVE(phi, space_link);
 		sfree(phi);
 	}
 }
@@ -314,6 +502,92 @@ tuple_visible_right(struct tnt_object *obj)
 	return phi_right(obj);
 }
 
+/* NIHTree subtree counts and Tree count_from:... include phi. there are
+   few of them, so counts are corrected by walking phi of the space:
+   phi_hidden() tells whether a phi entry is invisible to the reader */
+static bool
+phi_hidden(struct box_phi *phi, Index *index,
+	   struct tnt_object *(*visible)(struct tnt_object *))
+{
+	return (Index *)phi->index == index && visible(&phi->header) == NULL;
+}
+
+/* number of hidden phi in [from, to], NULL bound is unbounded */
+static u32
+phi_hidden_count(struct object_space *o, Tree *index,
+		 const struct index_node *from, const struct index_node *to,
+		 struct tnt_object *(*visible)(struct tnt_object *))
+{
+	struct index_node *node = NULL;
+	struct box_phi *phi;
+	u32 count = 0;
+
+	LIST_FOREACH(phi, &o->phi, space_link) {
+		if (!phi_hidden(phi, index, visible))
+			continue;
+		node = node ?: palloc(fiber->pool, index->node_size);
+		index->dtor(&phi->header, node, index->dtor_arg);
+		if (from && index->compare(from, node, index->dtor_arg) > 0)
+			continue;
+		if (to && index->compare(to, node, index->dtor_arg) < 0)
+			continue;
+		count++;
+	}
+	return count;
+}
+
+u32
+box_index_count(struct object_space *o, NIHTree *index,
+		const struct index_node *from, const struct index_node *to)
+{
+	u32 count = [index count_from_node:from to_node:to];
+	return count - phi_hidden_count(o, index, from, to, tuple_visible_right);
+}
+
+/* positions iterator of SELECT at key and skips offset visible entries
+   using subtree counts. hidden phi matching key are ranked within key
+   range, and raw skip is extended by those falling inside of it.
+   returns number of skipped visible entries */
+static u32
+select_skip(struct object_space *o, NIHTree *index, struct tbuf *key_data, u32 c, u32 offset)
+{
+	struct index_node *pattern = palloc(fiber->pool, index->node_size), *node = NULL;
+	struct tbuf key = *key_data;
+	struct box_phi *phi;
+	u32 *rank = NULL, n = 0, size = 0;
+
+	index->init_pattern(&key, c, pattern, index->dtor_arg);
+	LIST_FOREACH(phi, &o->phi, space_link) {
+		if (!phi_hidden(phi, index, tuple_visible_left))
+			continue;
+		node = node ?: palloc(fiber->pool, index->node_size);
+		index->dtor(&phi->header, node, index->dtor_arg);
+		if (index->compare(pattern, node, index->dtor_arg) != 0)
+			continue;
+		if (n == size) {
+			size = size ? size * 2 : 8;
+			u32 *tmp = palloc(fiber->pool, size * sizeof(*rank));
+			if (n > 0)
+				memcpy(tmp, rank, n * sizeof(*rank));
+			rank = tmp;
+		}
+		/* number of entries matching key before phi, kept sorted */
+		u32 r = [index count_from_node:c > 0 ? pattern : NULL to_node:node] - 1;
+		u32 i = n++;
+		for (; i > 0 && rank[i - 1] > r; i--)
+			rank[i] = rank[i - 1];
+		rank[i] = r;
+	}
+
+	u32 raw = offset, hidden = 0;
+	for (u32 i = 0; i < n && rank[i] < raw; i++)
+		raw++;
+	u32 skipped = [index iterator_init_with_key:key_data cardinalty:c skip:raw];
+	while (hidden < n && rank[hidden] < skipped)
+		hidden++;
+	return skipped - hidden;
+}
+
 static void
 object_space_delete(struct box_op *bop, struct tnt_object *index_obj, struct tnt_object *tuple)
 {
@@ -388,8 +662,16 @@ prepare_replace(struct box_op *bop, size_t cardinality, const void *data, u32 da
 	if (data_len == 0 || fields_bsize(cardinality, data, data_len) != data_len)
 		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "tuple encoding error");
 
-	bop->obj = tuple_alloc(cardinality, data_len);
+	bool coded = false;
+	u32 saved = 0;
+	if (bop->object_space->dict_fields)
+		data = box_dict_encode(bop->object_space, cardinality, data, &data_len, &coded, &saved);
+
+	bop->obj = tuple_alloc(bop->object_space, cardinality, data_len, coded);
 	memcpy(tuple_data(bop->obj), data, data_len);
+	if (coded)
+		tuple_dict_set_saved(bop->obj, saved);
+	tuple_build_offsets(bop->obj);
 
 	Index<BasicIndex> *pk = bop->object_space->index[0];
 	struct tnt_object *old_root = [pk find_obj:bop->obj];
@@ -417,14 +699,25 @@ snap_insert_row(struct object_space* object_space, size_t cardinality, const voi
 	if (data_len == 0 || fields_bsize(cardinality, data, data_len) != data_len)
 		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "tuple encoding error");
 
-	struct tnt_object *obj = tuple_alloc(cardinality, data_len);
+	bool coded = false;
+	u32 saved = 0;
+	if (object_space->dict_fields)
+		data = box_dict_encode(object_space, cardinality, data, &data_len, &coded, &saved);
+
+	struct tnt_object *obj = tuple_alloc(object_space, cardinality, data_len, coded);
 	memcpy(tuple_data(obj), data, data_len);
+	if (coded)
+		tuple_dict_set_saved(obj, saved);
 	if (!tuple_valid(obj)) {
 		raise_fmt("tuple misformatted");
 	}
+	tuple_build_offsets(obj);
 	Index<BasicIndex> *pk = object_space->index[0];
 	@try {
-		[pk replace: obj];
+		if (object_space->bulk_load)
+			[(id<HashIndex>)pk bulk_insert:obj];
+		else
+			[pk replace: obj];
 		bytes_usage(object_space, obj, +1);
 	} @catch (id e) {
 		tuple_free(obj);
@@ -553,6 +846,35 @@ do_field_splice(struct tbuf *field, const void *args_data, u32 args_data_size)
 	return diff;
 }
 
+/* fields of BOX_TUPLE_OFT are split lazily: unsplit field has .ptr == NULL
+   and its number in old tuple in .free */
+static void
+oft_field_load(struct tnt_object *obj, struct tbuf *field)
+{
+	const u8 *src = (u8 *)tuple_data(obj) + box_tuple_field_offset(obj, field->free);
+	const u8 *ptr = src;
+	u32 len = LOAD_VARINT32(ptr);
+	*field = (struct tbuf){ .ptr = (void *)src, .end = (void *)ptr,
+				.free = len, .pool = NULL };
+}
+
+/* point unsplit field of TUPLE_DICT tuple to its dictionary value.
+   returns growth of tuple size */
+static ssize_t
+dict_field_load(struct tbuf *field)
+{
+	const u8 *src = field->ptr;
+	if (*src != 0x80)
+		return 0;
+
+	const u8 *value = box_dict_field(src), *ptr = value;
+	u32 len = LOAD_VARINT32(ptr);
+	ssize_t diff = (ptr - value + len) - ((u8 *)field->end - src + field->free);
+	*field = (struct tbuf){ .ptr = (void *)value, .end = (void *)ptr,
+				.free = len, .pool = NULL };
+	return diff;
+}
+
 static void __attribute__((noinline))
 prepare_update_fields(struct box_op *bop, struct tbuf *data)
 {
@@ -586,7 +908,10 @@ prepare_update_fields(struct box_op *bop, struct tbuf *data)
 	int field_count = cardinality * 1.2;
 	fields = palloc(fiber->pool, field_count * sizeof(struct tbuf));
 
-	for (i = 0, field = tdata; i < cardinality; i++) {
+	if (bop->old_obj->type == BOX_TUPLE_OFT) {
+		for (i = 0; i < cardinality; i++)
+			fields[i] = (struct tbuf){ .ptr = NULL, .free = i };
+	} else for (i = 0, field = tdata; i < cardinality; i++) {
 		const void *src = field;
 		int len = LOAD_VARINT32(field);
 		/* .ptr  - start of varint
@@ -622,9 +947,13 @@ prepare_update_fields(struct box_op *bop, struct tbuf *data)
 				iproto_raise(ERR_CODE_ILLEGAL_PARAMS,
 					     "update of field beyond tuple cardinality");
 			field = &fields[field_no];
+			if (field->ptr == NULL)
+				oft_field_load(bop->old_obj, field);
 		}
 		if (op < 6) {
 			if (field->pool == NULL) {
+				if (bop->old_obj->flags & TUPLE_DICT)
+					bsize += dict_field_load(field);
 				void *field_data = field->end;
 				int field_len = field->free;
 				int expected_size = MAX(arg_size, field_len);
@@ -692,12 +1021,34 @@ prepare_update_fields(struct box_op *bop, struct tbuf *data)
 	if (tbuf_len(data) != 0)
 		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "can't unpack request");
 
-	bop->obj = tuple_alloc(cardinality, bsize);
-
-	u8 *p = tuple_data(bop->obj);
+	/* tuples of dictionary spaces are built aside and then encoded */
+	struct object_space *o = bop->object_space;
+	bool coded = bop->old_obj->flags & TUPLE_DICT;
+	bool dict = coded || o->dict_fields;
+	u8 *p, *new_data = NULL;
+	if (dict) {
+		p = new_data = palloc(fiber->pool, bsize);
+	} else {
+		bop->obj = tuple_alloc(o, cardinality, bsize, false);
+		p = tuple_data(bop->obj);
+	}
+	int old_cardinality = tuple_cardinality(bop->old_obj);
 	i = 0;
 	do {
-		if (fields[i].pool == NULL) {
+		if (fields[i].ptr == NULL) {
+			u32 first = fields[i].free, last = first;
+			for (i++; i < cardinality; i++) {
+				if (fields[i].ptr != NULL || fields[i].free != last + 1)
+					break;
+				last++;
+			}
+			u32 start = box_tuple_field_offset(bop->old_obj, first);
+			u32 end = last + 1 < old_cardinality ?
+				  box_tuple_field_offset(bop->old_obj, last + 1) :
+				  tuple_bsize(bop->old_obj);
+			memcpy(p, (u8 *)tdata + start, end - start);
+			p += end - start;
+		} else if (fields[i].pool == NULL) {
 			void *ptr = fields[i].ptr;
 			void *end = fields[i].end + fields[i].free;
 			for (i++; i < cardinality; i++) {
@@ -717,6 +1068,20 @@ prepare_update_fields(struct box_op *bop, struct tbuf *data)
 		}
 	} while (i < cardinality);
 
+	if (dict) {
+		u32 new_bsize = bsize, saved = 0;
+		const void *encoded = new_data;
+		if (o->dict_fields)
+			encoded = box_dict_encode(o, cardinality, new_data, &new_bsize, &coded, &saved);
+		else if (coded)
+			saved = box_dict_decoded_size(cardinality, new_data) - bsize;
+		bop->obj = tuple_alloc(o, cardinality, new_bsize, coded);
+		memcpy(tuple_data(bop->obj), encoded, new_bsize);
+		if (coded)
+			tuple_dict_set_saved(bop->obj, saved);
+	}
+	tuple_build_offsets(bop->obj);
+
 	if (![pk eq:bop->old_obj :bop->obj])
 		bop->obj_affected++;
 
@@ -772,11 +1137,205 @@ object_space_clear_stat_names(struct object_space* space) {
 	space->statbase = -1;
 }
 
+enum select_pred_op {
+	PRED_EQ, PRED_NE, PRED_LT, PRED_LE, PRED_GT, PRED_GE
+};
+
+struct select_pred {
+	u32 field_no;
+	u8 op;
+	u8 type; /* enum index_field_type */
+	u32 len;
+	const u8 *value;
+};
+
+/* SELECT_PROJECT: tuples not matching all predicates are skipped
+   (offset and limit count matching ones only), reply tuples consist of
+   requested fields only. fields beyond tuple cardinality are empty.
+   predicate compares field as its type says: numbers by value, STRING
+   bytewise. missing field or field of other size than numeric type
+   doesn't match any predicate */
+struct select_proj {
+	u32 field_count, pred_count;
+	u32 *field;
+	u32 *order; /* indexes of field[] sorted by field number */
+	const u8 **ptr;
+	struct select_pred *pred;
+};
+
+/* size of numeric field type, 0 for STRING */
+static u32
+pred_type_size(u8 type)
+{
+	switch (type) {
+	case UNUM8: case SNUM8: return 1;
+	case UNUM16: case SNUM16: return 2;
+	case UNUM32: case SNUM32: return 4;
+	case UNUM64: case SNUM64: return 8;
+	case STRING: return 0;
+	default:
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "invalid predicate type");
+	}
+}
+
+/* sizes of numeric a and b are checked by caller */
+static int
+field_value_compare(u8 type, const u8 *a, u32 alen, const u8 *b, u32 blen)
+{
+#define NUM_CMP(t) ({ t x, y; memcpy(&x, a, sizeof(x)); memcpy(&y, b, sizeof(y)); CMP(x, y); })
+	switch (type) {
+	case UNUM8: return NUM_CMP(u8);
+	case SNUM8: return NUM_CMP(i8);
+	case UNUM16: return NUM_CMP(u16);
+	case SNUM16: return NUM_CMP(i16);
+	case UNUM32: return NUM_CMP(u32);
+	case SNUM32: return NUM_CMP(i32);
+	case UNUM64: return NUM_CMP(u64);
+	case SNUM64: return NUM_CMP(i64);
+	}
+#undef NUM_CMP
+	int r = memcmp(a, b, MIN(alen, blen));
+	return r != 0 ? r : CMP(alen, blen);
+}
+
+static bool
+select_match(struct tnt_object *obj, const struct select_proj *proj)
+{
+	for (u32 i = 0; i < proj->pred_count; i++) {
+		const struct select_pred *pred = &proj->pred[i];
+		const u8 *f = tuple_field(obj, pred->field_no);
+		if (f == NULL)
+			return false;
+		f = tuple_field_value(obj, f);
+		u32 len = LOAD_VARINT32(f);
+		if (pred->type != STRING && len != pred->len)
+			return false;
+		int r = field_value_compare(pred->type, f, len, pred->value, pred->len);
+		bool ok;
+		switch (pred->op) {
+		case PRED_EQ: ok = r == 0; break;
+		case PRED_NE: ok = r != 0; break;
+		case PRED_LT: ok = r < 0; break;
+		case PRED_LE: ok = r <= 0; break;
+		case PRED_GT: ok = r > 0; break;
+		case PRED_GE: ok = r >= 0; break;
+		default: ok = false;
+		}
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+static void
+net_tuple_add_proj(struct netmsg_head *h, struct tnt_object *obj, struct select_proj *proj)
+{
+	u32 cardinality = tuple_cardinality(obj), bsize = 0, j = 0;
+	const u8 *f = tuple_data(obj);
+
+	/* single pass over tuple, unless it has offset table */
+	for (u32 i = 0; i < proj->field_count; i++) {
+		u32 k = proj->order[i], field_no = proj->field[k];
+		if (field_no >= cardinality) {
+			proj->ptr[k] = NULL;
+			bsize += varint32_sizeof(0);
+			continue;
+		}
+		if (obj->type == BOX_TUPLE_OFT)
+			f = tuple_field(obj, field_no);
+		else for (; j < field_no; j++)
+			f = next_field((void *)f);
+		const u8 *value = proj->ptr[k] = tuple_field_value(obj, f), *data = value;
+		u32 len = LOAD_VARINT32(data);
+		bsize += data - value + len;
+	}
+
+	struct box_tuple *reply = net_add_alloc(h, sizeof(*reply) + bsize);
+	reply->bsize = bsize;
+	reply->cardinality = proj->field_count;
+	u8 *out = reply->data;
+	for (u32 i = 0; i < proj->field_count; i++) {
+		if (proj->ptr[i] == NULL) {
+			out = save_varint32(out, 0);
+			continue;
+		}
+		const u8 *data = proj->ptr[i];
+		u32 len = LOAD_VARINT32(data);
+		u32 size = data - proj->ptr[i] + len;
+		memcpy(out, proj->ptr[i], size);
+		out += size;
+	}
+}
+
+static struct select_proj *
+read_select_proj(struct tbuf *data)
+{
+	struct select_proj *proj = palloc(fiber->pool, sizeof(*proj));
+	proj->field_count = read_u32(data);
+	if (proj->field_count == 0)
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "empty projection");
+	if (proj->field_count > tbuf_len(data) / sizeof(u32))
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "can't unpack request");
+	proj->field = palloc(fiber->pool, proj->field_count * sizeof(u32));
+	proj->order = palloc(fiber->pool, proj->field_count * sizeof(u32));
+	proj->ptr = palloc(fiber->pool, proj->field_count * sizeof(*proj->ptr));
+	for (u32 i = 0; i < proj->field_count; i++) {
+		u32 field_no = proj->field[i] = read_u32(data), j = i;
+		for (; j > 0 && proj->field[proj->order[j - 1]] > field_no; j--)
+			proj->order[j] = proj->order[j - 1];
+		proj->order[j] = i;
+	}
+
+	proj->pred_count = read_u32(data);
+	if (proj->pred_count > tbuf_len(data))
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "can't unpack request");
+	proj->pred = palloc(fiber->pool, proj->pred_count * sizeof(*proj->pred) + 1);
+	for (u32 i = 0; i < proj->pred_count; i++) {
+		struct select_pred *pred = &proj->pred[i];
+		pred->field_no = read_u32(data);
+		pred->op = read_u8(data);
+		if (pred->op > PRED_GE)
+			iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "invalid predicate op");
+		pred->type = read_u8(data);
+		u32 size = pred_type_size(pred->type);
+		pred->value = read_field(data);
+		pred->len = LOAD_VARINT32(pred->value);
+		if (size != 0 && pred->len != size)
+			iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "predicate value size mismatch");
+	}
+	return proj;
+}
+
+static inline void
+select_add(struct netmsg_head *h, struct tnt_object *obj,
+	   u32 *limit, u32 *offset, u32 *found, struct select_proj *proj)
+{
+	obj = tuple_visible_left(obj);
+	if (obj == NULL)
+		return;
+	if (unlikely(*limit == 0))
+		return;
+	if (proj != NULL && !select_match(obj, proj))
+		return;
+	if (unlikely(*offset > 0)) {
+		(*offset)--;
+		return;
+	}
+
+	(*found)++;
+	if (proj != NULL)
+		net_tuple_add_proj(h, obj, proj);
+	else
+		net_tuple_add(h, obj);
+	(*limit)--;
+}
+
 static u32 __attribute__((noinline))
-process_select(struct netmsg_head *h, Index<BasicIndex> *index,
-	       u32 limit, u32 offset, u32 count, struct tbuf *data)
+process_select(struct netmsg_head *h, struct object_space *space, Index<BasicIndex> *index,
+	       u32 limit, u32 offset, u32 count, struct tbuf *data,
+	       struct select_proj *proj)
 {
-	struct tnt_object *obj;
+	struct tnt_object *obj, *batch[INDEX_FIND_BATCH];
 	uint32_t *found;
 	index_cmp cmp = NULL;
 	bool is_hash = index_type_is_hash(index->conf.type);
@@ -785,29 +1344,37 @@ process_select(struct netmsg_head *h, Index<BasicIndex> *index,
 	found = net_add_alloc(h, sizeof(*found));
 	*found = 0;
 
-	for (u32 i = 0; i < count; i++) {
+	for (u32 i = 0; i < count; ) {
+		/* runs of full keys are looked up in batches */
+		u32 n = count - i > 1 ? [index find_keys:data
+						   count:MIN(count - i, INDEX_FIND_BATCH)
+						  result:batch] : 0;
+		if (n > 0) {
+			for (u32 j = 0; j < n; j++)
+				if (batch[j] != NULL)
+					__builtin_prefetch(batch[j]);
+			for (u32 j = 0; j < n; j++)
+				select_add(h, batch[j], &limit, &offset, found, proj);
+			i += n;
+			continue;
+		}
+
+		i++;
 		u32 c = read_u32(data);
 		if (index->conf.cardinality == c) {
 			obj = [index find_key:data cardinalty:c];
-			obj = tuple_visible_left(obj);
-			if (obj == NULL)
-				continue;
-			if (unlikely(limit == 0))
-				continue;
-			if (unlikely(offset > 0)) {
-				offset--;
-				continue;
-			}
-
-			(*found)++;
-			net_tuple_add(h, obj);
-			limit--;
+			select_add(h, obj, &limit, &offset, found, proj);
 		} else if (is_hash) {
 			iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "cardinality mismatch");
 		} else {
 			Tree *tree = (Tree *)index;
 			cmp = cmp ?: [tree compare];
-			[tree iterator_init_with_key:data cardinalty:c];
+			/* NIHTree skips offset using subtree counts */
+			if (offset > 0 && (proj == NULL || proj->pred_count == 0) &&
+			    [tree respondsTo:@selector(iterator_init_with_key:cardinalty:skip:)])
+				offset -= select_skip(space, (NIHTree *)tree, data, c, offset);
+			else
+				[tree iterator_init_with_key:data cardinalty:c];
 			if (unlikely(limit == 0))
 				continue;
 
@@ -815,13 +1382,18 @@ process_select(struct netmsg_head *h, Index<BasicIndex> *index,
 				obj = tuple_visible_left(obj);
 				if (unlikely(obj == NULL))
 					continue;
+				if (proj != NULL && !select_match(obj, proj))
+					continue;
 				if (unlikely(offset > 0)) {
 					offset--;
 					continue;
 				}
 
 				(*found)++;
-				net_tuple_add(h, obj);
+				if (proj != NULL)
+					net_tuple_add_proj(h, obj, proj);
+				else
+					net_tuple_add(h, obj);
 
 				if (--limit == 0)
 					break;
@@ -972,6 +1544,10 @@ bytes_usage(struct object_space *object_space, struct tnt_object *obj, int sign)
 	case BOX_TUPLE:
 		object_space->obj_bytes += sign * (tuple_bsize(obj) + tuple_overhead);
 		break;
+	case BOX_TUPLE_OFT:
+		object_space->obj_bytes += sign * (tuple_bsize(obj) + tuple_overhead +
+			box_tuple_oft_size(tuple_cardinality(obj), tuple_bsize(obj)));
+		break;
 	case BOX_SMALL_TUPLE:
 		object_space->obj_bytes += sign * (tuple_bsize(obj) + small_tuple_overhead);
 		break;
@@ -979,6 +1555,8 @@ bytes_usage(struct object_space *object_space, struct tnt_object *obj, int sign)
 		assert(false);
 	}
 	object_space->slab_bytes += sign * salloc_usable_size(obj);
+	if (obj->flags & TUPLE_DICT)
+		box_dict_account(object_space, sign * tuple_dict_saved(obj));
 }
 
 static void
@@ -990,9 +1568,13 @@ box_op_commit(struct box_op *bop)
 	say_trace("%s: old_obj:%p obj:%p", __func__, bop->old_obj, bop->obj);
 	if (bop->obj) {
 		bytes_usage(bop->object_space, bop->obj, +1);
+		tuple_snap_stamp(bop->object_space, bop->obj);
 	}
-	if (bop->old_obj)
+	if (bop->old_obj) {
 		bytes_usage(bop->object_space, bop->old_obj, -1);
+		if (bop->object_space->snap_frozen)
+			box_snap_displace(bop->object_space, bop->old_obj);
+	}
 
 	struct box_phi_cell *cell, *tmp;
 	TAILQ_FOREACH_SAFE(cell, &bop->phi, bop_link, tmp) {
@@ -1072,6 +1654,7 @@ box_submit(struct box_txn *txn)
 	int len = 0, count = 0;
 	struct box_op *bop, *single = NULL;
 	ev_tstamp submit_start = 0, diff;
+	int wal_sync_mode = fiber->wal_sync_mode;
 
 	submit_start = txn_stat_cpu(txn);
 
@@ -1086,6 +1669,8 @@ box_submit(struct box_txn *txn)
 			single = bop;
 			len += bop->data_len;
 			count++;
+			if (bop->flags & BOX_WAL_FSYNC)
+				fiber->wal_sync_mode = WAL_SYNC_FSYNC;
 		} else {
 			struct box_phi_cell *cell;
 			TAILQ_FOREACH(cell, &bop->phi, bop_link)
@@ -1099,25 +1684,31 @@ box_submit(struct box_txn *txn)
 		return 0;
 	}
 
-	if (count == 1) {
-		txn->submit = [txn->box->shard submit:single->data
-						  len:single->data_len
-						  tag:single->op<<5];
-	} else {
-		struct tbuf *buf = tbuf_alloc(fiber->pool);
-		int multi = tlv_add(buf, BOX_MULTI_OP);
-		TAILQ_FOREACH(bop, &txn->ops, link) {
-			int offt = tlv_add(buf, BOX_OP);
-			tbuf_append(buf, &bop->op, 2);
-			tbuf_append(buf, bop->data, bop->data_len);
-			tlv_end(buf, offt);
-		}
-		tlv_end(buf, multi);
+	u64 wal_start = tsc_now();
+	@try {
+		if (count == 1) {
+			txn->submit = [txn->box->shard submit:single->data
+							  len:single->data_len
+							  tag:single->op<<5];
+		} else {
+			struct tbuf *buf = tbuf_alloc(fiber->pool);
+			int multi = tlv_add(buf, BOX_MULTI_OP);
+			TAILQ_FOREACH(bop, &txn->ops, link) {
+				int offt = tlv_add(buf, BOX_OP);
+				tbuf_append(buf, &bop->op, 2);
+				tbuf_append(buf, bop->data, bop->data_len);
+				tlv_end(buf, offt);
+			}
+			tlv_end(buf, multi);
 
-		txn->submit = [txn->box->shard submit:buf->ptr
-						  len:tbuf_len(buf)
-						  tag:tlv];
+			txn->submit = [txn->box->shard submit:buf->ptr
+							  len:tbuf_len(buf)
+							  tag:tlv];
+		}
+	} @finally {
+		fiber->wal_sync_mode = wal_sync_mode;
 	}
+	iproto_wal_latency(txn->box->shard->id, tsc_now() - wal_start);
 
 	if (cfg.box_extended_stat && submit_start != 0) {
 		diff = (ev_time() - submit_start) * 1000;
@@ -1306,15 +1897,18 @@ box_select_cb(struct netmsg_head *wbuf, struct iproto *request)
 	u32 indexn = read_u32(&data);
 	u32 offset = read_u32(&data);
 	u32 limit = read_u32(&data);
+	struct select_proj *proj = NULL;
+	if ((request->msg_code & 0xffff) == SELECT_PROJECT)
+		proj = read_select_proj(&data);
 	u32 count = read_u32(&data);
 
 	space = object_space(box, n);
 
 	@try {
+		if (indexn >= MAX_IDX)
+			iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "index too big");
 		if (cfg.box_extended_stat)
 			stat_sum_static(space->statbase, BSS_SELECT_IDX0+indexn, 1);
-		if (indexn > MAX_IDX)
-			iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "index too big");
 
 		Index<BasicIndex> *index = space->index[indexn];
 		if (index == NULL)
@@ -1328,7 +1922,7 @@ box_select_cb(struct netmsg_head *wbuf, struct iproto *request)
 				start = ev_time();
 		}
 
-		u32 found = process_select(wbuf, index, limit, offset, count, &data);
+		u32 found = process_select(wbuf, space, index, limit, offset, count, &data, proj);
 		iproto_reply_fixup(wbuf, reply);
 
 		stat_collect(stat_base, SELECT_TUPLES, found);
@@ -1350,13 +1944,77 @@ box_select_cb(struct netmsg_head *wbuf, struct iproto *request)
 	}
 }
 
+static struct tbuf
+read_key(struct tbuf *data, u32 cardinality)
+{
+	struct tbuf key = *data;
+	for (u32 i = 0; i < cardinality; i++)
+		read_field(data);
+	key.end = data->ptr;
+	return key;
+}
+
+/* request: object_space, index, from_key, to_key.
+   keys are (partial) keys as in SELECT, empty key is unbounded */
+static void
+box_count_cb(struct netmsg_head *wbuf, struct iproto *request)
+{
+	Box *box = (shard_rt + request->shard_id)->shard->executor;
+	struct tbuf data = TBUF(request->data, request->data_len, fiber->pool);
+	struct iproto_retcode *reply = iproto_reply(wbuf, request, ERR_CODE_OK);
+
+	i32 n = read_u32(&data);
+	u32 indexn = read_u32(&data);
+	u32 from_cardinality = read_u32(&data);
+	struct tbuf from = read_key(&data, from_cardinality);
+	u32 to_cardinality = read_u32(&data);
+	struct tbuf to = read_key(&data, to_cardinality);
+	if (tbuf_len(&data) != 0)
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "can't unpack request");
+
+	struct object_space *space = object_space(box, n);
+	if (indexn >= MAX_IDX)
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "index too big");
+	Index<BasicIndex> *index = space->index[indexn];
+	if (index == NULL)
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "index is invalid");
+	if (!index_type_is_tree(index->conf.type))
+		iproto_raise(ERR_CODE_ILLEGAL_PARAMS, "COUNT requires tree index");
+
+	Tree *tree = (Tree *)index;
+	struct index_node *from_node = NULL, *to_node = NULL;
+	if (!LIST_EMPTY(&space->phi)) {
+		struct tbuf key;
+		if (from_cardinality > 0) {
+			key = from;
+			from_node = palloc(fiber->pool, tree->node_size);
+			tree->init_pattern(&key, from_cardinality, from_node, tree->dtor_arg);
+		}
+		if (to_cardinality > 0) {
+			key = to;
+			to_node = palloc(fiber->pool, tree->node_size);
+			tree->init_pattern(&key, to_cardinality, to_node, tree->dtor_arg);
+		}
+	}
+
+	u32 *count = net_add_alloc(wbuf, sizeof(*count));
+	/* NIHTree counts are logarithmic. they include uncommitted entries */
+	*count = [tree count_from:&from cardinalty:from_cardinality
+			       to:&to cardinalty:to_cardinality];
+	if (!LIST_EMPTY(&space->phi))
+		*count -= phi_hidden_count(space, tree, from_node, to_node, tuple_visible_left);
+	iproto_reply_fixup(wbuf, reply);
+	stat_collect(stat_base, COUNT, 1);
+}
+
 #define foreach_op(...) for(int *op = (int[]){__VA_ARGS__, 0}; *op; op++)
 
 void
 box_service(struct iproto_service *s)
 {
-	foreach_op(NOP, SELECT, SELECT_LIMIT)
+	foreach_op(NOP, SELECT, SELECT_LIMIT, SELECT_PROJECT)
 		service_register_iproto(s, *op, box_select_cb, IPROTO_NONBLOCK);
+	service_register_iproto(s, COUNT, box_count_cb, IPROTO_NONBLOCK);
 	foreach_op(INSERT, UPDATE_FIELDS, DELETE, DELETE_1_3)
 		service_register_iproto(s, *op, box_cb, IPROTO_ON_MASTER);
 	foreach_op(CREATE_OBJECT_SPACE, CREATE_INDEX, DROP_OBJECT_SPACE, DROP_INDEX, TRUNCATE)
@@ -1381,6 +2039,8 @@ box_service_ro(struct iproto_service *s)
 {
 	service_register_iproto(s, SELECT, box_select_cb, IPROTO_NONBLOCK);
 	service_register_iproto(s, SELECT_LIMIT, box_select_cb, IPROTO_NONBLOCK);
+	service_register_iproto(s, SELECT_PROJECT, box_select_cb, IPROTO_NONBLOCK);
+	service_register_iproto(s, COUNT, box_count_cb, IPROTO_NONBLOCK);
 
 	foreach_op(INSERT, UPDATE_FIELDS, DELETE, DELETE_1_3, PAXOS_LEADER,
 		   CREATE_OBJECT_SPACE, CREATE_INDEX, DROP_OBJECT_SPACE, DROP_INDEX, TRUNCATE)
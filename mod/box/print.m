@@ -240,6 +240,10 @@ xlog_print(struct tbuf *out, u16 op, struct tbuf *b)
 		index_conf_read(b, &ic);
 		tbuf_printf(out, "PK: ");
 		index_conf_print(out, &ic);
+		if (flags & 16)
+			tbuf_printf(out, " rows:%u", read_u32(b));
+		if (flags & 8)
+			tbuf_printf(out, " dict_fields:%016" PRIX64, read_u64(b));
 		break;
 	case CREATE_INDEX:
 		tbuf_printf(out, "%s n:%i ", box_ops[op], n);
@@ -248,6 +252,8 @@ xlog_print(struct tbuf *out, u16 op, struct tbuf *b)
 		ic.n = read_i8(b);
 		index_conf_read(b, &ic);
 		index_conf_print(out, &ic);
+		if (flags & 16)
+			tbuf_printf(out, " rows:%u", read_u32(b));
 		break;
 	case DROP_OBJECT_SPACE:
 		tbuf_printf(out, "%s n:%i ", box_ops[op], n);
@@ -264,6 +270,17 @@ xlog_print(struct tbuf *out, u16 op, struct tbuf *b)
 		tbuf_printf(out, "%s n:%i ", box_ops[op], n);
 		flags = read_u32(b);
 		break;
+	case DICT_ENTRIES:
+		tbuf_printf(out, "%s n:%i ", box_ops[op], n);
+		flags = read_u32(b);
+		op_cnt = read_u32(b);
+		tbuf_printf(out, "count:%u", op_cnt);
+		while (op_cnt-- > 0) {
+			tbuf_printf(out, " %u:", read_u32(b));
+			fmt = fmt_ini;
+			field_print(out, read_field(b), false);
+		}
+		break;
 	default:
 		tbuf_printf(out, "unknown wal op %" PRIi32, op);
 	}
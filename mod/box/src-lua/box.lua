@@ -83,6 +83,8 @@ void   box_rollback(struct box_txn *);
 extern const int object_space_max_idx;
 struct tnt_object *tuple_visible_left(struct tnt_object *);
 struct tnt_object *tuple_visible_right(struct tnt_object *);
+uint32_t box_index_count(struct object_space *, const struct BasicIndex *,
+                         const struct index_node *, const struct index_node *);
 ]]
 
 local _dispatch = _dispatch
@@ -106,6 +108,10 @@ local object_space_mt = {
             end
             local ind = index.cast(self.__ptr.index[i])
             ind.__visible = ffi.C.tuple_visible_right
+            local ptr = self.__ptr
+            ind.__count = function (index, from, to)
+                return ffi.C.box_index_count(ptr, index, from, to)
+            end
             self.__indexes[i] = ind
             return ind
         end,
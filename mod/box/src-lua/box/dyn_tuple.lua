@@ -15,7 +15,8 @@ module(...)
 ffi.cdef [[
 enum object_type {
 	BOX_TUPLE = 1,
-	BOX_SMALL_TUPLE = 2
+	BOX_SMALL_TUPLE = 2,
+	BOX_TUPLE_OFT = 4
 };
 
 struct box_tuple {
@@ -32,6 +33,8 @@ struct box_small_tuple {
 
 u32 *box_tuple_cache_update(int cardinality, const unsigned char *data); /* palloc allocated! */
 struct tnt_object *box_small_tuple_palloc_clone(struct tnt_object *obj);
+int box_tuple_dict(struct tnt_object *obj);
+struct tnt_object *tuple_dict_decode(struct tnt_object *obj);
 ]]
 
 local box_tuple = ffi.typeof('const struct box_tuple *')
@@ -189,9 +192,11 @@ local __tuple_index = {
                self.__tuple = ffi.cast(box_small_tuple, clone + 1)
                self.data = self.__tuple.data
            end
-           local __cache = ffi.new('u32[?]', self.cardinality*2)
-           ffi.copy(__cache, self.__cache, self.cardinality*2*4)
-           self.__cache = __cache
+           if self.__cache ~= nil then
+               local __cache = ffi.new('u32[?]', self.cardinality*2)
+               ffi.copy(__cache, self.__cache, self.cardinality*2*4)
+               self.__cache = __cache
+           end
            self._long_living = true
        end
    end,
@@ -234,6 +239,31 @@ local tuple_mt = {
    end
 }
 
+-- BOX_TUPLE_OFT: field offsets are read from offset table following data
+local __oft_tuple_index = setmetatable({
+   field = function(self, i, level)
+      assertarg(i, 'number', 1, level or 0)
+      if i < 0 or i >= self.cardinality then
+	 error('invalid field index', 2 + level or 0)
+      end
+      local offt = self.__oft[i]
+      local len, n = varint32.read(self.data + offt)
+      return len, offt + n
+   end,
+}, { __index = __tuple_index })
+
+local oft_tuple_mt = {
+   __index = function(self, key)
+      if type(key) == 'number' then
+	 return self:strfield(key)
+      else
+	 return __oft_tuple_index[key]
+      end
+   end,
+   __len = tuple_mt.__len,
+   __ipairs = tuple_mt.__ipairs,
+   __tostring = tuple_mt.__tostring
+}
 
 local function meta(obj, tuple, cardinality, bsize, data)
     return setmetatable({ __obj = obj,
@@ -246,18 +276,41 @@ local function meta(obj, tuple, cardinality, bsize, data)
 end
 
 local function box_tuple_cast (obj)
+    if ffi.C.box_tuple_dict(obj) ~= 0 then
+        obj = ffi.C.tuple_dict_decode(obj) -- plain copy, freed by autorelease
+    end
     ffi.C.object_incr_ref_autorelease(obj)
     local tuple = ffi.cast(box_tuple, obj + 1) --  tuple starts right after 'struct tnt_object'
     return meta(obj, tuple, tonumber(tuple.cardinality), tonumber(tuple.bsize), tuple.data)
 end
 local function box_small_tuple_cast (obj)
+    if ffi.C.box_tuple_dict(obj) ~= 0 then
+        return box_tuple_cast(obj)
+    end
     obj = ffi.C.box_small_tuple_palloc_clone(obj)
     local tuple = ffi.cast(box_small_tuple, obj + 1)
     return meta(obj, tuple, tonumber(tuple.cardinality), tonumber(tuple.bsize), tuple.data)
 end
+local function box_tuple_oft_cast (obj)
+    if ffi.C.box_tuple_dict(obj) ~= 0 then
+        return box_tuple_cast(obj) -- decoded copy is plain BOX_TUPLE
+    end
+    ffi.C.object_incr_ref_autorelease(obj)
+    local tuple = ffi.cast(box_tuple, obj + 1)
+    local bsize = tonumber(tuple.bsize)
+    local oft = ffi.cast(bsize <= 0xffff and u16_ptr or u32_ptr, tuple.data + bsize)
+    return setmetatable({ __obj = obj,
+                          __tuple = tuple,
+                          __oft = oft,
+                          cardinality = tonumber(tuple.cardinality),
+                          data = tuple.data,
+                          bsize = bsize},
+        oft_tuple_mt)
+end
 -- install automatic cast of object() return value
 object_cast[ffi.C.BOX_TUPLE] = box_tuple_cast
 object_cast[ffi.C.BOX_SMALL_TUPLE] = box_small_tuple_cast
+object_cast[ffi.C.BOX_TUPLE_OFT] = box_tuple_oft_cast
 
 function new(obj, cardinality, data, bsize)
     return setmetatable({ __obj = obj,
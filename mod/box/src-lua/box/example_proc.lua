@@ -393,6 +393,16 @@ user_proc.position = box.wrap(function(ushard, ind, i)
     return 0, {box.tuple{tostring(pos)}}
 end)
 
+user_proc.tuple_field = box.wrap(function(ushard, n, key, i)
+    local tuple = ushard:object_space(tonumber(n)):index(0):find(key)
+    return 0, {box.tuple{tuple[tonumber(i)]}}
+end)
+
+user_proc.count = box.wrap(function(ushard, ind, from, to)
+    local count = ushard:object_space(0):index(tonumber(ind)):count(tonumber(from), tonumber(to))
+    return 0, {box.tuple{tostring(count)}}
+end)
+
 user_proc.start_expire = box.wrap(function(ushard, n, ind)
     local loop = require 'box.loop'
     local expire = require 'box.expire'
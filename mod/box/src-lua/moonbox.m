@@ -112,6 +112,12 @@ box_tuple_cache_update(int cardinality, const unsigned char *data)
 	return cache;
 }
 
+int
+box_tuple_dict(struct tnt_object *obj)
+{
+	return obj->flags & TUPLE_DICT;
+}
+
 struct tnt_object *
 box_small_tuple_palloc_clone(struct tnt_object *obj)
 {
@@ -126,6 +132,7 @@ push_obj(struct lua_State *L, struct tnt_object *obj)
 {
 	switch (obj->type) {
 	case BOX_TUPLE:
+	case BOX_TUPLE_OFT:
 		object_incr_ref_autorelease(obj);
 		lua_pushlightuserdata(L, obj);
 		return 1;
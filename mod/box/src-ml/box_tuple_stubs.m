@@ -72,6 +72,8 @@ box_tuple_custom_alloc(struct tnt_object *obj)
 {
 	if (obj == NULL)
 		caml_raise_not_found();
+	if (obj->flags & TUPLE_DICT)
+		obj = tuple_dict_decode(obj); /* released by finalizer */
 
 	int cardinality = tuple_cardinality(obj),
 	     cache_size = sizeof(int) * cardinality * 2,
@@ -93,7 +95,8 @@ box_tuple_custom_alloc(struct tnt_object *obj)
 		memcpy(tuple_obj(tup), obj, small_obj_size);
 		break;
 	}
-	case BOX_TUPLE: {
+	case BOX_TUPLE:
+	case BOX_TUPLE_OFT: {
 		val = caml_alloc_custom((struct custom_operations *)&box_tuple_ops,
 					tup_size, 0, 1);
 		tup = Tuple_val(val);
@@ -108,9 +108,11 @@ extern void __attribute__((__noreturn__)) release_and_failwith(Error *e);
 static struct tnt_object *
 tuple_clone(struct tnt_object *obj)
 {
-	int smsize = sizeof(struct tnt_object) + sizeof(struct box_small_tuple) + tuple_bsize(obj);
+	int smsize = sizeof(struct tnt_object) + sizeof(struct box_small_tuple) + tuple_bsize(obj) +
+		     (obj->flags & TUPLE_DICT ? sizeof(u16) : 0); /* see tuple_dict_saved() */
 	switch(obj->type) {
 	case BOX_TUPLE:
+	case BOX_TUPLE_OFT:
 		object_incr_ref(obj);
 		return obj;
 	case BOX_SMALL_TUPLE:
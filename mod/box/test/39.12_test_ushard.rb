@@ -0,0 +1,49 @@
+#!/usr/bin/ruby
+# coding: utf-8
+
+$: << File.dirname($0)
+require '39_test_ushard'
+
+$one_env.meta 'shard 1 create por'
+$one_env.meta 'shard 1 add_replica two'
+$one_env.meta 'shard 1 add_replica three'
+$one_env.meta 'shard 1 type raft'
+
+sleep 5
+
+$one_env.meta 'shard 1 obj_space 0 create tree unique string 0'
+
+# concurrent submitters are coalesced by commit_batch into
+# multi-entry append_entries
+keys = []
+threads = (0...8).map do |t|
+  Thread.new do
+    connect = $one_env.connect
+    25.times do |i|
+      key = "k%i_%02i" % [t, i]
+      connect.insert_nolog [key, "v"], :shard => 1
+    end
+  end
+end
+threads.each { |t| t.join }
+8.times { |t| 25.times { |i| keys << "k%i_%02i" % [t, i] } }
+
+wait_for { $two.select_nolog(*(keys + [{:shard => 1}])).length == keys.length }
+
+puts "one: #{$one.select_nolog(*(keys + [{:shard => 1}])).length}"
+puts "two: #{$two.select_nolog(*(keys + [{:shard => 1}])).length}"
+puts
+
+# follower replays batched entries from its WAL
+$two_env.env_eval do
+  restart
+end
+$two = $two_env.connect
+$two.connect_name = "two"
+wait_for { $two.select_nolog(*(keys + [{:shard => 1}])).length == keys.length }
+puts "two after restart: #{$two.select_nolog(*(keys + [{:shard => 1}])).length}"
+puts
+
+$one.insert ["last"], :shard => 1
+wait_for { $two.select_nolog("last", :shard => 1).length > 0 }
+$two.select "last", :shard => 1
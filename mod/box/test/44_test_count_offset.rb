@@ -0,0 +1,59 @@
+#!/usr/bin/ruby
+# encoding: ASCII
+
+$: << File.dirname($0) + '/lib'
+require 'run_env'
+
+class Env < RunEnv
+  def config
+    super + <<EOD
+object_space[0].enabled = 1
+object_space[0].index[0].type = "POSTREE"
+object_space[0].index[0].unique = 1
+object_space[0].index[0].key_field[0].fieldno = 0
+object_space[0].index[0].key_field[0].type = "NUM"
+
+object_space[0].index[1].type = "POSTREE"
+object_space[0].index[1].unique = 1
+object_space[0].index[1].key_field[0].fieldno = 1
+object_space[0].index[1].key_field[0].type = "NUM"
+object_space[0].index[1].key_field[1].fieldno = 0
+object_space[0].index[1].key_field[1].type = "NUM"
+EOD
+  end
+end
+
+Env.env_eval do |env|
+  env.start
+  conn = env.connect
+  10.upto(109) {|i| conn.insert_nolog [i, i % 10] }
+
+  conn.count
+  conn.count [20], [29]
+  conn.count [3], [3], :index => 1
+  conn.select 3, :index => 1, :offset => 8
+  log_try { conn.count [], [], :index => 10 }
+
+  # wal writer sleeps on "sleep", both txns stay uncommitted for a while
+  t1 = Thread.new { env.connect.insert_nolog [1, 3, "sleep"] }
+  sleep 0.2
+  t2 = Thread.new { env.connect.delete_nolog 23 }
+  sleep 0.2
+
+  conn.count
+  conn.count [], [12]
+  conn.count [3], [3], :index => 1
+  conn.select 3, :index => 1, :offset => 8
+  conn.select 3, :index => 1, :offset => 10
+  conn.lua "user_proc.count", "0", "0", "12"
+  conn.lua "user_proc.count", "1", "3", "3"
+
+  t1.join
+  t2.join
+
+  conn.count
+  conn.count [], [12]
+  conn.count [3], [3], :index => 1
+  conn.select 3, :index => 1, :offset => 0, :limit => 2
+  conn.select 3, :index => 1, :offset => 8
+end
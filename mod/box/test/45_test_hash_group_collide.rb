@@ -0,0 +1,50 @@
+#!/usr/bin/ruby
+# encoding: ASCII
+
+$: << File.dirname($0) + '/lib'
+require 'run_env'
+
+class Env < RunEnv
+  def config
+    super + <<EOD
+object_space[0].enabled = 1
+object_space[0].index[0].type = "NUMHASH"
+object_space[0].index[0].unique = 1
+object_space[0].index[0].hash_layout = "GROUP"
+object_space[0].index[0].key_field[0].fieldno = 0
+object_space[0].index[0].key_field[0].type = "NUM"
+
+object_space[1].enabled = 1
+object_space[1].index[0].type = "NUMHASH"
+object_space[1].index[0].unique = 1
+object_space[1].index[0].hash_layout = "GROUP"
+object_space[1].index[0].key_field[0].fieldno = 0
+object_space[1].index[0].key_field[0].type = "NUM64"
+EOD
+  end
+end
+
+# keys differ only in high bits: without mixing they all land in one group
+Env.connect_eval do
+  [[0, (0...2000).map {|i| i << 20 }],
+   [1, (0...2000).map {|i| Quad.new(i << 40) }]].each do |n, keys|
+    self.object_space = n
+    keys.each {|k| insert_nolog [k, "v#{k.to_i}"] }
+
+    found = lambda do
+      keys.each_slice(100).map {|slice| select_nolog(*slice).length }.sum
+    end
+    log "space #{n}: found #{found.call}\n"
+
+    keys.each_with_index {|k, i| delete_nolog k if i.even? }
+    log "space #{n}: found #{found.call} after delete\n"
+
+    keys.each_with_index {|k, i| insert_nolog [k, "w#{k.to_i}"] if i.even? }
+    log "space #{n}: found #{found.call} after reinsert\n"
+
+    log "#{select_nolog(keys[0], keys[1], keys[1998], keys[1999]).inspect}\n\n"
+  end
+
+  self.object_space = 0
+  log_try { select "abc" }
+end
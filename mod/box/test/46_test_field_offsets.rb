@@ -0,0 +1,57 @@
+#!/usr/bin/ruby
+# encoding: ASCII
+
+$: << File.dirname($0) + '/lib'
+require 'run_env'
+
+class Env < RunEnv
+  def config
+    super + <<EOD
+object_space[0].enabled = 1
+object_space[0].field_offsets = 1
+object_space[0].index[0].type = "HASH"
+object_space[0].index[0].unique = 1
+object_space[0].index[0].key_field[0].fieldno = 0
+object_space[0].index[0].key_field[0].type = "STR"
+EOD
+  end
+end
+
+# 300 fields: both tuples get offset table, u32 offsets in "b" (bsize > 64K)
+a = ["a"] + (1..299).map {|i| "f#{i}" }
+b = ["b", "x" * 70000] + (2..299).map {|i| "g#{i}" }
+
+check = lambda do |conn|
+  conn.instance_eval do
+    log "a: #{select_nolog("a") == [a] ? "ok" : "mismatch"}\n"
+    log "b: #{select_nolog("b") == [b] ? "ok" : "mismatch"}\n\n"
+    lua "user_proc.tuple_field", "0", "a", "149"
+    lua "user_proc.tuple_field", "0", "a", "150"
+    lua "user_proc.tuple_field", "0", "b", "2"
+    lua "user_proc.tuple_field", "0", "b", "299"
+  end
+end
+
+env = Env.new
+env.connect_eval do
+  insert_nolog a
+  insert_nolog b
+  update_fields "a", [150, :set, "upd"], [10, :delete]
+  update_fields "b", [299, :set, "last"]
+  a[150] = "upd"
+  a.delete_at(10)
+  b[299] = "last"
+  check.call(self)
+
+  snaps = Dir.glob("*.snap").length
+  env.snapshot
+  wait_for("snapshot") { Dir.glob("*.snap").length > snaps }
+  env.stop
+end
+
+env.connect_eval do
+  check.call(self)
+  update_fields "b", [1, :set, "short"]
+  b[1] = "short"
+  check.call(self)
+end
@@ -0,0 +1,87 @@
+#!/usr/bin/ruby
+# encoding: ASCII
+
+$: << File.dirname($0) + '/lib'
+require 'run_env'
+require 'socket'
+
+class Env < RunEnv
+  def config
+    cfg = super
+    (0..2).each do |n|
+      cfg << <<EOD
+object_space[#{n}].enabled = 1
+object_space[#{n}].index[0].type = "HASH"
+object_space[#{n}].index[0].unique = 1
+object_space[#{n}].index[0].key_field[0].fieldno = 0
+object_space[#{n}].index[0].key_field[0].type = "STR"
+object_space[#{n}].dict_field[0].fieldno = 1
+EOD
+    end
+    cfg + <<EOD
+object_space[0].dict_field[1].fieldno = 2
+object_space[1].dict_max_entries = 2
+EOD
+  end
+
+  def admin(cmd)
+    sock = TCPSocket.new('localhost', @admin_port)
+    sock.write "#{cmd}\r\n"
+    out = ''
+    out << sock.gets until out.end_with?("...\r\n")
+    sock.close
+    out
+  end
+
+  # dictionary lines of show info and show slab
+  def dict_stat
+    admin("show info").each_line {|l| puts l.rstrip if l =~ /- n:|dict_/ }
+    admin("show slab").each_line {|l| puts l.rstrip if l =~ /dict:/ }
+    puts
+  end
+end
+
+env = Env.new
+env.connect_eval do
+  # space 1 gets codes first: space 0 codes are remapped on reload
+  self.object_space = 1
+  insert ["x1", "status_active"]
+  insert ["x2", "status_blocked"]
+  insert ["x3", "status_deleted"] # over dict_max_entries: stored as is
+  select "x1", "x2", "x3"
+
+  self.object_space = 0
+  insert ["a", "status_active", "country_russia"]
+  insert ["b", "status_pending", "country_russia"]
+  insert ["c", "status_active", "short"]
+  update_fields "a", [1, :set, "status_deleted"]
+  update_fields "b", [2, :set, "x"]
+  select "a", "b", "c"
+
+  # unique values: field is frozen after 1024 new entries
+  self.object_space = 2
+  (0...1100).each {|i| insert_nolog ["k#{i}", "value_%04i" % i] }
+  log "space 2: #{(0...1100).each_slice(100).map {|s| select_nolog(*s.map {|i| "k#{i}" }).length }.sum}\n\n"
+
+  env.dict_stat
+
+  snaps = Dir.glob("*.snap").length
+  env.snapshot
+  wait_for("snapshot") { Dir.glob("*.snap").length > snaps }
+  env.stop
+end
+
+env.connect_eval do
+  self.object_space = 0
+  select "a", "b", "c"
+  self.object_space = 1
+  select "x1", "x2", "x3"
+  self.object_space = 2
+  select "k0", "k1099"
+  env.dict_stat
+
+  self.object_space = 0
+  update_fields "c", [1, :set, "status_blocked"]
+  select "c"
+  env.dict_stat
+end
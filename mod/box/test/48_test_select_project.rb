@@ -0,0 +1,49 @@
+#!/usr/bin/ruby
+# encoding: ASCII
+
+$: << File.dirname($0) + '/lib'
+require 'run_env'
+
+class Env < RunEnv
+  def config
+    super + <<EOD
+object_space[0].enabled = 1
+object_space[0].index[0].type = "POSTREE"
+object_space[0].index[0].unique = 1
+object_space[0].index[0].key_field[0].fieldno = 0
+object_space[0].index[0].key_field[0].type = "NUM"
+
+object_space[0].index[1].type = "POSTREE"
+object_space[0].index[1].unique = 1
+object_space[0].index[1].key_field[0].fieldno = 1
+object_space[0].index[1].key_field[0].type = "NUM"
+object_space[0].index[1].key_field[1].fieldno = 0
+object_space[0].index[1].key_field[1].type = "NUM"
+EOD
+  end
+end
+
+Env.connect_eval do
+  # field 2 is signed: -40 .. 50, tuple 11 has no fields 2 and 3
+  1.upto(10) {|i| insert_nolog [i, 1, i * 10 - 50, "n#{i}"] }
+  insert_nolog [11, 1]
+  insert_nolog [12, 1, 300, "n12"]
+
+  select 1, :index => 1, :fields => [0, 3], :where => [[2, :lt, 0, :i32]]
+  select 1, :index => 1, :fields => [0, 3], :where => [[2, :lt, 0, :i32]], :offset => 1, :limit => 2
+  select 1, :index => 1, :fields => [3, 0], :where => [[2, :ge, 0, :i32], [3, :ne, "n5"]]
+  select 1, :index => 1, :fields => [3, 0], :where => [[2, :ge, 0, :i32], [3, :ne, "n5"]], :offset => 2, :limit => 3
+
+  # same bytes compared as unsigned
+  select 1, :index => 1, :fields => [0], :where => [[2, :gt, 100, :u32]]
+
+  # strings compare bytewise
+  select 1, :index => 1, :fields => [3], :where => [[3, :gt, "n5"]]
+
+  # field of other size doesn't match
+  select 1, :index => 1, :fields => [0], :where => [[2, :eq, 10, :u16]]
+
+  # fields beyond cardinality are empty
+  select 1, :index => 1, :fields => [0, 3, 7], :offset => 10, :limit => 1
+  select 11, 12, :fields => [1, 2]
+end
@@ -40,9 +40,10 @@ static struct index_node *
 box_tuple_u32_dtor(struct tnt_object *obj, struct index_node *node, void *arg)
 {
 	int n = (uintptr_t)arg;
-	u8 *f = tuple_field(obj, n);
+	const u8 *f = tuple_field(obj, n);
 	if (f == NULL)
 		index_raise("cardinality too small");
+	f = tuple_field_value(obj, f);
 	if (*f != sizeof(u32))
 		index_raise("expected u32");
 
@@ -57,6 +58,7 @@ box_tuple_u64_dtor(struct tnt_object *obj, struct index_node *node, void *arg)
 	const u8 *f = tuple_field(obj, n);
 	if (f == NULL)
 		index_raise("cardinality too small");
+	f = tuple_field_value(obj, f);
 	if (*f != sizeof(u64))
 		index_raise("expected u64");
 
@@ -71,6 +73,7 @@ box_tuple_lstr_dtor(struct tnt_object *obj, struct index_node *node, void  *arg)
 	const u8 *f = tuple_field(obj, n);
 	if (f == NULL)
 		index_raise("cardinality too small");
+	f = tuple_field_value(obj, f);
 	size_t size = LOAD_VARINT32(f);
 	if (size > 0xffff)
 		index_raise("string key too long");
@@ -89,6 +92,7 @@ box_tuple_gen_dtor(struct tnt_object *obj, struct index_node *node, void *arg)
 		const u8 *f = tuple_field(obj, desc->field[0].index);
 		if (f == NULL)
 			index_raise("cardinality too small");
+		f = tuple_field_value(obj, f);
 		u32 len = LOAD_VARINT32(f);
 		gen_set_field(&node->key, desc->field[0].type, len, f);
 		return node;
@@ -97,16 +101,34 @@ box_tuple_gen_dtor(struct tnt_object *obj, struct index_node *node, void *arg)
 	if (tuple_cardinality(obj) < desc->min_tuple_cardinality)
 		index_raise("cardinality too small");
 
+	if (obj->type == BOX_TUPLE_OFT) {
+		const u8 *data = tuple_data(obj);
+		for (int i = 0; i < desc->cardinality; i++) {
+			const struct index_field_desc *field = &desc->field[i];
+			const u8 *f = tuple_field_value(obj, data + box_tuple_field_offset(obj, field->index));
+			u32 len = LOAD_VARINT32(f);
+			gen_set_field((void *)&node->key + field->offset, field->type, len, f);
+		}
+		return node;
+	}
+
 	int i = 0, j = 0;
 	int indi = desc->fill_order[i];
 	const struct index_field_desc *field = &desc->field[indi];
 	const u8 *data = tuple_data(obj);
 
 	for (;;j++) {
+		const u8 *value = data;
 		u32 len = LOAD_VARINT32(data);
 		if (field->index == j) {
 			union index_field *f = (void *)&node->key + field->offset;
-			gen_set_field(f, field->type, len, data);
+			if (unlikely(*value == 0x80 && obj->flags & TUPLE_DICT)) {
+				value = box_dict_field(value);
+				u32 value_len = LOAD_VARINT32(value);
+				gen_set_field(f, field->type, value_len, value);
+			} else {
+				gen_set_field(f, field->type, len, data);
+			}
 			if (++i == desc->cardinality)
 				goto end;
 			indi = desc->fill_order[i];
@@ -191,6 +213,16 @@ cfg_box2index_conf(struct octopus_cfg_object_space_index *c, int sno, int ino, i
 	if (d->unique == false && (d->type == HASH || d->type == NUMHASH || d->type == PHASH))
 		exception("hash index should be unique");
 
+	if (strcmp(c->hash_layout, "DEFAULT") == 0)
+		d->hash_layout = HASH_LAYOUT_DEFAULT;
+	else if (strcmp(c->hash_layout, "GROUP") == 0)
+		d->hash_layout = HASH_LAYOUT_GROUP;
+	else
+		exception("unknown hash layout");
+
+	if (d->hash_layout != HASH_LAYOUT_DEFAULT && d->type != HASH && d->type != NUMHASH)
+		exception("hash_layout is valid only for HASH and NUMHASH index");
+
 	__typeof__(c->key_field[0]) key_field;
 	for (d->cardinality = 0; c->key_field[(int)d->cardinality] != NULL; d->cardinality++) {
 		key_field = c->key_field[(int)d->cardinality];
@@ -27,6 +27,8 @@
 #ifndef OCTOPUS_FEEDER_H
 #define OCTOPUS_FEEDER_H
 
+#include <sys/uio.h>
+
 typedef struct row_v12 *(*filter_callback)(struct row_v12 *r, const char *arg, int arglen);
 
 @interface Feeder : Object <RecoverRow> {
@@ -35,7 +37,15 @@ typedef struct row_v12 *(*filter_callback)(struct row_v12 *r, const char *arg, i
 	i64 min_scn, min_lsn;
 	int shard_id;
 	XLogReader *reader;
+	u32 flags; /* REPLICATION_* flags negotiated in handshake */
+	struct iovec iov[256];
+	int iovcnt, iov_rows;
+	size_t iov_bytes;
+	char *lz4_raw, *lz4_out;
+	size_t lz4_len, lz4_size, lz4_out_size;
+	int lz4_rows;
 }
+- (void) flush;
 + (void) register_filter: (const char*)name call: (filter_callback)filter;
 @end
 
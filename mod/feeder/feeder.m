@@ -31,9 +31,11 @@
 #import <iproto.h>
 #import <pickle.h>
 #import <say.h>
+#import <stat.h>
 #import <util.h>
 
 #include <third_party/crc32.h>
+#include <third_party/lz4/lz4.h>
 
 #include <string.h>
 #include <sys/types.h>
@@ -42,6 +44,11 @@
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#if HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #if CFG_lua_path
 #import <src-lua/octopus_lua.h>
@@ -222,7 +229,6 @@ lua_filter(struct row_v12 *r, __attribute((unused)) const char *arg, __attribute
 - (void)
 send_row:(struct row_v12 *)row
 {
-	/* FIXME: we should buffer writes */
 	if (will_say(DEBUG)) {
 		static struct palloc_pool *debug_pool = NULL;
 		static struct tbuf buf;
@@ -235,7 +241,111 @@ send_row:(struct row_v12 *)row
 		say_trace("send_row %*s", tbuf_len(&buf), (char *)buf.ptr);
 		tbuf_reset(&buf);
 	}
-	writef(fd, (const char *)row, sizeof(*row) + row->len);
+
+	if (flags & REPLICATION_LZ4) {
+		size_t len = sizeof(*row) + row->len;
+		if (lz4_len + len > lz4_size) {
+			lz4_size = MAX(lz4_size * 2, lz4_len + len);
+			lz4_raw = xrealloc(lz4_raw, lz4_size);
+		}
+		memcpy(lz4_raw + lz4_len, row, len);
+		lz4_len += len;
+		lz4_rows++;
+		if (lz4_len >= 64 * 1024)
+			[self flush];
+		return;
+	}
+
+	/* row is referenced, not copied: it must stay alive until [flush].
+	   XLogReader calls [recover_row_cutoff] before releasing rows */
+	if (flags & REPLICATION_MARKERS)
+		iov[iovcnt++] = (struct iovec){ .iov_base = (void *)&marker,
+						.iov_len = sizeof(marker) };
+	iov[iovcnt++] = (struct iovec){ .iov_base = row,
+					.iov_len = sizeof(*row) + row->len };
+	iov_bytes += sizeof(*row) + row->len;
+	iov_rows++;
+	if (iovcnt + 2 > nelem(iov) || iov_bytes >= 256 * 1024)
+		[self flush];
+}
+
+static void
+writevf(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0) {
+		ssize_t r = writev(fd, iov, iovcnt);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			say_syserror("writev");
+			_exit(EXIT_SUCCESS);
+		}
+		while (iovcnt > 0 && (size_t)r >= iov->iov_len) {
+			r -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+}
+
+static int stat_base = -1;
+
+static void
+stat_rows_per_write(int rows)
+{
+	if (stat_base < 0)
+		stat_base = stat_register_named("feeder");
+	stat_aggregate_named(stat_base, STAT_STR("rows_per_write"), rows);
+}
+
+- (void)
+flush
+{
+	if (iovcnt > 0) {
+		stat_rows_per_write(iov_rows);
+		writevf(fd, iov, iovcnt);
+		iovcnt = iov_rows = 0;
+		iov_bytes = 0;
+	}
+
+	if (lz4_len > 0)
+		[self flush_lz4];
+}
+
+- (void)
+recover_row_cutoff
+{
+	[self flush];
+}
+
+/* send buffered rows as single compressed frame */
+- (void)
+flush_lz4
+{
+
+	struct replication_lz4_frame *frame;
+	size_t size = sizeof(*frame) + LZ4_compressBound(lz4_len);
+	if (size > lz4_out_size) {
+		lz4_out_size = size;
+		lz4_out = xrealloc(lz4_out, lz4_out_size);
+	}
+
+	frame = (struct replication_lz4_frame *)lz4_out;
+	int r = LZ4_compress(lz4_raw, frame->data, lz4_len);
+	if (r <= 0) {
+		say_error("LZ4_compress failed");
+		_exit(EXIT_FAILURE);
+	}
+	frame->len = r;
+	frame->raw_len = lz4_len;
+	stat_rows_per_write(lz4_rows);
+	writef(fd, lz4_out, sizeof(*frame) + frame->len);
+	lz4_len = 0;
+	lz4_rows = 0;
 }
 
 - (void)
@@ -251,9 +361,16 @@ recover_row:(struct row_v12 *)row
 		return;
 	}
 
-	if ((row = filter(row, NULL, 0)))
+	struct row_v12 *orig = row;
+	if ((row = filter(row, NULL, 0))) {
+		/* row returned by filter may be owned by lua,
+		   copy it since sending is delayed */
+		if (row != orig) {
+			size_t len = sizeof(*row) + row->len;
+			row = memcpy(palloc(fiber->pool, len), row, len);
+		}
 		[self send_row:row];
-	else
+	} else
 		say_debug("filter skip");
 }
 
@@ -324,6 +441,74 @@ setup_filter:(struct feeder_filter*)_filter
 			 filter_type_names[_filter->type], _filter->name);
 }
 
+#if HAVE_SYS_SENDFILE_H
+/* returns -1 if WAL can't be sent as is, nothing is sent in that case */
+- (int)
+sendfile_wal:(XLog *)wal
+{
+	struct stat st;
+	u32 magic;
+	struct row_v12 *row;
+	off_t start = -1, end;
+
+	/* only correctly closed WALs: their content is immutable */
+	if (fstat([wal fileno], &st) < 0) {
+		say_syserror("fstat");
+		return -1;
+	}
+	end = st.st_size - sizeof(eof_marker);
+	if (pread([wal fileno], &magic, sizeof(magic), end) != sizeof(magic) ||
+	    magic != eof_marker)
+		return -1;
+
+	palloc_register_cut_point(fiber->pool);
+	while ((row = [wal fetch_row])) {
+		if (row->lsn >= min_lsn) {
+			start = [wal row_offset] - sizeof(marker);
+			break;
+		}
+	}
+	palloc_cutoff(fiber->pool);
+	if (start < 0)
+		return -1;
+
+	[self flush];
+	off_t offset = start;
+	while (offset < end) {
+		ssize_t r = sendfile(fd, [wal fileno], &offset, end - offset);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			say_syserror("sendfile");
+			_exit(EXIT_SUCCESS);
+		}
+	}
+	say_info("sent `%s' from %"PRIofft", %"PRIofft" bytes",
+		 wal->filename, start, end - start);
+	return 0;
+}
+#endif
+
+/* send closed WALs with sendfile, return WAL to continue with row by row sending */
+- (XLog *)
+stream_wals:(XLog *)wal
+{
+#if HAVE_SYS_SENDFILE_H
+	i64 next;
+	while ((next = [wal_dir next_file_lsn:wal->lsn]) > 0) {
+		if ([self sendfile_wal:wal] < 0)
+			break;
+		keepalive();
+
+		[wal free];
+		wal = [wal_dir open_for_read:next];
+		if (wal == nil)
+			raise_fmt("unable to open WAL %"PRIi64, next);
+	}
+#endif
+	return wal;
+}
+
 - (void)
 load_from:(i64)xid
 {
@@ -355,6 +540,9 @@ load_from:(i64)xid
 	}
 	if (initial_wal == nil)
 		raise_fmt("unable to find initial WAL");
+	/* unfiltered replica may receive WAL files as is */
+	if (shard_id == -1 && filter == id_filter && flags & REPLICATION_MARKERS)
+		initial_wal = [self stream_wals:initial_wal];
 	[reader load_incr:initial_wal];
 }
 
@@ -366,8 +554,9 @@ follow
 }
 
 static i64
-handshake(int sock, struct iproto *req, struct feeder_filter *filter)
+handshake(int sock, struct iproto *req, struct feeder_filter *filter, u32 *flags)
 {
+	u32 requested_flags = 0;
 	struct tbuf *rep = tbuf_alloc(fiber->pool);
 
 	if (req->data_len < sizeof(struct replication_handshake_base)) {
@@ -397,12 +586,14 @@ handshake(int sock, struct iproto *req, struct feeder_filter *filter)
 			say_error("bad handshake len");
 			_exit(EXIT_FAILURE);
 		}
-		if (hshake2->filter_type >= FILTER_TYPE_MAX) {
-			say_error("bad handshake filter type %d", hshake2->filter_type);
+		u32 filter_type = hshake2->filter_type & REPLICATION_FILTER_TYPE_MASK;
+		requested_flags = hshake2->filter_type & ~REPLICATION_FILTER_TYPE_MASK;
+		if (filter_type >= FILTER_TYPE_MAX) {
+			say_error("bad handshake filter type %d", filter_type);
 			_exit(EXIT_FAILURE);
 		}
 		if (strnlen(hshake2->filter, sizeof(hshake2->filter)) > 0) {
-			filter->type = hshake2->filter_type;
+			filter->type = filter_type;
 			filter->name = hshake->filter;
 			if (hshake2->filter_arglen > 0) {
 				filter->arglen = hshake2->filter_arglen;
@@ -415,15 +606,22 @@ handshake(int sock, struct iproto *req, struct feeder_filter *filter)
 		say_error("bad replication version");
 		_exit(EXIT_FAILURE);
 	}
+	*flags = requested_flags & REPLICATION_LZ4;
+	/* WAL streaming is pointless when rows are compressed */
+	if ((*flags & REPLICATION_LZ4) == 0)
+		*flags |= requested_flags & REPLICATION_MARKERS;
 	tbuf_append(rep, &(struct iproto_retcode)
 			 { .msg_code = req->msg_code,
 			   .data_len = sizeof(default_version) +
+				       (requested_flags ? sizeof(*flags) : 0) +
 				       field_sizeof(struct iproto_retcode, ret_code),
 			   .sync = req->sync,
 			   .ret_code = 0 },
 		    sizeof(struct iproto_retcode));
 
 	tbuf_append(rep, &default_version, sizeof(default_version));
+	if (requested_flags)
+		tbuf_append(rep, flags, sizeof(*flags));
 	writef(sock, rep->ptr, tbuf_len(rep));
 
 	return hshake->scn;
@@ -457,6 +655,12 @@ keepalive_send(va_list ap)
 	}
 }
 
+static void
+flush_rows(ev_prepare *ev __attribute__((unused)), int events __attribute__((unused)))
+{
+	[feeder flush];
+}
+
 static void
 recover_feed_slave(int sock, struct iproto *req)
 {
@@ -481,10 +685,20 @@ recover_feed_slave(int sock, struct iproto *req)
 	[Feeder register_filter:"raft" call:raft_filter];
 	feeder = [[Feeder alloc] init_fd:sock];
 
-	i64 xid = handshake(sock, req, &filter);
+	i64 xid = handshake(sock, req, &filter, &feeder->flags);
+	if (feeder->flags & REPLICATION_LZ4)
+		say_info("peer:%s lz4 compression", peer_name);
+	if (feeder->flags & REPLICATION_MARKERS)
+		say_info("peer:%s rows with markers", peer_name);
 	[feeder setup_filter:&filter];
 	[feeder load_from:xid];
 	[feeder follow];
+	[feeder flush];
+
+	/* rows are buffered, send them once loop gets idle */
+	ev_prepare flush_prepare = { .coro = 0 };
+	ev_prepare_init(&flush_prepare, flush_rows);
+	ev_prepare_start(&flush_prepare);
 
 	ev_io_init(&io, (void *)eof_monitor, sock, EV_READ);
 	ev_io_start(&io);
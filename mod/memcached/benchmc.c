@@ -0,0 +1,254 @@
+/*
+ * memcached multi-get throughput: text "get k1 k2 ..." vs binary
+ * getkq pipeline terminated by noop. both fetch the same keys in
+ * batches, report keys/s and requests/s.
+ *
+ * cc -O2 benchmc.c -o benchmc
+ * ./benchmc [host] [port] [keys] [batch] [value_size] [seconds]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <endian.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+struct header {
+	uint8_t magic;
+	uint8_t opcode;
+	uint16_t key_len;
+	uint8_t extras_len;
+	uint8_t data_type;
+	uint16_t status;
+	uint32_t body_len;
+	uint32_t opaque;
+	uint64_t cas;
+} __attribute__((packed));
+
+static char *rbuf;
+static size_t rbuf_size = 16 << 20, rlen;
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+connect_to(const char *host, const char *port)
+{
+	struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *ai;
+	if (getaddrinfo(host, port, &hints, &ai) != 0) {
+		fprintf(stderr, "can't resolve %s\n", host);
+		exit(1);
+	}
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		perror("connect");
+		exit(1);
+	}
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	freeaddrinfo(ai);
+	return fd;
+}
+
+static void
+write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t r = write(fd, buf, len);
+		if (r <= 0) {
+			perror("write");
+			exit(1);
+		}
+		buf += r;
+		len -= r;
+	}
+}
+
+static void
+fill(int fd)
+{
+	if (rlen == rbuf_size) {
+		fprintf(stderr, "reply is too large\n");
+		exit(1);
+	}
+	ssize_t r = read(fd, rbuf + rlen, rbuf_size - rlen);
+	if (r <= 0) {
+		fprintf(stderr, "connection closed\n");
+		exit(1);
+	}
+	rlen += r;
+}
+
+static void
+consume(size_t len)
+{
+	memmove(rbuf, rbuf + len, rlen - len);
+	rlen -= len;
+}
+
+/* reads text replies up to and including "END\r\n", returns number of VALUE lines */
+static int
+text_read_get(int fd)
+{
+	int values = 0;
+	size_t off = 0;
+	for (;;) {
+		char *eol;
+		while ((eol = memmem(rbuf + off, rlen - off, "\r\n", 2)) == NULL)
+			fill(fd);
+		size_t line = eol + 2 - (rbuf + off);
+		if (line == 5 && memcmp(rbuf + off, "END", 3) == 0) {
+			consume(off + line);
+			return values;
+		}
+		unsigned bytes = 0;
+		if (sscanf(rbuf + off, "VALUE %*s %*u %u", &bytes) != 1) {
+			fprintf(stderr, "bad reply: %.*s\n", (int)line, rbuf + off);
+			exit(1);
+		}
+		while (rlen < off + line + bytes + 2)
+			fill(fd);
+		off += line + bytes + 2;
+		values++;
+	}
+}
+
+/* reads binary replies up to and including noop, returns number of hits */
+static int
+binary_read_pipeline(int fd)
+{
+	int values = 0;
+	size_t off = 0;
+	for (;;) {
+		while (rlen < off + sizeof(struct header))
+			fill(fd);
+		struct header *h = (struct header *)(rbuf + off);
+		size_t len = sizeof(*h) + be32toh(h->body_len);
+		uint8_t opcode = h->opcode;
+		uint16_t status = be16toh(h->status);
+		while (rlen < off + len)
+			fill(fd);
+		off += len;
+		if (opcode == 0x0a) {
+			consume(off);
+			return values;
+		}
+		if (status == 0)
+			values++;
+	}
+}
+
+static size_t
+binary_req(char *p, uint8_t opcode, const char *key, const void *extras, int extras_len,
+	   const void *value, int value_len)
+{
+	int key_len = key ? strlen(key) : 0;
+	struct header h = { .magic = 0x80, .opcode = opcode,
+			    .key_len = htobe16(key_len), .extras_len = extras_len,
+			    .body_len = htobe32(extras_len + key_len + value_len) };
+	memcpy(p, &h, sizeof(h));
+	p += sizeof(h);
+	memcpy(p, extras, extras_len);
+	memcpy(p + extras_len, key, key_len);
+	memcpy(p + extras_len + key_len, value, value_len);
+	return sizeof(h) + extras_len + key_len + value_len;
+}
+
+static void
+populate(int fd, int keys, int value_size)
+{
+	char *value = malloc(value_size);
+	memset(value, 'x', value_size);
+	char *req = malloc(64 * (value_size + 64));
+	uint32_t extras[2] = { 0, 0 };
+	char key[32];
+
+	/* setq in chunks of 64, noop to sync */
+	for (int i = 0; i < keys; i += 64) {
+		size_t len = 0;
+		for (int j = i; j < i + 64 && j < keys; j++) {
+			snprintf(key, sizeof(key), "key:%i", j);
+			len += binary_req(req + len, 0x11, key, extras, sizeof(extras), value, value_size);
+		}
+		len += binary_req(req + len, 0x0a, NULL, NULL, 0, NULL, 0);
+		write_all(fd, req, len);
+		binary_read_pipeline(fd);
+	}
+	free(req);
+	free(value);
+}
+
+static void
+run(const char *name, int fd, int binary, int keys, int batch, double seconds)
+{
+	char *req = malloc((size_t)batch * 64 + 64);
+	char key[32];
+	uint64_t nreq = 0, nkeys = 0, hits = 0;
+	unsigned x = 12345;
+
+	double start = now(), elapsed;
+	do {
+		size_t len = 0;
+		if (!binary)
+			len += sprintf(req, "get");
+		for (int i = 0; i < batch; i++) {
+			x = x * 1103515245 + 12345;
+			snprintf(key, sizeof(key), "key:%u", (x >> 8) % keys);
+			if (binary)
+				len += binary_req(req + len, 0x0d, key, NULL, 0, NULL, 0);
+			else
+				len += sprintf(req + len, " %s", key);
+		}
+		if (binary)
+			len += binary_req(req + len, 0x0a, NULL, NULL, 0, NULL, 0);
+		else
+			len += sprintf(req + len, "\r\n");
+
+		write_all(fd, req, len);
+		hits += binary ? binary_read_pipeline(fd) : text_read_get(fd);
+		nreq++;
+		nkeys += batch;
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	printf("%-7s batch %4i: %10.0f keys/s %9.0f req/s  hits %.1f%%\n",
+	       name, batch, nkeys / elapsed, nreq / elapsed, 100.0 * hits / nkeys);
+	free(req);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+	const char *port = argc > 2 ? argv[2] : "11211";
+	int keys = argc > 3 ? atoi(argv[3]) : 100000;
+	int batch = argc > 4 ? atoi(argv[4]) : 100;
+	int value_size = argc > 5 ? atoi(argv[5]) : 100;
+	double seconds = argc > 6 ? atof(argv[6]) : 5;
+
+	rbuf = malloc(rbuf_size);
+	int fd = connect_to(host, port);
+	populate(fd, keys, value_size);
+
+	int batches[] = { 1, 10, batch };
+	for (int i = 0; i < 3; i++) {
+		if (i > 0 && batches[i] <= batches[i - 1])
+			continue;
+		run("text", fd, 0, keys, batches[i], seconds);
+		run("binary", fd, 1, keys, batches[i], seconds);
+	}
+	close(fd);
+	return 0;
+}
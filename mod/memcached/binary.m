@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2026 octopus contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#import <util.h>
+#import <fiber.h>
+#import <net_io.h>
+#import <say.h>
+#import <tbuf.h>
+
+#include <string.h>
+#include <endian.h>
+
+#import <mod/memcached/store.h>
+
+/* memcached binary protocol, see
+   https://github.com/memcached/memcached/wiki/BinaryProtocolRevamped
+
+   Quiet commands (getq, getkq, setq, ...) reply only on miss/error, client
+   terminates pipeline with noop. Replies are only queued into wbuf here,
+   they are flushed once input buffer runs out of complete requests,
+   so whole pipeline is answered by single writev. */
+
+enum {
+	MC_BIN_REQ_MAGIC = 0x80,
+	MC_BIN_RES_MAGIC = 0x81
+};
+
+enum mc_bin_opcode {
+	MC_BIN_GET = 0x00,
+	MC_BIN_SET = 0x01,
+	MC_BIN_ADD = 0x02,
+	MC_BIN_REPLACE = 0x03,
+	MC_BIN_DELETE = 0x04,
+	MC_BIN_INCR = 0x05,
+	MC_BIN_DECR = 0x06,
+	MC_BIN_QUIT = 0x07,
+	MC_BIN_FLUSH = 0x08,
+	MC_BIN_GETQ = 0x09,
+	MC_BIN_NOOP = 0x0a,
+	MC_BIN_VERSION = 0x0b,
+	MC_BIN_GETK = 0x0c,
+	MC_BIN_GETKQ = 0x0d,
+	MC_BIN_APPEND = 0x0e,
+	MC_BIN_PREPEND = 0x0f,
+	MC_BIN_STAT = 0x10,
+	MC_BIN_SETQ = 0x11,
+	MC_BIN_ADDQ = 0x12,
+	MC_BIN_REPLACEQ = 0x13,
+	MC_BIN_DELETEQ = 0x14,
+	MC_BIN_INCRQ = 0x15,
+	MC_BIN_DECRQ = 0x16,
+	MC_BIN_QUITQ = 0x17,
+	MC_BIN_FLUSHQ = 0x18,
+	MC_BIN_APPENDQ = 0x19,
+	MC_BIN_PREPENDQ = 0x1a,
+};
+
+enum mc_bin_status {
+	MC_BIN_OK = 0x00,
+	MC_BIN_ENOENT = 0x01,
+	MC_BIN_EEXISTS = 0x02,
+	MC_BIN_E2BIG = 0x03,
+	MC_BIN_EINVAL = 0x04,
+	MC_BIN_NOT_STORED = 0x05,
+	MC_BIN_DELTA_BADVAL = 0x06,
+	MC_BIN_UNKNOWN_COMMAND = 0x81,
+	MC_BIN_ENOMEM = 0x82,
+};
+
+struct mc_bin_header {
+	u8 magic;
+	u8 opcode;
+	u16 key_len;
+	u8 extras_len;
+	u8 data_type;
+	u16 status; /* vbucket in request */
+	u32 body_len;
+	u32 opaque;
+	u64 cas;
+} __attribute__((packed));
+
+#define MC_BIN_MAX_VALUE (1 << 20)
+#define MC_BIN_MAX_KEY 250
+
+struct mc_bin_req {
+	const struct mc_bin_header *h;
+	const char *extras;
+	char *key;
+	const char *value;
+	u32 value_len;
+	bool quiet;
+};
+
+static void *
+bin_reply(struct netmsg_head *wbuf, const struct mc_bin_req *r, u16 status,
+	  u8 extras_len, u16 key_len, u32 value_len, u64 cas)
+{
+	struct mc_bin_header *h = net_add_alloc(wbuf, sizeof(*h) + extras_len);
+	*h = (struct mc_bin_header){ .magic = MC_BIN_RES_MAGIC,
+				     .opcode = r->h->opcode,
+				     .key_len = htobe16(key_len),
+				     .extras_len = extras_len,
+				     .status = htobe16(status),
+				     .body_len = htobe32(extras_len + key_len + value_len),
+				     .opaque = r->h->opaque,
+				     .cas = htobe64(cas) };
+	return h + 1;
+}
+
+static void
+bin_status(struct netmsg_head *wbuf, const struct mc_bin_req *r, u16 status)
+{
+	if (status == MC_BIN_OK && r->quiet)
+		return;
+
+	const char *msg = NULL;
+	switch (status) {
+	case MC_BIN_OK: break;
+	case MC_BIN_ENOENT: msg = "Not found"; break;
+	case MC_BIN_EEXISTS: msg = "Data exists for key."; break;
+	case MC_BIN_E2BIG: msg = "Too large."; break;
+	case MC_BIN_EINVAL: msg = "Invalid arguments"; break;
+	case MC_BIN_NOT_STORED: msg = "Not stored."; break;
+	case MC_BIN_DELTA_BADVAL: msg = "Non-numeric server-side value for incr or decr"; break;
+	case MC_BIN_UNKNOWN_COMMAND: msg = "Unknown command"; break;
+	default: msg = "Server error"; break;
+	}
+
+	int len = msg ? strlen(msg) : 0;
+	bin_reply(wbuf, r, status, 0, 0, len, 0);
+	if (len)
+		net_add_iov(wbuf, msg, len);
+}
+
+static u64
+current_cas(Memcached *memc, const char *key)
+{
+	struct tnt_object *obj = [memc->mc_index find:key];
+	return obj ? mc_obj(obj)->cas : 0;
+}
+
+static void
+bin_get(Memcached *memc, struct netmsg_head *wbuf, const struct mc_bin_req *r, bool with_key)
+{
+	mc_stats.cmd_get++;
+	struct tnt_object *obj = [memc->mc_index find:r->key];
+	if (missing(obj)) {
+		mc_stats.get_misses++;
+		if (r->quiet)
+			return;
+		if (with_key) {
+			int key_len = strlen(r->key);
+			bin_reply(wbuf, r, MC_BIN_ENOENT, 0, key_len, 0, 0);
+			net_add_iov_dup(wbuf, r->key, key_len);
+		} else {
+			bin_status(wbuf, r, MC_BIN_ENOENT);
+		}
+		return;
+	}
+	mc_stats.get_hits++;
+
+	struct mc_obj *m = mc_obj(obj);
+	int key_len = with_key ? m->key_len - 1 : 0;
+	u32 *flags = bin_reply(wbuf, r, MC_BIN_OK, 4, key_len, m->value_len, m->cas);
+	*flags = htobe32(m->flags);
+	if (with_key)
+		net_add_obj_iov(wbuf, obj, m->data, key_len);
+	net_add_obj_iov(wbuf, obj, mc_value(m), m->value_len);
+}
+
+/* as in text protocol: up to 30 days exptime is relative to now */
+static u32
+bin_exptime(u32 exptime)
+{
+	if (exptime > 0 && exptime <= 60*60*24*30)
+		exptime = exptime + ev_now();
+	return exptime;
+}
+
+static u16
+bin_store(Memcached *memc, const struct mc_bin_req *r, char *value, u32 value_len,
+	  u32 flags, u32 exptime)
+{
+	mc_stats.cmd_set++;
+	if (value_len > MC_BIN_MAX_VALUE)
+		return MC_BIN_E2BIG;
+	exptime = bin_exptime(exptime);
+	if (!store(memc, r->key, exptime, flags, value_len, value))
+		return MC_BIN_ENOMEM;
+	mc_stats.total_items++;
+	return MC_BIN_OK;
+}
+
+static void
+bin_update(Memcached *memc, struct netmsg_head *wbuf, const struct mc_bin_req *r)
+{
+	u8 op = r->h->opcode;
+	u64 cas = be64toh(r->h->cas);
+	u32 flags = 0, exptime = 0;
+	char *value = (char *)r->value;
+	u32 value_len = r->value_len;
+
+	struct tnt_object *obj = [memc->mc_index find:r->key];
+	bool miss = missing(obj);
+	u16 status = MC_BIN_OK;
+
+	switch (op) {
+	case MC_BIN_SET:
+	case MC_BIN_SETQ:
+		if (cas && (miss || mc_obj(obj)->cas != cas))
+			status = miss ? MC_BIN_ENOENT : MC_BIN_EEXISTS;
+		break;
+	case MC_BIN_ADD:
+	case MC_BIN_ADDQ:
+		if (!miss)
+			status = MC_BIN_EEXISTS;
+		break;
+	case MC_BIN_REPLACE:
+	case MC_BIN_REPLACEQ:
+		if (miss)
+			status = MC_BIN_ENOENT;
+		else if (cas && mc_obj(obj)->cas != cas)
+			status = MC_BIN_EEXISTS;
+		break;
+	case MC_BIN_APPEND:
+	case MC_BIN_APPENDQ:
+	case MC_BIN_PREPEND:
+	case MC_BIN_PREPENDQ:
+		if (miss) {
+			status = MC_BIN_NOT_STORED;
+			break;
+		}
+		if (cas && mc_obj(obj)->cas != cas) {
+			status = MC_BIN_EEXISTS;
+			break;
+		}
+		struct mc_obj *m = mc_obj(obj);
+		struct tbuf *b = tbuf_alloc(fiber->pool);
+		if (op == MC_BIN_APPEND || op == MC_BIN_APPENDQ) {
+			tbuf_append(b, mc_value(m), m->value_len);
+			tbuf_append(b, value, value_len);
+		} else {
+			tbuf_append(b, value, value_len);
+			tbuf_append(b, mc_value(m), m->value_len);
+		}
+		flags = m->flags;
+		exptime = m->exptime;
+		value = b->ptr;
+		value_len = tbuf_len(b);
+		break;
+	}
+
+	if (status == MC_BIN_OK) {
+		if (r->h->extras_len == 8) {
+			flags = be32toh(((u32 *)r->extras)[0]);
+			exptime = be32toh(((u32 *)r->extras)[1]);
+			status = bin_store(memc, r, value, value_len, flags, exptime);
+		} else {
+			/* append/prepend keep flags & absolute exptime of old item */
+			mc_stats.cmd_set++;
+			if (value_len > MC_BIN_MAX_VALUE)
+				status = MC_BIN_E2BIG;
+			else if (!store(memc, r->key, exptime, flags, value_len, value))
+				status = MC_BIN_ENOMEM;
+			else
+				mc_stats.total_items++;
+		}
+	}
+
+	if (status != MC_BIN_OK || r->quiet) {
+		bin_status(wbuf, r, status);
+		return;
+	}
+	bin_reply(wbuf, r, MC_BIN_OK, 0, 0, 0, current_cas(memc, r->key));
+}
+
+static void
+bin_delete(Memcached *memc, struct netmsg_head *wbuf, const struct mc_bin_req *r)
+{
+	struct tnt_object *obj = [memc->mc_index find:r->key];
+	if (missing(obj)) {
+		bin_status(wbuf, r, MC_BIN_ENOENT);
+		return;
+	}
+	u64 cas = be64toh(r->h->cas);
+	if (cas && mc_obj(obj)->cas != cas) {
+		bin_status(wbuf, r, MC_BIN_EEXISTS);
+		return;
+	}
+	char *key = r->key;
+	bin_status(wbuf, r, delete(memc, &key, 1) ? MC_BIN_OK : MC_BIN_ENOMEM);
+}
+
+static bool
+is_numeric(const char *field, u32 value_len)
+{
+	if (value_len == 0)
+		return false;
+	for (int i = 0; i < value_len; i++)
+		if (field[i] < '0' || '9' < field[i])
+			return false;
+	return true;
+}
+
+static void
+bin_incr_decr(Memcached *memc, struct netmsg_head *wbuf, const struct mc_bin_req *r)
+{
+	u8 op = r->h->opcode;
+	u64 delta = be64toh(*(u64 *)r->extras);
+	u64 initial = be64toh(*(u64 *)(r->extras + 8));
+	u32 exptime = be32toh(*(u32 *)(r->extras + 16));
+	u64 cas = be64toh(r->h->cas);
+	u32 flags = 0;
+	u64 value;
+
+	struct tnt_object *obj = [memc->mc_index find:r->key];
+	if (missing(obj)) {
+		if (exptime == 0xffffffff) {
+			bin_status(wbuf, r, MC_BIN_ENOENT);
+			return;
+		}
+		value = initial;
+		exptime = bin_exptime(exptime);
+	} else {
+		struct mc_obj *m = mc_obj(obj);
+		if (cas && m->cas != cas) {
+			bin_status(wbuf, r, MC_BIN_EEXISTS);
+			return;
+		}
+		if (!is_numeric(mc_value(m), m->value_len)) {
+			bin_status(wbuf, r, MC_BIN_DELTA_BADVAL);
+			return;
+		}
+		value = 0;
+		for (const char *p = mc_value(m); p < mc_value(m) + m->value_len; p++)
+			value = value * 10 + (*p - '0');
+		if (op == MC_BIN_INCR || op == MC_BIN_INCRQ)
+			value += delta;
+		else
+			value = delta > value ? 0 : value - delta;
+		flags = m->flags;
+		exptime = m->exptime;
+	}
+
+	struct tbuf *b = tbuf_alloc(fiber->pool);
+	tbuf_printf(b, "%"PRIu64, value);
+
+	mc_stats.cmd_set++;
+	if (!store(memc, r->key, exptime, flags, tbuf_len(b), b->ptr)) {
+		bin_status(wbuf, r, MC_BIN_ENOMEM);
+		return;
+	}
+	mc_stats.total_items++;
+	if (r->quiet)
+		return;
+	bin_reply(wbuf, r, MC_BIN_OK, 0, 0, sizeof(u64), current_cas(memc, r->key));
+	u64 *v = net_add_alloc(wbuf, sizeof(u64));
+	*v = htobe64(value);
+}
+
+static void
+bin_stat_cb(const char *name, const char *value, void *arg)
+{
+	void **a = arg;
+	struct netmsg_head *wbuf = a[0];
+	const struct mc_bin_req *r = a[1];
+	int key_len = strlen(name), value_len = strlen(value);
+	bin_reply(wbuf, r, MC_BIN_OK, 0, key_len, value_len, 0);
+	net_add_iov_dup(wbuf, name, key_len);
+	net_add_iov_dup(wbuf, value, value_len);
+}
+
+static void
+bin_stat(struct netmsg_head *wbuf, const struct mc_bin_req *r)
+{
+	void *arg[2] = { wbuf, (void *)r };
+	mc_stats_each(bin_stat_cb, arg);
+	bin_reply(wbuf, r, MC_BIN_OK, 0, 0, 0, 0); /* terminator */
+}
+
+int
+memcached_binary_dispatch(Memcached *memc, struct tbuf *rbuf, struct netmsg_head *wbuf)
+{
+	if (tbuf_len(rbuf) < sizeof(struct mc_bin_header))
+		return 0;
+
+	const struct mc_bin_header *h = rbuf->ptr;
+	u32 body_len = be32toh(h->body_len);
+	u16 key_len = be16toh(h->key_len);
+
+	if (h->magic != MC_BIN_REQ_MAGIC ||
+	    body_len > MC_BIN_MAX_VALUE + MC_BIN_MAX_KEY + 64 ||
+	    key_len + h->extras_len > body_len)
+	{
+		say_warn("memcached binary proto error");
+		return -1;
+	}
+
+	if (tbuf_len(rbuf) < sizeof(*h) + body_len)
+		return 0;
+
+	struct mc_bin_req r = { .h = h,
+				.extras = (const char *)(h + 1),
+				.value = (const char *)(h + 1) + h->extras_len + key_len,
+				.value_len = body_len - h->extras_len - key_len };
+
+	u8 op = h->opcode;
+	switch (op) {
+	case MC_BIN_GETQ: case MC_BIN_GETKQ: case MC_BIN_SETQ: case MC_BIN_ADDQ:
+	case MC_BIN_REPLACEQ: case MC_BIN_DELETEQ: case MC_BIN_INCRQ: case MC_BIN_DECRQ:
+	case MC_BIN_QUITQ: case MC_BIN_FLUSHQ: case MC_BIN_APPENDQ: case MC_BIN_PREPENDQ:
+		r.quiet = true;
+	}
+
+	/* store keys are C strings */
+	r.key = palloc(fiber->pool, key_len + 1);
+	memcpy(r.key, r.extras + h->extras_len, key_len);
+	r.key[key_len] = 0;
+
+	mc_stats.bytes_read += sizeof(*h) + body_len;
+
+	bool need_key = false, valid = true;
+	switch (op) {
+	case MC_BIN_GET: case MC_BIN_GETQ: case MC_BIN_GETK: case MC_BIN_GETKQ:
+	case MC_BIN_DELETE: case MC_BIN_DELETEQ:
+		need_key = true;
+		valid = h->extras_len == 0 && r.value_len == 0;
+		break;
+	case MC_BIN_SET: case MC_BIN_SETQ: case MC_BIN_ADD: case MC_BIN_ADDQ:
+	case MC_BIN_REPLACE: case MC_BIN_REPLACEQ:
+		need_key = true;
+		valid = h->extras_len == 8;
+		break;
+	case MC_BIN_APPEND: case MC_BIN_APPENDQ: case MC_BIN_PREPEND: case MC_BIN_PREPENDQ:
+		need_key = true;
+		valid = h->extras_len == 0;
+		break;
+	case MC_BIN_INCR: case MC_BIN_INCRQ: case MC_BIN_DECR: case MC_BIN_DECRQ:
+		need_key = true;
+		valid = h->extras_len == 20 && r.value_len == 0;
+		break;
+	case MC_BIN_FLUSH: case MC_BIN_FLUSHQ:
+		valid = (h->extras_len == 0 || h->extras_len == 4) && key_len == 0;
+		break;
+	}
+	if (need_key)
+		valid = valid && key_len > 0 && key_len <= MC_BIN_MAX_KEY &&
+			strlen(r.key) == key_len;
+
+	int ret = 1;
+	if (!valid) {
+		r.quiet = false;
+		bin_status(wbuf, &r, MC_BIN_EINVAL);
+		goto out;
+	}
+
+	switch (op) {
+	case MC_BIN_GET:
+	case MC_BIN_GETQ:
+		bin_get(memc, wbuf, &r, false);
+		break;
+	case MC_BIN_GETK:
+	case MC_BIN_GETKQ:
+		bin_get(memc, wbuf, &r, true);
+		break;
+	case MC_BIN_SET: case MC_BIN_SETQ: case MC_BIN_ADD: case MC_BIN_ADDQ:
+	case MC_BIN_REPLACE: case MC_BIN_REPLACEQ:
+	case MC_BIN_APPEND: case MC_BIN_APPENDQ: case MC_BIN_PREPEND: case MC_BIN_PREPENDQ:
+		bin_update(memc, wbuf, &r);
+		break;
+	case MC_BIN_DELETE:
+	case MC_BIN_DELETEQ:
+		bin_delete(memc, wbuf, &r);
+		break;
+	case MC_BIN_INCR: case MC_BIN_INCRQ: case MC_BIN_DECR: case MC_BIN_DECRQ:
+		bin_incr_decr(memc, wbuf, &r);
+		break;
+	case MC_BIN_FLUSH:
+	case MC_BIN_FLUSHQ: {
+		i32 delay = h->extras_len == 4 ? be32toh(*(u32 *)r.extras) : 0;
+		fiber_create("flush_all", flush_all, memc, delay);
+		bin_status(wbuf, &r, MC_BIN_OK);
+		break;
+	}
+	case MC_BIN_NOOP:
+		bin_status(wbuf, &r, MC_BIN_OK);
+		break;
+	case MC_BIN_VERSION: {
+		static const char version[] = "1.2.5";
+		bin_reply(wbuf, &r, MC_BIN_OK, 0, 0, sizeof(version) - 1, 0);
+		net_add_iov(wbuf, version, sizeof(version) - 1);
+		break;
+	}
+	case MC_BIN_STAT:
+		bin_stat(wbuf, &r);
+		break;
+	case MC_BIN_QUIT:
+	case MC_BIN_QUITQ:
+		bin_status(wbuf, &r, MC_BIN_OK);
+		ret = -1;
+		break;
+	default:
+		bin_status(wbuf, &r, MC_BIN_UNKNOWN_COMMAND);
+		break;
+	}
+out:
+	tbuf_ltrim(rbuf, sizeof(*h) + body_len);
+	return ret;
+}
+
+register_source();
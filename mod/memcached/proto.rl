@@ -108,8 +108,7 @@ quote(const char *p, int len)
 }
 
 int __attribute__((noinline))
-memcached_dispatch(Memcached *memc, int fd,
-		   struct tbuf *rbuf, struct netmsg_head *wbuf)
+memcached_dispatch(Memcached *memc, struct tbuf *rbuf, struct netmsg_head *wbuf)
 {
 	int cs;
 	char *p, *pe;
@@ -242,7 +241,7 @@ memcached_dispatch(Memcached *memc, int fd,
 					if (store(memc, key, exptime, flags, bytes, data)) {
 						mc_stats.total_items++;
 						if (!noreply) {
-							net_add_iov(wbuf, b->ptr, tbuf_len(b));
+							net_add_iov_dup(wbuf, b->ptr, tbuf_len(b));
 							ADD_IOV_LITERAL("\r\n");
 						}
 					} else {
@@ -290,11 +289,11 @@ memcached_dispatch(Memcached *memc, int fd,
 					struct tbuf *b = tbuf_alloc(fiber->pool);
 					tbuf_printf(b, "VALUE %s %"PRIu32" %"PRIu32" %"PRIu64"\r\n",
 						    key, m->flags, m->value_len, m->cas);
-					net_add_iov(wbuf, b->ptr, tbuf_len(b));
+					net_add_iov_dup(wbuf, b->ptr, tbuf_len(b));
 					mc_stats.bytes_written += tbuf_len(b);
 				} else {
 					ADD_IOV_LITERAL("VALUE ");
-					net_add_iov(wbuf, key, strlen(key));
+					net_add_iov_dup(wbuf, key, strlen(key));
 					net_add_iov(wbuf, suffix, m->suffix_len);
 				}
 				net_add_obj_iov(wbuf, obj, value, m->value_len);
@@ -315,7 +314,7 @@ memcached_dispatch(Memcached *memc, int fd,
 		}
 
 		action quit {
-			return 0;
+			return -1;
 		}
 
 		action fstart { fstart = p; }
@@ -354,17 +353,10 @@ memcached_dispatch(Memcached *memc, int fd,
 		flush_delay = digit+ >fstart %{flush_delay = natoq(fstart, p);};
 
 		action read_data {
-			size_t parsed = p - (char *)rbuf->ptr;
-			while (tbuf_len(rbuf) - parsed < bytes + 2) {
-				int r = fiber_recv(fd, rbuf);
-				if (r <= 0) {
-					say_debug("read returned %i, closing connection", r);
-					return -1;
-				}
-			}
-
-			p = rbuf->ptr + parsed;
-			pe = rbuf->end;
+			/* data block isn't read yet: command will be
+			   parsed again once more input arrives */
+			if (pe - p < bytes + 2)
+				return 0;
 
 			data = p;
 
@@ -31,11 +31,26 @@
 #include <index.h>
 #import <log_io.h>
 
+/* expiration index: hierarchical timing wheel with 1 second resolution.
+   Level N slot holds items expiring within 256^(N+1) seconds, slots of
+   upper levels are cascaded to lower ones as time advances. Items which
+   are due are moved to `due' list and stay there until deleted */
+struct mc_link {
+	struct mc_link *next, **pprev;
+} __attribute__((packed));
+
+struct mc_wheel {
+	u32 now; /* last processed second */
+	struct mc_link *slot[4][256];
+	struct mc_link *due;
+};
+
 @interface Memcached : Object <Executor> {
 	Fiber *expire_fiber;
 @public
 	Shard<Shard> *shard;
 	CStringHash *mc_index;
+	struct mc_wheel wheel;
 }
 @end
 
@@ -44,6 +59,10 @@ enum object_type {
 	MC_OBJ = 1
 };
 
+/* object data is mc_obj, preceded by mc_link if item was created with
+   exptime. only mc_obj is written to WAL and snapshot */
+enum { MC_LINKED = 0x8 };
+
 struct mc_obj {
 	u32 exptime;
 	u32 flags;
@@ -59,7 +78,14 @@ mc_obj(struct tnt_object *obj)
 {
 	if (unlikely(obj->type != MC_OBJ))
 		abort();
-	return (struct mc_obj *)obj->data;
+	return (struct mc_obj *)(obj->data + (obj->flags & MC_LINKED ? sizeof(struct mc_link) : 0));
+}
+
+static inline struct mc_link *
+mc_link(struct tnt_object *obj)
+{
+	assert(obj->flags & MC_LINKED);
+	return (struct mc_link *)obj->data;
 }
 
 static inline int
@@ -83,6 +109,9 @@ missing(struct tnt_object *obj)
 	return obj == NULL || object_ghost(obj) || expired(obj);
 }
 
+void mc_expire_link(struct mc_wheel *w, struct tnt_object *obj);
+void mc_expire_unlink(struct tnt_object *obj);
+
 int store(Memcached *memc, const char *key, u32 exptime, u32 flags, u32 value_len, char *value);
 int delete(Memcached *memc, char **keys, int n);
 void flush_all(va_list ap);
@@ -96,11 +125,17 @@ extern struct mc_stats {
 	u64 get_hits;
 	u64 get_misses;
 	u64 evictions;
+	u64 expired;
+	u32 expire_lag; /* seconds, max over the last expire batch */
 	u64 bytes_read;
 	u64 bytes_written;
 } mc_stats;
 void print_stats(struct netmsg_head *wbuf);
+void mc_stats_each(void (*cb)(const char *name, const char *value, void *arg), void *arg);
 
+/* both return 1 if request was processed, 0 if more input is required
+   and -1 if connection must be closed */
 int __attribute__((noinline))
-memcached_dispatch(Memcached *memc, int fd, struct tbuf *rbuf, struct netmsg_head *wbuf);
+memcached_dispatch(Memcached *memc, struct tbuf *rbuf, struct netmsg_head *wbuf);
+int memcached_binary_dispatch(Memcached *memc, struct tbuf *rbuf, struct netmsg_head *wbuf);
 #endif
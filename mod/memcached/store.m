@@ -32,6 +32,7 @@
 #include <stat.h>
 #include <salloc.h>
 #import <pickle.h>
+#import <net_io.h>
 
 #include <sysexits.h>
 
@@ -42,6 +43,19 @@ static u64 cas;
 
 struct mc_stats mc_stats;
 
+/* only items with exptime get wheel link */
+static struct tnt_object *
+mc_object_alloc(int len, u32 exptime)
+{
+	if (exptime == 0)
+		return object_alloc(MC_OBJ, 1, len);
+
+	struct tnt_object *obj = object_alloc(MC_OBJ, 1, sizeof(struct mc_link) + len);
+	obj->flags |= MC_LINKED;
+	*mc_link(obj) = (struct mc_link){ NULL, NULL };
+	return obj;
+}
+
 static struct tnt_object *
 mc_alloc(const char *key, u32 exptime, u32 flags, u32 value_len, const char *value)
 {
@@ -52,8 +66,7 @@ mc_alloc(const char *key, u32 exptime, u32 flags, u32 value_len, const char *val
 
 	struct tnt_object *obj = NULL;
 
-	obj = object_alloc(MC_OBJ, 1, sizeof(struct mc_obj) +
-			   key_len + suffix_len + value_len);
+	obj = mc_object_alloc(sizeof(struct mc_obj) + key_len + suffix_len + value_len, exptime);
 
 	struct mc_obj *m = mc_obj(obj);
 	*m = (struct mc_obj){ .exptime = exptime,
@@ -69,6 +82,94 @@ mc_alloc(const char *key, u32 exptime, u32 flags, u32 value_len, const char *val
 }
 
 
+static struct mc_link **
+wheel_slot(struct mc_wheel *w, u32 t)
+{
+	if (t <= w->now)
+		return &w->due;
+	u32 delta = t - w->now;
+	if (delta < 1 << 8)
+		return &w->slot[0][t & 0xff];
+	if (delta < 1 << 16)
+		return &w->slot[1][(t >> 8) & 0xff];
+	if (delta < 1 << 24)
+		return &w->slot[2][(t >> 16) & 0xff];
+	return &w->slot[3][t >> 24];
+}
+
+static void
+wheel_insert(struct mc_link **head, struct mc_link *l)
+{
+	l->next = *head;
+	if (l->next)
+		l->next->pprev = &l->next;
+	l->pprev = head;
+	*head = l;
+}
+
+static struct tnt_object *
+mc_link_obj(struct mc_link *l)
+{
+	return (struct tnt_object *)((char *)l - offsetof(struct tnt_object, data));
+}
+
+void
+mc_expire_unlink(struct tnt_object *obj)
+{
+	if ((obj->flags & MC_LINKED) == 0)
+		return;
+	struct mc_link *l = mc_link(obj);
+	if (l->pprev == NULL)
+		return;
+	*l->pprev = l->next;
+	if (l->next)
+		l->next->pprev = l->pprev;
+	l->next = NULL;
+	l->pprev = NULL;
+}
+
+void
+mc_expire_link(struct mc_wheel *w, struct tnt_object *obj)
+{
+	if ((obj->flags & MC_LINKED) == 0)
+		return;
+	u32 exptime = mc_obj(obj)->exptime;
+	mc_expire_unlink(obj);
+	if (exptime != 0)
+		wheel_insert(wheel_slot(w, exptime), mc_link(obj));
+}
+
+static void
+wheel_cascade(struct mc_wheel *w, struct mc_link **head)
+{
+	struct mc_link *l = *head, *next;
+	*head = NULL;
+	for (; l; l = next) {
+		next = l->next;
+		wheel_insert(wheel_slot(w, mc_obj(mc_link_obj(l))->exptime), l);
+	}
+}
+
+/* cost is proportional to number of seconds passed plus number of
+   items expiring during them */
+static void
+wheel_advance(struct mc_wheel *w, u32 now)
+{
+	while (w->now < now) {
+		u32 t = ++w->now;
+		if ((t & 0xff) == 0) {
+			wheel_cascade(w, &w->slot[1][(t >> 8) & 0xff]);
+			if (((t >> 8) & 0xff) == 0) {
+				wheel_cascade(w, &w->slot[2][(t >> 16) & 0xff]);
+				if (((t >> 16) & 0xff) == 0)
+					wheel_cascade(w, &w->slot[3][t >> 24]);
+			}
+		}
+		/* all items of level 0 slot expire exactly at t */
+		wheel_cascade(w, &w->slot[0][t & 0xff]);
+	}
+}
+
 enum tag { STORE = user_tag, DELETE };
 
 static struct index_node *
@@ -87,6 +188,7 @@ init
 	[super init];
 	mc_index = [[CStringHash alloc] init:NULL];
 	mc_index->dtor = dtor;
+	wheel.now = ev_now();
 
 	return self;
 }
@@ -98,7 +200,27 @@ set_shard:(Shard<Shard> *)shard_
 }
 
 static void
-store_compat(CStringHash *mc_index, struct tbuf *op)
+mc_index_replace(Memcached *memc, struct tnt_object *obj)
+{
+	struct tnt_object *old = [memc->mc_index find_obj:obj];
+	[memc->mc_index replace:obj];
+	if (old && old != obj) {
+		mc_expire_unlink(old);
+		object_decr_ref(old);
+	}
+	mc_expire_link(&memc->wheel, obj);
+}
+
+static void
+mc_index_remove(Memcached *memc, struct tnt_object *obj)
+{
+	[memc->mc_index remove:obj];
+	mc_expire_unlink(obj);
+	object_decr_ref(obj);
+}
+
+static void
+store_compat(Memcached *memc, struct tbuf *op)
 {
 	int key_len = read_varint32(op);
 	char *key = read_bytes(op, key_len);
@@ -117,7 +239,7 @@ store_compat(CStringHash *mc_index, struct tbuf *op)
 
 	struct tnt_object *obj = mc_alloc(key, exptime, flags, value_len, value);
 	object_incr_ref(obj);
-	[mc_index replace:obj];
+	mc_index_replace(memc, obj);
 
 	struct mc_obj *m = mc_obj(obj);
 	if (m->cas > cas)
@@ -140,10 +262,10 @@ apply:(struct tbuf *)op tag:(u16)tag
 	switch(tag & TAG_MASK) {
 	case STORE:
 		m = op->ptr;
-		obj = object_alloc(MC_OBJ, 1, mc_len(m));
+		obj = mc_object_alloc(mc_len(m), m->exptime);
 		object_incr_ref(obj);
-		memcpy(obj->data, m, mc_len(m));
-		[mc_index replace:obj];
+		memcpy(mc_obj(obj), m, mc_len(m));
+		mc_index_replace(self, obj);
 		if (m->cas > cas)
 			cas = m->cas + 1;
 		say_debug("STORE	%s", m->data);
@@ -152,10 +274,8 @@ apply:(struct tbuf *)op tag:(u16)tag
 		while (tbuf_len(op) > 0) {
 			key = op->ptr;
 			obj = [mc_index find:key];
-			if (obj) {
-				[mc_index remove:obj];
-				object_decr_ref(obj);
-			}
+			if (obj)
+				mc_index_remove(self, obj);
 			tbuf_ltrim(op, strlen(key) + 1);
 			say_debug("DELETE	%s", key);
 		}
@@ -169,7 +289,7 @@ apply:(struct tbuf *)op tag:(u16)tag
 		case 13: {
 			read_u32(op); /* flags */
 			read_u32(op); /* cardinality */
-			store_compat(mc_index, op);
+			store_compat(self, op);
 			break;
 		}
 		case 20: {
@@ -179,10 +299,8 @@ apply:(struct tbuf *)op tag:(u16)tag
 			memcpy(key, op->ptr, key_len);
 			key[key_len] = 0;
 			obj = [mc_index find:key];
-			if (obj) {
-				[mc_index remove:obj];
-				object_decr_ref(obj);
-			}
+			if (obj)
+				mc_index_remove(self, obj);
 			say_debug("DELETE(c)	%s", key);
 			break;
 		}
@@ -196,7 +314,7 @@ apply:(struct tbuf *)op tag:(u16)tag
 		read_u32(op); /* obj_space */
 		read_u32(op); /* cardinality */
 		read_u32(op);  /* data_size */
-		store_compat(mc_index, op);
+		store_compat(self, op);
 		break;
 
 	default:
@@ -219,7 +337,7 @@ status_changed
 
 	if ([shard is_replica] == false) {
 		if (expire_fiber == NULL)
-			expire_fiber = fiber_create("memecached_expire", memcached_expire);
+			expire_fiber = fiber_create("memecached_expire", memcached_expire, self);
 		return;
 	}
 	if ([shard is_replica] && expire_fiber != NULL)
@@ -296,11 +414,13 @@ store(Memcached *memc, const char *key, u32 exptime, u32 flags, u32 value_len, c
 			if ((obj->flags & GHOST) == 0) {
 				[mc_index replace:obj];
 				object_unlock(old_obj);
+				mc_expire_unlink(old_obj);
 				object_decr_ref(old_obj);
 			} else {
 				obj->flags &= ~GHOST;
 				object_unlock(obj);
 			}
+			mc_expire_link(&memc->wheel, obj);
 			object_incr_ref(obj);
 			obj = NULL;
 			return 1;
@@ -358,9 +478,8 @@ delete(Memcached *memc, char **keys, int n)
 
 	if ([memc->shard submit:b->ptr len:tbuf_len(b) tag:DELETE|TAG_WAL] == 1) {
 		for (int i = 0; i < k; i++) {
-			[mc_index remove:obj[i]];
 			object_unlock(obj[i]);
-			object_decr_ref(obj[i]);
+			mc_index_remove(memc, obj[i]);
 		}
 		ret += k;
 	}
@@ -370,87 +489,95 @@ delete(Memcached *memc, char **keys, int n)
 static void
 memcached_expire(va_list ap)
 {
-	Recovery *recovery = va_arg(ap, Recovery *);
-	Shard<Shard> *shard;
-	Memcached *memc;
-	CStringHash *mc_index;
-	u32 i = 0;
+	Memcached *memc = va_arg(ap, Memcached *);
+	struct mc_wheel *w = &memc->wheel;
 
 	if (cfg.memcached_no_expire)
 		return;
 
 	say_info("memcached expire fiber started");
 	char **keys = malloc(cfg.memcached_expire_per_loop * sizeof(void *));
+	int k = 0;
 
 	for (;;) {
-		shard = [recovery shard:0];
-		memc = [shard executor];
-		mc_index = memc->mc_index;
-
-		double delay = (double)cfg.memcached_expire_per_loop *
-				       cfg.memcached_expire_full_sweep /
-			       ([mc_index slots] + 1);
-		if (delay > 1)
-			delay = 1;
-		fiber_sleep(delay);
+		/* come back immediately if previous batch was full */
+		fiber_sleep(k == cfg.memcached_expire_per_loop ? 0.001 : 1.0);
 
 		say_debug("expire loop");
-		if ([shard is_replica])
+		if ([memc->shard is_replica])
 			continue;
 
-		if (i >= [mc_index slots])
-			i = 0;
-
-		int k = 0;
-		for (int j = 0; j < cfg.memcached_expire_per_loop; j++, i++) {
-			struct tnt_object *obj = [mc_index get:i];
-			if (obj == NULL || object_ghost(obj))
-				continue;
-
-			if (!expired(obj))
-				continue;
-
-			struct mc_obj *m = mc_obj(obj);
+		/* expired() is true only once exptime has passed */
+		wheel_advance(w, (u32)ev_now() - 1);
 
+		u32 lag = 0;
+		k = 0;
+		for (struct mc_link *l = w->due; l && k < cfg.memcached_expire_per_loop; l = l->next) {
+			struct mc_obj *m = mc_obj(mc_link_obj(l));
 			keys[k] = palloc(fiber->pool, m->key_len);
 			strcpy(keys[k], m->data);
 			k++;
+			if (ev_now() - m->exptime > lag)
+				lag = ev_now() - m->exptime;
 		}
+		if (k == 0)
+			continue;
 
-		delete(memc, keys, k);
-		say_debug("expired %i keys", k);
+		/* deleted items are unlinked from due list, locked ones
+		   stay there and will be retried */
+		int deleted = delete(memc, keys, k);
+		mc_stats.expired += deleted;
+		mc_stats.expire_lag = lag;
+		say_debug("expired %i keys, lag %"PRIu32" sec", deleted, lag);
 
 		fiber_gc();
 	}
 }
 
 void
-print_stats(struct netmsg_head *wbuf)
+mc_stats_each(void (*cb)(const char *name, const char *value, void *arg), void *arg)
 {
 	u64 bytes_used, items;
-	struct tbuf *out = tbuf_alloc(wbuf->ctx->pool);
+	char v[64];
 	slab_total_stat(&bytes_used, &items);
 
-	tbuf_printf(out, "STAT pid %"PRIu32"\r\n", (u32)getpid());
-	tbuf_printf(out, "STAT uptime %"PRIu32"\r\n", (u32)tnt_uptime());
-	tbuf_printf(out, "STAT time %"PRIu32"\r\n", (u32)ev_now());
-	tbuf_printf(out, "STAT version 1.2.5 (octopus/(silver)box)\r\n");
-	tbuf_printf(out, "STAT pointer_size %zu\r\n", sizeof(void *)*8);
-	tbuf_printf(out, "STAT curr_items %"PRIu64"\r\n", items);
-	tbuf_printf(out, "STAT total_items %"PRIu64"\r\n", mc_stats.total_items);
-	tbuf_printf(out, "STAT bytes %"PRIu64"\r\n", bytes_used);
-	tbuf_printf(out, "STAT curr_connections %"PRIu32"\r\n", mc_stats.curr_connections);
-	tbuf_printf(out, "STAT total_connections %"PRIu32"\r\n", mc_stats.total_connections);
-	tbuf_printf(out, "STAT connection_structures %"PRIu32"\r\n", mc_stats.curr_connections); /* lie a bit */
-	tbuf_printf(out, "STAT cmd_get %"PRIu64"\r\n", mc_stats.cmd_get);
-	tbuf_printf(out, "STAT cmd_set %"PRIu64"\r\n", mc_stats.cmd_set);
-	tbuf_printf(out, "STAT get_hits %"PRIu64"\r\n", mc_stats.get_hits);
-	tbuf_printf(out, "STAT get_misses %"PRIu64"\r\n", mc_stats.get_misses);
-	tbuf_printf(out, "STAT evictions %"PRIu64"\r\n", mc_stats.evictions);
-	tbuf_printf(out, "STAT bytes_read %"PRIu64"\r\n", mc_stats.bytes_read);
-	tbuf_printf(out, "STAT bytes_written %"PRIu64"\r\n", mc_stats.bytes_written);
-	tbuf_printf(out, "STAT limit_maxbytes %"PRIu64"\r\n", (u64)(cfg.slab_alloc_arena * (1 << 30)));
-	tbuf_printf(out, "STAT threads 1\r\n");
+#define STAT(name, fmt, value) ({ snprintf(v, sizeof(v), fmt, value); cb(name, v, arg); })
+	STAT("pid", "%"PRIu32, (u32)getpid());
+	STAT("uptime", "%"PRIu32, (u32)tnt_uptime());
+	STAT("time", "%"PRIu32, (u32)ev_now());
+	STAT("version", "%s", "1.2.5 (octopus/(silver)box)");
+	STAT("pointer_size", "%zu", sizeof(void *)*8);
+	STAT("curr_items", "%"PRIu64, items);
+	STAT("total_items", "%"PRIu64, mc_stats.total_items);
+	STAT("bytes", "%"PRIu64, bytes_used);
+	STAT("curr_connections", "%"PRIu32, mc_stats.curr_connections);
+	STAT("total_connections", "%"PRIu32, mc_stats.total_connections);
+	STAT("connection_structures", "%"PRIu32, mc_stats.curr_connections); /* lie a bit */
+	STAT("cmd_get", "%"PRIu64, mc_stats.cmd_get);
+	STAT("cmd_set", "%"PRIu64, mc_stats.cmd_set);
+	STAT("get_hits", "%"PRIu64, mc_stats.get_hits);
+	STAT("get_misses", "%"PRIu64, mc_stats.get_misses);
+	STAT("evictions", "%"PRIu64, mc_stats.evictions);
+	STAT("expired", "%"PRIu64, mc_stats.expired);
+	STAT("expire_lag", "%"PRIu32, mc_stats.expire_lag);
+	STAT("bytes_read", "%"PRIu64, mc_stats.bytes_read);
+	STAT("bytes_written", "%"PRIu64, mc_stats.bytes_written);
+	STAT("limit_maxbytes", "%"PRIu64, (u64)(cfg.slab_alloc_arena * (1 << 30)));
+	STAT("threads", "%i", 1);
+#undef STAT
+}
+
+static void
+print_stat(const char *name, const char *value, void *arg)
+{
+	tbuf_printf(arg, "STAT %s %s\r\n", name, value);
+}
+
+void
+print_stats(struct netmsg_head *wbuf)
+{
+	struct tbuf *out = tbuf_alloc(wbuf->ctx->pool);
+	mc_stats_each(print_stat, out);
 	tbuf_printf(out, "END\r\n");
 
 	net_add_iov(wbuf, out->ptr, tbuf_len(out));
@@ -464,89 +591,287 @@ flush_all(va_list ap)
 	i32 delay = va_arg(ap, u32);
 	if (delay > ev_now())
 		fiber_sleep(delay - ev_now());
+	/* items without wheel link are deleted here. unlinked ghost is
+	   being stored right now: it is newer than flush */
+	struct tbuf *unlinked = tbuf_alloc(fiber->pool);
 	u32 slots = [mc_index slots];
 	for (u32 i = 0; i < slots; i++) {
 		struct tnt_object *obj = [mc_index get:i];
-		if (obj != NULL)
-			mc_obj(obj)->exptime = 1;
+		if (obj == NULL)
+			continue;
+		struct mc_obj *m = mc_obj(obj);
+		if (obj->flags & MC_LINKED) {
+			m->exptime = 1;
+			/* ghost is linked by store() once it's committed */
+			if (!object_ghost(obj))
+				mc_expire_link(&memc->wheel, obj);
+		} else if (!object_ghost(obj)) {
+			m->exptime = 1;
+			tbuf_append(unlinked, m->data, m->key_len);
+		}
+	}
+
+	char **keys = palloc(fiber->pool, cfg.memcached_expire_per_loop * sizeof(*keys));
+	const char *key = unlinked->ptr, *end = key + tbuf_len(unlinked);
+	while (key < end) {
+		/* key may be stored again while previous batch was written */
+		int k = 0;
+		for (; key < end && k < cfg.memcached_expire_per_loop; key += strlen(key) + 1) {
+			struct tnt_object *obj = [mc_index find:key];
+			if (obj && !object_ghost(obj) && mc_obj(obj)->exptime == 1)
+				keys[k++] = (char *)key;
+		}
+		if (k > 0)
+			delete(memc, keys, k);
 	}
 }
 
+/* connections are served by small pool of worker fibers: idle
+   connections cost nothing but netmsg_io. Worker takes connection
+   only when there is unprocessed input and runs at most MC_BATCH
+   requests from it. Replies of the whole batch are flushed by
+   single writev from writeall prepare callback */
+#define MC_BATCH 1024
+
+@interface memcached_conn : netmsg_io {
+@public
+	TAILQ_ENTRY(memcached_conn) processing_link;
+	LIST_ENTRY(memcached_conn) prepare_link;
+	Memcached *memc;
+	bool busy;	 /* owned by worker, input is not read meanwhile */
+	bool need_input; /* rbuf ends with incomplete request */
+}
+- (id)init:(int)fd_ memc:(Memcached *)memc_;
+@end
+
+static struct memcached_service {
+	struct netmsg_pool_ctx ctx;
+	TAILQ_HEAD(mc_tailq, memcached_conn) processing;
+	LIST_HEAD(, memcached_conn) prepare;
+	SLIST_HEAD(, Fiber) workers;
+	ev_prepare wakeup, writeall;
+} mc_service;
+
 static void
-memcached_handler(va_list ap)
+mc_schedule(struct memcached_conn *c)
 {
-	int fd = va_arg(ap, int);
-	Memcached *memc = va_arg(ap, Memcached *);
-	int r, p;
-	int batch_count;
+	if (c->busy || c->need_input || c->processing_link.tqe_prev != NULL)
+		return;
+	if (rbuf_len(c) == 0 || c->wbuf.bytes >= cfg.output_high_watermark)
+		return;
+	TAILQ_INSERT_TAIL(&mc_service.processing, c, processing_link);
+}
 
+static void
+mc_prepare_link(struct memcached_conn *c)
+{
+	if (c->prepare_link.le_prev == NULL)
+		LIST_INSERT_HEAD(&mc_service.prepare, c, prepare_link);
+}
+
+static void
+mc_write_cb(ev_io *ev, int events)
+{
+	struct memcached_conn *c = container_of(ev, struct memcached_conn, out);
+
+	netmsg_io_retain(c);
+	ssize_t r = netmsg_io_write_for_cb(ev, events);
+	if (r > 0)
+		mc_stats.bytes_written += r;
+	if (c->fd >= 0 && !c->busy && c->wbuf.bytes < cfg.output_low_watermark) {
+		/* output was stalled: resume input and pending requests */
+		if (c->need_input || rbuf_len(c) < cfg.input_low_watermark)
+			ev_io_start(&c->in);
+		mc_schedule(c);
+	}
+	netmsg_io_release(c);
+}
+
+@implementation memcached_conn
+- (id)
+init:(int)fd_ memc:(Memcached *)memc_
+{
+	netmsg_io_init(self, &mc_service.ctx, fd_);
+	ev_init(&out, mc_write_cb);
+	flags |= NETMSG_IO_SHARED_POOL;
+	memc = memc_;
 	mc_stats.total_connections++;
 	mc_stats.curr_connections++;
+	ev_io_start(&in);
+	return self;
+}
+
+- (void)
+data_ready
+{
+	/* worker will parse whole rbuf again */
+	need_input = false;
+	mc_schedule(self);
+}
+
+- (void)
+close
+{
+	if (fd < 0)
+		return;
+	mc_stats.curr_connections--;
+	if (processing_link.tqe_prev != NULL) {
+		TAILQ_REMOVE(&mc_service.processing, self, processing_link);
+		processing_link.tqe_prev = NULL;
+	}
+	if (prepare_link.le_prev != NULL) {
+		LIST_REMOVE(self, prepare_link);
+		prepare_link.le_prev = NULL;
+	}
+	[super close];
+	netmsg_io_release(self);
+}
+@end
 
-	static struct netmsg_pool_ctx ctx;
-	if (ctx.pool == NULL)
-		netmsg_pool_ctx_init(&ctx, "memcached_handler", 512 * 1024);
+static void
+mc_process(struct memcached_conn *c)
+{
+	int p = 1;
 
-	struct tbuf rbuf = TBUF(NULL, 0, fiber->pool);
-	struct netmsg_head wbuf;
-	netmsg_head_init(&wbuf, &ctx);
-	palloc_register_gc_root(fiber->pool, &rbuf, tbuf_gc);
+	netmsg_io_retain(c);
+	c->busy = true;
+	ev_io_stop(&c->in);
 
 	@try {
-		for (;;) {
-			batch_count = 0;
-			if (fiber_recv(fd, &rbuf) <= 0)
-				return;
-
-		dispatch:
-			p = memcached_dispatch(memc, fd, &rbuf, &wbuf);
-			if (p < 0) {
-				say_debug("negative dispatch, closing connection");
-				return;
-			}
+		for (int i = 0; i < MC_BATCH && rbuf_len(c) > 0 && c->fd >= 0; i++) {
+			/* binary and text requests may be freely mixed,
+			   binary ones always start with request magic */
+			if (*(u8 *)c->rbuf.ptr == 0x80)
+				p = memcached_binary_dispatch(c->memc, &c->rbuf, &c->wbuf);
+			else
+				p = memcached_dispatch(c->memc, &c->rbuf, &c->wbuf);
+			if (p <= 0 || c->wbuf.bytes >= cfg.output_high_watermark)
+				break;
+		}
+	}
+	@catch (Error *e) {
+		say_debug("got error %s", e->reason);
+		[e release];
+		p = -1;
+	}
 
-			if (p == 0 && batch_count == 0) /* we havn't successfully parsed any requests */
-				continue;
+	c->busy = false;
+	if (c->fd < 0)
+		goto out;
+
+	if (p < 0) {
+		say_debug("negative dispatch, closing connection");
+		ssize_t r = netmsg_writev(c->fd, &c->wbuf);
+		if (r > 0)
+			mc_stats.bytes_written += r;
+		[c close];
+		goto out;
+	}
 
-			if (p == 1) {
-				batch_count++;
-				/* some unparsed commands remain and batch count less than 20 */
-				if (tbuf_len(&rbuf) > 0 && batch_count < 20)
-					goto dispatch;
-			}
+	if (rbuf_len(c) == 0)
+		rbuf_ltrim(c, 0); /* release input buffer of idle connection */
+	c->need_input = p == 0;
+	mc_schedule(c);
+	mc_prepare_link(c);
+out:
+	netmsg_io_release(c);
+}
 
-			mc_stats.bytes_written += wbuf.bytes;
-			r = fiber_writev(fd, &wbuf);
-			if (r < 0) {
-				say_debug("flush_output failed, closing connection");
-				return;
-			}
+static void
+memcached_worker(va_list ap __attribute__((unused)))
+{
+	for (;;) {
+		SLIST_INSERT_HEAD(&mc_service.workers, fiber, worker_link);
+		struct memcached_conn *c = yield();
+		mc_process(c);
+		fiber_gc();
+	}
+}
 
-			fiber_gc();
-			netmsg_pool_ctx_gc(&ctx);
+static void
+mc_wakeup_workers(ev_prepare *ev __attribute__((unused)))
+{
+	struct memcached_conn *c, *last = TAILQ_LAST(&mc_service.processing, mc_tailq);
+	/* connections requeued by workers will wait for next loop iteration */
+	while (last != NULL && !SLIST_EMPTY(&mc_service.workers)) {
+		c = TAILQ_FIRST(&mc_service.processing);
+		TAILQ_REMOVE(&mc_service.processing, c, processing_link);
+		c->processing_link.tqe_prev = NULL;
+
+		struct Fiber *w = SLIST_FIRST(&mc_service.workers);
+		SLIST_REMOVE_HEAD(&mc_service.workers, worker_link);
+		resume(w, c);
+		if (c == last)
+			break;
+	}
+	netmsg_pool_ctx_gc(&mc_service.ctx);
+}
 
-			if (p == 1 && tbuf_len(&rbuf) > 0) {
-				batch_count = 0;
-				goto dispatch;
-			}
+/* same as service_prepare_io() of iproto_service */
+static void
+mc_prepare_io(struct memcached_conn *c)
+{
+	if (c->busy)
+		return;
+
+	if (!c->need_input && rbuf_len(c) >= cfg.input_low_watermark)
+		ev_io_stop(&c->in);
+	else if (c->wbuf.bytes < cfg.output_low_watermark)
+		ev_io_start(&c->in);
+
+	if (c->wbuf.bytes > 0) {
+		ssize_t r = netmsg_writev(c->fd, &c->wbuf);
+		if (r < 0) {
+			say_syswarn("writev() to %s failed, closing connection",
+				    net_fd_name(c->fd));
+			[c close];
+			return;
 		}
+		mc_stats.bytes_written += r;
 	}
-	@catch (Error *e) {
-		say_debug("got error %s", e->reason);
-		[e release];
+
+	if (c->wbuf.bytes > 0) {
+		ev_io_start(&c->out);
+		if (c->wbuf.bytes >= cfg.output_high_watermark)
+			ev_io_stop(&c->in);
+	} else {
+		ev_io_stop(&c->out);
 	}
-	@finally {
-		netmsg_head_dealloc(&wbuf);
-		palloc_unregister_gc_root(fiber->pool, &rbuf);
-		close(fd);
-		mc_stats.curr_connections--;
+}
+
+static void
+mc_write_data(ev_prepare *ev __attribute__((unused)))
+{
+	struct memcached_conn *c, *tmp;
+	LIST_FOREACH_SAFE(c, &mc_service.prepare, prepare_link, tmp) {
+		LIST_REMOVE(c, prepare_link);
+		c->prepare_link.le_prev = NULL;
+		netmsg_io_retain(c);
+		mc_prepare_io(c);
+		netmsg_io_release(c);
 	}
 }
 
 static void
 memcached_accept(int fd, void *data)
 {
-	fiber_create("memcached/handler", memcached_handler, fd, data);
+	[[memcached_conn alloc] init:fd memc:data];
+}
+
+static void
+memcached_service_init(void)
+{
+	netmsg_pool_ctx_init(&mc_service.ctx, "memcached", 2 * 1024 * 1024);
+	TAILQ_INIT(&mc_service.processing);
+
+	ev_prepare_init(&mc_service.wakeup, (void *)mc_wakeup_workers);
+	ev_prepare_start(&mc_service.wakeup);
+	ev_prepare_init(&mc_service.writeall, (void *)mc_write_data);
+	ev_set_priority(&mc_service.writeall, -2);
+	ev_prepare_start(&mc_service.writeall);
+
+	for (int i = 0; i < cfg.memcached_workers; i++)
+		fiber_create("memcached/worker", memcached_worker);
 }
 
 static void
@@ -559,6 +884,7 @@ init_second_stage(va_list ap)
 
 	assert(memc);
 
+	memcached_service_init();
 	if (fiber_create("memcached/acceptor", tcp_server, cfg.primary_addr,
 			 memcached_accept, NULL, memc) == NULL)
 	{
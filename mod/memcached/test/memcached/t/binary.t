@@ -0,0 +1,98 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 17;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+use constant {
+    CMD_GET   => 0x00,
+    CMD_SET   => 0x01,
+    CMD_INCR  => 0x05,
+    CMD_NOOP  => 0x0a,
+    CMD_GETKQ => 0x0d,
+
+    ERR_OK     => 0x00,
+    ERR_ENOENT => 0x01,
+};
+
+sub bin_request {
+    my ($cmd, $key, $val, $opaque, $extra) = @_;
+    $key = '' unless defined $key;
+    $val = '' unless defined $val;
+    $extra = '' unless defined $extra;
+    my $body_len = length($extra) + length($key) + length($val);
+    return pack("CCnCCnNNNN", 0x80, $cmd, length($key), length($extra), 0, 0,
+                $body_len, $opaque, 0, 0) . $extra . $key . $val;
+}
+
+sub bin_response {
+    my $hdr = '';
+    while (length($hdr) < 24) {
+        my $n = read($sock, $hdr, 24 - length($hdr), length($hdr));
+        return undef unless $n;
+    }
+    my ($magic, $cmd, $key_len, $extra_len, $type, $status, $body_len, $opaque) =
+        unpack("CCnCCnNN", $hdr);
+    my $body = '';
+    while (length($body) < $body_len) {
+        my $n = read($sock, $body, $body_len - length($body), length($body));
+        return undef unless $n;
+    }
+    return { magic => $magic, cmd => $cmd, status => $status, opaque => $opaque,
+             extra => substr($body, 0, $extra_len),
+             key => substr($body, $extra_len, $key_len),
+             val => substr($body, $extra_len + $key_len) };
+}
+
+sub bin_set {
+    my ($key, $val, $flags, $exptime) = @_;
+    print $sock bin_request(CMD_SET, $key, $val, 0, pack("NN", $flags, $exptime));
+    my $r = bin_response();
+    is($r->{status}, ERR_OK, "set $key");
+}
+
+bin_set("foo", "fooval", 5, 0);
+bin_set("bar", "barval", 7, 0);
+
+# quiet gets are answered only on hit, noop flushes the pipeline
+print $sock bin_request(CMD_GETKQ, "foo", undef, 1) .
+            bin_request(CMD_GETKQ, "missing", undef, 2) .
+            bin_request(CMD_GETKQ, "bar", undef, 3) .
+            bin_request(CMD_NOOP, undef, undef, 4);
+
+my $r = bin_response();
+is($r->{opaque}, 1, "getkq foo answered first");
+is($r->{key}, "foo", "getkq foo key");
+is($r->{val}, "fooval", "getkq foo value");
+is(unpack("N", $r->{extra}), 5, "getkq foo flags");
+
+$r = bin_response();
+is($r->{opaque}, 3, "getkq missing is quiet");
+is($r->{key}, "bar", "getkq bar key");
+is($r->{val}, "barval", "getkq bar value");
+
+$r = bin_response();
+is($r->{cmd}, CMD_NOOP, "noop ends pipeline");
+is($r->{opaque}, 4, "noop opaque");
+is($r->{status}, ERR_OK, "noop status");
+
+# incr of missing key creates it, exptime up to 30 days is relative
+print $sock bin_request(CMD_INCR, "cnt", undef, 5, pack("NNNNN", 0, 1, 0, 10, 1));
+$r = bin_response();
+is($r->{status}, ERR_OK, "incr created cnt");
+is(unpack("N", substr($r->{val}, 4)), 10, "incr initial value");
+
+print $sock bin_request(CMD_GET, "cnt", undef, 6);
+$r = bin_response();
+is($r->{status}, ERR_OK, "cnt is not expired yet");
+is($r->{val}, "10", "cnt value");
+
+sleep(2.5);
+print $sock bin_request(CMD_GET, "cnt", undef, 7);
+$r = bin_response();
+is($r->{status}, ERR_ENOENT, "cnt expired");
@@ -1,7 +1,7 @@
 #!/usr/bin/perl
 
 use strict;
-use Test::More tests => 14;
+use Test::More tests => 24;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -42,3 +42,25 @@ is(scalar <$sock>, "STORED\r\n", "stored foo = '1234'");
 mem_get_is($sock, "foo", '1234');
 sleep(2.2);
 mem_get_is($sock, "foo", undef);
+
+# items with and without exptime are flushed, memory of both is released
+my $items = mem_stats($sock)->{curr_items};
+print $sock "set plain 0 0 5\r\nplain\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored plain");
+print $sock "set timed 0 100 5\r\ntimed\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored timed");
+print $sock "flush_all\r\n";
+is(scalar <$sock>, "OK\r\n", "did flush_all");
+mem_get_is($sock, "plain", undef);
+mem_get_is($sock, "timed", undef);
+sleep(2.2);
+is(mem_stats($sock)->{curr_items}, $items, "flushed items are released");
+
+# item without exptime survives expiration of its neighbour
+print $sock "set plain 0 0 5\r\nplain\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored plain");
+print $sock "set timed 0 1 5\r\ntimed\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored timed");
+sleep(2.2);
+mem_get_is($sock, "plain", "plain");
+mem_get_is($sock, "timed", undef);
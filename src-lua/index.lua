@@ -11,6 +11,7 @@ local type = type
 local tostring = tostring
 local format = string.format
 local select = select
+local unpack = unpack
 local pcall = pcall
 local table = table
 local assertarg = assertarg
@@ -44,6 +45,7 @@ local iterator_init_with_object_direction = objc.msg_lookup("iterator_init_with_
 local iterator_next = objc.msg_lookup("iterator_next")
 local position_with_node = objc.msg_lookup("position_with_node:")
 local position_with_object = objc.msg_lookup("position_with_object:")
+local count_from_node = objc.msg_lookup("count_from_node:to_node:")
 -- hash index methods
 local get = objc.msg_lookup('get:')
 local cur_iter = objc.msg_lookup('cur_iter')
@@ -51,6 +53,7 @@ local iterator_init_pos = objc.msg_lookup('iterator_init_pos:')
 
 local maxnodesize = ffi.sizeof('struct index_node') + 8 * ffi.sizeof('union index_field')
 local node = ffi.cast('struct index_node *', ffi.C.malloc(maxnodesize))
+local from_node = ffi.cast('struct index_node *', ffi.C.malloc(maxnodesize))
 local strbuf = ffi.new('char[?]', 5 + 0xffff)
 gen = {node = node, strbuf = strbuf}
 
@@ -351,6 +354,21 @@ local postree_mt = {
             else
                 error('bad call to index:position')
             end
+        end,
+        -- number of entries with from <= key <= to, from and to are (partial) keys:
+        -- scalar or table of key fields, nil is unbounded. index owner may override
+        -- __count to skip entries hidden by __visible
+        count = function (self, from, to)
+            local from_ptr, to_ptr = nil, nil
+            if from ~= nil then
+                local node = type(from) == 'table' and self:packnode(unpack(from)) or self:packnode(from)
+                ffi.copy(from_node, node, maxnodesize)
+                from_ptr = from_node
+            end
+            if to ~= nil then
+                to_ptr = type(to) == 'table' and self:packnode(unpack(to)) or self:packnode(to)
+            end
+            return tonumber(ffi.cast(uint32_t, self.__count(self.__ptr, from_ptr, to_ptr)))
         end
     },
     __tostring = basic_mt.__tostring
@@ -380,7 +398,8 @@ local function proxy(index)
                 __packnode = gen_packnode(index),
                 __switchcnt = 0,
                 __field_indexes = {},
-                __visible = visible
+                __visible = visible,
+                __count = count_from_node
               }
     for i=1,index.conf.cardinality do
         p.__field_indexes[i] = tonumber(index.conf.field[i-1].index)
@@ -57,7 +57,7 @@ pub struct Row {
     _data: RowData,
 }
 
-const ROW_LAYOUT : Layout = unsafe { Layout::from_size_align_unchecked(46, 16) };
+pub(super) const ROW_LAYOUT : Layout = unsafe { Layout::from_size_align_unchecked(46, 16) };
 
 
 pub struct BoxRow {
@@ -42,9 +42,11 @@ use super::*;
 const DEFAULT_COOKIE : u64 = 0;
 const DEFAULT_VERSION : u32 = 12;
 const V12 : &'static str = "0.12\n";
+const V12_LZ4 : &'static str = "0.12lz4\n";
 const INPROGRESS_SUFFIX : &'static str = ".inprogress";
 const MARKER : u32 = 0xba0babed;
 const EOF_MARKER : u32 = 0x10adab1e;
+const LZ4_BLOCK_MARKER : u32 = 0xb10cba5e;
 
 pub fn read_headers(reader: &mut BufReader<File>) -> io::Result<Vec<String>> {
     let mut vec = Vec::new();
@@ -60,8 +62,17 @@ pub fn read_headers(reader: &mut BufReader<File>) -> io::Result<Vec<String>> {
     }
 }
 
+// decompressed content of LZ4 blocks: stream of v12 rows,
+// row may span block boundary
+struct Lz4Blocks {
+    buf: Vec<u8>,
+    pos: usize,
+    eof: bool,
+}
+
 pub struct XlogReader {
     io: BufReader<File>,
+    lz4: Option<Lz4Blocks>,
 //    filename: PathBuf, // DUP?
     stat: ev::Stat,
 
@@ -204,10 +215,103 @@ impl XlogWriter {
     }
 }
 
+impl Lz4Blocks {
+    fn new() -> Self {
+        Self { buf: Vec::new(), pos: 0, eof: false }
+    }
+
+    fn read_block(&mut self, io: &mut BufReader<File>) -> Result<()> {
+        let marker = io.read_u32::<LittleEndian>().context("reading block marker")?;
+
+        match marker {
+            LZ4_BLOCK_MARKER => (),
+            EOF_MARKER => {
+                self.eof = true;
+                return Ok(())
+            },
+            _ => bail!("invalid block marker: expected 0x{:08x}, got 0x{:08x}", LZ4_BLOCK_MARKER, marker)
+        }
+
+        let mut header = [0; 16];
+        io.read_exact(&mut header).context("reading block header")?;
+
+        let header_crc32c = (&header[0..4]).read_u32::<LittleEndian>().unwrap();
+        if crc32c(&header[4..]) != header_crc32c {
+            bail!("block header crc32c mismatch: expected 0x{:08x}, calculated 0x{:08x}",
+                  header_crc32c, crc32c(&header[4..]));
+        }
+        let len = (&header[4..8]).read_u32::<LittleEndian>().unwrap() as usize;
+        let raw_len = (&header[8..12]).read_u32::<LittleEndian>().unwrap() as usize;
+        let data_crc32c = (&header[12..16]).read_u32::<LittleEndian>().unwrap();
+
+        let mut data = vec![0; len];
+        io.read_exact(&mut data).context("reading block")?;
+        if crc32c(&data) != data_crc32c {
+            bail!("block data crc32c mismatch: expected 0x{:08x}, calculated 0x{:08x}",
+                  data_crc32c, crc32c(&data));
+        }
+
+        self.buf.drain(..self.pos);
+        self.pos = 0;
+        let start = self.buf.len();
+        self.buf.resize(start + raw_len, 0);
+
+        let n = unsafe {
+            extern {
+                fn LZ4_decompress_safe(source: *const libc::c_char, dest: *mut libc::c_char,
+                                       compressed_size: libc::c_int, max_decompressed_size: libc::c_int) -> libc::c_int;
+            }
+            LZ4_decompress_safe(data.as_ptr() as *const _, self.buf[start..].as_mut_ptr() as *mut _,
+                                len as libc::c_int, raw_len as libc::c_int)
+        };
+        if n < 0 || n as usize != raw_len {
+            bail!("block decompression failed")
+        }
+        Ok(())
+    }
+
+    // returns false on clean EOF
+    fn fill(&mut self, io: &mut BufReader<File>, len: usize) -> Result<bool> {
+        while self.buf.len() - self.pos < len {
+            if self.eof {
+                if self.buf.len() != self.pos {
+                    bail!("truncated row at the end of file")
+                }
+                return Ok(false)
+            }
+            self.read_block(io)?;
+        }
+        Ok(true)
+    }
+
+    fn read_row(&mut self, io: &mut BufReader<File>) -> Result<Option<BoxRow>> {
+        let header_size = mem::size_of_val(&MARKER) + ROW_LAYOUT.size();
+        if !self.fill(io, header_size)? {
+            return Ok(None)
+        }
+
+        let header = &self.buf[self.pos..self.pos + header_size];
+        let marker = (&header[0..4]).read_u32::<LittleEndian>().unwrap();
+        if marker != MARKER {
+            bail!("invalid row marker: expected 0x{:08x}, got 0x{:08x}", MARKER, marker)
+        }
+        let len = (&header[header_size - 8..]).read_u32::<LittleEndian>().unwrap() as usize;
+
+        if !self.fill(io, header_size + len)? {
+            bail!("unexpected EOF")
+        }
+        let mut row_buf = &self.buf[self.pos + 4..self.pos + header_size + len];
+        let row = Row::read(&mut row_buf)?;
+        self.pos += header_size + len;
+        Ok(Some(row))
+    }
+}
+
 impl XlogReader {
     fn new(io: BufReader<File>) -> Self {
         Self {
             io,
+            lz4: None,
             stat: ev::Stat::new(),
         }
     }
@@ -230,6 +334,10 @@ impl XlogReader {
 
     #[allow(deprecated)]
     pub fn read_row(&mut self) -> Result<Option<BoxRow>> {
+        if let Some(lz4) = &mut self.lz4 {
+            return lz4.read_row(&mut self.io)
+        }
+
         let marker = self.io.read_u32::<LittleEndian>().context("reading row_magic")?;
 
         match marker {
@@ -254,7 +362,7 @@ impl XLog {
             bail!("unexpected EOF");
         }
 
-        if buf != "XLOG\n" {
+        if buf != "XLOG\n" && buf != "SNAP\n" {
             bail!("invalid filetype")
         }
 
@@ -264,14 +372,19 @@ impl XLog {
             bail!("unexpected EOF");
         }
 
-        if buf != V12 {
+        if buf != V12 && buf != V12_LZ4 {
             bail!("invalid version")
         }
 
         let headers = read_headers(&mut reader).context("reading headers")?;
 
+        let mut reader = XlogReader::new(reader);
+        if buf == V12_LZ4 {
+            reader.lz4 = Some(Lz4Blocks::new());
+        }
+
         Ok(Self {
-            io: IO::Read(XlogReader::new(reader)),
+            io: IO::Read(reader),
             filename: filename.into(),
             dir: Rc::new(XLogDir::new_dummy()?),
 
@@ -170,6 +170,11 @@ impl XLogDir {
         Ok(files.last().map(|(lsn, _)| *lsn))
     }
 
+    fn next_lsn(&self, lsn: i64) -> io::Result<Option<i64>> {
+        let files = self.scan_dir()?;
+        Ok(files.iter().map(|(file_lsn, _)| *file_lsn).find(|file_lsn| *file_lsn > lsn))
+    }
+
     fn find_with_lsn(&self, lsn: i64) -> io::Result<Option<(i64, PathBuf)>> {
         let files = self.scan_dir()?;
         Ok(find(&files, lsn).cloned())
@@ -264,6 +269,18 @@ mod xlog_dir_ffi {
         }
     }
 
+    #[no_mangle]
+    unsafe extern "C" fn xlog_dir_next_lsn(dir: *const XLogDir, lsn: i64) -> i64 {
+        match (*dir).next_lsn(lsn) {
+            Ok(None) => 0,
+            Ok(Some(lsn)) => lsn,
+            Err(e) => {
+                warn!("next_lsn: {}", e);
+                -1
+            }
+        }
+    }
+
     fn open_for_read(caller: &str, dir: *const XLogDirObjc, find: &dyn Fn() -> io::Result<Option<(i64, PathBuf)>>) -> *mut XLogObjc {
         extern {
             fn xlog_dir_open_for_read(dir: *const XLogDirObjc , lsn: i64, filename: *const c_char) -> *mut XLogObjc;
@@ -347,4 +364,13 @@ mod xlog_dir_tests {
         let a = XLogDir::new_waldir(&path, objc_dir).unwrap();
         assert_eq!(a.greatest_lsn().unwrap(), Some(150));
     }
+
+    #[test]
+    fn test_next_lsn() {
+        let path = Path::new("testdata");
+        let a = XLogDir::new_waldir(&path, objc_dir).unwrap();
+        assert_eq!(a.next_lsn(0).unwrap(), Some(2));
+        assert_eq!(a.next_lsn(20).unwrap(), Some(30));
+        assert_eq!(a.next_lsn(150).unwrap(), None);
+    }
 }
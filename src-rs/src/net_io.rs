@@ -279,6 +279,19 @@ impl Msg {
         }
     }
 
+    fn copyout(&mut self, dst: *mut u8) -> usize {
+        let mut off = 0;
+        for n in &self.node {
+            for iov in &n.iov {
+                unsafe { ptr::copy_nonoverlapping(iov.iov_base as *const u8, dst.add(off), iov.iov_len) };
+                off += iov.iov_len;
+            }
+        }
+        debug_assert_eq!(off, self.bytes);
+        self.clear();
+        off
+    }
+
     fn writev(&mut self, fd: i32) -> isize {
         if self.bytes == 0 {
             return 0;
@@ -432,6 +445,11 @@ unsafe extern "C" fn netmsg_writev(fd: c_int, msg: *mut Msg) -> ssize_t {
     (*msg).writev(fd)
 }
 
+#[no_mangle]
+unsafe extern "C" fn netmsg_copyout(msg: *mut Msg, dst: *mut c_void) -> usize {
+    (*msg).copyout(dst as *mut u8)
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -489,6 +507,23 @@ mod tests {
         assert_eq!(tail_node, &**msg.node.back().unwrap());
     }
 
+    #[test]
+    fn test_copyout() {
+        let ctx = PoolCtx::new("test_ctx".as_ptr() as *const _, 64 * 1024);
+        let ctx = unsafe { &*(&ctx as *const _) };
+        let mut msg = Msg::new(&ctx);
+        let v: Vec<u8> = (0..200).collect();
+
+        for i in 0..100 {
+            msg.add(v[i * 2..].as_ptr() as *const _, 1);
+        }
+        let mut out = vec![0u8; msg.bytes];
+        assert_eq!(100, msg.copyout(out.as_mut_ptr()));
+        assert_eq!(0, msg.bytes);
+        assert!(msg.node.is_empty());
+        assert!(out.iter().enumerate().all(|(i, &x)| x as usize == i * 2));
+    }
+
     #[test]
     fn test_drop() {
         let ctx = PoolCtx::new("test_ctx".as_ptr() as *const _, 64 * 1024);
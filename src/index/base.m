@@ -42,6 +42,7 @@
 new_conf:(const struct index_conf *)ic dtor:(const struct dtor_conf *)dc
 {
 	Index *i;
+	bool group = ic->hash_layout == HASH_LAYOUT_GROUP;
 	if (ic->cardinality == 1 && ic->type == NUMHASH) {
 		if (ic->unique == false)
 			index_raise("NUMHASH index must be unique");
@@ -53,11 +54,11 @@ new_conf:(const struct index_conf *)ic dtor:(const struct dtor_conf *)dc
 		case UNUM16:
 		case SNUM32:
 		case UNUM32:
-			i = [Int32Hash alloc];
+			i = group ? [Int32GroupHash alloc] : [Int32Hash alloc];
 			break;
 		case SNUM64:
 		case UNUM64:
-			i = [Int64Hash alloc];
+			i = group ? [Int64GroupHash alloc] : [Int64Hash alloc];
 			break;
 		default:
 			abort();
@@ -65,7 +66,10 @@ new_conf:(const struct index_conf *)ic dtor:(const struct dtor_conf *)dc
 	} else if (ic->type == HASH || ic->type == PHASH) {
 		if (ic->unique == false)
 			return nil;
-		i = ic->type == HASH ? [GenHash alloc] : [PHash alloc];
+		if (ic->type == PHASH)
+			i = [PHash alloc];
+		else
+			i = group ? [GenGroupHash alloc] : [GenHash alloc];
 	} else if (ic->type == SPTREE) {
 		i = [SPTree alloc];
 	} else if (ic->type == FASTTREE) {
@@ -218,6 +222,17 @@ find:(const char *)key
 	return [(id<BasicIndex>)self find_node: &node_a];
 }
 
+- (u32)
+find_keys:(struct tbuf *)key_data count:(u32)count result:(struct tnt_object **)obj
+{
+	u32 n;
+	for (n = 0; n < count && index_peek_cardinality(key_data) == conf.cardinality; n++) {
+		u32 c = read_u32(key_data);
+		obj[n] = [(id<BasicIndex>)self find_key:key_data cardinalty:c];
+	}
+	return n;
+}
+
 - (u32)
 size
 {
@@ -696,6 +696,10 @@ index_conf_validate(struct index_conf *d)
 		//index_raise("index_conf.unique is not bool");
 	if (d->unique == false && (d->type == HASH || d->type == NUMHASH || d->type == PHASH))
 		index_raise("hash index should be unique");
+	if (d->hash_layout < 0 || d->hash_layout >= MAX_HASH_LAYOUT)
+		index_raise("index_conf.hash_layout is invalid");
+	if (d->hash_layout != HASH_LAYOUT_DEFAULT && d->type != HASH && d->type != NUMHASH)
+		index_raise("index_conf.hash_layout is valid only for HASH and NUMHASH");
 
 	for (int k = 0; k < d->cardinality; k++) {
 		d->fill_order[k] = k;
@@ -739,7 +743,7 @@ void
 index_conf_read(struct tbuf *data, struct index_conf *c)
 {
 	char version = read_i8(data);
-	if (version != 0x10)
+	if (version != 0x10 && version != 0x11)
 		index_raise("index_conf bad version");
 
 	c->cardinality = read_u8(data);
@@ -754,6 +758,7 @@ index_conf_read(struct tbuf *data, struct index_conf *c)
 		c->field[i].sort_order = read_i8(data);
 		c->field[i].type = read_i8(data);
 	}
+	c->hash_layout = version >= 0x11 ? read_i8(data) : HASH_LAYOUT_DEFAULT;
 }
 
 static const char *
@@ -772,6 +777,17 @@ index_type(enum index_type t)
 	assert(false);
 }
 
+static const char *
+index_hash_layout(enum index_hash_layout l)
+{
+	switch (l) {
+	case HASH_LAYOUT_DEFAULT: return "DEFAULT";
+	case HASH_LAYOUT_GROUP: return "GROUP";
+	case MAX_HASH_LAYOUT: break;
+	}
+	assert(false);
+}
+
 static const char *
 index_field_type(enum index_field_type t)
 {
@@ -808,12 +824,15 @@ index_conf_print(struct tbuf *out, const struct index_conf *c)
 		tbuf_printf(out, " field%i:{index:%i type:%s sort:%s}", i,
 			    c->field[i].index, index_field_type(c->field[i].type),
 			    index_sort_order(c->field[i].sort_order));
+	if (c->hash_layout != HASH_LAYOUT_DEFAULT)
+		tbuf_printf(out, " hash_layout:%s", index_hash_layout(c->hash_layout));
 }
 
 void
 index_conf_write(struct tbuf *data, struct index_conf *c)
 {
-	char version = 0x10;
+	/* 0x11 is written only if it's needed: older versions can read the rest */
+	char version = c->hash_layout == HASH_LAYOUT_DEFAULT ? 0x10 : 0x11;
 	write_i8(data, version);
 
 	write_i8(data, c->cardinality);
@@ -825,6 +844,8 @@ index_conf_write(struct tbuf *data, struct index_conf *c)
 		write_i8(data, c->field[i].sort_order);
 		write_i8(data, c->field[i].type);
 	}
+	if (version >= 0x11)
+		write_i8(data, c->hash_layout);
 }
 
 
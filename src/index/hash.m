@@ -26,6 +26,7 @@
 
 #import <util.h>
 #import <fiber.h>
+#import <palloc.h>
 #import <iproto.h>
 #import <index.h>
 #import <pickle.h>
@@ -68,6 +69,27 @@ typedef const void* cstr;
 #include <mhash.h>
 
 
+/* same as above with Swiss table style group probing */
+#define mh_group_map 1
+#define mh_name _i32g
+#define mh_slot_t struct index_node
+#define mh_slot_key(h, slot) (slot)->key.u32
+#define mh_slot_val(slot) (slot)->obj
+#define mh_slot_size(h) (sizeof(void *) + sizeof(u32))
+#define mh_slot mh_var_slot
+#include <mhash.h>
+
+#define mh_group_map 1
+#define mh_name _i64g
+#define mh_slot_t struct index_node
+#define mh_slot_key(h, slot) (slot)->key.u64
+#define mh_slot_val(slot) (slot)->obj
+#define mh_slot_size(h) (sizeof(void *) + sizeof(u64))
+#define mh_slot mh_var_slot
+#define mh_hash(h, a) ({ (uint32_t)((a)>>33^(a)^(a)<<11); })
+#include <mhash.h>
+
+
 #include <third_party/murmur_hash2.c>
 #define mh_name _cstr
 #define mh_slot_t struct index_node
@@ -153,6 +175,12 @@ replace:(struct tnt_object *)obj					\
 	struct index_node *node_ = GET_NODE(obj, node_a);		\
         mh_##type##_sput(h, (void *)node_, NULL);			\
 }									\
+- (void)								\
+bulk_insert:(struct tnt_object *)obj					\
+{									\
+	struct index_node *node_ = GET_NODE(obj, node_a);		\
+	mh_##type##_sput_new(h, (void *)node_);				\
+}									\
 - (int)									\
 remove:(struct tnt_object *)obj						\
 {									\
@@ -209,115 +237,123 @@ ordered_iterator_init							\
 }									\
 - (u32) size { return mh_size(h); }					\
 - (u32) slots { return mh_end(h); }					\
+- (u32) generation { return h->generation; }				\
 - (size_t) bytes { return mh_##type##_bytes(h); }
 
-
-@implementation Int32Hash
-DEFINE_METHODS(i32)
-
-- (int)
-eq:(struct tnt_object *)obj_a :(struct tnt_object *)obj_b
-{
-	struct index_node node_b;
-	struct index_node *na = GET_NODE(obj_a, node_a),
-			  *nb = GET_NODE(obj_b, node_b);
-	return na->key.u32 == nb->key.u32;
+/* hash all keys and prefetch their buckets, then probe:
+   bucket loads of the whole batch overlap instead of missing one by one */
+#define DEFINE_FIND_KEYS(type, key_t, read_key)				\
+- (u32)									\
+find_keys:(struct tbuf *)key_data count:(u32)count result:(struct tnt_object **)obj \
+{									\
+	key_t key[INDEX_FIND_BATCH];					\
+	unsigned hash[INDEX_FIND_BATCH];				\
+	u32 n;								\
+	count = MIN(count, INDEX_FIND_BATCH);				\
+	for (n = 0; n < count && index_peek_cardinality(key_data) == 1; n++) { \
+		read_u32(key_data);					\
+		key[n] = read_key;					\
+		hash[n] = mh_##type##_prefetch(h, key[n]);		\
+	}								\
+	for (u32 i = 0; i < n; i++) {					\
+		u32 k = mh_##type##_get_hashed(h, key[i], hash[i]);	\
+		obj[i] = k != mh_end(h) ? mh_##type##_value(h, k) : NULL; \
+	}								\
+	return n;							\
 }
 
-- (struct tnt_object *)
-find_key:(struct tbuf *)key_data cardinalty:(u32)key_cardinality
+static i32
+read_i32_key(struct tbuf *key_data)
 {
-        if (key_cardinality != 1)
-		index_raise("hashed key has cardinality != 1");
-	u32 key_size = read_u8(key_data); /* key_size is actually varint */
-	if (key_size != sizeof(i32))
+	if (read_u8(key_data) != sizeof(i32)) /* key_size is actually varint */
 		index_raise("key is not i32");
-
-	i32 num = read_u32(key_data);
-
-        u32 k = mh_i32_get(h, num);
-        if (k != mh_end(h))
-		return mh_i32_value(h, k);
-	return NULL;
+	return read_u32(key_data);
 }
 
-- (struct tnt_object *)
-find:(const char *)key
+static i64
+read_i64_key(struct tbuf *key_data)
 {
-	i32 num = *(i32 *)key;
-	u32 k = mh_i32_get(h, num);
-	if (k != mh_end(h))
-		return mh_i32_value(h, k);
-	return NULL;
+	if (read_u8(key_data) != sizeof(i64))
+		index_raise("key is not i64");
+	return read_u64(key_data);
 }
 
-- (void)
-iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality
+/* iterator_init_with_key: reads key size as varint */
+static i32
+read_i32_iter_key(struct tbuf *key_data)
 {
-	if (cardinality != 1)
-		index_raise("cardinality too big");
-	u32 len = read_varint32(key_data);
-	if (len != sizeof(i32))
+	if (read_varint32(key_data) != sizeof(i32))
 		index_raise("key is not u32");
-	iter = mh_i32_get(h, read_u32(key_data));
+	return read_u32(key_data);
 }
 
-@end
-
-@implementation Int64Hash
-DEFINE_METHODS(i64)
-
-- (int)
-eq:(struct tnt_object *)obj_a :(struct tnt_object *)obj_b
-{
-	struct index_node node_b;
-	struct index_node *na = GET_NODE(obj_a, node_a),
-			  *nb = GET_NODE(obj_b, node_b);
-	return na->key.u64 == nb->key.u64;
-}
-
-- (struct tnt_object *)
-find_key:(struct tbuf *)key_data cardinalty:(u32)key_cardinality
+static i64
+read_i64_iter_key(struct tbuf *key_data)
 {
-        if (key_cardinality != 1)
-                index_raise("hashed key has cardinality != 1");
-	u32 key_size = read_u8(key_data); /* key_size is actually varint */
-	if (key_size != sizeof(i64))
+	if (read_varint32(key_data) != sizeof(i64))
 		index_raise("key is not i64");
+	return read_u64(key_data);
+}
 
-	i64 num = read_u64(key_data);
 
-        u32 k = mh_i64_get(h, num);
-        if (k != mh_end(h))
-		return mh_i64_value(h, k);
-	return NULL;
+#define DEFINE_NUM_METHODS(type, key_t, field)				\
+DEFINE_METHODS(type)							\
+DEFINE_FIND_KEYS(type, key_t, read_##key_t##_key(key_data))		\
+- (int)									\
+eq:(struct tnt_object *)obj_a :(struct tnt_object *)obj_b		\
+{									\
+	struct index_node node_b;					\
+	struct index_node *na = GET_NODE(obj_a, node_a),		\
+			  *nb = GET_NODE(obj_b, node_b);		\
+	return na->key.field == nb->key.field;				\
+}									\
+- (struct tnt_object *)							\
+find_key:(struct tbuf *)key_data cardinalty:(u32)key_cardinality	\
+{									\
+	if (key_cardinality != 1)					\
+		index_raise("hashed key has cardinality != 1");		\
+	key_t num = read_##key_t##_key(key_data);			\
+	u32 k = mh_##type##_get(h, num);				\
+	if (k != mh_end(h))						\
+		return mh_##type##_value(h, k);				\
+	return NULL;							\
+}									\
+- (struct tnt_object *)							\
+find:(const char *)key							\
+{									\
+	key_t num = *(key_t *)key;					\
+	u32 k = mh_##type##_get(h, num);				\
+	if (k != mh_end(h))						\
+		return mh_##type##_value(h, k);				\
+	return NULL;							\
+}									\
+- (void)								\
+iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality \
+{									\
+	if (cardinality != 1)						\
+		index_raise("cardinality too big");			\
+	iter = mh_##type##_get(h, read_##key_t##_iter_key(key_data)); \
 }
 
-- (struct tnt_object *)
-find:(const char *)key
-{
-	i64 num = *(i64 *)key;
-	u32 k = mh_i64_get(h, num);
-	if (k != mh_end(h))
-		return mh_i64_value(h, k);
-	return NULL;
-}
+@implementation Int32Hash
+DEFINE_NUM_METHODS(i32, i32, u32)
+@end
 
-- (void)
-iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality
-{
-	if (cardinality != 1)
-		index_raise("cardinality too big");
-	u32 len = read_varint32(key_data);
-	if (len != sizeof(i64))
-		index_raise("key is not i64");
-	iter = mh_i64_get(h, read_u64(key_data));
-}
+@implementation Int64Hash
+DEFINE_NUM_METHODS(i64, i64, u64)
+@end
+
+@implementation Int32GroupHash
+DEFINE_NUM_METHODS(i32g, i32, u32)
+@end
 
+@implementation Int64GroupHash
+DEFINE_NUM_METHODS(i64g, i64, u64)
 @end
 
 @implementation CStringHash
 DEFINE_METHODS(cstr)
+DEFINE_FIND_KEYS(cstr, cstr, read_field(key_data))
 
 - (id)
 init:(void *)ic
@@ -371,6 +407,18 @@ iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality
 
 @end
 
+static const struct index_node *
+gen_hash_node_a(Index *hs, tnt_ptr ptr)
+{
+	hs->dtor(tnt_ptr2obj(ptr), &hs->node_a, hs->dtor_arg);
+	return &hs->node_a;
+}
+
+#define gen_hash_slot_key_eq(hs, ptr, key) ({				\
+		hs->dtor(tnt_ptr2obj(ptr), &hs->search_pattern, hs->dtor_arg); \
+		hs->eq(key, &hs->search_pattern, &hs->conf);		\
+		})
+
 #define mh_byte_map 1
 #define mh_may_skip 1
 #define mh_neighbors 2
@@ -393,15 +441,11 @@ typedef struct gen_slot gen_slot_t;
 #define mh_dirty(h, i)        (mh_slot(h, i)->collision)
 #define mh_setdirty(h, i)     mh_slot(h, i)->collision = 1
 #define mh_slot_copy(h, a, b) (a)->ptr = (b)->ptr
-#define mh_arg_t GenHash*
+#define mh_arg_t Index*
 
 static const struct index_node* gen_hash_slot_key(struct mh_gen_t const * h, gen_slot_t const * slot);
 #define mh_slot_key(h, slot) gen_hash_slot_key(h, slot)
-#define mh_slot_key_eq(h, i, key) ({ \
-		GenHash *hs = (h)->arg; \
-		hs->dtor(tnt_ptr2obj(mh_slot(h, i)->ptr), &hs->search_pattern, hs->dtor_arg); \
-		hs->eq(key, &hs->search_pattern, &hs->conf); \
-		})
+#define mh_slot_key_eq(h, i, key) gen_hash_slot_key_eq((h)->arg, mh_slot(h, i)->ptr, key)
 #define mh_slot_set_key(h, slot, key)
 #define mh_hash(h, key) ({ gen_hash_node((key), &(h)->arg->conf); })
 #include <mhash.h>
@@ -409,143 +453,196 @@ static const struct index_node* gen_hash_slot_key(struct mh_gen_t const * h, gen
 static const struct index_node*
 gen_hash_slot_key(struct mh_gen_t const * h, gen_slot_t const * slot)
 {
-	GenHash *hs = (h)->arg;
-	hs->dtor(tnt_ptr2obj(slot->ptr), &hs->node_a, hs->dtor_arg);
-	return &hs->node_a;
+	return gen_hash_node_a(h->arg, slot->ptr);
 }
 
-@implementation GenHash
-- (id)
-init:(struct index_conf*)ic dtor:(const struct dtor_conf*)dc
-{
-	[super init:ic dtor:dc];
-	h = mh_gen_init(xrealloc);
-	h->arg = self;
-	return self;
-}
-- (void)
-clear
-{
-	mh_gen_clear(h);
-}
-- (id)
-free
-{
-	mh_gen_destroy(h);
-	return [super free];
-}
+/* control bytes live in separate map, slot is bare pointer */
+#define mh_group_map 1
+#define mh_name _geng
+struct geng_slot {
+	tnt_ptr ptr;
+} __attribute__((packed));
+#define mh_slot_t struct geng_slot
+#define mh_arg_t Index*
 
-- (struct tnt_object*)
-get:(u32)i
-{
-	if (i >= mh_end(h) || !mh_gen_slot_occupied(h, i)) {
-		return NULL;
-	}
-	return tnt_ptr2obj(mh_gen_slot(h, i)->ptr);
-}
-- (void)
-resize:(u32)buckets
-{
-	mh_gen_start_resize(h, buckets);
-}
-- (struct tnt_object*)
-find_obj:(struct tnt_object*)obj
-{
-	gen_slot_t p = {.ptr = tnt_obj2ptr(obj), .hsh = 0, .collision= 0} ;
-	u32 k = mh_gen_sget(h, &p);
-	if (k != mh_end(h))
-		return tnt_ptr2obj(mh_gen_slot(h, k)->ptr);
-	return NULL;
-}
-- (struct tnt_object*)
-find_node:(const struct index_node *)node
-{
-	u32 k = mh_gen_sget_by_key(h, node);
-	if (k != mh_end(h))
-		return tnt_ptr2obj(mh_gen_slot(h, k)->ptr);
-	return NULL;
-}
-- (void)
-replace:(struct tnt_object *)obj
-{
-	gen_slot_t p = {.ptr = tnt_obj2ptr(obj), .hsh = 0, .collision= 0} ;
-	mh_gen_sput(h, &p, NULL);
-}
-- (int)
-remove:(struct tnt_object *)obj
-{
-	gen_slot_t p = {.ptr = tnt_obj2ptr(obj), .hsh = 0, .collision= 0} ;
-	return mh_gen_sremove(h, &p, NULL);
-}
-- (void)
-iterator_init_with_object:(struct tnt_object*)obj
-{
-	gen_slot_t p = {.ptr = tnt_obj2ptr(obj), .hsh = 0, .collision= 0} ;
-	iter = mh_gen_sget(h, &p);
-}
-- (void)
-iterator_init_with_node:(const struct index_node*)node
-{
-	iter = mh_gen_sget_by_key(h, node);
-}
-- (struct tnt_object*)
-iterator_next
-{
-	for (; iter < mh_end(h); iter++) {
-		if (!mh_gen_slot_occupied(h, iter))
-			continue;
-		return tnt_ptr2obj(mh_gen_slot(h, iter++)->ptr);
-	}
-	return NULL;
-}
-- (void)
-ordered_iterator_init
-{
-	int i = 0;
-	[self iterator_init];
-	/* assert(j + 1 == ..) assumes that hash has at least one elem */
-	if (mh_size(h) == 0)
-		return;
-	char *slots = xcalloc(mh_size(h), node_size);
-	char *current = slots;
-	for (i = 0; i < mh_end(h); i++) {
-		if (!mh_gen_slot_occupied(h, i))
-			continue;
-
-		dtor(tnt_ptr2obj(mh_gen_slot(h, i)->ptr), (struct index_node*)current, dtor_arg);
-		current += node_size;
-	}
-	qsort_arg(slots, mh_size(h), node_size, compare, self);
-	current = slots;
-	for (i = 0; i < mh_size(h); i++) {
-		gen_slot_t ptr = {.ptr = tnt_obj2ptr(*(void**)current), .hsh = 0, .collision= 0} ;
-		mh_gen_hijack_slot_put(h, i, &ptr);
-		current += node_size;
-	}
-	for (; i < mh_end(h); i++) {
-		mh_gen_hijack_slot_free(h, i);
-	}
-	free(slots);
-}
-- (u32) size { return mh_size(h); }
-- (u32) slots { return mh_end(h); }
-- (size_t) bytes { return mh_gen_bytes(h); }
+static const struct index_node* geng_hash_slot_key(struct mh_geng_t const * h, struct geng_slot const * slot);
+#define mh_slot_key(h, slot) geng_hash_slot_key(h, slot)
+#define mh_slot_key_eq(h, i, key) gen_hash_slot_key_eq((h)->arg, mh_slot(h, i)->ptr, key)
+#define mh_slot_set_key(h, slot, key)
+#define mh_hash(h, key) ({ gen_hash_node((key), &(h)->arg->conf); })
+#include <mhash.h>
 
-- (struct tnt_object *)
-find_key:(struct tbuf *)key_data cardinalty:(u32)cardinality
+static const struct index_node*
+geng_hash_slot_key(struct mh_geng_t const * h, struct geng_slot const * slot)
 {
-	if (cardinality != conf.cardinality)
-		index_raise("cardinality should match");
-	init_pattern(key_data, cardinality, &node_a, dtor_arg);
-	return [self find_node: &node_a];
+	return gen_hash_node_a(h->arg, slot->ptr);
 }
 
-- (void)
-iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality
-{
-	if (cardinality != conf.cardinality)
-		index_raise("cardinality should match");
-	init_pattern(key_data, cardinality, &node_a, dtor_arg);
-	[self iterator_init_with_node: &node_a];
+#define DEFINE_GEN_METHODS(type)					\
+- (id)									\
+init:(struct index_conf*)ic dtor:(const struct dtor_conf*)dc		\
+{									\
+	[super init:ic dtor:dc];					\
+	h = mh_##type##_init(xrealloc);					\
+	h->arg = self;							\
+	return self;							\
+}									\
+- (void)								\
+clear									\
+{									\
+	mh_##type##_clear(h);						\
+}									\
+- (id)									\
+free									\
+{									\
+	mh_##type##_destroy(h);						\
+	return [super free];						\
+}									\
+- (struct tnt_object*)							\
+get:(u32)i								\
+{									\
+	if (i >= mh_end(h) || !mh_##type##_slot_occupied(h, i)) {	\
+		return NULL;						\
+	}								\
+	return tnt_ptr2obj(mh_##type##_slot(h, i)->ptr);		\
+}									\
+- (void)								\
+resize:(u32)buckets							\
+{									\
+	mh_##type##_start_resize(h, buckets);				\
+}									\
+- (struct tnt_object*)							\
+find_obj:(struct tnt_object*)obj					\
+{									\
+	typeof(*h->slots) p = { .ptr = tnt_obj2ptr(obj) };		\
+	u32 k = mh_##type##_sget(h, &p);				\
+	if (k != mh_end(h))						\
+		return tnt_ptr2obj(mh_##type##_slot(h, k)->ptr);	\
+	return NULL;							\
+}									\
+- (struct tnt_object*)							\
+find_node:(const struct index_node *)node				\
+{									\
+	u32 k = mh_##type##_sget_by_key(h, node);			\
+	if (k != mh_end(h))						\
+		return tnt_ptr2obj(mh_##type##_slot(h, k)->ptr);	\
+	return NULL;							\
+}									\
+- (void)								\
+replace:(struct tnt_object *)obj					\
+{									\
+	typeof(*h->slots) p = { .ptr = tnt_obj2ptr(obj) };		\
+	mh_##type##_sput(h, &p, NULL);					\
+}									\
+- (void)								\
+bulk_insert:(struct tnt_object *)obj					\
+{									\
+	typeof(*h->slots) p = { .ptr = tnt_obj2ptr(obj) };		\
+	mh_##type##_sput_new(h, &p);					\
+}									\
+- (int)									\
+remove:(struct tnt_object *)obj						\
+{									\
+	typeof(*h->slots) p = { .ptr = tnt_obj2ptr(obj) };		\
+	return mh_##type##_sremove(h, &p, NULL);			\
+}									\
+- (void)								\
+iterator_init_with_object:(struct tnt_object*)obj			\
+{									\
+	typeof(*h->slots) p = { .ptr = tnt_obj2ptr(obj) };		\
+	iter = mh_##type##_sget(h, &p);					\
+}									\
+- (void)								\
+iterator_init_with_node:(const struct index_node*)node			\
+{									\
+	iter = mh_##type##_sget_by_key(h, node);			\
+}									\
+- (struct tnt_object*)							\
+iterator_next								\
+{									\
+	for (; iter < mh_end(h); iter++) {				\
+		if (!mh_##type##_slot_occupied(h, iter))		\
+			continue;					\
+		return tnt_ptr2obj(mh_##type##_slot(h, iter++)->ptr);	\
+	}								\
+	return NULL;							\
+}									\
+- (void)								\
+ordered_iterator_init							\
+{									\
+	int i = 0;							\
+	[self iterator_init];						\
+	/* assert(j + 1 == ..) assumes that hash has at least one elem */ \
+	if (mh_size(h) == 0)						\
+		return;							\
+	char *slots = xcalloc(mh_size(h), node_size);			\
+	char *current = slots;						\
+	for (i = 0; i < mh_end(h); i++) {				\
+		if (!mh_##type##_slot_occupied(h, i))			\
+			continue;					\
+									\
+		dtor(tnt_ptr2obj(mh_##type##_slot(h, i)->ptr), (struct index_node*)current, dtor_arg); \
+		current += node_size;					\
+	}								\
+	qsort_arg(slots, mh_size(h), node_size, compare, self);		\
+	current = slots;						\
+	for (i = 0; i < mh_size(h); i++) {				\
+		typeof(*h->slots) ptr = { .ptr = tnt_obj2ptr(*(void**)current) }; \
+		mh_##type##_hijack_slot_put(h, i, &ptr);		\
+		current += node_size;					\
+	}								\
+	for (; i < mh_end(h); i++) {					\
+		mh_##type##_hijack_slot_free(h, i);			\
+	}								\
+	free(slots);							\
+}									\
+- (u32) size { return mh_size(h); }					\
+- (u32) slots { return mh_end(h); }					\
+- (u32) generation { return h->generation; }				\
+- (size_t) bytes { return mh_##type##_bytes(h); }			\
+									\
+- (struct tnt_object *)							\
+find_key:(struct tbuf *)key_data cardinalty:(u32)cardinality		\
+{									\
+	if (cardinality != conf.cardinality)				\
+		index_raise("cardinality should match");		\
+	init_pattern(key_data, cardinality, &node_a, dtor_arg);		\
+	return [self find_node: &node_a];				\
+}									\
+									\
+- (u32)									\
+find_keys:(struct tbuf *)key_data count:(u32)count result:(struct tnt_object **)obj \
+{									\
+	count = MIN(count, INDEX_FIND_BATCH);				\
+	char *nodes = palloc(fiber->pool, count * node_size);		\
+	unsigned hash[INDEX_FIND_BATCH];				\
+	u32 n;								\
+									\
+	for (n = 0; n < count && index_peek_cardinality(key_data) == conf.cardinality; n++) { \
+		struct index_node *node = (struct index_node *)(nodes + n * node_size); \
+		init_pattern(key_data, read_u32(key_data), node, dtor_arg); \
+		hash[n] = mh_##type##_prefetch(h, node);		\
+	}								\
+	for (u32 i = 0; i < n; i++) {					\
+		u32 k = mh_##type##_get_hashed(h, (struct index_node *)(nodes + i * node_size), hash[i]); \
+		obj[i] = k != mh_end(h) ? tnt_ptr2obj(mh_##type##_slot(h, k)->ptr) : NULL; \
+	}								\
+	return n;							\
+}									\
+									\
+- (void)								\
+iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality \
+{									\
+	if (cardinality != conf.cardinality)				\
+		index_raise("cardinality should match");		\
+	init_pattern(key_data, cardinality, &node_a, dtor_arg);		\
+	[self iterator_init_with_node: &node_a];			\
 }
+
+@implementation GenHash
+DEFINE_GEN_METHODS(gen)
+@end
+
+@implementation GenGroupHash
+DEFINE_GEN_METHODS(geng)
 @end
@@ -41,6 +41,21 @@ nih_tuple_2_index_key(const void *tuple_key, void *index_key, void *arg)
 	return true;
 }
 
+/* single UNUM32/UNUM64 unique index: nihtree keys are bare numbers */
+static bool
+nih_tuple_2_num_key(const void *tuple_key, void *index_key, void *arg)
+{
+	NIHTree* t = (NIHTree*)arg;
+	tnt_ptr *obj = (typeof(obj))tuple_key;
+	struct index_node node;
+	t->dtor(tnt_ptr2obj(*obj), &node, t->dtor_arg);
+	memcpy(index_key, &node.key, t->tconf.sizeof_key);
+	return true;
+}
+
+#define nih_key(node) ((void *)(tconf.key_type == nihkey_generic ? \
+				(const void *)(node) : (const void *)&(node)->key))
+
 static int
 nih_index_key_cmp(const void *a, const void *b, void *arg)
 {
@@ -133,7 +148,7 @@ iterator_init_with_node:(const struct index_node *)node direction:(enum iterator
 {
 	if (node != &search_pattern)
 		memcpy(&search_pattern, node, node_size);
-	nihtree_iter_init_set_buf(&tree, &tconf, &iter, &search_pattern,
+	nihtree_iter_init_set_buf(&tree, &tconf, &iter, nih_key(&search_pattern),
 			direction == iterator_forward ? nihscan_forward : nihscan_backward,
 			&node_b);
 }
@@ -141,14 +156,55 @@ iterator_init_with_node:(const struct index_node *)node direction:(enum iterator
 - (uint32_t)
 position_with_node:(const struct index_node *)key
 {
-	return nihtree_key_position_buf(&tree, &tconf, key, NULL, &node_b);
+	return nihtree_key_position_buf(&tree, &tconf, nih_key(key), NULL, &node_b);
 }
 
 - (uint32_t)
 position_with_object:(struct tnt_object*)obj
 {
 	dtor(obj, &node_a, dtor_arg);
-	return nihtree_key_position_buf(&tree, &tconf, &node_a, NULL, &node_b);
+	return nihtree_key_position_buf(&tree, &tconf, nih_key(&node_a), NULL, &node_b);
+}
+
+- (u32)
+iterator_init_with_key:(struct tbuf *)key_data cardinalty:(u32)cardinality skip:(u32)n
+{
+	u32 lower = 0, upper = nihtree_count(&tree);
+	[self iterator_init_with_key:key_data cardinalty:cardinality direction:iterator_forward];
+	if (cardinality > 0) {
+		lower = nihtree_key_bound_buf(&tree, &tconf, nih_key(&search_pattern), nihscan_forward, &node_b);
+		upper = nihtree_key_bound_buf(&tree, &tconf, nih_key(&search_pattern), nihscan_backward, &node_b);
+	}
+	n = MIN(n, upper - lower);
+	nihtree_iter_skip(&iter, n);
+	return n;
+}
+
+- (u32)
+count_from_node:(const struct index_node *)from to_node:(const struct index_node *)to
+{
+	u32 lower = 0, upper = nihtree_count(&tree);
+	if (from != NULL)
+		lower = nihtree_key_bound_buf(&tree, &tconf, nih_key(from), nihscan_forward, &node_b);
+	if (to != NULL)
+		upper = nihtree_key_bound_buf(&tree, &tconf, nih_key(to), nihscan_backward, &node_b);
+	return upper > lower ? upper - lower : 0;
+}
+
+- (u32)
+count_from:(struct tbuf *)from cardinalty:(u32)from_cardinality
+	 to:(struct tbuf *)to cardinalty:(u32)to_cardinality
+{
+	u32 lower = 0, upper = nihtree_count(&tree);
+	if (from_cardinality > 0) {
+		init_pattern(from, from_cardinality, &node_a, dtor_arg);
+		lower = nihtree_key_bound_buf(&tree, &tconf, nih_key(&node_a), nihscan_forward, &node_b);
+	}
+	if (to_cardinality > 0) {
+		init_pattern(to, to_cardinality, &node_a, dtor_arg);
+		upper = nihtree_key_bound_buf(&tree, &tconf, nih_key(&node_a), nihscan_backward, &node_b);
+	}
+	return upper > lower ? upper - lower : 0;
 }
 
 - (void)
@@ -215,6 +271,13 @@ set_sorted_nodes:(void *)nodes count:(size_t)count
 	tconf.tuple_2_key = nih_tuple_2_index_key;
 	tconf.key_cmp = nih_index_key_cmp;
 	tconf.key_tuple_cmp = NULL;
+	if (conf.unique && conf.cardinality == 1 && conf.field[0].sort_order != DESC &&
+	    (conf.field[0].type == UNUM32 || conf.field[0].type == UNUM64))
+	{
+		tconf.key_type = conf.field[0].type == UNUM32 ? nihkey_u32 : nihkey_u64;
+		tconf.sizeof_key = 0;
+		tconf.tuple_2_key = nih_tuple_2_num_key;
+	}
 	tconf.arg = self;
 	niherrcode_t r = nihtree_conf_init(&tconf);
 	nih_raise(r);
@@ -229,7 +292,7 @@ replace:(struct tnt_object *)obj
 {
 	dtor(obj, &node_a, dtor_arg);
 	tnt_ptr ptr = tnt_obj2ptr(obj);
-	niherrcode_t r = nihtree_insert_key_buf(&tree, &tconf, &ptr, true, &node_a, &search_pattern);
+	niherrcode_t r = nihtree_insert_key_buf(&tree, &tconf, &ptr, true, nih_key(&node_a), &search_pattern);
 	if (r != NIH_OK)
 		nih_raise(r);
 }
@@ -238,7 +301,7 @@ replace:(struct tnt_object *)obj
 remove:(struct tnt_object *)obj
 {
 	dtor(obj, &node_a, dtor_arg);
-	niherrcode_t r = nihtree_delete_buf(&tree, &tconf, &node_a, &search_pattern);
+	niherrcode_t r = nihtree_delete_buf(&tree, &tconf, nih_key(&node_a), &search_pattern);
 	if (r != NIH_OK && r != NIH_NOTFOUND)
 		nih_raise(r);
 	return r == NIH_OK;
@@ -248,7 +311,7 @@ remove:(struct tnt_object *)obj
 iterator_init_with_object:(struct tnt_object *)obj direction:(enum iterator_direction)direction
 {
 	dtor(obj, &search_pattern, dtor_arg);
-	nihtree_iter_init_set_buf(&tree, &tconf, &iter, &search_pattern,
+	nihtree_iter_init_set_buf(&tree, &tconf, &iter, nih_key(&search_pattern),
 				direction == iterator_forward ? nihscan_forward : nihscan_backward, &node_a);
 }
 
@@ -278,7 +341,7 @@ iterator_next_check:(index_cmp)check
 - (struct tnt_object *)
 find_node:(const struct index_node *)node
 {
-	tnt_ptr* r = nihtree_find_by_key_buf(&tree, &tconf, node, NULL, &node_b);
+	tnt_ptr* r = nihtree_find_by_key_buf(&tree, &tconf, nih_key(node), NULL, &node_b);
 	return r != NULL ? tnt_ptr2obj(*r) : NULL;
 }
 
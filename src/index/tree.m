@@ -26,6 +26,7 @@
 
 #import <util.h>
 #import <fiber.h>
+#import <palloc.h>
 #import <assoc.h>
 #import <index.h>
 #import <say.h>
@@ -82,6 +83,46 @@ find_key:(struct tbuf *)key_data cardinalty:(u32)cardinality
 	return [self find_node: &node_a];
 }
 
+struct find_keys_arg {
+	char *nodes;
+	size_t node_size;
+	index_cmp compare;
+	void *dtor_arg;
+};
+
+static int
+find_keys_cmp(const void *a, const void *b, void *arg)
+{
+	struct find_keys_arg *x = arg;
+	return x->compare(x->nodes + *(const u32 *)a * x->node_size,
+			  x->nodes + *(const u32 *)b * x->node_size, x->dtor_arg);
+}
+
+/* keys are looked up in index order: consecutive descents share
+   upper levels of tree and walk leaves left to right */
+- (u32)
+find_keys:(struct tbuf *)key_data count:(u32)count result:(struct tnt_object **)obj
+{
+	count = MIN(count, INDEX_FIND_BATCH);
+	struct find_keys_arg arg = { .nodes = palloc(fiber->pool, count * node_size),
+				     .node_size = node_size,
+				     .compare = compare,
+				     .dtor_arg = dtor_arg };
+	u32 order[INDEX_FIND_BATCH];
+	u32 n;
+
+	for (n = 0; n < count && index_peek_cardinality(key_data) == conf.cardinality; n++) {
+		struct index_node *node = (struct index_node *)(arg.nodes + n * node_size);
+		init_pattern(key_data, read_u32(key_data), node, dtor_arg);
+		order[n] = n;
+	}
+	if (n > 1)
+		qsort_arg(order, n, sizeof(order[0]), find_keys_cmp, &arg);
+	for (u32 i = 0; i < n; i++)
+		obj[order[i]] = [self find_node:(struct index_node *)(arg.nodes + order[i] * node_size)];
+	return n;
+}
+
 - (struct tnt_object *)
 find_obj:(struct tnt_object *)obj
 {
@@ -212,6 +253,27 @@ sort_nodes:(void *)nodes_ count:(size_t)count onduplicate:(ixsort_on_duplicate)o
 	}
 	return no_dups;
 }
+
+- (u32)
+count_from:(struct tbuf *)from cardinalty:(u32)from_cardinality
+	 to:(struct tbuf *)to cardinalty:(u32)to_cardinality
+{
+	struct index_node *to_node = NULL;
+	struct tnt_object *obj;
+	u32 count = 0;
+
+	if (to_cardinality > 0) {
+		to_node = palloc(fiber->pool, node_size);
+		init_pattern(to, to_cardinality, to_node, dtor_arg);
+	}
+	[self iterator_init_with_key:from cardinalty:from_cardinality];
+	while ((obj = [self iterator_next]) != NULL) {
+		if (to_node && compare(to_node, GET_NODE(obj, node_a), dtor_arg) < 0)
+			break;
+		count++;
+	}
+	return count;
+}
 @end
 
 register_source()
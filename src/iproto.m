@@ -61,6 +61,7 @@ enum iproto_stat ENUM_INITIALIZER(STAT);
 static char const * const stat_ops[] = ENUM_STR_INITIALIZER(STAT);
 static int stat_base;
 static int stat_cb_base;
+static int stat_lat_base;
 
 struct worker_arg {
 	struct iproto_handler *ih;
@@ -89,6 +90,85 @@ error(struct iproto_ingress_svc *io, struct iproto *msg, int rc, const char *err
 	return 1;
 }
 
+/* request latency in ms: per msg_code and per shard, collected for both
+   NONBLOCK and worker paths. names are allocated once and cached */
+static struct stat_name const *lat_op_name[256], *lat_shard_name[MAX_SHARD], *lat_wal_name[MAX_SHARD];
+
+static struct stat_name const *
+lat_name(struct stat_name const **cache, const char *fmt, int n)
+{
+	if (unlikely(*cache == NULL)) {
+		char buf[32];
+		int len = snprintf(buf, sizeof(buf), fmt, n);
+		*cache = stat_malloc_name(buf, len);
+	}
+	return *cache;
+}
+
+#if CFG_slow_request_time
+static void
+slow_request_log(struct iproto_ingress_svc *io, const struct iproto *msg, double ms, double wal_ms)
+{
+	static ev_tstamp period;
+	static int count;
+
+	if (ev_now() - period >= 1) {
+		if (count > cfg.slow_request_log_rate)
+			say_warn("%i slow requests were not logged",
+				 count - cfg.slow_request_log_rate);
+		period = ev_now();
+		count = 0;
+	}
+	if (count++ >= cfg.slow_request_log_rate)
+		return;
+
+	say_warn("slow request %.3f ms (wal %.3f ms) peer:%s op:0x%x sync:%u shard:%i len:%u",
+		 ms, wal_ms, io->fd >= 0 ? net_fd_name(io->fd) : "closed",
+		 msg->msg_code, msg->sync, msg->shard_id, msg->data_len);
+}
+#endif
+
+static void
+iproto_latency(struct iproto_ingress_svc *io, const struct iproto *msg, u64 start, u64 wal_wait)
+{
+	double ms = (tsc_now() - start) * tsc_ms;
+
+	if (msg->msg_code < nelem(lat_op_name)) {
+		stat_aggregate_fastnamed(stat_lat_base,
+					 lat_name(&lat_op_name[msg->msg_code], "op_0x%x", msg->msg_code),
+					 ms);
+	} else {
+		char buf[32];
+		int len = snprintf(buf, sizeof(buf), "op_0x%x", msg->msg_code);
+		stat_aggregate_named(stat_lat_base, buf, len, ms);
+	}
+	if (msg->shard_id < nelem(lat_shard_name))
+		stat_aggregate_fastnamed(stat_lat_base,
+					 lat_name(&lat_shard_name[msg->shard_id], "shard_%i", msg->shard_id),
+					 ms);
+#if CFG_slow_request_time
+	if (cfg.slow_request_time > 0 && ms > cfg.slow_request_time * 1000)
+		slow_request_log(io, msg, ms, wal_wait * tsc_ms);
+#else
+	(void)io; (void)wal_wait;
+#endif
+}
+
+void
+iproto_wal_latency(int shard_id, u64 ticks)
+{
+	double ms = ticks * tsc_ms;
+	static struct stat_name const *wal_wait_name;
+	fiber->wal_wait += ticks;
+	if (unlikely(wal_wait_name == NULL))
+		wal_wait_name = stat_malloc_name("wal_wait", 8);
+	stat_aggregate_fastnamed(stat_lat_base, wal_wait_name, ms);
+	if (shard_id >= 0 && shard_id < nelem(lat_wal_name))
+		stat_aggregate_fastnamed(stat_lat_base,
+					 lat_name(&lat_wal_name[shard_id], "wal_wait_shard_%i", shard_id),
+					 ms);
+}
+
 struct iproto *iproto_rbuf_req(struct netmsg_io *io)
 {
 	int len = rbuf_len(io);
@@ -123,6 +203,8 @@ iproto_worker(va_list ap)
 #if CFG_warn_cb_time
 		ev_tstamp start = ev_now();
 #endif
+		u64 start_tsc = tsc_now();
+		fiber->wal_wait = 0;
 		@try {
 			a.ih->cb(&a.io->wbuf, a.r);
 		}
@@ -137,6 +219,7 @@ iproto_worker(va_list ap)
 		if (ev_now() - start > cfg.warn_cb_time)
 			say_warn("too long IPROTO:%i %.3f sec", a.r->msg_code, ev_now() - start);
 #endif
+		iproto_latency(a.io, a.r, start_tsc, fiber->wal_wait);
 
 		if (a.io->fd >= 0 && a.io->prepare_link.le_prev == NULL) {
 			LIST_INSERT_HEAD(&service->prepare, a.io, prepare_link);
@@ -234,6 +317,8 @@ close
 		prepare_link.le_prev = NULL;
 	}
 	LIST_REMOVE(self, link);
+	if (io_conn != NULL)
+		iproto_io_conn_close(self);
 	[super close];
 	netmsg_io_release(self);
 }
@@ -273,6 +358,12 @@ init:(int)fd_ pool:(struct palloc_pool *)pool_
 
 - (void)
 init:(int)fd_ service:(struct iproto_service *)service_
+{
+	[self init:fd_ service:service_ io_conn:NULL];
+}
+
+- (void)
+init:(int)fd_ service:(struct iproto_service *)service_ io_conn:(struct iproto_io_conn *)conn
 {
 	say_trace("%s: service:%s peer:%s", __func__, service_->name, net_fd_name(fd_));
 	ingress_cnt++;
@@ -283,10 +374,21 @@ init:(int)fd_ service:(struct iproto_service *)service_
 	ev_init(&self->out, iproto_service_svc_write_cb);
 	self->flags |= NETMSG_IO_SHARED_POOL;
 	LIST_INSERT_HEAD(&service->clients, self, link);
-	ev_io_start(&in);
+	/* socket of io thread connection is never polled by main thread */
+	io_conn = conn;
+	if (io_conn == NULL)
+		ev_io_start(&in);
 }
 @end
 
+void
+iproto_ingress_feed(struct iproto_ingress_svc *io, const void *data, int len)
+{
+	rbuf_append(io, data, len);
+	stat_sum_static(stat_base, IPROTO_READ, len);
+	[io data_ready];
+}
+
 static void
 iproto_accept_client(int fd, void *data)
 {
@@ -322,10 +424,17 @@ iproto_service(struct iproto_service *service, const char *addr)
 
 	if (service->ingress_class == Nil)
 		service->ingress_class = [iproto_ingress_svc class];
-	service->acceptor = fiber_create("iproto/acceptor", tcp_server, addr,
-					 iproto_accept_client, service->on_bind, service);
-	if (service->acceptor == NULL)
-		panic("unable to start iproto_service `%s'", addr);
+#if CFG_iproto_io_threads
+	if (cfg.iproto_io_threads > 0 && iproto_io_threads_start(service, cfg.iproto_io_threads) < 0)
+		panic("unable to start io threads of iproto_service `%s'", addr);
+	if (service->io_threads == NULL)
+#endif
+	{
+		service->acceptor = fiber_create("iproto/acceptor", tcp_server, addr,
+						 iproto_accept_client, service->on_bind, service);
+		if (service->acceptor == NULL)
+			panic("unable to start iproto_service `%s'", addr);
+	}
 
 	ev_prepare_init(&service->wakeup, (void *)iproto_wakeup_workers);
 	ev_prepare_start(&service->wakeup);
@@ -389,6 +498,7 @@ local(struct iproto_ingress_svc *io, struct iproto *msg, struct iproto_handler *
 		stat_collect(stat_base, IPROTO_STREAM_OP, 1);
 		struct netmsg_mark header_mark;
 		netmsg_getmark(&io->wbuf, &header_mark);
+		u64 start_tsc = tsc_now();
 		@try {
 			ih->cb(&io->wbuf, msg);
 		}
@@ -397,6 +507,7 @@ local(struct iproto_ingress_svc *io, struct iproto *msg, struct iproto_handler *
 			iproto_error(&io->wbuf, msg, exc_rc(e), e->reason);
 			[e release];
 		}
+		iproto_latency(io, msg, start_tsc, 0);
 	} else {
 		struct iproto_service *service = io->service;
 		struct Fiber *w = SLIST_FIRST(&service->workers);
@@ -490,7 +601,8 @@ process_requests(struct iproto_service *service, struct iproto_ingress_svc *io)
 		io->processing_link.tqe_prev = NULL;
 
 		/* input buffer is empty or has partially read oversize request */
-		ev_io_start(&io->in);
+		if (io->io_conn == NULL)
+			ev_io_start(&io->in);
 	} else if (io->batch < service->batch) {
 		/* avoid unfair scheduling in case of absense of stream requests
 		   and all workers being busy */
@@ -504,6 +616,13 @@ out:
 static void
 service_prepare_io(struct iproto_ingress_svc *io)
 {
+	if (io->io_conn != NULL) {
+		ssize_t r = iproto_io_conn_flush(io);
+		if (r > 0)
+			stat_sum_static(stat_base, IPROTO_WRITTEN, r);
+		return;
+	}
+
 	if (rbuf_len(io) >= cfg.input_low_watermark && iproto_rbuf_req(io)) {
 		if (ev_now() - io->input_overflow_warn > 10) {
 			say_warn("peer %s input buffer low watermark overflow (size %i)",
@@ -731,6 +850,7 @@ iproto_init(void)
 {
 	stat_base = stat_register(stat_ops, nelem(stat_ops));
 	stat_cb_base = stat_register_callback("stat", report_ingress_cnt);
+	stat_lat_base = stat_register_named("iproto_lat");
 }
 
 register_source();
@@ -0,0 +1,741 @@
+/*
+ * Copyright (C) 2026 octopus contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* Network io threads of iproto service.
+
+   Every io thread owns a listening socket bound to the service address
+   with SO_REUSEPORT, so kernel spreads incoming connections among threads.
+   Thread accepts connections, reads and frames requests and writes replies.
+   Requests are executed by main thread as usual: for every connection there
+   is iproto_ingress_svc on main thread, whose socket is never polled by libev.
+
+   There is only one libev loop (EV_MULTIPLICITY == 0), palloc and fibers
+   are not thread safe, so io threads run plain epoll loops and never call
+   say_*(): all errors are reported by main thread.
+
+   Threads and main thread exchange messages through lock free queues:
+     io thread -> main: ACCEPT, DATA (complete requests), CLOSE, FREE
+     main -> io thread: WRITE (serialized reply), WAKE, RELEASE
+   Connection lifetime: main thread sends RELEASE when it closes connection
+   (either by itself or after CLOSE), io thread closes socket and answers with
+   FREE, which is the last message about connection in the queue. */
+
+#import <util.h>
+#import <fiber.h>
+#import <iproto.h>
+#import <say.h>
+
+#import <cfg/defs.h>
+
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_EVENTFD_H
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define IO_READ_CHUNK (16 * 1024)
+
+enum io_msg_type { IO_ACCEPT, IO_DATA, IO_CLOSE, IO_FREE,	/* io thread -> main */
+		   IO_WRITE, IO_WAKE, IO_RELEASE };		/* main -> io thread */
+
+struct io_msg {
+	struct io_msg *next;
+	struct iproto_io_conn *conn;
+	enum io_msg_type type;
+	int err;			/* IO_CLOSE: errno, 0 on EOF */
+	size_t len, off;
+	char data[];
+};
+
+/* multiple producers, single consumer */
+struct io_queue {
+	struct io_msg *head, *tail, stub;
+	int fd;				/* eventfd */
+	int signaled;
+};
+
+struct iproto_io_conn {
+	int fd;
+	struct iproto_io_thread *thread;
+	size_t inflight;		/* DATA bytes not yet consumed by main */
+	size_t main_pending;		/* input bytes buffered by main */
+	bool paused;			/* io thread stopped reading */
+
+	/* main thread */
+	struct iproto_ingress_svc *ingress;
+
+	/* io thread */
+	struct io_msg *rbuf;
+	size_t rsize;
+	struct io_msg *out_head, **out_tail;
+	size_t out_bytes;
+	u32 events;
+	bool closing;			/* CLOSE sent, waiting for RELEASE */
+	LIST_ENTRY(iproto_io_conn) paused_link, dirty_link;
+};
+
+struct iproto_io_thread {
+	pthread_t thread;
+	int epfd, listen_fd;
+	struct io_queue inbox;
+	struct iproto_io_threads *threads;
+	bool posted;
+	LIST_HEAD(, iproto_io_conn) paused, dirty, released;
+};
+
+struct iproto_io_threads {
+	struct iproto_service *service;
+	struct io_queue outbox;
+	ev_io ev;
+	size_t input_limit, output_limit;
+	int count;
+	struct iproto_io_thread thread[];
+};
+
+static int
+io_queue_init(struct io_queue *q)
+{
+	q->stub.next = NULL;
+	q->head = q->tail = &q->stub;
+	q->signaled = 0;
+	q->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return q->fd;
+}
+
+static void
+io_queue_push(struct io_queue *q, struct io_msg *m)
+{
+	m->next = NULL;
+	struct io_msg *prev = __atomic_exchange_n(&q->tail, m, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, m, __ATOMIC_RELEASE);
+}
+
+/* must be called after push(es), wakes consumer at most once per ack */
+static void
+io_queue_wake(struct io_queue *q)
+{
+	if (__atomic_exchange_n(&q->signaled, 1, __ATOMIC_SEQ_CST))
+		return;
+	u64 v = 1;
+	while (write(q->fd, &v, sizeof(v)) < 0 && errno == EINTR);
+}
+
+/* consumer: must be called before draining queue */
+static void
+io_queue_ack(struct io_queue *q)
+{
+	u64 v;
+	while (read(q->fd, &v, sizeof(v)) < 0 && errno == EINTR);
+	__atomic_store_n(&q->signaled, 0, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static struct io_msg *
+io_queue_pop(struct io_queue *q)
+{
+	struct io_msg *head = q->head,
+		      *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+	if (head == &q->stub) {
+		if (next == NULL)
+			return NULL;
+		q->head = head = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next != NULL) {
+		q->head = next;
+		return head;
+	}
+	/* producer is between exchange and store: it will wake us up */
+	if (head != __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	io_queue_push(q, &q->stub);
+	next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	if (next != NULL) {
+		q->head = next;
+		return head;
+	}
+	return NULL;
+}
+
+static struct io_msg *
+io_msg_alloc(enum io_msg_type type, struct iproto_io_conn *c, size_t size)
+{
+	struct io_msg *m = xmalloc(sizeof(*m) + size);
+	m->type = type;
+	m->conn = c;
+	m->err = 0;
+	m->len = m->off = 0;
+	return m;
+}
+
+static void
+io_thread_post(struct iproto_io_thread *t, enum io_msg_type type, struct iproto_io_conn *c, int err)
+{
+	struct io_msg *m = io_msg_alloc(type, c, 0);
+	m->err = err;
+	io_queue_push(&t->threads->outbox, m);
+	t->posted = true;
+}
+
+static void
+io_conn_set_events(struct iproto_io_thread *t, struct iproto_io_conn *c, u32 events)
+{
+	if (c->events == events)
+		return;
+	struct epoll_event ev = { .events = events, .data.ptr = c };
+	epoll_ctl(t->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->events = events;
+}
+
+static void
+io_conn_shutdown(struct iproto_io_thread *t, struct iproto_io_conn *c, int err)
+{
+	epoll_ctl(t->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	c->events = 0;
+	c->closing = true;
+	if (c->paused) {
+		LIST_REMOVE(c, paused_link);
+		c->paused = false;
+	}
+	io_thread_post(t, IO_CLOSE, c, err);
+}
+
+static void
+io_conn_release(struct iproto_io_thread *t, struct iproto_io_conn *c)
+{
+	if (!c->closing)
+		epoll_ctl(t->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	if (c->paused)
+		LIST_REMOVE(c, paused_link);
+	if (c->dirty_link.le_prev != NULL)
+		LIST_REMOVE(c, dirty_link);
+	close(c->fd);
+
+	struct io_msg *m, *tmp;
+	for (m = c->out_head; m != NULL; m = tmp) {
+		tmp = m->next;
+		free(m);
+	}
+	free(c->rbuf);
+	c->closing = true;
+	/* FREE is the last message about connection: main thread frees it */
+	LIST_INSERT_HEAD(&t->released, c, dirty_link);
+}
+
+/* stop reading if main thread is lagging behind or peer does not read replies */
+static void
+io_conn_throttle(struct iproto_io_thread *t, struct iproto_io_conn *c)
+{
+	if (c->closing)
+		return;
+
+	size_t pending = __atomic_load_n(&c->inflight, __ATOMIC_ACQUIRE) +
+			 __atomic_load_n(&c->main_pending, __ATOMIC_ACQUIRE);
+	bool stop = pending >= t->threads->input_limit ||
+		    c->out_bytes >= t->threads->output_limit;
+
+	if (stop != c->paused) {
+		if (stop)
+			LIST_INSERT_HEAD(&t->paused, c, paused_link);
+		else
+			LIST_REMOVE(c, paused_link);
+		__atomic_store_n(&c->paused, stop, __ATOMIC_RELEASE);
+	}
+	io_conn_set_events(t, c, (stop ? 0 : EPOLLIN) | (c->out_head != NULL ? EPOLLOUT : 0));
+}
+
+static void
+io_conn_read(struct iproto_io_thread *t, struct iproto_io_conn *c)
+{
+	for (;;) {
+		struct io_msg *b = c->rbuf;
+		if (b == NULL) {
+			c->rsize = 2 * IO_READ_CHUNK;
+			c->rbuf = b = io_msg_alloc(IO_DATA, c, c->rsize);
+		} else if (c->rsize - b->len < IO_READ_CHUNK) {
+			c->rsize = MAX(c->rsize * 2, b->len + IO_READ_CHUNK);
+			c->rbuf = b = xrealloc(b, sizeof(*b) + c->rsize);
+		}
+
+		size_t space = c->rsize - b->len;
+		ssize_t r = read(c->fd, b->data + b->len, space);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (r <= 0) {
+			io_conn_shutdown(t, c, r < 0 ? errno : 0);
+			return;
+		}
+		b->len += r;
+		if ((size_t)r < space)
+			break;
+	}
+
+	/* pass complete requests, keep partially read one */
+	struct io_msg *b = c->rbuf;
+	size_t len = 0;
+	while (b->len - len >= sizeof(struct iproto)) {
+		struct iproto req;
+		memcpy(&req, b->data + len, sizeof(req));
+		if (b->len - len < sizeof(req) + req.data_len)
+			break;
+		len += sizeof(req) + req.data_len;
+	}
+
+	if (len > 0) {
+		size_t tail = b->len - len;
+		c->rbuf = NULL;
+		if (tail > 0) {
+			c->rsize = MAX(2 * IO_READ_CHUNK, tail + IO_READ_CHUNK);
+			c->rbuf = io_msg_alloc(IO_DATA, c, c->rsize);
+			memcpy(c->rbuf->data, b->data + len, tail);
+			c->rbuf->len = tail;
+		}
+		b->type = IO_DATA;
+		b->conn = c;
+		b->len = len;
+		__atomic_add_fetch(&c->inflight, len, __ATOMIC_RELEASE);
+		io_queue_push(&t->threads->outbox, b);
+		t->posted = true;
+	}
+	io_conn_throttle(t, c);
+}
+
+static void
+io_conn_write(struct iproto_io_thread *t, struct iproto_io_conn *c)
+{
+	struct iovec iov[64];
+	struct io_msg *m;
+
+	while (c->out_head != NULL) {
+		int n = 0;
+		for (m = c->out_head; m != NULL && n < (int)nelem(iov); m = m->next)
+			iov[n++] = (struct iovec){ m->data + m->off, m->len - m->off };
+
+		ssize_t r = writev(c->fd, iov, n);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			io_conn_shutdown(t, c, errno);
+			return;
+		}
+
+		c->out_bytes -= r;
+		while (r > 0) {
+			m = c->out_head;
+			size_t left = m->len - m->off;
+			if ((size_t)r < left) {
+				m->off += r;
+				break;
+			}
+			r -= left;
+			c->out_head = m->next;
+			free(m);
+		}
+		if (c->out_head == NULL)
+			c->out_tail = &c->out_head;
+	}
+	io_conn_throttle(t, c);
+}
+
+static void
+io_thread_accept(struct iproto_io_thread *t)
+{
+	int fd, one = 1;
+
+	while ((fd = accept(t->listen_fd, NULL, NULL)) >= 0) {
+		if (ioctl(fd, FIONBIO, &one) < 0) {
+			close(fd);
+			continue;
+		}
+		/* not a fatal error */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		struct iproto_io_conn *c = xcalloc(1, sizeof(*c));
+		c->fd = fd;
+		c->thread = t;
+		c->out_tail = &c->out_head;
+		c->events = EPOLLIN;
+
+		struct epoll_event ev = { .events = c->events, .data.ptr = c };
+		if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			free(c);
+			continue;
+		}
+		io_thread_post(t, IO_ACCEPT, c, 0);
+	}
+
+	/* can't accept, too many open files: throttle this thread */
+	if (errno == EMFILE || errno == ENFILE)
+		usleep(100 * 1000);
+}
+
+static void
+io_thread_inbox(struct iproto_io_thread *t)
+{
+	struct iproto_io_conn *c, *tmp;
+	struct io_msg *m;
+
+	io_queue_ack(&t->inbox);
+	while ((m = io_queue_pop(&t->inbox)) != NULL) {
+		c = m->conn;
+		switch (m->type) {
+		case IO_WRITE:
+			if (c->closing) {
+				free(m);
+				break;
+			}
+			m->next = NULL;
+			*c->out_tail = m;
+			c->out_tail = &m->next;
+			c->out_bytes += m->len;
+			/* replies queued during one wakeup are written by single writev() */
+			if (c->dirty_link.le_prev == NULL)
+				LIST_INSERT_HEAD(&t->dirty, c, dirty_link);
+			break;
+		case IO_RELEASE:
+			io_conn_release(t, c);
+			free(m);
+			break;
+		default:
+			free(m);
+			break;
+		}
+	}
+
+	LIST_FOREACH_SAFE(c, &t->dirty, dirty_link, tmp) {
+		LIST_REMOVE(c, dirty_link);
+		c->dirty_link.le_prev = NULL;
+		if (!c->closing)
+			io_conn_write(t, c);
+	}
+	/* main thread consumed some input */
+	LIST_FOREACH_SAFE(c, &t->paused, paused_link, tmp)
+		io_conn_throttle(t, c);
+}
+
+static void *
+io_thread_loop(void *arg)
+{
+	struct iproto_io_thread *t = arg;
+	struct epoll_event ev[64];
+	sigset_t set;
+
+	/* signals are handled by main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	for (;;) {
+		int n = epoll_wait(t->epfd, ev, nelem(ev), -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			panic_syserror("epoll_wait");
+		}
+
+		for (int i = 0; i < n; i++) {
+			void *p = ev[i].data.ptr;
+			if (p == &t->listen_fd) {
+				io_thread_accept(t);
+			} else if (p == &t->inbox) {
+				io_thread_inbox(t);
+			} else {
+				struct iproto_io_conn *c = p;
+				if (c->closing)
+					continue;
+				if (ev[i].events & EPOLLOUT)
+					io_conn_write(t, c);
+				if (c->closing)
+					continue;
+				if (ev[i].events & EPOLLIN ||
+				    (ev[i].events & (EPOLLHUP|EPOLLERR) && !c->paused))
+					io_conn_read(t, c); /* read() will report error */
+				else if (ev[i].events & (EPOLLHUP|EPOLLERR))
+					io_conn_shutdown(t, c, 0);
+			}
+		}
+
+		/* ev[] may refer to released connections until now */
+		struct iproto_io_conn *c, *tmp;
+		LIST_FOREACH_SAFE(c, &t->released, dirty_link, tmp)
+			io_thread_post(t, IO_FREE, c, 0);
+		LIST_INIT(&t->released);
+
+		if (t->posted) {
+			t->posted = false;
+			io_queue_wake(&t->threads->outbox);
+		}
+	}
+	return NULL;
+}
+
+static void
+io_threads_outbox_cb(ev_io *ev, int events _unused_)
+{
+	struct iproto_io_threads *threads = container_of(ev, struct iproto_io_threads, ev);
+	struct iproto_service *service = threads->service;
+	struct iproto_io_conn *c;
+	struct io_msg *m;
+
+	io_queue_ack(&threads->outbox);
+	while ((m = io_queue_pop(&threads->outbox)) != NULL) {
+		c = m->conn;
+		switch (m->type) {
+		case IO_ACCEPT:
+			c->ingress = [service->ingress_class alloc];
+			[c->ingress init:c->fd service:service io_conn:c];
+			break;
+		case IO_DATA:
+			if (c->ingress != NULL)
+				iproto_ingress_feed(c->ingress, m->data, m->len);
+			__atomic_sub_fetch(&c->inflight, m->len, __ATOMIC_RELEASE);
+			break;
+		case IO_CLOSE:
+			if (c->ingress == NULL)
+				break;
+			if (m->err != 0) {
+				errno = m->err;
+				say_syswarn("io to %s failed, closing connection", net_fd_name(c->fd));
+			} else {
+				say_debug("peer %s closed connection", net_fd_name(c->fd));
+			}
+			[c->ingress close];
+			break;
+		case IO_FREE:
+			free(c);
+			break;
+		default:
+			assert(false);
+		}
+		free(m);
+	}
+}
+
+static void
+io_conn_send(struct iproto_io_conn *c, struct io_msg *m)
+{
+	io_queue_push(&c->thread->inbox, m);
+	io_queue_wake(&c->thread->inbox);
+}
+
+ssize_t
+iproto_io_conn_flush(struct iproto_ingress_svc *io)
+{
+	struct iproto_io_conn *c = io->io_conn;
+	size_t len = io->wbuf.bytes;
+
+	__atomic_store_n(&c->main_pending, rbuf_len(io), __ATOMIC_RELEASE);
+	if (len == 0) {
+		if (__atomic_load_n(&c->paused, __ATOMIC_ACQUIRE))
+			io_conn_send(c, io_msg_alloc(IO_WAKE, c, 0));
+		return 0;
+	}
+
+	/* reply holds refs to tuples, which must be released by main thread */
+	struct io_msg *m = io_msg_alloc(IO_WRITE, c, len);
+	m->len = netmsg_copyout(&io->wbuf, m->data);
+	io_conn_send(c, m);
+	return len;
+}
+
+void
+iproto_io_conn_close(struct iproto_ingress_svc *io)
+{
+	struct iproto_io_conn *c = io->io_conn;
+
+	c->ingress = NULL;
+	io->io_conn = NULL;
+	io->fd = -1; /* socket is closed by io thread */
+	io_conn_send(c, io_msg_alloc(IO_RELEASE, c, 0));
+}
+
+static int
+reuseport_socket(struct sockaddr_in *sin, bool reuseport)
+{
+	int fd, one = 1;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+		say_syserror("socket");
+		return -1;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+	    (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1) ||
+	    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == -1)
+	{
+		say_syserror("setsockopt");
+		goto error;
+	}
+	if (ioctl(fd, FIONBIO, &one) < 0) {
+		say_syserror("ioctl");
+		goto error;
+	}
+	if (bind(fd, (struct sockaddr *)sin, sizeof(*sin)) == -1)
+		goto error;
+	return fd;
+error:
+	close(fd);
+	return -1;
+}
+
+static void
+io_threads_bind(va_list ap)
+{
+	struct iproto_io_threads *threads = va_arg(ap, struct iproto_io_threads *);
+	struct iproto_service *service = threads->service;
+	struct sockaddr_in sin;
+	bool warning_said = false;
+	int fd;
+
+	atosaddr(service->addr, (struct sockaddr *)&sin);
+
+	/* sockets with SO_REUSEPORT would happily share port with
+	   previous instance of octopus: wait until it is released */
+	while ((fd = reuseport_socket(&sin, false)) < 0) {
+		if (errno != EADDRINUSE) {
+			say_syserror("bind(%s)", sintoa(&sin));
+			return;
+		}
+		if (!warning_said) {
+			say_syserror("bind(%s)", sintoa(&sin));
+			say_info("will retry binding after 0.1 seconds.");
+			warning_said = true;
+		}
+		fiber_sleep(0.1);
+	}
+	close(fd);
+
+	for (int i = 0; i < threads->count; i++) {
+		struct iproto_io_thread *t = &threads->thread[i];
+		struct epoll_event ev = { .events = EPOLLIN };
+
+		if ((t->listen_fd = reuseport_socket(&sin, true)) < 0) {
+			say_syserror("bind(%s)", sintoa(&sin));
+			goto error;
+		}
+		if (service->on_bind != NULL)
+			service->on_bind(t->listen_fd);
+		if (listen(t->listen_fd, cfg.backlog) == -1) {
+			say_syserror("listen");
+			goto error;
+		}
+
+		if ((t->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+			say_syserror("epoll_create1");
+			goto error;
+		}
+		ev.data.ptr = &t->listen_fd;
+		if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->listen_fd, &ev) < 0) {
+			say_syserror("epoll_ctl");
+			goto error;
+		}
+		ev.data.ptr = &t->inbox;
+		if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->inbox.fd, &ev) < 0) {
+			say_syserror("epoll_ctl");
+			goto error;
+		}
+
+		int err = pthread_create(&t->thread, NULL, io_thread_loop, t);
+		if (err != 0) {
+			errno = err;
+			say_syserror("pthread_create");
+			goto error;
+		}
+	}
+	say_info("bound to TCP/%s with %i io threads", sintoa(&sin), threads->count);
+	return;
+error:
+	panic("unable to start io threads of iproto_service `%s'", service->addr);
+}
+
+int
+iproto_io_threads_start(struct iproto_service *service, int count)
+{
+	struct sockaddr_storage saddr;
+
+	if (atosaddr(service->addr, (struct sockaddr *)&saddr) < 0 ||
+	    saddr.ss_family != AF_INET)
+	{
+		say_warn("%s: io threads are supported only for TCP addresses", service->name);
+		return 0;
+	}
+
+	struct iproto_io_threads *threads = xcalloc(1, sizeof(*threads) +
+						    count * sizeof(threads->thread[0]));
+	threads->service = service;
+	threads->count = count;
+	threads->input_limit = cfg.input_buffer_size;
+	threads->output_limit = cfg.output_high_watermark;
+	if (io_queue_init(&threads->outbox) < 0) {
+		say_syserror("eventfd");
+		return -1;
+	}
+	for (int i = 0; i < count; i++) {
+		struct iproto_io_thread *t = &threads->thread[i];
+		t->threads = threads;
+		t->listen_fd = t->epfd = -1;
+		LIST_INIT(&t->paused);
+		LIST_INIT(&t->dirty);
+		LIST_INIT(&t->released);
+		if (io_queue_init(&t->inbox) < 0) {
+			say_syserror("eventfd");
+			return -1;
+		}
+	}
+
+	ev_io_init(&threads->ev, io_threads_outbox_cb, threads->outbox.fd, EV_READ);
+	ev_io_start(&threads->ev);
+	service->io_threads = threads;
+
+	fiber_create("iproto/io_threads", io_threads_bind, threads);
+	return 0;
+}
+
+#else
+
+ssize_t iproto_io_conn_flush(struct iproto_ingress_svc *io _unused_) { abort(); }
+void iproto_io_conn_close(struct iproto_ingress_svc *io _unused_) { abort(); }
+
+int
+iproto_io_threads_start(struct iproto_service *service, int count _unused_)
+{
+	say_warn("%s: io threads are not supported on this platform", service->name);
+	return 0;
+}
+#endif
+
+register_source();
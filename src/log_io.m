@@ -34,6 +34,7 @@
 #import <shard.h>
 
 #include <third_party/crc32.h>
+#include <third_party/lz4/lz4.h>
 
 #include <dirent.h>
 #include <errno.h>
@@ -43,6 +44,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/file.h>
+#include <pthread.h>
 
 #if !HAVE_DECL_FDATASYNC
 extern int fdatasync(int fd);
@@ -69,11 +71,13 @@ memrchr(const void *s, int c, size_t n)
 const u64 default_cookie = 0;
 const u32 default_version = 12;
 const char *v12 = "0.12\n";
+const char *v12_lz4 = "0.12lz4\n";
 const char *snap_mark = "SNAP\n";
 const char *xlog_mark = "XLOG\n";
 const char *inprogress_suffix = ".inprogress";
 const u32 marker = 0xba0babed;
 const u32 eof_marker = 0x10adab1e;
+static const u32 lz4_block_marker = 0xb10cba5e;
 Class version3 = nil;
 Class version4 = nil;
 Class version11 = nil;
@@ -148,10 +152,93 @@ set_file_buf(FILE *fd, const int bufsize)
 	return vbuf;
 }
 
+/* snapshot loading is CPU bound: verify crc of rows in separate thread
+   running ahead of reader, so reader may skip checks of verified rows.
+   reading ahead also warms page cache for reader */
+struct xlog_verifier {
+	pthread_t thread;
+	int fd;
+	off_t start;
+	off_t verified; /* rows ending below are crc checked */
+	off_t consumed; /* reader position */
+	bool stop;
+};
+
+#define VERIFY_AHEAD_WINDOW (64 * 1024 * 1024)
+
+static void *
+xlog_verifier_thread(void *arg)
+{
+	struct xlog_verifier *v = arg;
+	size_t size = 4 * 1024 * 1024, len = 0;
+	char *buf = xmalloc(size);
+	off_t pos = v->start; /* file offset of buf[0] */
+
+	while (!__atomic_load_n(&v->stop, __ATOMIC_ACQUIRE)) {
+		if (pos - __atomic_load_n(&v->consumed, __ATOMIC_ACQUIRE) > VERIFY_AHEAD_WINDOW) {
+			usleep(1000);
+			continue;
+		}
+
+		ssize_t r = pread(v->fd, buf + len, size - len, pos + len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) /* reader will check the rest itself */
+			break;
+		len += r;
+
+		const char *ptr = buf;
+		for (;;) {
+			struct row_v12 row;
+			size_t avail = buf + len - ptr;
+			u32 magic;
+
+			if (avail < sizeof(magic) + sizeof(row))
+				break;
+			memcpy(&magic, ptr, sizeof(magic));
+			memcpy(&row, ptr + sizeof(magic), sizeof(row));
+			/* eof marker or garbage: let reader deal with it */
+			if (magic != marker ||
+			    row.header_crc32c != crc32c(0, (unsigned char *)&row + offsetof(struct row_v12, lsn),
+							sizeof(row) - offsetof(struct row_v12, lsn)))
+				goto out;
+			if (avail < sizeof(magic) + sizeof(row) + row.len)
+				break;
+			if (row.data_crc32c != crc32c(0, (unsigned char *)ptr + sizeof(magic) + sizeof(row), row.len))
+				goto out;
+
+			ptr += sizeof(magic) + sizeof(row) + row.len;
+			__atomic_store_n(&v->verified, pos + (ptr - buf), __ATOMIC_RELEASE);
+		}
+
+		size_t done = ptr - buf;
+		memmove(buf, ptr, len - done);
+		pos += done;
+		len -= done;
+		if (len == size) { /* row larger than buffer */
+			size *= 2;
+			buf = xrealloc(buf, size);
+		}
+	}
+out:
+	free(buf);
+	return NULL;
+}
+
+static void
+xlog_verifier_stop(struct xlog_verifier *v)
+{
+	__atomic_store_n(&v->stop, true, __ATOMIC_RELEASE);
+	pthread_join(v->thread, NULL);
+	close(v->fd);
+	free(v);
+}
+
 @implementation XLog
 - (bool) eof { return eof; }
 - (u32) version { return 0; }
 - (i64) last_read_lsn { return last_read_lsn; }
+- (off_t) row_offset { return row_offset; }
 
 - (XLog *)
 init_filename:(const char *)filename_
@@ -179,6 +266,7 @@ open_for_read_filename:(const char *)filename dir:(XLogDir *)dir
 {
 	char filetype_[32], version_[32];
 	XLog *l = nil;
+	Class class;
 	FILE *fd;
 	char *fbuf;
 
@@ -203,12 +291,16 @@ open_for_read_filename:(const char *)filename dir:(XLogDir *)dir
 		goto error;
 	}
 
-	if (strcmp(version_, v12) != 0) {
+	if (strcmp(version_, v12) == 0) {
+		class = [XLog12 class];
+	} else if (strcmp(version_, v12_lz4) == 0) {
+		class = [SnapLZ4 class];
+	} else {
 		say_error("bad version `%s' of %s", version_, filename);
 		goto error;
 	}
 
-	l = [[XLog12 alloc] init_filename:filename fd:fd dir:dir vbuf:fbuf];
+	l = [[class alloc] init_filename:filename fd:fd dir:dir vbuf:fbuf];
 	if ([l read_header] < 0) {
 		if (feof(fd))
 			say_error("unexpected EOF reading %s", filename);
@@ -285,6 +377,10 @@ inprogress_rename
 - (int)
 close
 {
+	if (verifier) {
+		xlog_verifier_stop(verifier);
+		verifier = NULL;
+	}
 	if (fd == NULL)
 		return 0;
 	if (fclose(fd) < 0) {
@@ -331,6 +427,16 @@ flush
 	return 0;
 }
 
+- (int)
+datasync
+{
+	if (fdatasync(fileno(fd)) < 0) {
+		say_syserror("fdatasync");
+		return -1;
+	}
+	return 0;
+}
+
 - (void)
 fadvise_dont_need
 {
@@ -422,6 +528,7 @@ restart:
 		magic |= ((u64)c & 0xff) << magic_shift;
 	}
 	marker_offset = ftello(fd) - mdesc.size;
+	row_offset = marker_offset + mdesc.size;
 	if (good_offset != marker_offset)
 		say_warn("skipped %" PRIofft " bytes after %08" PRIofft " offset",
 			 marker_offset - good_offset, good_offset);
@@ -476,6 +583,32 @@ eof:
 	return NULL;
 }
 
+- (void)
+verify_ahead
+{
+	assert(mode == LOG_READ);
+	if (verifier)
+		return;
+
+	struct xlog_verifier *v = xcalloc(1, sizeof(*v));
+	v->start = v->verified = v->consumed = ftello(fd);
+	v->fd = open(filename, O_RDONLY);
+	if (v->fd < 0) {
+		say_syserror("can't open %s", filename);
+		free(v);
+		return;
+	}
+	int err = pthread_create(&v->thread, NULL, xlog_verifier_thread, v);
+	if (err != 0) {
+		errno = err;
+		say_syserror("pthread_create");
+		close(v->fd);
+		free(v);
+		return;
+	}
+	verifier = v;
+}
+
 - (void)
 follow:(follow_cb *)cb data:(void *)data
 {
@@ -619,6 +752,70 @@ exit:
 	return next_lsn - 1;
 }
 
+- (int)
+append_raw:(int)src len:(off_t)len rows:(size_t)count
+{
+	assert(mode == LOG_WRITE);
+	assert(no_wet);
+
+	if (fflush(fd) < 0) {
+		say_syserror("fflush");
+		return -1;
+	}
+
+	int dst = fileno(fd);
+	bool copy_range = true;
+	while (len > 0) {
+		ssize_t r = -1;
+#if HAVE_COPY_FILE_RANGE
+		if (copy_range) {
+			r = copy_file_range(src, NULL, dst, NULL, len, 0);
+			if (r < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL)) {
+				copy_range = false;
+				continue;
+			}
+		}
+#else
+		copy_range = false;
+#endif
+		if (!copy_range) {
+			char buf[64 * 1024];
+			r = read(src, buf, MIN(sizeof(buf), len));
+			if (r > 0 && write(dst, buf, r) != r)
+				r = -1;
+		}
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			say_syserror("can't append raw rows");
+			return -1;
+		}
+		len -= r;
+		bytes_written += r;
+	}
+
+	/* resync stdio position after direct writes */
+	if (fseeko(fd, 0, SEEK_END) < 0) {
+		say_syserror("fseeko");
+		return -1;
+	}
+	rows += count;
+	return 0;
+}
+
+- (bool)
+submit_write:(bool)sync
+{
+	(void)sync;
+	return false; /* stdio writes are synchronous */
+}
+
+- (int)
+completion_fd
+{
+	return -1;
+}
+
 - (int)
 fileno
 {
@@ -681,13 +878,24 @@ read_row
 
 	tbuf_append(m, NULL, offsetof(struct row_v12, data));
 
+	/* rows are verified contiguously from the current position,
+	   so row boundaries of reader and verifier are the same */
+	bool verified = false;
+	if (verifier) {
+		__atomic_store_n(&verifier->consumed, row_offset, __ATOMIC_RELEASE);
+		verified = row_offset + sizeof(struct row_v12) + row_v12(m)->len <=
+			   __atomic_load_n(&verifier->verified, __ATOMIC_ACQUIRE);
+	}
+
 	/* header crc32c calculated on all fields before data_crc32c> */
-	header_crc = crc32c(0, m->ptr + offsetof(struct row_v12, lsn),
-			    sizeof(struct row_v12) - offsetof(struct row_v12, lsn));
+	if (!verified) {
+		header_crc = crc32c(0, m->ptr + offsetof(struct row_v12, lsn),
+				    sizeof(struct row_v12) - offsetof(struct row_v12, lsn));
 
-	if (row_v12(m)->header_crc32c != header_crc) {
-		say_error("header crc32c mismatch");
-		return NULL;
+		if (row_v12(m)->header_crc32c != header_crc) {
+			say_error("header crc32c mismatch");
+			return NULL;
+		}
 	}
 
 	tbuf_reserve(m, tbuf_len(m) + row_v12(m)->len);
@@ -699,10 +907,12 @@ read_row
 
 	tbuf_append(m, NULL, row_v12(m)->len);
 
-	data_crc = crc32c(0, row_v12(m)->data, row_v12(m)->len);
-	if (row_v12(m)->data_crc32c != data_crc) {
-		say_error("data crc32c mismatch");
-		return NULL;
+	if (!verified) {
+		data_crc = crc32c(0, row_v12(m)->data, row_v12(m)->len);
+		if (row_v12(m)->data_crc32c != data_crc) {
+			say_error("data crc32c mismatch");
+			return NULL;
+		}
 	}
 
 	if (tbuf_len(m) < sizeof(struct row_v12)) {
@@ -749,16 +959,24 @@ append_row:(struct row_v12 *)row data:(const void *)data
 		return NULL;
 #endif
 
+	if ([self write_row:row data:data] < 0)
+		return NULL;
+
+	[self append_successful:sizeof(marker) + sizeof(*row) + row->len];
+	return row;
+}
+
+- (int)
+write_row:(const struct row_v12 *)row data:(const void *)data
+{
 	if (fwrite(&marker, sizeof(marker), 1, fd) != 1 ||
 	    fwrite(row, sizeof(*row), 1, fd) != 1 ||
 	    fwrite(data, row->len, 1, fd) != 1)
 	{
 		say_syserror("fwrite");
-		return NULL;
+		return -1;
 	}
-
-	[self append_successful:sizeof(marker) + sizeof(*row) + row->len];
-	return row;
+	return 0;
 }
 @end
 
@@ -801,6 +1019,13 @@ greatest_lsn
 	return xlog_dir_greatest_lsn(rs_dir);
 }
 
+- (i64)
+next_file_lsn:(i64)lsn
+{
+	extern i64 xlog_dir_next_lsn(struct XLogDirRS *, i64);
+	return xlog_dir_next_lsn(rs_dir, lsn);
+}
+
 - (const char *)
 format_filename:(i64)lsn suffix:(const char *)extra_suffix
 {
@@ -818,6 +1043,12 @@ format_filename:(i64)lsn
 }
 
 
+- (void)
+set_xlog_class:(Class)class
+{
+	xlog_class = class;
+}
+
 - (XLog *)
 open_for_read:(i64)lsn
 {
@@ -912,11 +1143,6 @@ init_dirname:(const char *)dirname_
 }
 @end
 
-@interface Snap12 : XLog12 {
-	size_t bytes;
-	ev_tstamp step_ts, last_ts;
-}@end
-
 @implementation Snap12
 - (XLog *)
 init_filename:(const char *)filename_
@@ -990,6 +1216,31 @@ append_row:(struct row_v12 *)row12 data:(const void *)data
 	return ret;
 }
 
+- (int)
+append_raw:(int)src len:(off_t)len rows:(size_t)count
+{
+	const off_t block = 4 * 1024 * 1024;
+	while (len > 0) {
+		off_t n = MIN(len, block);
+		ev_tstamp start = ev_time();
+
+		if ([super append_raw:src len:n rows:n == len ? count : 0] < 0)
+			return -1;
+		len -= n;
+
+		if (cfg.snap_fadvise_dont_need)
+			[self fadvise_dont_need];
+
+		const int io_rate_limit = cfg.snap_io_rate_limit * 1024 * 1024;
+		if (io_rate_limit > 0) {
+			double sec = (double)n / io_rate_limit - (ev_time() - start);
+			if (sec > 0)
+				usleep(sec * 1e6);
+		}
+	}
+	return 0;
+}
+
 #if HAVE_POSIX_FADVISE
 - (int)
 close
@@ -1002,6 +1253,237 @@ close
 @end
 
 
+struct lz4_block {
+	u32 header_crc32c;
+	u32 len;
+	u32 raw_len;
+	u32 data_crc32c;
+} __attribute__((packed));
+
+#define LZ4_BLOCK_SIZE (1024 * 1024)
+
+static void
+lz4_reserve(char **buf, size_t *size, size_t len)
+{
+	if (*size >= len)
+		return;
+	*size = MAX(*size * 2, len);
+	*buf = xrealloc(*buf, *size);
+}
+
+@implementation SnapLZ4
+- (void)
+write_header
+{
+	fwrite(dir->filetype, strlen(dir->filetype), 1, fd);
+	fwrite(v12_lz4, strlen(v12_lz4), 1, fd);
+	fprintf(fd, "Created-by: octopus\n");
+	fprintf(fd, "Octopus-version: %s\n", octopus_version());
+}
+
+- (int)
+write_block
+{
+	if (raw_len == 0)
+		return 0;
+
+	lz4_reserve(&zbuf, &zbuf_size, LZ4_compressBound(raw_len));
+	int len = LZ4_compress(raw, zbuf, raw_len);
+	if (len <= 0) {
+		say_error("LZ4_compress failed");
+		return -1;
+	}
+
+	struct lz4_block block = { .len = len,
+				   .raw_len = raw_len,
+				   .data_crc32c = crc32c(0, (unsigned char *)zbuf, len) };
+	block.header_crc32c = crc32c(0, (unsigned char *)&block + sizeof(block.header_crc32c),
+				     sizeof(block) - sizeof(block.header_crc32c));
+
+	if (fwrite(&lz4_block_marker, sizeof(lz4_block_marker), 1, fd) != 1 ||
+	    fwrite(&block, sizeof(block), 1, fd) != 1 ||
+	    fwrite(zbuf, len, 1, fd) != 1)
+	{
+		say_syserror("fwrite");
+		return -1;
+	}
+	bytes_written += sizeof(lz4_block_marker) + sizeof(block) + len;
+	raw_len = 0;
+	return 0;
+}
+
+- (int)
+write_row:(const struct row_v12 *)row data:(const void *)data
+{
+	size_t len = sizeof(marker) + sizeof(*row) + row->len;
+	lz4_reserve(&raw, &raw_size, raw_len + len);
+
+	char *p = raw + raw_len;
+	memcpy(p, &marker, sizeof(marker));
+	memcpy(p + sizeof(marker), row, sizeof(*row));
+	memcpy(p + sizeof(marker) + sizeof(*row), data, row->len);
+	raw_len += len;
+
+	if (raw_len >= LZ4_BLOCK_SIZE)
+		return [self write_block];
+	return 0;
+}
+
+- (int)
+append_raw:(int)src len:(off_t)len rows:(size_t)count
+{
+	assert(mode == LOG_WRITE);
+	assert(no_wet);
+
+	/* chunk holds plain v12 rows: recompress it, block boundaries
+	   need not to be aligned with rows */
+	while (len > 0) {
+		lz4_reserve(&raw, &raw_size, LZ4_BLOCK_SIZE);
+		ssize_t r = read(src, raw + raw_len, MIN(raw_size - raw_len, (size_t)len));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			say_syserror("can't append raw rows");
+			return -1;
+		}
+		raw_len += r;
+		len -= r;
+		if (raw_len >= LZ4_BLOCK_SIZE && [self write_block] < 0)
+			return -1;
+	}
+	rows += count;
+	return 0;
+}
+
+- (int)
+write_eof_marker
+{
+	if ([self write_block] < 0)
+		return -1;
+	return [super write_eof_marker];
+}
+
+- (int)
+read_block
+{
+	struct lz4_block block;
+	u32 magic;
+	off_t block_offset = ftello(fd);
+
+	if (fread(&magic, sizeof(magic), 1, fd) != 1)
+		goto short_read;
+	if (magic == eof_marker) {
+		eof = 1;
+		return 0;
+	}
+	if (magic != lz4_block_marker) {
+		say_error("bad block marker at %08" PRIofft, block_offset);
+		return -1;
+	}
+	if (fread(&block, sizeof(block), 1, fd) != 1)
+		goto short_read;
+	if (block.header_crc32c != crc32c(0, (unsigned char *)&block + sizeof(block.header_crc32c),
+					  sizeof(block) - sizeof(block.header_crc32c)))
+	{
+		say_error("block header crc32c mismatch at %08" PRIofft, block_offset);
+		return -1;
+	}
+
+	lz4_reserve(&zbuf, &zbuf_size, block.len);
+	if (fread(zbuf, block.len, 1, fd) != 1)
+		goto short_read;
+	if (block.data_crc32c != crc32c(0, (unsigned char *)zbuf, block.len)) {
+		say_error("block data crc32c mismatch at %08" PRIofft, block_offset);
+		return -1;
+	}
+
+	if (raw_pos > 0) {
+		memmove(raw, raw + raw_pos, raw_len - raw_pos);
+		raw_len -= raw_pos;
+		raw_pos = 0;
+	}
+	lz4_reserve(&raw, &raw_size, raw_len + block.raw_len);
+
+	int r = LZ4_decompress_safe(zbuf, raw + raw_len, block.len, block.raw_len);
+	if (r < 0 || (u32)r != block.raw_len) {
+		say_error("block decompression failed at %08" PRIofft, block_offset);
+		return -1;
+	}
+	raw_len += r;
+	return 0;
+
+short_read:
+	if (ferror(fd))
+		say_syserror("fread");
+	else
+		say_error("unexpected EOF at %08" PRIofft, block_offset);
+	clearerr(fd);
+	fseeko(fd, block_offset, SEEK_SET);
+	return -1;
+}
+
+- (bool)
+fill:(size_t)len
+{
+	while (raw_len - raw_pos < len) {
+		if (eof) {
+			if (raw_len != raw_pos)
+				say_error("truncated row at the end of %s", filename);
+			return false;
+		}
+		if ([self read_block] < 0)
+			return false;
+	}
+	return true;
+}
+
+- (struct row_v12 *)
+fetch_row
+{
+	struct row_v12 header;
+	u32 magic;
+
+	if (![self fill:sizeof(magic) + sizeof(header)])
+		return NULL;
+
+	memcpy(&magic, raw + raw_pos, sizeof(magic));
+	if (magic != marker) {
+		say_error("bad row marker in %s", filename);
+		return NULL;
+	}
+	memcpy(&header, raw + raw_pos + sizeof(magic), sizeof(header));
+
+	/* rows are covered by block crc, no need to check them again */
+	size_t len = sizeof(header) + header.len;
+	if (![self fill:sizeof(magic) + len])
+		return NULL;
+
+	struct row_v12 *row = palloc(fiber->pool, len);
+	memcpy(row, raw + raw_pos + sizeof(magic), len);
+	raw_pos += sizeof(magic) + len;
+
+	++rows;
+	last_read_lsn = row->lsn;
+	return row;
+}
+
+- (void)
+verify_ahead
+{
+	/* verify-ahead thread understands plain v12 rows only */
+}
+
+- (int)
+close
+{
+	free(raw);
+	free(zbuf);
+	raw = zbuf = NULL;
+	raw_len = raw_pos = raw_size = zbuf_size = 0;
+	return [super close];
+}
+@end
+
 @implementation SnapDir
 - (id)
 init_dirname:(const char *)dirname_
@@ -1015,6 +1497,11 @@ init_dirname:(const char *)dirname_
 	// rate limiting only v12 snapshots
 	if (xlog_class == [XLog12 class])
 		xlog_class = [Snap12 class];
+	if (cfg.snap_compression != NULL && strcmp(cfg.snap_compression, "lz4") == 0)
+		xlog_class = [SnapLZ4 class];
+	else if (cfg.snap_compression != NULL && strcmp(cfg.snap_compression, "none") != 0)
+		say_warn("unknown snap_compression `%s', snapshots will be written uncompressed",
+			 cfg.snap_compression);
         return self;
 }
 @end
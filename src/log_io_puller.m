@@ -30,8 +30,10 @@
 #import <net_io.h>
 #import <iproto.h>
 #import <say.h>
+#import <stat.h>
 
 #include <third_party/crc32.h>
+#include <third_party/lz4/lz4.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -43,6 +45,7 @@ feeder_param_eq(struct feeder_param *this, struct feeder_param *that)
 {
 	bool equal =
 		this->ver == that->ver &&
+		this->flags == that->flags &&
 		this->addr.sin_family == that->addr.sin_family &&
 		this->addr.sin_addr.s_addr == that->addr.sin_addr.s_addr &&
 		this->addr.sin_port == that->addr.sin_port &&
@@ -121,8 +124,19 @@ feeder_param_fill_from_cfg(struct feeder_param *param, struct octopus_cfg *_cfg)
 		}
 	}
 
-	if (param->filter.type == FILTER_TYPE_ID ||
-	    (param->filter.type == FILTER_TYPE_LUA && param->filter.arg == NULL)) {
+	param->flags = 0;
+	if (_cfg->wal_feeder_compression != NULL) {
+		if (strcasecmp(_cfg->wal_feeder_compression, "lz4") == 0)
+			param->flags |= REPLICATION_LZ4;
+		else if (strcasecmp(_cfg->wal_feeder_compression, "none") != 0)
+			say_warn("unknown wal_feeder_compression `%s'", _cfg->wal_feeder_compression);
+	}
+	if (_cfg->wal_feeder_sendfile)
+		param->flags |= REPLICATION_MARKERS;
+
+	if (param->flags == 0 &&
+	    (param->filter.type == FILTER_TYPE_ID ||
+	     (param->filter.type == FILTER_TYPE_LUA && param->filter.arg == NULL))) {
 		param->ver = 1;
 	} else {
 		param->ver = 2;
@@ -134,7 +148,9 @@ feeder_param_fill_from_cfg(struct feeder_param *param, struct octopus_cfg *_cfg)
 - (ssize_t) recv_with_timeout: (ev_tstamp)timeout;
 - (int) establish_connection;
 - (int) replication_compat: (i64)scn;
-- (int) replication_handshake:(void*)hshake len:(size_t)len;
+- (int) replication_handshake:(void*)hshake len:(size_t)len flags:(u32)req_flags;
+- (int) replication_handshake_v2:(i64)scn flags:(u32)req_flags;
+- (void) lz4_unpack;
 @end
 
 @implementation XLogPuller
@@ -149,6 +165,8 @@ init
 	fd = -1;
 	rbuf = TBUF(NULL, 0, fiber->pool);
 	palloc_register_gc_root(fiber->pool, &rbuf, tbuf_gc);
+	zbuf = TBUF(NULL, 0, fiber->pool);
+	palloc_register_gc_root(fiber->pool, &zbuf, tbuf_gc);
 	return self;
 }
 
@@ -237,7 +255,7 @@ replication_compat:(i64)scn
 }
 
 - (int)
-replication_handshake:(void*)hshake len:(size_t)hsize
+replication_handshake:(void*)hshake len:(size_t)hsize flags:(u32)req_flags
 {
 	struct tbuf *req = tbuf_alloc(fiber->pool);
 	struct iproto ireq = { .msg_code = MSG_REPLICA, .sync = 0, .data_len = hsize };
@@ -278,14 +296,16 @@ replication_handshake:(void*)hshake len:(size_t)hsize
 		}
 
 		say_debug("%s: recv handshake part, %u bytes", __func__, tbuf_len(&rbuf));
-	} while (tbuf_len(&rbuf) < sizeof(struct iproto_retcode) + sizeof(version));
+	} while (tbuf_len(&rbuf) < sizeof(struct iproto_retcode) + sizeof(version) +
+				   (req_flags ? sizeof(flags) : 0));
 
 	struct iproto_retcode *reply = (void *)iproto_parse(&rbuf);
 	if (reply == NULL ||
 	    reply->ret_code != 0 ||
 	    reply->sync != iproto(req)->sync ||
 	    reply->msg_code != iproto(req)->msg_code ||
-	    reply->data_len != sizeof(reply->ret_code) + sizeof(version))
+	    (reply->data_len != sizeof(reply->ret_code) + sizeof(version) &&
+	     reply->data_len != sizeof(reply->ret_code) + sizeof(version) + sizeof(flags)))
 	{
 		snprintf(errbuf, sizeof(errbuf), "can't parse reply: bad iproto packet");
 		return -1;
@@ -295,14 +315,34 @@ replication_handshake:(void*)hshake len:(size_t)hsize
 		  reply->data_len, tbuf_len(&rbuf));
 
 	memcpy(&version, reply->data, sizeof(version));
+	if (reply->data_len > sizeof(reply->ret_code) + sizeof(version))
+		memcpy(&flags, reply->data + sizeof(version), sizeof(flags));
 	return 0;
 }
 
+- (int)
+replication_handshake_v2:(i64)scn flags:(u32)req_flags
+{
+	struct tbuf *hbuf = tbuf_alloc(fiber->pool);
+	struct replication_handshake_v2 hshake = {
+		.ver = 2, .scn = scn, .filter = {0},
+		.filter_type = feeder->filter.type | req_flags,
+		.filter_arglen = feeder->filter.arglen};
+	if (feeder->filter.name)
+		strncpy(hshake.filter, feeder->filter.name,
+			sizeof(hshake.filter) - 1);
+	tbuf_add_dup(hbuf, &hshake);
+	tbuf_append(hbuf, feeder->filter.arg, feeder->filter.arglen);
+
+	return [self replication_handshake: hbuf->ptr len: tbuf_len(hbuf) flags: req_flags];
+}
+
 - (int)
 handshake:(i64)scn
 {
 	assert(scn >= 0);
 
+	flags = 0;
 	if ([self establish_connection] < 0)
 		goto err;
 
@@ -315,22 +355,24 @@ handshake:(i64)scn
 			strncpy(hshake.filter, feeder->filter.name,
 				sizeof(hshake.filter) - 1);
 
-		if ([self replication_handshake: &hshake len: sizeof(hshake)] < 0)
+		if ([self replication_handshake: &hshake len: sizeof(hshake) flags: 0] < 0)
 			goto err;
 	} else if (feeder->ver == 2) {
-		struct tbuf *hbuf = tbuf_alloc(fiber->pool);
-		struct replication_handshake_v2 hshake = {
-			.ver = 2, .scn = scn, .filter = {0},
-			.filter_type = feeder->filter.type,
-		       	.filter_arglen = feeder->filter.arglen};
-		if (feeder->filter.name)
-			strncpy(hshake.filter, feeder->filter.name,
-				sizeof(hshake.filter) - 1);
-		tbuf_add_dup(hbuf, &hshake);
-		tbuf_append(hbuf, feeder->filter.arg, feeder->filter.arglen);
-
-		if ([self replication_handshake: hbuf->ptr len: tbuf_len(hbuf)] < 0)
-			goto err;
+		u32 req_flags = feeder->flags;
+		while ([self replication_handshake_v2: scn flags: req_flags] < 0) {
+			if (req_flags == 0 || abort)
+				goto err;
+			/* feeders without REPLICATION_* support reject
+			   unknown filter_type and drop connection */
+			say_warn("feeder/%s handshake failed: %s, retrying without lz4/markers",
+				 sintoa(&feeder->addr), errbuf);
+			req_flags = 0;
+			tbuf_reset(&rbuf);
+			close(fd);
+			fd = -1;
+			if ([self establish_connection] < 0)
+				goto err;
+		}
 	}
 
 	if (version != default_version) {
@@ -338,12 +380,23 @@ handshake:(i64)scn
 		goto err;
 	}
 
-	say_info("succefully connected to feeder/%s, version:%i", sintoa(&feeder->addr), version);
+	if (flags & REPLICATION_LZ4) {
+		/* rows which arrived along with handshake reply are compressed */
+		tbuf_append(&zbuf, rbuf.ptr, tbuf_len(&rbuf));
+		tbuf_reset(&rbuf);
+		[self lz4_unpack];
+	} else if (feeder->flags & REPLICATION_LZ4) {
+		say_warn("feeder/%s declined compression", sintoa(&feeder->addr));
+	}
+
+	say_info("succefully connected to feeder/%s, version:%i%s", sintoa(&feeder->addr), version,
+		 flags & REPLICATION_LZ4 ? " lz4" : "");
 	say_info("starting remote recovery from scn:%"PRIi64" filter:%s arg:%.*s",
 		 scn, feeder->filter.name, feeder->filter.arglen, (char *)feeder->filter.arg);
 	return 1;
 err:
 	tbuf_reset(&rbuf);
+	tbuf_reset(&zbuf);
 	if (fd >= 0) {
 		close(fd);
 		fd = -1;
@@ -352,16 +405,18 @@ err:
 }
 
 static bool
-contains_full_row_v12(const struct tbuf *b)
+contains_full_row_v12(const struct tbuf *b, size_t skip)
 {
-	return tbuf_len(b) >= sizeof(struct row_v12) &&
-		tbuf_len(b) >= sizeof(struct row_v12) + row_v12(b)->len;
+	const struct row_v12 *row = b->ptr + skip;
+	return tbuf_len(b) >= skip + sizeof(struct row_v12) &&
+		tbuf_len(b) >= skip + sizeof(struct row_v12) + row->len;
 }
 
 - (ssize_t)
 recv_with_timeout: (ev_tstamp)timeout
 {
-	ssize_t r = tbuf_recv(&rbuf, fd);
+	struct tbuf *in = flags & REPLICATION_LZ4 ? &zbuf : &rbuf;
+	ssize_t r = tbuf_recv(in, fd);
 	if (r >= 0)
 		return r;
 
@@ -393,7 +448,7 @@ recv_with_timeout: (ev_tstamp)timeout
 		return -2;
 
 	if (w == &io)
-		return tbuf_recv(&rbuf, fd);
+		return tbuf_recv(in, fd);
 
 	assert(false);
 }
@@ -404,7 +459,7 @@ recv
 	if (abort)
 		raise_fmt("recv aborted");
 
-	tbuf_reserve(&rbuf, 256 * 1024);
+	tbuf_reserve(flags & REPLICATION_LZ4 ? &zbuf : &rbuf, 256 * 1024);
 	ssize_t r = [self recv_with_timeout: cfg.wal_feeder_keepalive_timeout];
 
 	if (r <= 0) {
@@ -416,9 +471,46 @@ recv
 		}
 	}
 
+	if (flags & REPLICATION_LZ4)
+		[self lz4_unpack];
 	return r;
 }
 
+static int stat_base = -1;
+
+- (void)
+lz4_unpack
+{
+	size_t len = 0, raw_len = 0;
+
+	while (tbuf_len(&zbuf) >= sizeof(struct replication_lz4_frame)) {
+		struct replication_lz4_frame *frame = zbuf.ptr;
+		if (tbuf_len(&zbuf) < sizeof(*frame) + frame->len)
+			break;
+
+		char *dst = tbuf_expand(&rbuf, frame->raw_len);
+		int r = LZ4_decompress_safe(frame->data, dst, frame->len, frame->raw_len);
+		if (r < 0 || (u32)r != frame->raw_len)
+			raise_fmt("lz4 frame decompression failed");
+
+		len += sizeof(*frame) + frame->len;
+		raw_len += frame->raw_len;
+		tbuf_ltrim(&zbuf, sizeof(*frame) + frame->len);
+	}
+
+	if (len == 0)
+		return;
+
+	if (stat_base < 0)
+		stat_base = stat_register_named("replication");
+	char name[64];
+	const char *peer = sintoa(&feeder->addr);
+	snprintf(name, sizeof(name), "%s_lz4_saved", peer);
+	stat_sum_named(stat_base, STAT_STR(name), (double)raw_len - len);
+	snprintf(name, sizeof(name), "%s_lz4_ratio", peer);
+	stat_aggregate_named(stat_base, STAT_STR(name), (double)raw_len / len);
+}
+
 - (void)
 abort_recv
 {
@@ -434,12 +526,19 @@ fetch_row
 	struct tbuf *buf = NULL;
 	struct row_v12 *row = NULL;
 	u32 data_crc;
+	size_t skip = flags & REPLICATION_MARKERS ? sizeof(marker) : 0;
 
 	switch (version) {
 	case 12:
-		if (!contains_full_row_v12(&rbuf))
+		if (!contains_full_row_v12(&rbuf, skip))
 			return NULL;
 
+		if (skip) {
+			if (*(u32 *)rbuf.ptr != marker)
+				raise_fmt("bad row marker");
+			tbuf_ltrim(&rbuf, skip);
+		}
+
 		buf = tbuf_split(&rbuf, sizeof(struct row_v12) + row_v12(&rbuf)->len);
 
 		data_crc = crc32c(0, row_v12(buf)->data, row_v12(buf)->len);
@@ -470,9 +569,10 @@ fetch_row
 - (ssize_t)
 recv_row
 {
+	size_t skip = flags & REPLICATION_MARKERS ? sizeof(marker) : 0;
 	switch (version) {
 	case 12:
-		while (!contains_full_row_v12(&rbuf))
+		while (!contains_full_row_v12(&rbuf, skip))
 			[self recv];
 		break;
 	default:
@@ -493,6 +593,7 @@ free
 	assert(!in_recv);
 	[self close];
 	palloc_unregister_gc_root(fiber->pool, &rbuf);
+	palloc_unregister_gc_root(fiber->pool, &zbuf);
 	return [super free];
 }
 
@@ -36,6 +36,7 @@
 #import <iproto.h>
 #import <mbox.h>
 #import <shard.h>
+#import <stat.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -44,7 +45,7 @@
 
 @interface Raft (xxx)
 - (int)wal_voted_for:(uint8_t)peer_id;
-- (int)wal_le:(const struct log_entry *)le;
+- (int)wal_les:(struct log_entry * const *)le count:(int)count;
 - (void)apply_data:(const void *)data len:(int)len tag:(u16)tag;
 @end
 
@@ -68,7 +69,7 @@
 #define MSG_CHECK(self, wbuf, type, msg)	({				\
 	type *__msg = container_of((msg), type, iproto); \
 	struct netmsg_io *io = container_of((wbuf), struct netmsg_io, wbuf); \
-	if (__msg->version != proto_version) {				\
+	if (__msg->version > proto_version) {				\
 		say_warn("%s: bad version %i, closing connect from peer %i", \
 			 __func__, __msg->version, __msg->peer_id);	\
 		[io close];						\
@@ -87,8 +88,16 @@
 
 const char *raft_msg_code[] = ENUM_STR_INITIALIZER(RAFT_CODE);
 const int quorum = 2; /* FIXME: hardcoded */
+const int append_inflight_max = 4; /* append_entries in flight, each carries a batch */
+const int append_batch_max = 256; /* must fit into single WAL pack */
 
-static u16 proto_version;
+/* 0: single entry per append_entries, no count field
+   1: counted list of entries per append_entries
+   Peers accept both.  Only multi-entry append_entries are sent as v1 and
+   only to peers which replied with version >= 1, everything else goes as
+   v0, so v0 peers keep working in mixed cluster. */
+static u16 proto_version = 1;
+static int stat_base;
 
 
 struct msg_request_vote {
@@ -108,10 +117,16 @@ struct msg_append_entries {
 	i64 prev_log_index;
 	i64 prev_log_term;
 	i64 leader_commit;
-	i64 entry_term;
+	u16 count; /* zero means keepalive */
+	char data[]; /* count times msg_entry followed by entry body */
+}  __attribute__((packed));
+/* v0 append_entries has no count and carries single msg_entry at its place,
+   zero tag means keepalive */
+
+struct msg_entry {
+	i64 term;
 	u16 tag;
 	u32 len;
-	char val[];
 }  __attribute__((packed));
 
 struct msg_reply {
@@ -133,7 +148,9 @@ union msg {
 enum log_entry_state { WAL_APPEND = 1 << 0, /* writen raft_append */
 		       WAL_COMMIT = 1 << 1, /* writen raft_commit */
 		       DELETED    = 1 << 2,
-		       REPLICATED = 1 << 3 };
+		       REPLICATED = 1 << 3,
+		       WAL_PENDING = 1 << 4, /* owned by fiber waiting for WAL */
+		       SENT       = 1 << 5 }; /* leader: included into append_entries batch */
 
 struct log_entry {
 	TAILQ_ENTRY(log_entry) link;
@@ -186,7 +203,7 @@ check_term(Raft *self, i64 term)
 }
 
 static struct msg_reply *
-msg_reply(struct iproto *_msg)
+msg_reply(Raft *self, struct iproto *_msg)
 {
 	struct iproto_retcode *msg = (struct iproto_retcode *)_msg;
 	if (msg->ret_code != 0) {
@@ -194,7 +211,24 @@ msg_reply(struct iproto *_msg)
 			 msg->ret_code, msg->data_len - 4, msg->data);
 		return NULL;
 	}
-	return container_of(msg, struct msg_reply, iproto);
+	struct msg_reply *reply = container_of(msg, struct msg_reply, iproto);
+	if (reply->peer_id < nelem(self->peer_version))
+		self->peer_version[reply->peer_id] = reply->version;
+	return reply;
+}
+
+/* max number of entries in single append_entries to peer_id,
+   or to every remote if peer_id < 0 */
+static int
+append_batch_limit(Raft *self, int peer_id)
+{
+	for (int i = 0; i < nelem(self->egress); i++) {
+		if (peer_id >= 0 && i != peer_id)
+			continue;
+		if (self->egress[i] && self->peer_version[i] < 1)
+			return 1;
+	}
+	return append_batch_max;
 }
 
 static struct msg_reply *
@@ -202,7 +236,7 @@ raft_mbox_get(Raft *self, struct iproto_mbox *mbox)
 {
 	struct iproto *msg;
 	while ((msg = iproto_mbox_get(mbox))) {
-		struct msg_reply *reply = msg_reply(msg);
+		struct msg_reply *reply = msg_reply(self, msg);
 		if (reply) {
 			assert(reply->peer_id != self->peer_id);
 			return reply;
@@ -227,36 +261,55 @@ reply(Raft *self, struct netmsg_head *h, const struct iproto *msg, u8 result)
 	};
 }
 
-#define APPEND_ENTRIES_INITIALIZER(msg, self, le) {			\
-	.iproto = { .msg_code = RAFT_APPEND_ENTRIES,			\
-		    .shard_id = (self)->id,				\
-		    .data_len = sizeof(msg) - sizeof(struct iproto) },	\
-	.version = proto_version,					\
-	.peer_id = (self)->peer_id,					\
-	.term = (self)->term,						\
-	.prev_log_index = TAILQ_PREV((le), log_tailq, link)->scn,	\
-	.prev_log_term = TAILQ_PREV((le), log_tailq, link)->term,	\
-	.leader_commit = (self)->commited->scn,				\
-	.entry_term = (le)->term,					\
-	.tag = (le)->tag,						\
-	.len = (le)->len						\
+/* build append_entries carrying count entries starting from le.
+   single entry is sent as v0 message, understood by any peer.
+   entry headers and iov are allocated from fiber->pool */
+static struct iovec *
+append_entries_prepare(Raft *self, struct msg_append_entries *msg, struct log_entry *le, int count)
+{
+	struct log_entry *prev = TAILQ_PREV(le, log_tailq, link);
+	u16 version = count > 1 ? 1 : 0;
+	u32 data_len = version > 0 ? sizeof(*msg) : offsetof(struct msg_append_entries, count);
+	*msg = (struct msg_append_entries){
+		.iproto = { .msg_code = RAFT_APPEND_ENTRIES,
+			    .shard_id = self->id,
+			    .data_len = data_len - sizeof(struct iproto) },
+		.version = version,
+		.peer_id = self->peer_id,
+		.term = self->term,
+		.prev_log_index = prev->scn,
+		.prev_log_term = prev->term,
+		.leader_commit = self->commited->scn,
+		.count = count
+	};
+
+	struct iovec *iov = palloc(fiber->pool, sizeof(*iov) * count * 2);
+	struct msg_entry *entry = palloc(fiber->pool, sizeof(*entry) * count);
+	for (int i = 0; i < count; i++, le = TAILQ_NEXT(le, link)) {
+		entry[i] = (struct msg_entry){ .term = le->term,
+					       .tag = le->tag,
+					       .len = le->len };
+		iov[i * 2] = (struct iovec){ .iov_base = entry + i, .iov_len = sizeof(*entry) };
+		iov[i * 2 + 1] = (struct iovec){ .iov_base = le->data, .iov_len = le->len };
+	}
+	return iov;
 }
 
 static int
-send_log_entry(Raft *self, int peer_id, struct log_entry *le)
+send_log_entries(Raft *self, int peer_id, struct log_entry *le, int count)
 {
 	struct log_entry *prev = TAILQ_PREV(le, log_tailq, link);
 	if (self->role != LEADER) /* only leader can send entries */
 		return -3;
 	if (!prev)
 		return -2;
-	say_debug("%s: >> term:%"PRIi64" SCN:%"PRIi64" prev_log_scn:%"PRIi64" prev_log_term:%"PRIi64,
-		   __func__, self->term, self->scn, prev->scn, prev->term);
+	say_debug("%s: >> term:%"PRIi64" SCN:%"PRIi64" prev_log_scn:%"PRIi64" prev_log_term:%"PRIi64" count:%i",
+		   __func__, self->term, self->scn, prev->scn, prev->term, count);
 
-	struct msg_append_entries msg = APPEND_ENTRIES_INITIALIZER(msg, self, le);
-	struct iovec iov = { .iov_base = le->data, .iov_len = le->len };
+	struct msg_append_entries msg;
+	struct iovec *iov = append_entries_prepare(self, &msg, le, count);
 	struct iproto_mbox mbox = IPROTO_MBOX_INITIALIZER(mbox, fiber->pool);
-	iproto_mbox_send(&mbox, self->egress[peer_id], &msg.iproto, &iov, 1);
+	iproto_mbox_send(&mbox, self->egress[peer_id], &msg.iproto, iov, count * 2);
 	mbox_timedwait(&mbox, 1, (election_timeout * 3));
 	struct msg_reply *reply = raft_mbox_get(self, &mbox);
 	int result = reply ? reply->result : -1;
@@ -288,7 +341,7 @@ catchup(va_list ap)
 again:
 	le = TAILQ_LAST(&self->log, log_tailq);
 	do {
-		int ret = send_log_entry(self, peer_id, le);
+		int ret = send_log_entries(self, peer_id, le, 1);
 		if (ret == -1) /* timeout */
 			continue;
 		else if (ret == 1)
@@ -302,12 +355,18 @@ again:
 
 	le = TAILQ_NEXT(le, link);
 	while (le) {
-		int ret = send_log_entry(self, peer_id, le);
+		int count = 0, batch_max = append_batch_limit(self, peer_id);
+		for (struct log_entry *e = le; e && count < batch_max; e = TAILQ_NEXT(e, link))
+			count++;
+
+		int ret = send_log_entries(self, peer_id, le, count);
+		prelease(fiber->pool);
 		if (ret == -1)
 			continue;
 		if (ret != 1)
 			break;
-		le = TAILQ_NEXT(le, link);
+		while (count--)
+			le = TAILQ_NEXT(le, link);
 	}
 
 exit:
@@ -345,7 +404,7 @@ wait_for_replies(Raft *self, struct iproto_mbox *mbox, ev_tstamp delay)
 
 		reply_count++; /* including errors */
 		msg = iproto_mbox_get(mbox);
-		reply = msg ? msg_reply(msg) : NULL;
+		reply = msg ? msg_reply(self, msg) : NULL;
 		if (reply == NULL) /* error */
 			continue;
 
@@ -383,7 +442,7 @@ request_vote(Raft *self)
 		.iproto = { .msg_code = RAFT_REQUEST_VOTE,
 			    .shard_id = self->id,
 			    .data_len = sizeof(msg) - sizeof(struct iproto) },
-		.version = proto_version,
+		.version = 0, /* same layout in every version */
 		.peer_id = self->peer_id,
 		.term = self->term,
 		.last_log_index = last->scn,
@@ -404,20 +463,22 @@ send_keepalive(Raft *self)
 	struct log_entry *last = TAILQ_LAST(&self->log, log_tailq);
 	assert(last->scn > 0);
 
+	/* v0 keepalive: every peer understands it and replies with its version */
 	struct msg_append_entries msg = {
 		.iproto = { .msg_code = RAFT_APPEND_ENTRIES,
 			    .shard_id = self->id,
-			    .data_len = sizeof(msg) - sizeof(struct iproto) },
-		.version = proto_version,
+			    .data_len = offsetof(struct msg_append_entries, count) - sizeof(struct iproto) },
+		.version = 0,
 		.peer_id = self->peer_id,
 		.term = self->term,
 		.prev_log_index = last->scn,
 		.prev_log_term = last->term,
 		.leader_commit = self->scn, /* self->scn === self->commited->scn */
-		.tag = 0, // no op
 	};
+	struct msg_entry nop = { .tag = 0 }; // no op
+	struct iovec iov = { .iov_base = &nop, .iov_len = sizeof(nop) };
 	struct iproto_mbox mbox = IPROTO_MBOX_INITIALIZER(mbox, fiber->pool);
-	iproto_mbox_broadcast(&mbox, &self->remotes, &msg.iproto, NULL, 0);
+	iproto_mbox_broadcast(&mbox, &self->remotes, &msg.iproto, &iov, 1);
 	fiber_sleep(election_timeout / 3);
 	wait_for_replies(self, &mbox, election_timeout / 3); /* check term on replies */
 	iproto_mbox_release(&mbox);
@@ -623,38 +684,55 @@ log_entry_discard(Raft *self, struct log_entry *le)
 	assert(le->state == 0 || le->state & DELETED);
 
 	TAILQ_REMOVE(&self->log, le, link);
+	if (le->state & WAL_PENDING)
+		return; /* will be freed by fiber writing it, see log_entries_persist() */
 	sfree(le);
 }
 
+/* persist consecutive tail entries with single WAL pack.
+   returns number of leading entries which are written and still in the log,
+   all entries past that are removed from the log */
 static int
-log_entry_persist(Raft *self, struct log_entry *le)
+log_entries_persist(Raft *self, struct log_entry **batch, int count)
 {
-	assert (le->state == 0);
-	assert(le == TAILQ_LAST(&self->log, log_tailq));
+	assert(batch[count - 1] == TAILQ_LAST(&self->log, log_tailq));
+	for (int i = 0; i < count; i++) {
+		assert(batch[i]->state == 0 || batch[i]->state == SENT);
+		batch[i]->state |= WAL_PENDING;
+	}
 
 	assert(fiber->wake_link.tqe_prev == NULL);
-	le->worker = fiber;
-	int rc = [self wal_le:le];
-	le->worker = NULL;
-	if (rc == 1) {
+	int rc = [self wal_les:batch count:count];
+
+	/* log_truncate() may remove tail of the batch while we were waiting
+	   for WAL, such entries are unlinked but not freed */
+	int alive = count;
+	for (int i = 0; i < count; i++) {
+		batch[i]->state &= ~WAL_PENDING;
+		if (batch[i]->state & DELETED) {
+			alive = MIN(alive, i);
+			sfree(batch[i]);
+		}
+	}
+
+	int written = MAX(0, MIN(rc, alive));
+	for (int i = 0; i < written; i++) {
+		struct log_entry *le = batch[i];
 		assert(le->scn < self->last_wal_append ||
 		       le->scn == self->last_wal_append + 1);
 		self->last_wal_append = le->scn;
 		le->state |= WAL_APPEND;
-		return 1;
-	} else {
-		assert(rc == 0 || rc == -1);
-		/* 0: io error, -1: truncate (resume with NULL) */
+	}
 
-		if (rc == 0) {
-			say_warn("can't persist");
-			self->role = FOLLOWER;
-		}
-		return 0;
+	if (written < alive) {
+		/* io error: every following WAL request will fail too */
+		say_warn("can't persist");
+		self->role = FOLLOWER;
+		log_truncate(self, batch[written]);
 	}
+	return written;
 }
 
-
 static void
 log_entry_mark_commited(Raft *self, struct log_entry *le)
 {
@@ -671,7 +749,7 @@ log_commit(Raft *self, i64 scn)
 	if (self->scn >= scn)
 		return NULL;
 
-	self->leader_commit = scn;
+	self->leader_commit = MAX(self->leader_commit, scn);
 	struct log_entry *le;
 
 	le = TAILQ_NEXT(self->commited, link);
@@ -710,14 +788,30 @@ append_entries_cb(struct netmsg_head *wbuf, struct iproto *msg)
 	struct Raft *self = RT_SHARD(msg);
 	struct msg_append_entries *append = MSG_CHECK(self, wbuf, struct msg_append_entries, msg);
 	int result = 0;
-	int is_keepalive = append->tag == 0;
+
+	/* v0 message carries single entry at place of count */
+	size_t header_len = append->version == 0 ?
+			    offsetof(struct msg_append_entries, count) + sizeof(struct msg_entry) :
+			    sizeof(*append);
+	if (sizeof(struct iproto) + msg->data_len < header_len) {
+		say_warn("%s: short append_entries from peer %i", __func__, append->peer_id);
+		reply(self, wbuf, msg, 0);
+		return;
+	}
+	const char *entries = append->version == 0 ? (const char *)&append->count : append->data,
+		   *end = (const char *)(msg + 1) + msg->data_len;
+	int entry_count;
+	if (append->version == 0)
+		entry_count = ((const struct msg_entry *)entries)->tag != 0;
+	else
+		entry_count = append->count;
+	int is_keepalive = entry_count == 0;
 
 	if (!is_keepalive) {
-		say_trace("%s: << term:%"PRIi64" entry_term:%"PRIi64
-			   " prev_log_scn:%"PRIi64" prev_log_term:%"PRIi64"%s",
-			   __func__, append->term, append->entry_term,
-			   append->prev_log_index, append->prev_log_term,
-			   append->tag == 0 ? " keepalive" : "");
+		say_trace("%s: << term:%"PRIi64" count:%i"
+			   " prev_log_scn:%"PRIi64" prev_log_term:%"PRIi64,
+			   __func__, append->term, entry_count,
+			   append->prev_log_index, append->prev_log_term);
 		say_trace("|\tpeer:%s op:0x%x sync:%u req_term:%"PRIi64,
 			   net_fd_name(container_of(wbuf, struct netmsg_io, wbuf)->fd),
 			   msg->msg_code, msg->sync, append->term);
@@ -740,22 +834,51 @@ append_entries_cb(struct netmsg_head *wbuf, struct iproto *msg)
 			return;
 		}
 
-		struct log_entry *le;
-		le = log_entry_append(self, append->prev_log_index + 1, append->entry_term,
-				      append->val, append->len, append->tag);
-		if (le->state & WAL_APPEND) {
-			result = 1; /* already written to WAL */
-		} else {
-			result = log_entry_persist(self, le);
-			if (!result)
-				log_entry_discard(self, le);
+		if (entry_count > WAL_PACK_MAX) {
+			say_warn("%s: malformed append_entries from peer %i, count:%i",
+				 __func__, append->peer_id, entry_count);
+			goto reply;
+		}
+
+		const char *ptr = entries;
+		for (int i = 0; i < entry_count; i++) {
+			const struct msg_entry *entry = (const struct msg_entry *)ptr;
+			if (end - ptr < sizeof(*entry) || end - ptr - sizeof(*entry) < entry->len) {
+				say_warn("%s: malformed append_entries from peer %i", __func__, append->peer_id);
+				goto reply;
+			}
+			ptr += sizeof(*entry) + entry->len;
+		}
+
+		struct log_entry **batch = palloc(fiber->pool, sizeof(*batch) * entry_count);
+		struct log_entry *le = NULL;
+		int count = 0;
+
+		ptr = entries;
+		for (int i = 0; i < entry_count; i++) {
+			const struct msg_entry *entry = (const struct msg_entry *)ptr;
+			ptr += sizeof(*entry) + entry->len;
+
+			le = log_entry_append(self, append->prev_log_index + 1 + i, entry->term,
+					      entry + 1, entry->len, entry->tag);
+			if (le->state & WAL_PENDING) {
+				/* same entry is being written by concurrent request,
+				   leader will retry */
+				assert(count == 0);
+				goto reply;
+			}
+			if ((le->state & (WAL_APPEND|REPLICATED)) == 0)
+				batch[count++] = le;
+			else
+				assert(count == 0); /* already written to WAL */
 		}
 
+		result = count == 0 || log_entries_persist(self, batch, count) == count;
 		if (result)
 			log_commit(self, MIN(le->scn, append->leader_commit));
 	} else {
-		say_trace("|\tlog mismatch prev_log_scn:%"PRIi64 " prev_log_term:%"PRIi64 " tag:%s : %s",
-			   append->prev_log_index, append->prev_log_term, xlog_tag_to_a(append->tag),
+		say_trace("|\tlog mismatch prev_log_scn:%"PRIi64 " prev_log_term:%"PRIi64 " : %s",
+			   append->prev_log_index, append->prev_log_term,
 			   match == 0 ? "prev log entry term not equal" : "log entry not found");
 	}
 
@@ -936,27 +1059,56 @@ wal_dumper_fib(va_list ap)
 	}
 }
 
+/* Entries of concurrent submitters are coalesced: fiber which finds
+   free append slot becomes batch owner.  It sends all not yet sent
+   entries of current term with single append_entries, writes them with
+   single WAL pack and waits for quorum.  Up to append_inflight_max
+   batches are in flight.  Other submitters wait until owner commits or
+   truncates their entries or until next slot is free. */
+
+static int batch_turn; /* resume argument: append slot is free */
+
 static int
-commit_log_entry(Raft *self, struct log_entry *le)
+log_entry_finish(Raft *self, struct log_entry *le, int result)
 {
-	//palloc_register_cut_point(fiber->pool);
-	struct msg_append_entries msg = APPEND_ENTRIES_INITIALIZER(msg, self, le);
-	struct iovec iov = { .iov_base = le->data, .iov_len = le->len };
-	struct iproto_mbox mbox = IPROTO_MBOX_INITIALIZER(mbox, fiber->pool);
-	iproto_mbox_broadcast(&mbox, &self->remotes, &msg.iproto, &iov, 1);
+	switch (result) {
+	case 1:
+		log_commit(self, le->scn - 1); /* commit all previous entries */
+		log_entry_mark_commited(self, le);
+		break;
+	case 0:
+		break;
+	case -1:
+		if (le->state & DELETED)
+			log_entry_discard(self, le); /* resumed by log_truncate() */
+		else
+			log_truncate(self, le);
+		break;
+	}
+	return result;
+}
 
-	assert(self->role == LEADER); // FIXME: а может быть по другому?
-	int result = 0;
-	if (le->state == 0 && log_entry_persist(self, le) != 1) {
-		result = -1;
-		goto release;
+static void
+batch_next(Raft *self)
+{
+	struct log_entry *le = TAILQ_LAST(&self->log, log_tailq), *next = NULL;
+	while (le && le->scn > self->scn && (le->state & SENT) == 0) {
+		if (le->worker)
+			next = le;
+		le = TAILQ_PREV(le, log_tailq, link);
 	}
+	if (next)
+		resume(next->worker, &batch_turn);
+}
 
+static int
+wait_for_quorum(Raft *self, struct log_entry *le, struct log_entry *last, struct iproto_mbox *mbox)
+{
 	ev_tstamp deadline = ev_now() + election_timeout;
 
 	assert(le->state & WAL_APPEND);
 	le->worker = fiber;
-	int votes = wait_for_replies(self, &mbox, 0); /* FIXME: таймаут = ? */
+	int votes = wait_for_replies(self, mbox, 0); /* FIXME: таймаут = ? */
 	if (votes == 0) {
 		ev_timer w = { .coro = 1 };
 		ev_timer_init(&w, (void *)fiber, deadline - ev_now(), 0);
@@ -967,38 +1119,113 @@ commit_log_entry(Raft *self, struct log_entry *le)
 		if (y == NULL)
 			votes = -1;
 	}
-
 	le->worker = NULL;
 
-	if (votes >= 0) {
-		result = votes >= quorum - 1;
-	} else {
-		/* wake up by log_truncate or by log_entry_commit */
-		if (self->leader_commit >= le->scn)
-			result = 1;
-		else
-			result = -1;
+	if (votes >= 0)
+		return votes >= quorum - 1;
+
+	/* wake up by log_truncate or by log_entry_commit */
+	if (self->leader_commit >= last->scn && (le->state & DELETED) == 0)
+		return 1;
+	return -1;
+}
+
+/* first unsent entry of the batch le belongs to */
+static struct log_entry *
+batch_head(Raft *self, struct log_entry *le)
+{
+	struct log_entry *head = le, *prev;
+	while ((prev = TAILQ_PREV(head, log_tailq, link)) &&
+	       prev->scn > self->scn && prev->term == le->term &&
+	       (prev->state & SENT) == 0)
+		head = prev;
+	return head;
+}
+
+static int
+commit_batch(Raft *self, struct log_entry *le)
+{
+	struct log_entry *head = batch_head(self, le), *last;
+	int idx = le->scn - head->scn;
+	assert(idx < WAL_PACK_MAX);
+	int count = TAILQ_LAST(&self->log, log_tailq)->scn - head->scn + 1;
+	count = MIN(count, MAX(append_batch_limit(self, -1), idx + 1));
+	assert(count <= WAL_PACK_MAX);
+
+	struct log_entry **batch = palloc(fiber->pool, sizeof(*batch) * count);
+	last = head;
+	for (int i = 0; i < count; i++, last = TAILQ_NEXT(last, link)) {
+		assert(last->state == 0);
+		last->state |= SENT;
+		batch[i] = last;
 	}
+	last = batch[count - 1];
 
-release:
-	iproto_mbox_release(&mbox);
-	// palloc_cutoff(fiber->pool);
+	self->append_inflight++;
+	stat_aggregate_named(stat_base, STAT_STR("entries_per_append"), count);
 
-	switch (result) {
-	case 1:
-		log_commit(self, le->scn - 1); /* commit all previous entries */
-		log_entry_mark_commited(self, le);
-		break;
-	case 0:
-		break;
-	case -1:
-		log_entry_discard(self, le);
-		break;
+	struct msg_append_entries msg;
+	struct iovec *iov = append_entries_prepare(self, &msg, head, count);
+	struct iproto_mbox mbox = IPROTO_MBOX_INITIALIZER(mbox, fiber->pool);
+	iproto_mbox_broadcast(&mbox, &self->remotes, &msg.iproto, iov, count * 2);
+
+	int result = -1;
+	int written = log_entries_persist(self, batch, count);
+	if (written <= idx) /* le is already removed from the log */
+		goto release;
+
+	while (written == count) {
+		result = wait_for_quorum(self, le, last, &mbox);
+		if (result != 0)
+			break;
+
+		/* no quorum: resend whole batch */
+		iproto_mbox_release(&mbox);
+		iproto_mbox_broadcast(&mbox, &self->remotes, &msg.iproto, iov, count * 2);
 	}
+	log_entry_finish(self, le, result);
+	if (result == 1)
+		log_commit(self, last->scn); /* resumes rest of the batch */
+release:
+	iproto_mbox_release(&mbox);
+	self->append_inflight--;
+	if (self->role == LEADER)
+		batch_next(self);
 	return result;
 }
 
+static int
+commit_log_entry(Raft *self, struct log_entry *le)
+{
+	if (self->role != LEADER) /* leadership lost while waiting */
+		return log_entry_finish(self, le, -1);
+
+	if ((le->state & SENT) == 0 && self->append_inflight < append_inflight_max) {
+		int batch_max = append_batch_limit(self, -1) > 1 ? WAL_PACK_MAX : 1;
+		if (le->scn - batch_head(self, le)->scn < batch_max)
+			return commit_batch(self, le);
+		/* le doesn't fit into single WAL pack (or v0 peer is present and
+		   batching is off) with entries queued before it: let the oldest
+		   waiter send its batch first */
+		batch_next(self);
+	}
 
+	/* entry either sent by batch owner or waits for free append slot */
+	ev_timer w = { .coro = 1 };
+	ev_timer_init(&w, (void *)fiber, election_timeout, 0);
+	ev_timer_start(&w);
+	le->worker = fiber;
+	void *y = yield();
+	le->worker = NULL;
+	ev_timer_stop(&w);
+
+	if (y == &w || y == &batch_turn)
+		return 0;
+
+	assert(y == NULL);
+	return log_entry_finish(self, le, self->leader_commit >= le->scn &&
+					  (le->state & DELETED) == 0 ? 1 : -1);
+}
 
 static void
 commit_nop(va_list ap)
@@ -1012,10 +1239,11 @@ commit_nop(va_list ap)
 	struct log_entry *le = log_entry_alloc(self, INT64_MAX, term, body, nelem(body), nop);
 
 	while (self->role == LEADER && term == self->term) {
-		if (commit_log_entry(self, le) == 1) {
+		int result = commit_log_entry(self, le);
+		if (result == 1)
 			self->nop_commited = 1;
+		if (result != 0)
 			return;
-		}
 	}
 }
 
@@ -1097,14 +1325,17 @@ submit:(const void *)data len:(u32)len tag:(u16)tag
 
 	struct log_entry *tmp = self->commited;
 	while ((tmp = TAILQ_NEXT(tmp, link)))
-		assert(tmp->worker);
+		assert(tmp->worker || tmp->state & SENT); /* batch owner doesn't set worker */
 
+	ev_tstamp start = ev_now();
 	struct log_entry *le = log_entry_alloc(self, INT64_MAX, self->term, data, len, tag);
 
 	int result;
 	assert(fiber->wake_link.tqe_prev == NULL);
 	do result = commit_log_entry(self, le);
 	while (result == 0);
+	if (result > 0)
+		stat_aggregate_named(stat_base, STAT_STR("commit_latency"), (ev_now() - start) * 1000);
 	return result > 0;
 }
 
@@ -1282,20 +1513,31 @@ wal_voted_for:(u8)vote_peer_id
 }
 
 - (int)
-wal_le:(const struct log_entry *)le
+wal_les:(struct log_entry * const *)le count:(int)count
 {
-	struct tbuf buf = TBUF(NULL, 0, fiber->pool);
+	struct wal_pack pack;
 	u16 flags = 0;
-	tbuf_append(&buf, &flags, sizeof(flags));
-	tbuf_append(&buf, &le->term, sizeof(le->term));
-	tbuf_append(&buf, &le->tag, sizeof(le->tag));
-	return [self write_scn:le->scn header:&buf data:le->data len:le->len tag:raft_append];
+	wal_pack_prepare(recovery->writer, &pack);
+	for (int i = 0; i < count; i++) {
+		struct row_v12 row = { .scn = le[i]->scn,
+				       .tag = raft_append,
+				       .shard_id = self->id };
+		wal_pack_append_row(&pack, &row);
+		wal_pack_append_data(&pack, &flags, sizeof(flags));
+		wal_pack_append_data(&pack, &le[i]->term, sizeof(le[i]->term));
+		wal_pack_append_data(&pack, &le[i]->tag, sizeof(le[i]->tag));
+		wal_pack_append_data(&pack, le[i]->data, le[i]->len);
+	}
+	assert(fiber->wake_link.tqe_prev == NULL);
+	struct wal_reply *reply = [recovery->writer wal_pack_submit];
+	return reply ? reply->row_count : -1;
 }
 
 void
 raft_service(struct iproto_service *s)
 {
 	netmsg_pool_ctx_init(&raft_ctx, "raft_pool", 64 * 1024);
+	stat_base = stat_register_named("raft");
 
         service_register_iproto(s, RAFT_REQUEST_VOTE, request_vote_cb, IPROTO_LOCAL|IPROTO_DROP_ERROR);
 	service_register_iproto(s, RAFT_APPEND_ENTRIES, append_entries_cb, IPROTO_LOCAL|IPROTO_DROP_ERROR);
@@ -45,10 +45,12 @@ init_recovery:(id<RecoverRow>)recovery_
 - (void)
 recover_row_stream:(XLog *)stream
 {
+	bool has_cutoff = [(id)recovery respondsTo:@selector(recover_row_cutoff)];
 	@try {
 		unsigned row_count = 0;
 		unsigned estimated_snap_rows = 0;
 		struct row_v12 *row;
+		ev_tstamp start = ev_time();
 		palloc_register_cut_point(fiber->pool);
 
 		if (stream->dir == snap_dir) {
@@ -84,23 +86,32 @@ recover_row_stream:(XLog *)stream
 			row_count++;
 
 			if ((row_count & 0x1ff) == 0x1ff) {
+				if (has_cutoff)
+					[(id)recovery recover_row_cutoff];
 				palloc_cutoff(fiber->pool);
 				palloc_register_cut_point(fiber->pool);
 			}
 
 			if ((row_count & 0x1ffff) == 0x1ffff) {
+				double rate = row_count / (ev_time() - start) / 1000.;
 				if (estimated_snap_rows && row_count <= estimated_snap_rows) {
 					float pct = 100. * row_count / estimated_snap_rows;
-					say_info("%.1fM/%.2f%% rows recovered",
-						 row_count / 1000000., pct);
-					title("loading %.2f%%", pct);
+					say_info("%.1fM/%.2f%% rows recovered, %.1fK rows/s",
+						 row_count / 1000000., pct, rate);
+					title("loading %.2f%% %.1fK rows/s", pct, rate);
 				} else {
-					say_info("%.1fM rows recovered", row_count / 1000000.);
+					say_info("%.1fM rows recovered, %.1fK rows/s",
+						 row_count / 1000000., rate);
+					if (stream->dir == snap_dir)
+						title("loading %.1fM rows %.1fK rows/s",
+						      row_count / 1000000., rate);
 				}
 			}
 		}
 	}
 	@finally {
+		if (has_cutoff)
+			[(id)recovery recover_row_cutoff];
 		palloc_cutoff(fiber->pool);
 	}
 }
@@ -124,6 +135,8 @@ recover_snap:(XLog *)snap
 		}
 
 		say_info("recover from `%s'", snap->filename);
+		if (cfg.snap_load_threads > 1)
+			[snap verify_ahead];
 		lsn = snap->lsn;
 		[self recover_row_stream:snap];
 
@@ -781,6 +781,17 @@ write_initial_state
 	return [snap_writer snapshot_write];
 }
 
+- (bool)
+snapshot_nofork_capable
+{
+	for (int i = 0; i < MAX_SHARD; i++) {
+		Shard<Shard> *shard = [self shard:i];
+		if (shard && ![(id)[shard executor] respondsTo:@selector(snapshot_freeze)])
+			return false;
+	}
+	return true;
+}
+
 - (int)
 fork_and_snapshot
 {
@@ -795,6 +806,16 @@ fork_and_snapshot
 		return -1;
 	}
 
+	if (cfg.snap_no_fork && [self snapshot_nofork_capable]) {
+		lsn = [self lsn];
+		snapshot_running = true;
+		int r = [snap_writer snapshot_write_nofork:&snapshot_lock];
+		snapshot_running = false;
+		if (r == 0)
+			last_snapshot_lsn = lsn;
+		return r;
+	}
+
 	wlock(&snapshot_lock);
 	lsn = [self lsn];
 	p = oct_fork();
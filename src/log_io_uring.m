@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2026 octopus contributors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#import <util.h>
+#import <log_io.h>
+#import <say.h>
+
+#if HAVE_LIBURING
+#include <liburing.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+enum { URING_WRITE = 1, URING_SYNC = 2 };
+
+struct xlog_uring {
+	struct io_uring ring;
+	bool header_flushed;
+	int inflight; /* number of submitted sqe */
+	int submit_error;
+	bool sync; /* fdatasync linked to inflight write */
+	off_t synced_offset;
+	char *buf;
+	size_t len, size;
+};
+
+@implementation XLogUring
+
++ (bool)
+available
+{
+	struct io_uring ring;
+	struct io_uring_probe *probe;
+	bool ok;
+
+	if (io_uring_queue_init(2, &ring, 0) < 0)
+		return false;
+	probe = io_uring_get_probe_ring(&ring);
+	ok = probe != NULL &&
+	     io_uring_opcode_supported(probe, IORING_OP_WRITE) &&
+	     io_uring_opcode_supported(probe, IORING_OP_FSYNC);
+	if (probe)
+		io_uring_free_probe(probe);
+	io_uring_queue_exit(&ring);
+	return ok;
+}
+
+- (XLog *)
+init_filename:(const char *)filename_
+	   fd:(FILE *)fd_
+	  dir:(XLogDir *)dir_
+	 vbuf:(char *)vbuf_
+{
+	[super init_filename:filename_ fd:fd_ dir:dir_ vbuf:vbuf_];
+
+	uring = xcalloc(1, sizeof(*uring));
+	int r = io_uring_queue_init(4, &uring->ring, 0);
+	if (r < 0) {
+		errno = -r;
+		say_syserror("io_uring_queue_init, falling back to stdio");
+		free(uring);
+		uring = NULL;
+		return self;
+	}
+	uring->synced_offset = -1;
+	return self;
+}
+
+- (void)
+reap
+{
+	struct io_uring_cqe *cqe;
+	ssize_t written = uring->submit_error;
+	int sync_res = -ECANCELED;
+
+	for (; uring->inflight > 0; uring->inflight--) {
+		int r;
+		while ((r = io_uring_wait_cqe(&uring->ring, &cqe)) == -EINTR);
+		if (r < 0) {
+			errno = -r;
+			panic_syserror("io_uring_wait_cqe");
+		}
+		if (io_uring_cqe_get_data(cqe) == (void *)URING_WRITE)
+			written = cqe->res;
+		else
+			sync_res = cqe->res;
+		io_uring_cqe_seen(&uring->ring, cqe);
+	}
+	uring->submit_error = 0;
+
+	off_t tail;
+	if (written == (ssize_t)uring->len) {
+		tail = wet_rows_offset[wet_rows - 1];
+		next_lsn += wet_rows;
+		rows += wet_rows;
+	} else {
+		if (written < 0) {
+			errno = -written;
+			say_syserror("io_uring write");
+			written = 0;
+		}
+
+		tail = offset;
+		for (int i = 0; i < wet_rows; i++) {
+			if (wet_rows_offset[i] > offset + written) {
+				say_error("failed to write %lli rows", (long long)(wet_rows - i));
+				break;
+			}
+			tail = wet_rows_offset[i];
+			next_lsn++;
+			rows++;
+		}
+		if (ftruncate(fileno(fd), tail) == -1)
+			say_syserror("ftruncate");
+	}
+
+	if (uring->sync) {
+		if (sync_res == 0)
+			uring->synced_offset = tail;
+		else if (sync_res != -ECANCELED) {
+			errno = -sync_res;
+			say_syserror("io_uring fdatasync");
+		}
+	}
+
+	bytes_written += tail - offset;
+	offset = tail;
+	wet_rows = 0;
+	uring->len = 0;
+	uring->sync = false;
+}
+
+- (void)
+uring_teardown
+{
+	if (uring == NULL)
+		return;
+	if (uring->inflight > 0)
+		[self reap];
+	io_uring_queue_exit(&uring->ring);
+	free(uring->buf);
+	free(uring);
+	uring = NULL;
+}
+
+- (int)
+write_row:(const struct row_v12 *)row data:(const void *)data
+{
+	if (uring == NULL)
+		return [super write_row:row data:data];
+
+	/* batch is appended only after previous one is reaped */
+	assert(uring->inflight == 0);
+
+	if (!uring->header_flushed) {
+		if (fflush(fd) < 0) {
+			say_syserror("fflush");
+			return -1;
+		}
+		uring->header_flushed = true;
+	}
+
+	size_t len = sizeof(marker) + sizeof(*row) + row->len;
+	if (uring->len + len > uring->size) {
+		uring->size = MAX(uring->size * 2, uring->len + len);
+		uring->buf = xrealloc(uring->buf, uring->size);
+	}
+
+	char *p = uring->buf + uring->len;
+	memcpy(p, &marker, sizeof(marker));
+	memcpy(p + sizeof(marker), row, sizeof(*row));
+	memcpy(p + sizeof(marker) + sizeof(*row), data, row->len);
+	uring->len += len;
+	return 0;
+}
+
+- (bool)
+submit_write:(bool)sync
+{
+	if (uring == NULL || wet_rows == 0 || uring->inflight > 0)
+		return false;
+
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&uring->ring);
+	io_uring_prep_write(sqe, fileno(fd), uring->buf, uring->len, offset);
+	io_uring_sqe_set_data(sqe, (void *)URING_WRITE);
+
+	if (sync) {
+		sqe->flags |= IOSQE_IO_LINK;
+		sqe = io_uring_get_sqe(&uring->ring);
+		io_uring_prep_fsync(sqe, fileno(fd), IORING_FSYNC_DATASYNC);
+		io_uring_sqe_set_data(sqe, (void *)URING_SYNC);
+	}
+
+	int r;
+	while ((r = io_uring_submit(&uring->ring)) == -EINTR);
+	if (r < 0) {
+		/* drop queued sqe, error will be reported by [confirm_write] */
+		io_uring_queue_exit(&uring->ring);
+		if ((errno = -io_uring_queue_init(4, &uring->ring, 0)) != 0)
+			panic_syserror("io_uring_queue_init");
+		uring->submit_error = r;
+		return false;
+	}
+	uring->inflight = sync ? 2 : 1;
+	uring->sync = sync;
+	return true;
+}
+
+- (int)
+completion_fd
+{
+	return uring != NULL ? uring->ring.ring_fd : -1;
+}
+
+- (i64)
+confirm_write
+{
+	if (uring == NULL)
+		return [super confirm_write];
+
+	assert(next_lsn != 0);
+	assert(mode == LOG_WRITE);
+
+	if (wet_rows > 0) {
+		if (uring->inflight == 0 && uring->submit_error == 0)
+			[self submit_write:false];
+		[self reap];
+	}
+	return next_lsn - 1;
+}
+
+- (int)
+flush
+{
+	if (uring != NULL && wet_rows == 0 && uring->synced_offset == offset)
+		return 0;
+	return [super flush];
+}
+
+- (int)
+datasync
+{
+	if (uring != NULL && wet_rows == 0 && uring->synced_offset == offset)
+		return 0;
+	return [super datasync];
+}
+
+- (int)
+write_eof_marker
+{
+	if (uring != NULL) {
+		if (wet_rows > 0)
+			[self confirm_write];
+		/* rows were written past stdio, reposition before appending marker */
+		if (fseeko(fd, offset, SEEK_SET) < 0) {
+			say_syserror("fseeko");
+			return -1;
+		}
+		uring->synced_offset = -1;
+	}
+	return [super write_eof_marker];
+}
+
+- (int)
+close
+{
+	[self uring_teardown];
+	return [super close];
+}
+
+@end
+#endif
+
+register_source();
@@ -35,6 +35,7 @@
 #import <say.h>
 #import <spawn_child.h>
 #import <shard.h>
+#import <stat.h>
 
 #include <third_party/crc32.h>
 
@@ -46,6 +47,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 
 #if HAVE_LINUX_FALLOC_H
 #include <linux/falloc.h>
@@ -62,6 +66,7 @@ struct wal_disk_writer_conf {
 	XLog *current_wal;	/* the WAL we'r currently reading/writing from/to */
 	XLog *wal_to_close;
 	i64 scn[MAX_SHARD];
+	ev_tstamp last_flush;
 }
 - (id) init_conf:(const struct wal_disk_writer_conf *)conf_;
 @end
@@ -115,10 +120,27 @@ prepare_write
 	return 0;
 }
 
+/* returns true if write is in progress and [confirm_write] must be
+   called after completion_fd becomes readable */
+- (bool)
+submit_write:(bool)sync
+{
+	if (current_wal == nil)
+		return false;
+	if (cfg.wal_fsync_delay >= 0 && ev_now() - last_flush >= cfg.wal_fsync_delay)
+		sync = true;
+	return [current_wal submit_write:sync];
+}
+
+- (int)
+completion_fd
+{
+	return current_wal != nil ? [current_wal completion_fd] : -1;
+}
+
 - (int)
 confirm_write
 {
-	static ev_tstamp last_flush;
 	int count = 0;
 
 	if (current_wal != nil) {
@@ -166,24 +188,135 @@ confirm_write
 	return count;
 }
 
+- (int)
+datasync
+{
+	/* rows of just rotated WAL are not synced until it closed */
+	if (wal_to_close != nil && [wal_to_close datasync] < 0)
+		return -1;
+	if (current_wal != nil && [current_wal datasync] < 0)
+		return -1;
+	return 0;
+}
+
 @end
 
+int
+wal_sync_mode_parse(const char *str)
+{
+	if (str == NULL || strcmp(str, "async") == 0)
+		return WAL_SYNC_ASYNC;
+	if (strcmp(str, "write") == 0)
+		return WAL_SYNC_WRITE;
+	if (strcmp(str, "fsync") == 0)
+		return WAL_SYNC_FSYNC;
+	return -1;
+}
+
 struct request {
 	u32 row_count;
 	int shard_id;
 	i64 epoch;
+	u32 sync_mode;
+	u32 bytes;
+	i64 first_lsn;
 	struct wal_reply *reply;
 	struct row_v12 **rows;
 };
 
+/* group commit: replies to WAL_SYNC_FSYNC requests are held until
+   single fdatasync covering all rows written during the window succeeds.
+   Replies are never reordered, so everything queued behind held reply is held too. */
+struct group_commit {
+	struct wal_reply *held;
+	int held_count, held_size;
+	bool dirty; /* has rows to be synced */
+	ev_tstamp start;
+	u32 rows, bytes;
+	struct wal_reply stat; /* sync stat, piggybacked on the next reply */
+};
+
+static void
+group_commit_hold(struct group_commit *gc, const struct wal_reply *reply)
+{
+	if (gc->held_count == gc->held_size) {
+		gc->held_size = gc->held_size * 2 ?: 64;
+		gc->held = xrealloc(gc->held, gc->held_size * sizeof(*gc->held));
+	}
+	gc->held[gc->held_count++] = *reply;
+}
+
+static void
+group_commit_add(struct group_commit *gc, u32 rows, u32 bytes)
+{
+	if (!gc->dirty) {
+		gc->dirty = true;
+		gc->start = ev_now();
+	}
+	gc->rows += rows;
+	gc->bytes += bytes;
+}
+
+/* milliseconds left till the end of window, 0 if window is over */
+static int
+group_commit_timeout(const struct group_commit *gc)
+{
+	if (cfg.wal_group_commit_bytes > 0 && gc->bytes >= cfg.wal_group_commit_bytes)
+		return 0;
+	ev_tstamp left = gc->start + cfg.wal_group_commit_delay - ev_now();
+	return left > 0 ? (int)(left * 1000) + 1 : 0;
+}
+
+static void
+group_commit_stamp(struct group_commit *gc, struct wal_reply *reply)
+{
+	if (gc->stat.group_rows == 0)
+		return;
+	reply->group_rows = gc->stat.group_rows;
+	reply->group_bytes = gc->stat.group_bytes;
+	reply->sync_time = gc->stat.sync_time;
+	gc->stat.group_rows = 0;
+}
+
+static int flush_iov(int fd, struct iovec *iov, int count);
+
+static int
+group_commit_sync(WALDiskWriter *writer, struct group_commit *gc, int fd)
+{
+	ev_tstamp start = ev_time();
+	/* there is no sane way to recover from fdatasync failure:
+	   rows may be lost by kernel while already visible to readers of the file */
+	if ([writer datasync] < 0)
+		panic("unable to sync WAL, can't guarantee durability");
+
+	gc->stat.group_rows = gc->rows;
+	gc->stat.group_bytes = gc->bytes;
+	gc->stat.sync_time = ev_time() - start;
+	gc->dirty = false;
+	gc->rows = gc->bytes = 0;
+
+	if (gc->held_count == 0)
+		return 0;
+
+	group_commit_stamp(gc, &gc->held[0]);
+	struct iovec *iov = palloc(fiber->pool, gc->held_count * sizeof(*iov));
+	for (int i = 0; i < gc->held_count; i++)
+		iov[i] = (struct iovec){ .iov_base = &gc->held[i],
+					 .iov_len = gc->held[i].packet_len };
+	int count = gc->held_count;
+	gc->held_count = 0;
+	return flush_iov(fd, iov, count);
+}
+
 #define BATCH_SIZE 1024
-static int flush(int fd, const struct request *requests, int count)
+static int
+flush_iov(int fd, struct iovec *iov, int count)
 {
-	struct iovec iovbuf[BATCH_SIZE], *iov = iovbuf;
-	for (int i = 0; i < count; i++) {
-		struct wal_reply *reply = requests[i].reply;
-		iov[i] = (struct iovec){ .iov_base = reply,
-					 .iov_len = reply->packet_len };
+	while (count > IOV_MAX) {
+		if (flush_iov(fd, iov, IOV_MAX) < 0)
+			return -1;
+		iov += IOV_MAX;
+		count -= IOV_MAX;
 	}
 
 	do {
@@ -208,6 +341,18 @@ static int flush(int fd, const struct request *requests, int count)
 	return 0;
 }
 
+static int
+flush(int fd, const struct request *requests, int count)
+{
+	struct iovec iov[BATCH_SIZE];
+	for (int i = 0; i < count; i++) {
+		struct wal_reply *reply = requests[i].reply;
+		iov[i] = (struct iovec){ .iov_base = reply,
+					 .iov_len = reply->packet_len };
+	}
+	return flush_iov(fd, iov, count);
+}
+
 static int
 request_row_count(struct tbuf *rbuf)
 {
@@ -234,28 +379,81 @@ request_parse(struct request *request, int row_count, struct tbuf *rbuf)
 	request->reply = p0alloc(fiber->pool, sizeof(struct wal_reply));
 	request->reply->seq = read_u64(rbuf);
 	request->epoch = read_u64(rbuf);
+	request->sync_mode = read_u32(rbuf);
 	request->reply->lsn = -1;
 	request->shard_id = -1;
+	request->bytes = 0;
 
 	for (int i = 0; i < row_count; i++) {
 		struct row_v12 *h = read_bytes(rbuf, sizeof(*h));
 		tbuf_ltrim(rbuf, h->len); /* row data */
+		request->bytes += sizeof(*h) + h->len;
 		request->rows[i] = h;
 		assert(request->shard_id == -1 || request->shard_id == h->shard_id);
 		request->shard_id = h->shard_id;
 	}
 }
 
+static int
+batch_reply(WALDiskWriter *writer, int fd, struct request *requests, int request_count,
+	    int rows_appended, i64 *epoch, struct group_commit *gc)
+{
+	int rows_confirmed = [writer confirm_write];
+	assert(rows_appended >= rows_confirmed);
+
+	if (rows_appended != rows_confirmed) /* some rows failed to flush */
+		(*epoch)++;
+
+	int reply_count = 0;
+	for (int i = 0; i < request_count; i++) {
+		struct request *request = &requests[i];
+		struct wal_reply *reply = request->reply;
+
+		reply->row_count = MIN(rows_confirmed, request->row_count); /* real number rows written to disk */
+		reply->packet_len = sizeof(struct wal_reply);
+		reply->epoch = *epoch;
+		if (reply->row_count > 0)
+			reply->lsn = request->first_lsn + reply->row_count - 1;
+
+		rows_confirmed -= reply->row_count;
+
+		if (reply->row_count > 0 && request->sync_mode >= WAL_SYNC_WRITE)
+			group_commit_add(gc, reply->row_count,
+					 (u64)request->bytes * reply->row_count / request->row_count);
+
+		if (gc->held_count > 0 ||
+		    (reply->row_count > 0 && request->sync_mode == WAL_SYNC_FSYNC))
+			group_commit_hold(gc, reply);
+		else
+			reply_count++;
+
+		say_debug("reply[%i] rows:%i LSN:%"PRIi64,
+			  i, reply->row_count, reply->lsn);
+	}
+
+	if (reply_count > 0) {
+		group_commit_stamp(gc, requests[0].reply);
+		if (flush(fd, requests, reply_count) < 0)
+			return -1;
+	}
+
+	if (gc->dirty && group_commit_timeout(gc) == 0)
+		return group_commit_sync(writer, gc, fd);
+	return 0;
+}
+
 int
 wal_disk_writer(int fd, int cfd __attribute__((unused)), void *state, int len)
 {
 	struct wal_disk_writer_conf *conf = state;
 	WALDiskWriter *writer = [[WALDiskWriter alloc] init_conf:conf];
 	struct request requests[BATCH_SIZE];
+	struct group_commit gc = { .held = NULL };
 	struct tbuf rbuf = TBUF(NULL, 0, fiber->pool);
 	int result = EXIT_FAILURE;
 	ssize_t r;
-	int request_count;
+	int request_count = 0, rows_appended = 0;
+	bool inflight = false; /* batch is being written asynchronously */
 	i64 epoch = 0;
 
 	assert(sizeof(*conf) == len);
@@ -272,23 +470,90 @@ wal_disk_writer(int fd, int cfd __attribute__((unused)), void *state, int len)
 	/* ignore SIGUSR1, so accidental miss in 'kill -USR1' won't cause crash */
 	signal(SIGUSR1, SIG_IGN);
 
+	if (cfg.wal_io_uring) {
+#if HAVE_LIBURING
+		if ([XLogUring available]) {
+			[wal_dir set_xlog_class:[XLogUring class]];
+			say_info("using io_uring for WAL writes");
+		} else
+			say_warn("io_uring is not available, falling back to stdio");
+#else
+		say_warn("io_uring support is not compiled in, falling back to stdio");
+#endif
+	}
+
 	for (;;) {
-		tbuf_reserve(&rbuf, 16 * 1024);
-		r = tbuf_recv(&rbuf, fd);
-		if (r < 0 && (errno == EINTR))
-			continue;
-		else if (r < 0) {
-			say_syserror("recv");
-			result = EX_OSERR;
-			goto exit;
-		} else if (r == 0) {
-			result = EX_OK;
-			goto exit;
+		/* complete requests may be already buffered while previous batch was in flight */
+		bool ready = !inflight && request_row_count(&rbuf) >= 0;
+
+		if (!ready && (inflight || gc.dirty)) {
+			struct pollfd pfd[2] = { { .fd = fd, .events = POLLIN },
+						 { .fd = [writer completion_fd], .events = POLLIN } };
+			int timeout = -1;
+			if (!inflight) {
+				/* wait for the next batch no longer than group commit window */
+				ev_now_update();
+				timeout = group_commit_timeout(&gc);
+			}
+			if (timeout != 0) {
+				r = poll(pfd, inflight ? 2 : 1, timeout);
+				if (r < 0 && errno == EINTR)
+					continue;
+				if (r < 0) {
+					say_syserror("poll");
+					result = EX_OSERR;
+					goto exit;
+				}
+				if (r == 0)
+					timeout = 0;
+			}
+			if (timeout == 0) {
+				if (group_commit_sync(writer, &gc, fd) < 0) {
+					/* parent is dead, exit quetly */
+					result = EX_OK;
+					goto exit;
+				}
+				fiber_gc();
+				continue;
+			}
+			if (inflight && pfd[1].revents) {
+				inflight = false;
+				if (batch_reply(writer, fd, requests, request_count,
+						rows_appended, &epoch, &gc) < 0)
+				{
+					/* parent is dead, exit quetly */
+					result = EX_OK;
+					goto exit;
+				}
+				fiber_gc();
+				continue;
+			}
+			if (!pfd[0].revents)
+				continue;
 		}
 
-		if (cfg.coredump > 0 && ev_now() - start_time > cfg.coredump * 60) {
-			maximize_core_rlimit();
-			cfg.coredump = 0;
+		if (!ready) {
+			tbuf_reserve(&rbuf, 16 * 1024);
+			r = tbuf_recv(&rbuf, fd);
+			if (r < 0 && (errno == EINTR))
+				continue;
+			else if (r < 0) {
+				say_syserror("recv");
+				result = EX_OSERR;
+				goto exit;
+			} else if (r == 0) {
+				result = EX_OK;
+				goto exit;
+			}
+
+			if (cfg.coredump > 0 && ev_now() - start_time > cfg.coredump * 60) {
+				maximize_core_rlimit();
+				cfg.coredump = 0;
+			}
+
+			/* keep receiving until previous batch is written */
+			if (inflight)
+				continue;
 		}
 
 		request_count = 0;
@@ -298,8 +563,8 @@ wal_disk_writer(int fd, int cfd __attribute__((unused)), void *state, int len)
 		/* we're not running inside ev_loop, so update ev_now manually just before write */
 		ev_now_update();
 
-
-		int rows_appended = 0;
+		bool sync = false;
+		rows_appended = 0;
 		for (int i = 0; i < nelem(requests); i++) {
 			struct request *request = &requests[i];
 			int row_count = request_row_count(&rbuf);
@@ -320,6 +585,9 @@ wal_disk_writer(int fd, int cfd __attribute__((unused)), void *state, int len)
 					break;
 				}
 
+				/* row data may be moved by the next recv, so remember LSN now */
+				if (j == 0)
+					request->first_lsn = row->lsn;
 				rows_appended++;
 				say_debug("|	shard:%i SCN:%"PRIi64" tag:%s data_len:%u",
 					  row->shard_id, row->scn, xlog_tag_to_a(row->tag), row->len);
@@ -327,34 +595,22 @@ wal_disk_writer(int fd, int cfd __attribute__((unused)), void *state, int len)
 			for (; j < row_count && request->epoch != epoch; j++)
 				request->rows[j] = NULL;
 
+			if (j > 0 && request->sync_mode >= WAL_SYNC_WRITE)
+				sync = true;
 			request_count++;
 		}
 		if (request_count == 0)
 			continue;
 
-		int rows_confirmed = [writer confirm_write];
-		assert(rows_appended >= rows_confirmed);
-
-		if (rows_appended != rows_confirmed) /* some rows failed to flush */
-			epoch++;
-
-		for (int i = 0; i < request_count; i++) {
-			struct request *request = &requests[i];
-			struct wal_reply *reply = request->reply;
-
-			reply->row_count = MIN(rows_confirmed, request->row_count); /* real number rows written to disk */
-			reply->packet_len = sizeof(struct wal_reply);
-			reply->epoch = epoch;
-			if (reply->row_count > 0)
-				reply->lsn = request->rows[reply->row_count - 1]->lsn;
-
-			rows_confirmed -= reply->row_count;
-
-			say_debug("reply[%i] rows:%i LSN:%"PRIi64,
-				  i, reply->row_count, reply->lsn);
+		/* zero length group commit window: fdatasync may be linked to the write itself */
+		if ([writer submit_write:(sync && cfg.wal_group_commit_delay <= 0)]) {
+			inflight = true;
+			continue;
 		}
 
-		if (flush(fd, requests, request_count) < 0) {
+		if (batch_reply(writer, fd, requests, request_count,
+				rows_appended, &epoch, &gc) < 0)
+		{
 			/* parent is dead, exit quetly */
 			result = EX_OK;
 			goto exit;
@@ -365,6 +621,7 @@ wal_disk_writer(int fd, int cfd __attribute__((unused)), void *state, int len)
 exit:
 	[writer->current_wal free];
 	writer->current_wal = nil;
+	free(gc.held);
 	return result;
 }
 
@@ -404,6 +661,12 @@ wal_disk_writer_input_dispatch(ev_io *ev, int __attribute__((unused)) events)
 		say_debug("%s: => rows:%i LSN:%"PRIi64" => %"PRIi64, __func__,
 			  reply->row_count, self->lsn, reply->lsn);
 
+		if (reply->group_rows > 0) {
+			stat_aggregate_named(self->stat_base, STAT_STR("group_commit_rows"), reply->group_rows);
+			stat_aggregate_named(self->stat_base, STAT_STR("group_commit_bytes"), reply->group_bytes);
+			stat_aggregate_named(self->stat_base, STAT_STR("fdatasync_time"), reply->sync_time * 1000);
+		}
+
 		if (reply->row_count > 0) { /* success or partial success */
 			self->lsn = reply->lsn;
 			if (pack->seq == reply->seq)
@@ -431,6 +694,9 @@ wal_disk_writer_input_dispatch(ev_io *ev, int __attribute__((unused)) events)
 - (i64) lsn { return lsn; }
 - (const struct child *) wal_writer { return &wal_writer; };
 
+static int default_sync_mode;
+static u8 shard_sync_mode[MAX_SHARD];
+
 void optimistic_write(ev_prepare *ev, int events __attribute__((unused)))
 {
 	XLogWriter *self = container_of(ev, XLogWriter, prepare);
@@ -469,6 +735,20 @@ init_lsn:(i64)init_lsn
 	if (cfg.rows_per_wal <= 4)
 		panic("inacceptable value of 'rows_per_wal'");
 
+	if ((default_sync_mode = wal_sync_mode_parse(cfg.wal_sync_mode)) < 0)
+		panic("inacceptable value of 'wal_sync_mode'");
+	for (int i = 0; i < MAX_SHARD; i++)
+		shard_sync_mode[i] = default_sync_mode;
+	for (int i = 0; cfg.wal_sync_mode_shard && cfg.wal_sync_mode_shard[i] && i < MAX_SHARD; i++) {
+		if (!CNF_STRUCT_DEFINED(cfg.wal_sync_mode_shard[i]))
+			continue;
+		int mode = wal_sync_mode_parse(cfg.wal_sync_mode_shard[i]->mode);
+		if (mode < 0)
+			panic("inacceptable value of 'wal_sync_mode_shard[%i].mode'", i);
+		shard_sync_mode[i] = mode;
+	}
+	stat_base = stat_register_named("wal");
+
 	say_info("Configuring WAL writer LSN:%"PRIi64, lsn);
 
 	struct wal_disk_writer_conf *conf = xcalloc(1, sizeof(*conf));
@@ -556,6 +836,8 @@ wal_pack_submit
 {
 	struct wal_pack *pack = TAILQ_LAST(&wal_queue, wal_pack_tailq);
 	pack->request->row_count = pack->row_count;
+	pack->request->sync_mode = MAX(fiber->wal_sync_mode,
+				       pack->shard_id >= 0 ? shard_sync_mode[pack->shard_id] : default_sync_mode);
 	say_debug("submit WAL request seq:%"PRIi64, pack->seq);
 	struct wal_reply *reply = yield();
 	TAILQ_REMOVE(&wal_queue, pack, link);
@@ -598,35 +880,119 @@ init_state:(id<RecoveryState>)state_
 }
 
 
+struct snap_view_job {
+	id<SnapshotView> executor;
+	void *view;
+	XLog *snap;
+	int ret, err, efd;
+};
+
+static void *
+snap_view_thread(void *arg)
+{
+	struct snap_view_job *job = arg;
+	u64 one = 1;
+
+	job->ret = [job->executor snapshot_write_view:job->view to:job->snap];
+	job->err = errno;
+	if (write(job->efd, &one, sizeof(one)) != sizeof(one))
+		abort();
+	return NULL;
+}
+
+/* dump frozen view from separate thread, event loop keeps running */
+static int
+snap_view_write(XLog *snap, id<SnapshotView> executor, void *view)
+{
+	struct snap_view_job job = { .executor = executor, .view = view, .snap = snap };
+	pthread_t tid;
+	u64 done;
+
+	job.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (job.efd < 0) {
+		say_syserror("eventfd");
+		return -1;
+	}
+	int err = pthread_create(&tid, NULL, snap_view_thread, &job);
+	if (err != 0) {
+		errno = err;
+		say_syserror("pthread_create");
+		close(job.efd);
+		return -1;
+	}
+	/* snapshot thread is done with view when it is fed completely */
+	for (;;) {
+		int r = [executor snapshot_feed:view];
+		if (r < 0)
+			break;
+		fiber_sleep(r == 0 ? 0.001 : 0);
+	}
+	fiber_read(job.efd, &done, sizeof(done));
+	pthread_join(tid, NULL);
+	close(job.efd);
+	errno = job.err;
+	return job.ret;
+}
+
 - (int)
 snapshot_write
+{
+	return [self snapshot_write_nofork:NULL];
+}
+
+/* lock == NULL: state is frozen by fork() (or there is no concurrent activity),
+   rows are written directly by executors.
+   otherwise everything snapshot consists of is captured under lock in one go */
+- (int)
+snapshot_write_nofork:(struct rwlock *)lock
 {
         XLog *snap;
-	i64 *scn;
-	u32 total_rows = 0;
+	i64 lsn, scn[MAX_SHARD] = { 0 };
+	u32 total_rows = 0, run_crc_log = 0;
 	bool legacy_mode = 0;
+	struct {
+		id executor;
+		void *view;
+		struct row_v12 *creator;
+	} part[MAX_SHARD] = { { nil } };
+	int ret = -1;
 
-	say_debug("%s: LSN:%"PRIi64, __func__, [state lsn]);
+	if (lock)
+		wlock(lock);
 
-	if ([state lsn] < 0)
-		return -1;
+	lsn = [state lsn];
+	say_debug("%s: LSN:%"PRIi64, __func__, lsn);
 
-	scn = xcalloc(MAX_SHARD, sizeof(*scn));
-	for (int i = 0; i < MAX_SHARD; i++) {
+	for (int i = 0; lsn >= 0 && i < MAX_SHARD; i++) {
 		Shard<Shard> *shard = [state shard:i];
 		if (shard == nil)
 			continue;
-		if (i == 0 && shard->dummy)
+		if (i == 0 && shard->dummy) {
 			legacy_mode = 1;
+			run_crc_log = shard->run_crc;
+		}
 
 		scn[i] = [shard scn];
-		total_rows += [[shard executor] snapshot_estimate];
+		part[i].executor = [shard executor];
+		total_rows += [part[i].executor snapshot_estimate];
+
+		struct row_v12 *creator = [shard creator_row]; /* static buffer */
+		part[i].creator = memcpy(xmalloc(sizeof(*creator) + creator->len), creator,
+					 sizeof(*creator) + creator->len);
+		if (lock)
+			part[i].view = [part[i].executor snapshot_freeze];
 	}
 
-	snap = [snap_dir open_for_write:[state lsn]];
+	if (lock)
+		wunlock(lock);
+
+	if (lsn < 0)
+		goto out;
+
+	snap = [snap_dir open_for_write:lsn];
 	if (snap == nil) {
 		say_syserror("can't open snap for writing");
-		return -1;
+		goto out;
 	}
 	[(XLog12 *)snap write_header_scn:scn];
 	snap->no_wet = true; /* We don't handle write errors here because
@@ -642,7 +1008,7 @@ snapshot_write
 	char *filename = strdup(snap->filename);
 	char *suffix = strrchr(filename, '.');
 	*suffix = 0;
-	say_info("saving snapshot `%s'", filename);
+	say_info("saving snapshot `%s'%s", filename, lock ? " without fork" : "");
 
 	i64 snap_scn = -1;
 
@@ -650,27 +1016,28 @@ snapshot_write
 		say_info("legacy snapshot without microsharding");
 		struct tbuf *snap_ini = tbuf_alloc(fiber->pool);
 		tbuf_append(snap_ini, &total_rows, sizeof(total_rows));
-
-		u32 run_crc_log = [state shard:0]->run_crc;
 		tbuf_append(snap_ini, &run_crc_log, sizeof(run_crc_log));
 		u32 run_crc_mod = 0;
 		tbuf_append(snap_ini, &run_crc_mod, sizeof(run_crc_mod));
 
-		if ([state lsn] == 1) {
+		if (lsn == 1)
 			snap_scn = 1;
-		} else {
-			assert([state shard:0]);
-			snap_scn = [[state shard:0] scn];
-		}
+		else
+			snap_scn = scn[0];
 
 		if ([snap append_row:snap_ini->ptr len:tbuf_len(snap_ini)
 				 scn:snap_scn tag:snap_initial] == NULL)
 		{
 			say_error("unable write initial row");
-			return -1;
+			goto out;
+		}
+		if (part[0].view) {
+			if (snap_view_write(snap, part[0].executor, part[0].view) < 0)
+				goto out;
+		} else {
+			if ([part[0].executor snapshot_write_rows:snap] < 0)
+				goto out;
 		}
-		if ([[[state shard:0] executor] snapshot_write_rows:snap] < 0)
-			return -1;
 	} else {
 		struct tbuf *snap_ini = tbuf_alloc(fiber->pool);
 		u8 ver = 0;
@@ -683,35 +1050,44 @@ snapshot_write
 				 scn:snap_scn tag:snap_initial] == NULL)
 		{
 			say_error("unable write initial row");
-			return -1;
+			goto out;
 		}
 
 		for (int i = 0; i < MAX_SHARD; i++) {
-			Shard<Shard> *shard = [state shard:i];
-			if (shard == nil)
+			struct row_v12 *header = part[i].creator;
+			if (header == NULL)
 				continue;
 
-			struct row_v12 *header = [shard creator_row];
 			if ([snap append_row:header data:header->data] == NULL)
 			{
 				say_error("unable write initial row");
-				return -1;
+				goto out;
 			}
 
-			if ([[shard executor] snapshot_write_rows:snap] < 0)
-				return -1;
+			if (part[i].view) {
+				if (snap_view_write(snap, part[i].executor, part[i].view) < 0)
+					goto out;
+			} else {
+				if ([part[i].executor snapshot_write_rows:snap] < 0)
+					goto out;
+			}
 
 			char dummy[2] = { 0 };
-			if ([snap append_row:dummy len:sizeof(dummy)
-				       shard:shard tag:shard_final] == NULL)
-				return -1;
+			static struct row_v12 row;
+			row = (struct row_v12){ .scn = scn[i],
+						.tm = ev_now(),
+						.tag = shard_final,
+						.shard_id = i,
+						.len = sizeof(dummy) };
+			if ([snap append_row:&row data:dummy] == NULL)
+				goto out;
 		}
 	}
 
 	const char end[] = "END";
 	if ([snap append_row:end len:strlen(end) scn:snap_scn tag:snap_final] == NULL) {
 		say_error("unable write final row");
-		return -1;
+		goto out;
 	}
 
 	if ([snap rows] == 0) /* initial snapshot in compat mode has no rows */
@@ -719,25 +1095,258 @@ snapshot_write
 
 	if ([snap flush] == -1) {
 		say_syserror("snap flush failed");
-		return -1;
+		goto out;
 	}
 
 	if ([snap write_eof_marker] == -1) {
 		say_syserror("snap close failed");
-		return -1;
+		goto out;
 	}
 
 	if ([snap inprogress_rename] == -1) {
 		say_syserror("snap inprogress rename failed");
-		return -1;
+		goto out;
 	}
 
 	[snap free];
 	say_info("done");
-	return 0;
+	ret = 0;
+out:
+	for (int i = 0; i < MAX_SHARD; i++) {
+		if (part[i].view)
+			[part[i].executor snapshot_release:part[i].view];
+		free(part[i].creator);
+	}
+	return ret;
 }
 
 
 @end
 
+struct snap_chunk {
+	int fd;
+	i64 lsn, scn;
+	u16 shard_id;
+	double tm;
+	size_t rows;
+	off_t bytes;
+	char *buf;
+	size_t len, size;
+	int state; /* 0: pending, 1: done, -1: failed */
+	snap_chunk_cb *cb;
+	void *arg;
+};
+
+struct snap_parallel {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct snap_chunk *chunks;
+	int count, next;
+};
+
+static int
+snap_chunk_flush(struct snap_chunk *chunk)
+{
+	const char *p = chunk->buf;
+	while (chunk->len > 0) {
+		ssize_t r = write(chunk->fd, p, chunk->len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			return -1;
+		p += r;
+		chunk->len -= r;
+	}
+	return 0;
+}
+
+/* same row layout as -[XLog12 append_row:data:] in snapshot mode:
+   all rows carry snapshot LSN, so they are position independent */
+int
+snap_chunk_append(struct snap_chunk *chunk, u16 tag, const struct iovec *iov, int iovcnt)
+{
+	struct row_v12 row = { .lsn = chunk->lsn,
+			       .scn = chunk->scn ?: chunk->lsn,
+			       .tm = chunk->tm,
+			       .tag = tag,
+			       .shard_id = chunk->shard_id };
+
+	if ((row.tag & ~TAG_MASK) == 0)
+		row.tag |= TAG_SNAP;
+	for (int i = 0; i < iovcnt; i++) {
+		row.data_crc32c = crc32c(row.data_crc32c, iov[i].iov_base, iov[i].iov_len);
+		row.len += iov[i].iov_len;
+	}
+	assert(row.len > 0);
+	row.header_crc32c = crc32c(0, (unsigned char *)&row + sizeof(row.header_crc32c),
+				   sizeof(row) - sizeof(row.header_crc32c));
+
+	size_t len = sizeof(marker) + sizeof(row) + row.len;
+	if (chunk->len + len > chunk->size) {
+		if (snap_chunk_flush(chunk) < 0)
+			return -1;
+		if (len > chunk->size) {
+			chunk->size = len;
+			chunk->buf = xrealloc(chunk->buf, chunk->size);
+		}
+	}
+
+	char *p = chunk->buf + chunk->len;
+	memcpy(p, &marker, sizeof(marker));
+	p += sizeof(marker);
+	memcpy(p, &row, sizeof(row));
+	p += sizeof(row);
+	for (int i = 0; i < iovcnt; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	chunk->len += len;
+	chunk->bytes += len;
+	chunk->rows++;
+	return 0;
+}
+
+static void *
+snap_worker(void *arg)
+{
+	struct snap_parallel *p = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&p->mtx);
+		int i = p->next < p->count ? p->next++ : -1;
+		pthread_mutex_unlock(&p->mtx);
+		if (i < 0)
+			return NULL;
+
+		struct snap_chunk *chunk = &p->chunks[i];
+		int r = chunk->cb(chunk, chunk->arg);
+		if (r >= 0)
+			r = snap_chunk_flush(chunk);
+
+		pthread_mutex_lock(&p->mtx);
+		chunk->state = r < 0 ? -1 : 1;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->mtx);
+	}
+}
+
+static int
+snap_chunk_tmpfile(XLog *snap)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/.snap_chunk.XXXXXX", snap->dir->dirname);
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		say_syserror("mkstemp");
+		return -1;
+	}
+	unlink(path);
+	return fd;
+}
+
+static int
+snapshot_write_chunks_(XLog *snap, i64 scn, u16 shard_id, double tm,
+		       int count, snap_chunk_cb *cb, void **args, bool progress)
+{
+	struct snap_parallel p = { .count = count };
+	int threads = MAX(1, MIN(cfg.snap_dump_threads, count));
+	pthread_t *tid = xcalloc(threads, sizeof(*tid));
+	int started = 0, ret = 0;
+
+	pthread_mutex_init(&p.mtx, NULL);
+	pthread_cond_init(&p.cond, NULL);
+	p.chunks = xcalloc(count, sizeof(*p.chunks));
+
+	for (int i = 0; i < count; i++) {
+		struct snap_chunk *chunk = &p.chunks[i];
+		chunk->fd = snap_chunk_tmpfile(snap);
+		if (chunk->fd < 0) {
+			p.count = i;
+			ret = -1;
+			goto out;
+		}
+		chunk->lsn = snap->next_lsn;
+		chunk->scn = scn;
+		chunk->shard_id = shard_id;
+		chunk->tm = tm;
+		chunk->size = 1024 * 1024;
+		chunk->buf = xmalloc(chunk->size);
+		chunk->cb = cb;
+		chunk->arg = args[i];
+	}
+
+	for (; started < threads; started++) {
+		int err = pthread_create(&tid[started], NULL, snap_worker, &p);
+		if (err != 0) {
+			errno = err;
+			say_syserror("pthread_create");
+			break;
+		}
+	}
+	if (started == 0)
+		snap_worker(&p);
+
+	/* stitch chunks in order while workers proceed with the rest */
+	for (int i = 0; i < count; i++) {
+		struct snap_chunk *chunk = &p.chunks[i];
+
+		pthread_mutex_lock(&p.mtx);
+		while (chunk->state == 0)
+			pthread_cond_wait(&p.cond, &p.mtx);
+		pthread_mutex_unlock(&p.mtx);
+
+		if (chunk->state < 0) {
+			say_error("unable to serialize snapshot chunk %i", i);
+			ret = -1;
+			break;
+		}
+
+		if (lseek(chunk->fd, 0, SEEK_SET) < 0 ||
+		    [snap append_raw:chunk->fd len:chunk->bytes rows:chunk->rows] < 0)
+		{
+			ret = -1;
+			break;
+		}
+		close(chunk->fd);
+		chunk->fd = -1;
+		if (progress)
+			title("snap_dump %i/%i chunks", i + 1, count);
+	}
+
+	if (ret < 0) {
+		/* don't start new chunks, wait for running ones */
+		pthread_mutex_lock(&p.mtx);
+		p.next = p.count;
+		pthread_mutex_unlock(&p.mtx);
+	}
+	for (int i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+out:
+	for (int i = 0; i < p.count; i++) {
+		if (p.chunks[i].fd >= 0)
+			close(p.chunks[i].fd);
+		free(p.chunks[i].buf);
+	}
+	free(p.chunks);
+	free(tid);
+	pthread_mutex_destroy(&p.mtx);
+	pthread_cond_destroy(&p.cond);
+	return ret;
+}
+
+int
+snapshot_write_parallel(XLog *snap, Shard *shard, int count, snap_chunk_cb *cb, void **args)
+{
+	ev_now_update();
+	return snapshot_write_chunks_(snap, shard->scn, shard->id, ev_now(),
+				      count, cb, args, true);
+}
+
+int
+snapshot_write_chunks(XLog *snap, i64 scn, u16 shard_id, double tm,
+		      int count, snap_chunk_cb *cb, void **args)
+{
+	return snapshot_write_chunks_(snap, scn, shard_id, tm, count, cb, args, false);
+}
+
 register_source();
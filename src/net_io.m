@@ -110,8 +110,8 @@ rbuf_alloc(struct netmsg_io *io, int size)
 	palloc_ref(pool);
 }
 
-ssize_t
-rbuf_recv(struct netmsg_io *io, int size)
+static void
+rbuf_reserve(struct netmsg_io *io, int size)
 {
 	if (io->rbuf.pool == NULL) {
 		rbuf_alloc(io, size * 2);
@@ -127,9 +127,22 @@ rbuf_recv(struct netmsg_io *io, int size)
 			palloc_unref(pool);
 		}
 	}
+}
+
+ssize_t
+rbuf_recv(struct netmsg_io *io, int size)
+{
+	rbuf_reserve(io, size);
 	return tbuf_recv(&io->rbuf, io->fd);
 }
 
+void
+rbuf_append(struct netmsg_io *io, const void *data, int size)
+{
+	rbuf_reserve(io, size);
+	tbuf_append(&io->rbuf, data, size);
+}
+
 
 void
 netmsg_io_shutdown(struct netmsg_io *io, int how)
@@ -872,8 +872,18 @@ init_storage:
 	} else if (CFG_SLAB_SIZE > 32*1024*1024) {
 		panic("slab_alloc_slab_power too big");
 	}
+	if (cfg.slab_alloc_hugepages == NULL || strcmp(cfg.slab_alloc_hugepages, "none") == 0)
+		salloc_pages = SALLOC_PAGES_NORMAL;
+	else if (strcmp(cfg.slab_alloc_hugepages, "thp") == 0)
+		salloc_pages = SALLOC_PAGES_THP;
+	else if (strcmp(cfg.slab_alloc_hugepages, "hugetlb") == 0)
+		salloc_pages = SALLOC_PAGES_HUGETLB;
+	else
+		panic("inacceptable value of 'slab_alloc_hugepages'");
+	salloc_numa_node = cfg.slab_alloc_numa_node;
 	salloc_init(fixed_arena, cfg.slab_alloc_minimal, cfg.slab_alloc_factor);
 
+	tsc_calibrate();
 	stat_init();
 #ifdef CFG_graphite_addr
 	graphite_init();
@@ -120,18 +120,21 @@ hist_val(int p) {
 }
 
 struct stat_percent {
-	double p50, p90, p99;
+	double p50, p90, p99, p999;
 };
 static struct stat_percent
 hist_percent(uint32_t *hist, uint32_t cnt)
 {
 	int i;
-	uint32_t sum = 0, c1 = cnt/100, c10 = cnt/10, c50 = cnt/2;
-	struct stat_percent p = {-1,-1,-1};
+	uint32_t sum = 0, c01 = cnt/1000, c1 = cnt/100, c10 = cnt/10, c50 = cnt/2;
+	struct stat_percent p = {-1,-1,-1,-1};
 	for (i=HIST_CNT-1; i>=0; i--) {
 		if (hist[i] == 0)
 			continue;
 		sum += hist[i];
+		if (p.p999 < 0 && sum >= c01) {
+			p.p999 = hist_val(i);
+		}
 		if (p.p99 < 0 && sum >= c1) {
 			p.p99 = hist_val(i);
 		}
@@ -476,6 +479,7 @@ stat_admin_out(struct stat_accum *cur, struct tbuf *b)
 				tbuf_printf(b, "%sp50: %-8.3f", COMMA, pcnt.p50);
 				tbuf_printf(b, "%sp90: %-8.3f", COMMA, pcnt.p90);
 				tbuf_printf(b, "%sp99: %-8.3f", COMMA, pcnt.p99);
+				tbuf_printf(b, "%sp999: %-8.3f", COMMA, pcnt.p999);
 			}
 			sum_rps = p->sum / nelem(stat_bases[0].records);
 			if (p->cnt != 0)
@@ -783,6 +787,7 @@ stat_base_print_to_graphite(struct stat_base *bs)
 				graphite_send3(bs->name, acc->name->str, "p50", pcnt.p50);
 				graphite_send3(bs->name, acc->name->str, "p90", pcnt.p90);
 				graphite_send3(bs->name, acc->name->str, "p99", pcnt.p99);
+				graphite_send3(bs->name, acc->name->str, "p999", pcnt.p999);
 			}
 			if (acc->sum != 0 || acc->cnt != 0) {
 				double sum_rps = (double)acc->sum / diff_time;
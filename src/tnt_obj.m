@@ -81,7 +81,7 @@ object_ref(struct tnt_object *obj, int count)
 void
 object_incr_ref(struct tnt_object *obj)
 {
-	assert(obj->type == 1);
+	assert(obj->type == 1 || obj->type == 4); /* BOX_TUPLE or MC_OBJ, BOX_TUPLE_OFT */
 	struct gc_oct_object *gcobj = container_of(obj, struct gc_oct_object, obj);
 	assert(gcobj->refs + 1 > 0);
 	gcobj->refs++;
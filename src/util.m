@@ -199,6 +199,27 @@ drand(double top)
 	return (top * (double)rand()) / RAND_MAX;
 }
 
+double tsc_ms = 1e-6;
+
+void
+tsc_calibrate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	struct timespec a, b;
+	u64 start, stop;
+	double ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	start = tsc_now();
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		ns = (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+	} while (ns < 10e6);
+	stop = tsc_now();
+	tsc_ms = ns / 1e6 / (stop - start);
+#endif
+}
+
 #if defined(__ia64__) && defined(__hpux__)
 typedef unsigned _Unwind_Ptr __attribute__((__mode__(__word__)));
 #else
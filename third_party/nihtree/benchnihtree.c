@@ -49,9 +49,69 @@ elapsedtime(struct timeval *begin) {
 #define N	4000000
 #define D	250
 #define M	100000
+#define L	10000000
+
+static int
+cmpU32Fn(const void *a, const void *b, void *arg __attribute__((unused))) {
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int
+cmpU64Fn(const void *a, const void *b, void *arg __attribute__((unused))) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+/* random lookups in tree of nkeys sorted keys: key_cmp callback vs nihkey_u32/u64 */
+static void
+searchBench(uint32_t nkeys, int sizeof_key, nihkey_type_t key_type) {
+	nihtree_t	tt;
+	nihtree_conf_t	tc;
+	struct timeval	begin;
+	double		elapsed;
+	uint64_t	buf[1024];
+	uint32_t	i, j, nFound = 0;
+
+	memset(&tc, 0, sizeof(tc));
+	tc.sizeof_tuple = sizeof_key;
+	tc.key_cmp = sizeof_key == 4 ? cmpU32Fn : cmpU64Fn;
+	tc.key_type = key_type;
+	tc.inner_max = 128;
+	tc.leaf_max = 32;
+	nihtree_conf_init(&tc);
+	nihtree_init(&tt);
+
+	/* even keys only: half of lookups miss */
+	for (i = 0; i < nkeys; i += j) {
+		for (j = 0; j < 1024 && i + j < nkeys; j++) {
+			uint64_t k = 2 * (uint64_t)(i + j);
+			if (sizeof_key == 4)
+				((uint32_t*)buf)[j] = k;
+			else
+				buf[j] = k;
+		}
+		nihtree_append(&tt, &tc, buf, j);
+	}
+
+	uint32_t x = 12345;
+	gettimeofday(&begin, NULL);
+	for (i = 0; i < L; i++) {
+		x = x * 1103515245 + 12345;
+		uint64_t k = (x >> 1) % (2 * (uint64_t)nkeys);
+		uint32_t k32 = k;
+		if (nihtree_find_by_key(&tt, &tc, sizeof_key == 4 ? (void*)&k32 : (void*)&k, NULL) != NULL)
+			nFound++;
+	}
+	elapsed = elapsedtime(&begin);
+	printf("Search u%d %s in %u keys (height %u, %u found): %.2f secs, %.3g lookups per second\n",
+	       sizeof_key * 8, key_type == nihkey_generic ? "key_cmp" : "numeric",
+	       nkeys, nihtree_height(&tt), nFound, elapsed, L / elapsed);
+	nihtree_release(&tt, &tc);
+}
 
 int
-main(int argc __attribute__((unused)), char *argv[] __attribute__((unused))) {
+main(int argc, char *argv[]) {
 	int			i, n, K, nFound = 0;
 	threeInt		e;
 	double			msum;
@@ -173,5 +233,12 @@ main(int argc __attribute__((unused)), char *argv[] __attribute__((unused))) {
 				((double)D)/elapsed,
 				elapsed/((double)D), msum
 			);
+
+	/* ./benchnihtree 100000000 */
+	uint32_t nkeys = argc > 1 ? strtoul(argv[1], NULL, 0) : 10 * 1000 * 1000;
+	searchBench(nkeys, 4, nihkey_generic);
+	searchBench(nkeys, 4, nihkey_u32);
+	searchBench(nkeys, 8, nihkey_generic);
+	searchBench(nkeys, 8, nihkey_u64);
 	return 0;
 }
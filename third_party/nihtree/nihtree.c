@@ -33,6 +33,10 @@
 #include "../bsearch.h"
 #define NIH_TREE_INTERNAL
 #include "nihtree.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NIH_AVX2_DISPATCH 1
+#endif
 
 #if NIH_TREE_DEBUG
 #define trace(format, ...) fprintf(stderr, "%s:%d " format "\n", __func__, __LINE__, ##__VA_ARGS__)
@@ -201,10 +205,42 @@ nih_free(nihtree_conf_t* conf, void* p) {
 	conf->nhrealloc(p, 0, conf->arg);
 }
 
+static int
+nih_u32_cmp(const void *a, const void *b, void *arg) {
+	(void)arg;
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int
+nih_u64_cmp(const void *a, const void *b, void *arg) {
+	(void)arg;
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
 niherrcode_t
 nihtree_conf_init(nihtree_conf_t* conf) {
 	if (conf->sizeof_tuple == 0)
 		return NIH_WRONG_CONFIG;
+	switch (conf->key_type) {
+	case nihkey_generic:
+		break;
+	case nihkey_u32:
+		if (conf->sizeof_key != 0 && conf->sizeof_key != sizeof(uint32_t))
+			return NIH_WRONG_CONFIG;
+		conf->sizeof_key = sizeof(uint32_t);
+		conf->key_cmp = nih_u32_cmp;
+		break;
+	case nihkey_u64:
+		if (conf->sizeof_key != 0 && conf->sizeof_key != sizeof(uint64_t))
+			return NIH_WRONG_CONFIG;
+		conf->sizeof_key = sizeof(uint64_t);
+		conf->key_cmp = nih_u64_cmp;
+		break;
+	default:
+		return NIH_WRONG_CONFIG;
+	}
 	if (conf->tuple_2_key == NULL) {
 		if (conf->sizeof_key != 0 &&
 				conf->sizeof_key != conf->sizeof_tuple) {
@@ -477,8 +513,143 @@ nihtree_release(nihtree_t* tree, nihtree_conf_t* conf) {
 	}
 }
 
+/* number of sorted keys less than (or equal to) key: branchless bisection
+ * down to a window of few cache lines, then SIMD linear scan of window */
+#define NIH_BISECT(keys, cnt, key, or_equal, window) ({ \
+	int _lo = 0, _hi = (cnt); \
+	while (_hi - _lo > (window)) { \
+		int _mid = (_lo + _hi) / 2; \
+		bool _less = (keys)[_mid] < (key) || ((or_equal) && (keys)[_mid] == (key)); \
+		_lo = _less ? _mid + 1 : _lo; \
+		_hi = _less ? _hi : _mid; \
+	} \
+	_lo; })
+
+#if NIH_AVX2_DISPATCH
+/* AVX2 is picked at run time: binary stays runnable on older CPUs */
+static bool nih_avx2;
+
+static void __attribute__((constructor))
+nih_cpu_init(void) {
+	__builtin_cpu_init();
+	nih_avx2 = __builtin_cpu_supports("avx2");
+}
+
+static int __attribute__((target("avx2")))
+nih_scan_u32_avx2(const uint32_t *keys, int cnt, uint32_t key, bool or_equal) {
+	int i = 0;
+	const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+	const __m256i k = _mm256_xor_si256(_mm256_set1_epi32(key), bias);
+	for (; i + 8 <= cnt; i += 8) {
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), bias);
+		__m256i m = or_equal ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v);
+		unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+		if (or_equal)
+			mask = ~mask & 0xff;
+		if (mask != 0xff)
+			return i + __builtin_popcount(mask);
+	}
+	while (i < cnt && (keys[i] < key || (or_equal && keys[i] == key)))
+		i++;
+	return i;
+}
+
+static int __attribute__((target("avx2")))
+nih_scan_u64_avx2(const uint64_t *keys, int cnt, uint64_t key, bool or_equal) {
+	int i = 0;
+	const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+	const __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(key), bias);
+	for (; i + 4 <= cnt; i += 4) {
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), bias);
+		__m256i m = or_equal ? _mm256_cmpgt_epi64(v, k) : _mm256_cmpgt_epi64(k, v);
+		unsigned mask = _mm256_movemask_pd(_mm256_castsi256_pd(m));
+		if (or_equal)
+			mask = ~mask & 0xf;
+		if (mask != 0xf)
+			return i + __builtin_popcount(mask);
+	}
+	while (i < cnt && (keys[i] < key || (or_equal && keys[i] == key)))
+		i++;
+	return i;
+}
+#endif
+
+static inline int
+nih_scan_u32(const uint32_t *keys, int cnt, uint32_t key, bool or_equal) {
+	int i = 0;
+#if NIH_AVX2_DISPATCH
+	if (nih_avx2)
+		return nih_scan_u32_avx2(keys, cnt, key, or_equal);
+#endif
+#if defined(__SSE2__)
+	const __m128i bias = _mm_set1_epi32(INT32_MIN);
+	const __m128i k = _mm_xor_si128(_mm_set1_epi32(key), bias);
+	for (; i + 4 <= cnt; i += 4) {
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + i)), bias);
+		__m128i m = or_equal ? _mm_cmpgt_epi32(v, k) : _mm_cmpgt_epi32(k, v);
+		unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(m));
+		if (or_equal)
+			mask = ~mask & 0xf;
+		if (mask != 0xf)
+			return i + __builtin_popcount(mask);
+	}
+#endif
+	while (i < cnt && (keys[i] < key || (or_equal && keys[i] == key)))
+		i++;
+	return i;
+}
+
+static inline int
+nih_count_u32(const uint32_t *keys, int cnt, uint32_t key, bool or_equal) {
+	int lo = NIH_BISECT(keys, cnt, key, or_equal, 16);
+	return lo + nih_scan_u32(keys + lo, cnt - lo, key, or_equal);
+}
+
+static inline int
+nih_scan_u64(const uint64_t *keys, int cnt, uint64_t key, bool or_equal) {
+	int i = 0;
+#if NIH_AVX2_DISPATCH
+	if (nih_avx2)
+		return nih_scan_u64_avx2(keys, cnt, key, or_equal);
+#endif
+	while (i < cnt && (keys[i] < key || (or_equal && keys[i] == key)))
+		i++;
+	return i;
+}
+
+static inline int
+nih_count_u64(const uint64_t *keys, int cnt, uint64_t key, bool or_equal) {
+	int lo = NIH_BISECT(keys, cnt, key, or_equal, 8);
+	return lo + nih_scan_u64(keys + lo, cnt - lo, key, or_equal);
+}
+
+/* same result as bsearch below: keys of inner node are unique */
+static inline int
+nihnode_pos_num(nihnode_t *node, nihtree_conf_t* conf, void const *key, nihscan_direction_t dir) {
+	bool or_equal = dir != nihscan_forward;
+	int cnt;
+	if (conf->key_type == nihkey_u32)
+		cnt = nih_count_u32(nihnode_keys(node), node->cnt, *(const uint32_t*)key, or_equal);
+	else
+		cnt = nih_count_u64(nihnode_keys(node), node->cnt, *(const uint64_t*)key, or_equal);
+	if (dir == nihscan_search)
+		return cnt - 1;
+	return cnt > 0 ? cnt - 1 : 0;
+}
+
+static inline int
+nih_key_cmp(nihtree_conf_t* conf, void const *a, void const *b) {
+	switch (conf->key_type) {
+	case nihkey_u32: return nih_u32_cmp(a, b, NULL);
+	case nihkey_u64: return nih_u64_cmp(a, b, NULL);
+	default: return conf->key_cmp(a, b, conf->arg);
+	}
+}
+
 static inline int
 nihnode_pos(nihnode_t *node, nihtree_conf_t* conf, void const *key, nihscan_direction_t dir) {
+	if (conf->key_type != nihkey_generic)
+		return nihnode_pos_num(node, conf, key, dir);
 	BSEARCH_STRUCT(int) bs;
 	BSEARCH_INIT(&bs, node->cnt);
 	void* keys = nihnode_keys(node);
@@ -514,12 +685,14 @@ nihleaf_pos(nihleaf_t *leaf, nihtree_conf_t* conf, void const *key, void* buf, n
 	while (BSEARCH_NOT_FOUND(&bs)) {
 		void *tuple = leaf->data + bs.mid*conf->sizeof_tuple;
 		int diff;
-		if (conf->key_tuple_cmp != NULL) {
+		if (conf->tuple_2_key == NULL) {
+			diff = nih_key_cmp(conf, key, tuple);
+		} else if (conf->key_tuple_cmp != NULL) {
 			diff = conf->key_tuple_cmp(key, tuple, conf->arg);
 		} else {
 			if (!conf->tuple_2_key(tuple, buf, conf->arg))
 				abort();
-			diff = conf->key_cmp(key, buf, conf->arg);
+			diff = nih_key_cmp(conf, key, buf);
 		}
 		if (dir == nihscan_search) {
 			BSEARCH_STEP_TO_EQUAL_MAY_BREAK(&bs, diff);
@@ -656,6 +829,40 @@ nihtree_key_position_buf(nihtree_t *tt, nihtree_conf_t* conf, void const *key, n
 	return nihtree_key_position_i(tt->root, conf, key, r, buf);
 }
 
+static uint32_t
+nihtree_key_bound_i(nihpage_t *page, nihtree_conf_t* conf, void const *key,
+		nihscan_direction_t direction, void* buf) {
+	uint32_t res = 0;
+	while (page->common.height > 0) {
+		nihnode_t* node = &page->node;
+		int pos = nihnode_pos(node, conf, key, direction);
+		res += nihnode_counts_sumfirst(node, pos, 1);
+		page = node->children[pos];
+	}
+	search_res_t s = nihleaf_pos(&page->leaf, conf, key, buf, direction);
+	return res + s.pos;
+}
+
+uint32_t
+nihtree_key_bound(nihtree_t *tt, nihtree_conf_t* conf, void const *key,
+		nihscan_direction_t direction) {
+	void *buf = NULL;
+	if (tt->root == NULL)
+		return 0;
+	if (conf->key_tuple_cmp == NULL)
+		buf = alloca(conf->sizeof_key);
+	return nihtree_key_bound_i(tt->root, conf, key, direction, buf);
+}
+
+uint32_t
+nihtree_key_bound_buf(nihtree_t *tt, nihtree_conf_t* conf, void const *key,
+		nihscan_direction_t direction, void *buf) {
+	if (tt->root == NULL)
+		return 0;
+	assert(conf->key_tuple_cmp == NULL || buf != NULL);
+	return nihtree_key_bound_i(tt->root, conf, key, direction, buf);
+}
+
 typedef struct modify_ctx {
 	nihtree_conf_t* conf;
 	void	*tuple, *key, *buf;
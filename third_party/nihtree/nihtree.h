@@ -31,6 +31,15 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+/* with numeric key types keys are plain unsigned integers compared by
+ * nihtree itself (key_cmp may be NULL), inner nodes are searched with
+ * SIMD linear scan instead of bsearch through key_cmp */
+typedef enum nihkey_type {
+	nihkey_generic = 0,
+	nihkey_u32, /* sizeof_key == 4 */
+	nihkey_u64  /* sizeof_key == 8 */
+} nihkey_type_t;
+
 typedef struct nihtree_conf {
 	int sizeof_tuple;
 	int sizeof_key; /* ATTENTION: alloca is used to allocate space for */
@@ -40,6 +49,7 @@ typedef struct nihtree_conf {
 	int leaf_max; /* maximum tuple number in leaf page */
 	int inner_max; /* maximum child/key number in inner page */
 	bool flexi_size;
+	nihkey_type_t key_type;
 
 	void *arg;
 
@@ -157,6 +167,12 @@ void* nihtree_find_by_key(nihtree_t *tt, nihtree_conf_t* conf, void const *key,
 uint32_t nihtree_key_position(nihtree_t *tt, nihtree_conf_t* conf, void const *key,
 		niherrcode_t *r);
 
+/* nihscan_forward: returns number of tuples less than key
+ * nihscan_backward: returns number of tuples less than or equal to key
+ * so count of tuples matching (partial) key is difference of both */
+uint32_t nihtree_key_bound(nihtree_t *tt, nihtree_conf_t* conf, void const *key,
+		nihscan_direction_t direction);
+
 static inline size_t
 nihtree_iter_need_size(int height) {
         if (height == 0)
@@ -213,6 +229,8 @@ void* nihtree_find_by_key_buf(nihtree_t *tt, nihtree_conf_t* conf, void const *k
 		niherrcode_t *r, void *buf);
 uint32_t nihtree_key_position_buf(nihtree_t *tt, nihtree_conf_t* conf, void const *key,
 		niherrcode_t *r, void *buf);
+uint32_t nihtree_key_bound_buf(nihtree_t *tt, nihtree_conf_t* conf, void const *key,
+		nihscan_direction_t direction, void *buf);
 void nihtree_iter_init_set_buf(nihtree_t *tt, nihtree_conf_t* conf,
 		nihtree_iter_t* it, void *key, nihscan_direction_t direction, void* buf);
 
@@ -145,6 +145,8 @@ check_order(nihtree_t *tt, nihtree_conf_t* conf, nihtree_iter_t *it) {
 		ik.k = i;
 		int pos = nihtree_key_position(tt, conf, &ik, &err);
 		int npos;
+		assert(nihtree_key_bound(tt, conf, &ik, nihscan_forward) == pos);
+		assert(nihtree_key_bound(tt, conf, &ik, nihscan_backward) == pos + (err == NIH_OK));
 		nihtree_iter_init_set(tt, conf, it, &ik, nihscan_forward);
 		tp = nihtree_iter_next(it);
 		if (tp == NULL) {
@@ -188,6 +190,104 @@ check_skip(nihtree_iter_t *it, unsigned skip, uint32_t ch[3], tuple_t *tpls) {
 	printf("Check skip %u: %u %u %d\n", skip, ch[0], ch[1], ch[2]);
 }
 
+static int
+num_cmp(const void *a, const void *b, void *arg) {
+	if ((uintptr_t)arg == 4) {
+		uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+		return x < y ? -1 : x > y;
+	}
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+/* nihkey_u32/u64 trees must behave exactly as bsearch through key_cmp:
+ * same keys are loaded into both, every key around stored ones is probed
+ * in every scan direction. keys are sparse and have high bit set
+ * in the upper half to catch signed compares in SIMD scan */
+static void
+check_numeric(int sizeof_key, int nkeys) {
+	nihtree_t	num_tt, gen_tt;
+	nihtree_conf_t	num_tc, gen_tc;
+	nihtree_iter_t	*num_it = alloca(nihtree_iter_need_size(31)),
+			*gen_it = alloca(nihtree_iter_need_size(31));
+	uint64_t	*keys = malloc(nkeys * sizeof(uint64_t));
+	uint64_t	probe;
+	niherrcode_t	num_err, gen_err;
+	nihscan_direction_t dirs[] = { nihscan_forward, nihscan_backward };
+	int		i, d, bad = 0;
+
+	num_it->max_height = gen_it->max_height = 31;
+	memset(&gen_tc, 0, sizeof(gen_tc));
+	gen_tc.sizeof_tuple = sizeof_key;
+	gen_tc.key_cmp = num_cmp;
+	gen_tc.arg = (void*)(uintptr_t)sizeof_key;
+	gen_tc.inner_max = 64;
+	gen_tc.leaf_max = 16;
+	num_tc = gen_tc;
+	num_tc.key_type = sizeof_key == 4 ? nihkey_u32 : nihkey_u64;
+	nihtree_conf_init(&gen_tc);
+	nihtree_conf_init(&num_tc);
+	nihtree_init(&num_tt);
+	nihtree_init(&gen_tt);
+
+	for (i = 0; i < nkeys; i++) {
+		uint64_t k = 3 * (uint64_t)i + 1;
+		if (i >= nkeys / 2)
+			k |= sizeof_key == 4 ? 0x80000000ULL : 0x8000000000000000ULL;
+		if (sizeof_key == 4)
+			((uint32_t*)keys)[i] = k;
+		else
+			keys[i] = k;
+	}
+	nihtree_append(&gen_tt, &gen_tc, keys, nkeys);
+	nihtree_append(&num_tt, &num_tc, keys, nkeys);
+
+	for (i = -1; i <= nkeys; i++) {
+		for (int delta = -1; delta <= 1; delta++) {
+			if (i < 0)
+				probe = delta < 0 ? 0 : (uint64_t)delta;
+			else if (i == nkeys)
+				probe = sizeof_key == 4 ? UINT32_MAX : UINT64_MAX;
+			else
+				probe = (sizeof_key == 4 ? ((uint32_t*)keys)[i] : keys[i]) + delta;
+			uint32_t probe32 = probe;
+			void *key = sizeof_key == 4 ? (void*)&probe32 : (void*)&probe;
+
+			/* nihscan_search */
+			void *nf = nihtree_find_by_key(&num_tt, &num_tc, key, NULL),
+			     *gf = nihtree_find_by_key(&gen_tt, &gen_tc, key, NULL);
+			if ((nf == NULL) != (gf == NULL) ||
+			    (nf && memcmp(nf, gf, sizeof_key) != 0))
+				bad++;
+			if (nihtree_key_position(&num_tt, &num_tc, key, &num_err) !=
+			    nihtree_key_position(&gen_tt, &gen_tc, key, &gen_err) ||
+			    num_err != gen_err)
+				bad++;
+
+			for (d = 0; d < 2; d++) {
+				if (nihtree_key_bound(&num_tt, &num_tc, key, dirs[d]) !=
+				    nihtree_key_bound(&gen_tt, &gen_tc, key, dirs[d]))
+					bad++;
+				nihtree_iter_init_set(&num_tt, &num_tc, num_it, key, dirs[d]);
+				nihtree_iter_init_set(&gen_tt, &gen_tc, gen_it, key, dirs[d]);
+				for (int j = 0; j < 3; j++) {
+					void *nt = nihtree_iter_next(num_it),
+					     *gt = nihtree_iter_next(gen_it);
+					if ((nt == NULL) != (gt == NULL) ||
+					    (nt && memcmp(nt, gt, sizeof_key) != 0))
+						bad++;
+				}
+			}
+		}
+	}
+	printf("Check numeric u%d %d keys (height %u): %s\n", sizeof_key * 8, nkeys,
+	       nihtree_height(&num_tt), bad ? "WRONG" : "ok");
+
+	nihtree_release(&num_tt, &num_tc);
+	nihtree_release(&gen_tt, &gen_tc);
+	free(keys);
+}
+
 int
 main(int argn, char *argv[]) {
 	niherrcode_t 	err = 0;
@@ -217,6 +317,25 @@ main(int argn, char *argv[]) {
 	tc.arg = (void*)MAGICK;
 	tc.nhrealloc = realloc_count;
 
+	/* both SIMD and plain scan, whichever CPU has */
+	for (int avx2 = 0; avx2 <= 1; avx2++) {
+#if NIH_AVX2_DISPATCH
+		if (avx2 && !__builtin_cpu_supports("avx2"))
+			break;
+		nih_avx2 = avx2;
+#else
+		if (avx2)
+			break;
+#endif
+		for (int nkeys = 1; nkeys < 20000; nkeys = nkeys * 7 + 3) {
+			check_numeric(4, nkeys);
+			check_numeric(8, nkeys);
+		}
+	}
+#if NIH_AVX2_DISPATCH
+	nih_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
 	nihtree_conf_init(&tc);
 	if (err != NIH_OK)
 		printf("nihtree_init returns %d\n", err);
@@ -0,0 +1,154 @@
+/*
+ * salloc arena page size benchmark: synthetic box-like space (tuples of
+ * random size in salloc + open addressing hash index over them), random
+ * lookups which touch tuple data. reports lookup rate and dTLB misses.
+ *
+ * cc -O2 -I.. -DHAVE_MADVISE=1 benchsalloc.c -o benchsalloc
+ * ./benchsalloc [tuples] [arena_gb] [numa_node]
+ *
+ * hugetlb mode needs reserved pages: sysctl vm.nr_hugepages=N
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+# include <sys/syscall.h>
+# include <sys/ioctl.h>
+# include <linux/perf_event.h>
+#endif
+#include "salloc.c"
+
+struct tuple {
+	uint32_t bsize, cardinality;
+	uint32_t id;
+	uint8_t data[];
+};
+
+static inline double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+dtlb_counter(void)
+{
+#if defined(__linux__)
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static uint64_t
+counter_read(int fd)
+{
+	uint64_t v = 0;
+	if (fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v))
+		return 0;
+	return v;
+}
+
+static inline uint32_t
+hash32(uint32_t k)
+{
+	k ^= k >> 16;
+	k *= 0x85ebca6b;
+	k ^= k >> 13;
+	k *= 0xc2b2ae35;
+	k ^= k >> 16;
+	return k;
+}
+
+static void
+run(const char *name, enum salloc_pages pages, size_t arena, uint32_t n)
+{
+	uint32_t mask = 1;
+	while (mask < n * 2)
+		mask <<= 1;
+	struct tuple **hash = calloc(mask, sizeof(*hash));
+	mask -= 1;
+
+	salloc_pages = pages;
+	salloc_init(arena, 64, 1.05);
+
+	srand(1);
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t bsize = 32 + rand() % 160;
+		struct tuple *t = salloc(sizeof(*t) + bsize);
+		if (t == NULL) {
+			fprintf(stderr, "%s: arena is too small for %u tuples\n", name, n);
+			exit(1);
+		}
+		t->bsize = bsize;
+		t->cardinality = 4;
+		t->id = i;
+		memset(t->data, i, bsize);
+
+		uint32_t k = hash32(i) & mask;
+		while (hash[k])
+			k = (k + 1) & mask;
+		hash[k] = t;
+	}
+
+	int fd = dtlb_counter();
+	uint64_t sum = 0;
+	const uint32_t lookups = 10 * 1000 * 1000;
+	uint32_t x = 12345;
+
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	double start = now();
+	for (uint32_t i = 0; i < lookups; i++) {
+		x = x * 1103515245 + 12345;
+		uint32_t id = x % n;
+		uint32_t k = hash32(id) & mask;
+		while (hash[k]->id != id)
+			k = (k + 1) & mask;
+		sum += hash[k]->data[hash[k]->bsize - 1];
+	}
+	double elapsed = now() - start;
+	if (fd >= 0)
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	uint64_t misses = counter_read(fd);
+	if (fd >= 0)
+		close(fd);
+
+	printf("%-8s hugetlb:%6zuMB thp:%6zuMB  %8.2f Mlookups/s  dTLB misses/lookup: %s%.3f  (%llu)\n",
+	       name, fixed_arena->hugetlb_size >> 20, fixed_arena->thp_size >> 20,
+	       lookups / elapsed / 1e6, fd < 0 ? "n/a " : "",
+	       (double)misses / lookups, (unsigned long long)sum);
+
+	salloc_destroy();
+	free(hash);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint32_t n = argc > 1 ? atoi(argv[1]) : 10 * 1000 * 1000;
+	size_t arena = (argc > 2 ? atof(argv[2]) : 4.0) * (1 << 30);
+	salloc_numa_node = argc > 3 ? atoi(argv[3]) : -1;
+
+	run("none", SALLOC_PAGES_NORMAL, arena, n);
+	run("thp", SALLOC_PAGES_THP, arena, n);
+	run("hugetlb", SALLOC_PAGES_HUGETLB, arena, n);
+	return 0;
+}
@@ -37,10 +37,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif
 #ifdef HAVE_SYS_PARAM_H
 # include <sys/param.h>
 #endif
@@ -99,6 +103,7 @@ void __asan_unpoison_memory_region(void const volatile *addr, size_t size);
 # define panic_syserror(x) abort()
 # define say_syserror(...) (void)0;
 # define say_info(...) (void)0;
+# define say_warn(...) (void)0;
 #endif
 
 #ifndef SLAB_SIZE
@@ -134,6 +139,7 @@ struct slab {
 #if HAVE_MADVISE
 	bool need_madvise;
 #endif
+	bool evacuate; /* taken out of allocation by salloc_defrag_begin() */
 	SLIST_ENTRY(slab) link;
 	SLIST_ENTRY(slab) free_link;
 	TAILQ_ENTRY(slab) cache_partial_link;
@@ -150,9 +156,19 @@ struct arena {
 	size_t used;
 	size_t item_used;
 	int    free_slabs_cnt;
+	size_t hugetlb_size, thp_size; /* part of size backed by huge pages */
+	int    hugetlb_fallbacks;
 	struct slab_slist_head slabs, free_slabs;
 };
 
+enum salloc_pages salloc_pages = SALLOC_PAGES_NORMAL;
+int salloc_numa_node = -1;
+static size_t hugepage_size;
+
+static struct slab **evac_slabs;
+static int evac_slabs_cnt, evac_slabs_size, defrag_runs;
+static size_t defrag_released;
+
 static uint32_t slab_active_caches;
 static struct slab_cache slab_caches[256];
 static struct arena arena[2], *fixed_arena = &arena[0], *grow_arena = &arena[1];
@@ -224,15 +240,16 @@ slab_cache_series_init(enum arena_type arena_type, size_t minimal, double factor
 }
 
 static void *
-mmapa(size_t size, size_t align)
+mmapa(size_t size, size_t align, int flags)
 {
 	void *ptr, *aptr;
 	assert (size % align == 0);
 
 	ptr = mmap(MMAP_HINT_ADDR, size + align, /* add padding for later rounding */
-		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
 	if (ptr == MAP_FAILED) {
-		say_syserror("mmap");
+		if (flags == 0)
+			say_syserror("mmap");
 		return NULL;
 	}
 
@@ -246,13 +263,106 @@ mmapa(size_t size, size_t align)
 	return ptr;
 }
 
+static size_t
+read_hugepage_size(void)
+{
+	size_t size = 2 * 1024 * 1024;
+#if defined(__linux__)
+	FILE *f = fopen("/proc/meminfo", "r");
+	char line[128];
+	unsigned long kb;
+
+	if (f == NULL)
+		return size;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+			size = kb * 1024;
+			break;
+		}
+	fclose(f);
+#endif
+	return size;
+}
+
+/* preferred policy: allocation falls back to other nodes instead of OOM */
+static void
+numa_bind(void *ptr, size_t size)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	const int mpol_preferred = 1;
+	unsigned long nodemask[4] = { 0 };
+	const unsigned long maxnode = sizeof(nodemask) * 8;
+
+	if (salloc_numa_node < 0)
+		return;
+	if ((unsigned long)salloc_numa_node >= maxnode) {
+		say_warn("salloc: numa node %i is out of range", salloc_numa_node);
+		return;
+	}
+	nodemask[salloc_numa_node / (sizeof(nodemask[0]) * 8)] |=
+		1UL << (salloc_numa_node % (sizeof(nodemask[0]) * 8));
+	if (syscall(SYS_mbind, ptr, size, mpol_preferred, nodemask, maxnode, 0) < 0)
+		say_syserror("mbind");
+#else
+	(void)ptr; (void)size;
+#endif
+}
+
+static void *
+mmap_hugetlb(size_t size)
+{
+#if defined(MAP_HUGETLB)
+	if (size % hugepage_size != 0)
+		return NULL;
+	/* huge pages are hugepage_size aligned and mapping can only be
+	   trimmed on huge page boundary: avoid padding when possible */
+	if (SLAB_SIZE <= hugepage_size) {
+		void *ptr = mmap(MMAP_HINT_ADDR, size, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		return ptr == MAP_FAILED ? NULL : ptr;
+	}
+	return mmapa(size, SLAB_SIZE, MAP_HUGETLB);
+#else
+	(void)size;
+	return NULL;
+#endif
+}
+
 static bool
 arena_add_mmap(struct arena *arena, size_t size)
 {
-	void *ptr = mmapa(size, SLAB_SIZE);
-	if (!ptr)
-		return false;
+	void *ptr = NULL;
+	enum salloc_pages pages = salloc_pages;
+
+	/* grow arena is extended by single slab, don't waste huge pages on it */
+	if (pages == SALLOC_PAGES_HUGETLB && arena == fixed_arena) {
+		ptr = mmap_hugetlb(size);
+		if (ptr == NULL && arena->hugetlb_fallbacks++ == 0)
+			say_warn("salloc: can't map %zu bytes of huge pages, falling back to THP;"
+				 " check vm.nr_hugepages", size);
+	}
+	if (pages == SALLOC_PAGES_HUGETLB && ptr == NULL)
+		pages = SALLOC_PAGES_THP;
+
+	if (ptr == NULL) {
+		ptr = mmapa(size, SLAB_SIZE, 0);
+		if (!ptr)
+			return false;
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+		if (pages == SALLOC_PAGES_THP && madvise(ptr, size, MADV_HUGEPAGE) < 0) {
+			say_syserror("madvise(MADV_HUGEPAGE)");
+			pages = SALLOC_PAGES_NORMAL;
+		}
+#else
+		pages = SALLOC_PAGES_NORMAL;
+#endif
+	}
+	numa_bind(ptr, size);
 
+	if (pages == SALLOC_PAGES_HUGETLB)
+		arena->hugetlb_size += size;
+	else if (pages == SALLOC_PAGES_THP)
+		arena->thp_size += size;
 	arena->size += size;
 	arena->brk = arena->base = ptr;
 	return true;
@@ -307,10 +417,14 @@ salloc_init(size_t size, size_t minimal, double factor)
 #endif
 	assert(sizeof(struct slab) <= page_size);
 
+	hugepage_size = read_hugepage_size();
+
 	if (size > 0) {
 		size -= size % SLAB_SIZE; /* round to size of max slab */
 		if (size < SLAB_SIZE * 2)
 			size = SLAB_SIZE * 2;
+		if (salloc_pages == SALLOC_PAGES_HUGETLB && size % hugepage_size != 0)
+			size = TYPEALIGN(MAX(hugepage_size, SLAB_SIZE), size);
 
 		if (!arena_init(fixed_arena, size))
 			panic_syserror("salloc_init: can't initialize arena");
@@ -322,8 +436,10 @@ salloc_init(size_t size, size_t minimal, double factor)
 	slab_cache_series_init(size > 0 ? SLAB_FIXED : SLAB_GROW,
 			       MAX(sizeof(void *), minimal), factor);
 	if (size > 0)
-		say_info("slab allocator configured, fixed_arena:%.1fGB",
-			 size / (1024. * 1024 * 1024));
+		say_info("slab allocator configured, fixed_arena:%.1fGB%s",
+			 size / (1024. * 1024 * 1024),
+			 fixed_arena->hugetlb_size ? " hugetlb" :
+			 fixed_arena->thp_size ? " thp" : "");
 }
 
 void
@@ -357,6 +473,7 @@ format_slab(struct slab_cache *cache, struct slab *slab)
 	slab->cache = cache;
 	slab->items = 0;
 	slab->used = 0;
+	slab->evacuate = false;
 	slab->brk = (void *)CACHEALIGN((void *)slab + sizeof(struct slab));
 
 	ASAN_POISON_MEMORY_REGION(slab->brk, SLAB_SIZE - (slab->brk - (void *)slab), 0xfa);
@@ -511,7 +628,7 @@ sfree(void *ptr)
 	struct slab_cache *cache = slab->cache;
 	struct slab_item *item = ptr;
 
-	if (fully_populated(slab))
+	if (fully_populated(slab) && !slab->evacuate)
 		TAILQ_INSERT_TAIL(&cache->partial_populated_slabs, slab, cache_partial_link);
 
 	assert(valid_item(slab, item));
@@ -524,13 +641,18 @@ sfree(void *ptr)
 	slab->items -= 1;
 
 	if (slab->items == 0) {
-		TAILQ_REMOVE(&cache->partial_populated_slabs, slab, cache_partial_link);
+		if (slab->evacuate)
+			slab->evacuate = false; /* not in partial list */
+		else
+			TAILQ_REMOVE(&cache->partial_populated_slabs, slab, cache_partial_link);
 		TAILQ_REMOVE(&cache->slabs, slab, cache_link);
 		SLIST_INSERT_HEAD(&cache->arena->free_slabs, slab, free_link);
 		cache->arena->free_slabs_cnt++;
 
 #if HAVE_MADVISE
-		if (slab->need_madvise) {
+		/* hugetlb page can't be partially released, keep it.
+		   THP is split by kernel and released as usual */
+		if (slab->need_madvise && cache->arena->hugetlb_size == 0) {
 			slab->need_madvise = false;
 			int r;
 			r = madvise((void *)slab + page_size, SLAB_SIZE - page_size, MADV_DONTNEED);
@@ -552,6 +674,86 @@ slab_cache_free(struct slab_cache *cache, void *ptr)
 	sfree(ptr);
 }
 
+/* sparse slabs of salloc() caches are excluded from allocation, so
+   owner can move their items elsewhere with salloc() + sfree().
+   no more slabs are picked than rest of the cache can absorb */
+int
+salloc_defrag_begin(double max_fill)
+{
+	const size_t capacity = SLAB_SIZE - sizeof(struct slab);
+	struct slab *slab;
+
+	assert(evac_slabs_cnt == 0);
+	defrag_runs++;
+
+	for (uint32_t i = 0; i < slab_active_caches; i++) {
+		struct slab_cache *cache = &slab_caches[i];
+		size_t used = 0, slabs = 0;
+
+		TAILQ_FOREACH(slab, &cache->slabs, cache_link) {
+			used += slab->used;
+			slabs++;
+		}
+		/* keep enough slabs (plus one for slack) to hold all items */
+		size_t keep = used / capacity + 2;
+		if (slabs <= keep)
+			continue;
+		size_t evacuate = slabs - keep;
+
+		TAILQ_FOREACH(slab, &cache->slabs, cache_link) {
+			if (evacuate == 0)
+				break;
+			if (slab->used >= capacity * max_fill)
+				continue;
+			assert(!fully_populated(slab));
+			evacuate--;
+
+			TAILQ_REMOVE(&cache->partial_populated_slabs, slab, cache_partial_link);
+			slab->evacuate = true;
+#if HAVE_MADVISE
+			slab->need_madvise = true;
+#endif
+			if (evac_slabs_cnt == evac_slabs_size) {
+				evac_slabs_size = evac_slabs_size ? evac_slabs_size * 2 : 64;
+				evac_slabs = realloc(evac_slabs, evac_slabs_size * sizeof(*evac_slabs));
+				if (evac_slabs == NULL)
+					panic("salloc_defrag_begin: out of memory");
+			}
+			evac_slabs[evac_slabs_cnt++] = slab;
+		}
+	}
+	return evac_slabs_cnt;
+}
+
+bool
+salloc_evacuating(const void *ptr)
+{
+	return slab_of_ptr(ptr)->evacuate;
+}
+
+/* slabs that weren't emptied go back to allocation */
+int
+salloc_defrag_end(void)
+{
+	int released = 0;
+
+	for (int i = 0; i < evac_slabs_cnt; i++) {
+		struct slab *slab = evac_slabs[i];
+		if (slab->evacuate) {
+			slab->evacuate = false;
+			TAILQ_INSERT_TAIL(&slab->cache->partial_populated_slabs, slab, cache_partial_link);
+		} else {
+			released++;
+		}
+	}
+	defrag_released += released;
+
+	free(evac_slabs);
+	evac_slabs = NULL;
+	evac_slabs_cnt = evac_slabs_size = 0;
+	return released;
+}
+
 #ifdef OCTOPUS
 static void
 cache_stat(struct slab_cache *cache, struct tbuf *out)
@@ -577,6 +779,8 @@ cache_stat(struct slab_cache *cache, struct tbuf *out)
 
 }
 
+void (*slab_stat_hook)(struct tbuf *buf);
+
 void
 slab_stat(struct tbuf *t)
 {
@@ -589,13 +793,19 @@ slab_stat(struct tbuf *t)
 		if (arena[i].size == 0)
 			break;
 
-		tbuf_printf(t, "    - { type: %s, used: %.2f, size: %zu, free_slabs: %i }" CRLF,
+		tbuf_printf(t, "    - { type: %s, used: %.2f, size: %zu, free_slabs: %i"
+			    ", hugetlb: %zu, thp: %zu, hugetlb_fallbacks: %i, numa_node: %i }" CRLF,
 			    &arena[i] == fixed_arena ? "fixed" :
 			    &arena[i] == grow_arena ? "grow" : "unknown",
 			    (double)arena[i].used / arena[i].size * 100,
-			    arena[i].size, arena[i].free_slabs_cnt);
+			    arena[i].size, arena[i].free_slabs_cnt,
+			    arena[i].hugetlb_size, arena[i].thp_size,
+			    arena[i].hugetlb_fallbacks, salloc_numa_node);
 	}
 
+	tbuf_printf(t, "  defrag: { runs: %i, slabs_released: %zu }" CRLF,
+		    defrag_runs, defrag_released);
+
 	tbuf_printf(t, "  caches:" CRLF);
 	for (uint32_t i = 0; i < slab_active_caches; i++)
 		cache_stat(&slab_caches[i], t);
@@ -613,6 +823,9 @@ slab_stat(struct tbuf *t)
 		tbuf_printf(t, "  items_used: 0" CRLF);
 		tbuf_printf(t, "  arena_used: 0" CRLF);
 	}
+
+	if (slab_stat_hook != NULL)
+		slab_stat_hook(t);
 }
 static int
 stradd(char* d, char const *s) {
@@ -645,6 +858,8 @@ void slab_stat_report(void (*report)(char const * name, int len, double value))
 		slen = stradd(buf+len, "item_used");
 		used = arena[i].item_used;
 		report(buf, len+slen, (double)used/arena[i].size * 100);
+		slen = stradd(buf+len, "huge_size");
+		report(buf, len+slen, (double)(arena[i].hugetlb_size + arena[i].thp_size));
 	}
 }
 
@@ -32,6 +32,7 @@
 # import <tbuf.h>
 #endif
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -58,12 +59,22 @@ enum arena_type {
 	SLAB_GROW
 };
 
+/* backing of arena memory, see salloc_pages/salloc_numa_node */
+enum salloc_pages {
+	SALLOC_PAGES_NORMAL,
+	SALLOC_PAGES_THP,	/* transparent huge pages, madvise(MADV_HUGEPAGE) */
+	SALLOC_PAGES_HUGETLB	/* explicit huge pages, falls back to THP */
+};
+
 enum salloc_error {
 	ESALLOC_NOCACHE,
 	ESALLOC_NOMEM
 };
 
 extern int salloc_error;
+/* must be set before salloc_init() */
+extern enum salloc_pages salloc_pages;
+extern int salloc_numa_node; /* -1: no binding */
 
 void salloc_init(size_t size, size_t minimal, double factor);
 void salloc_destroy(void);
@@ -75,11 +86,17 @@ void sfree(void *ptr);
 void slab_validate();
 #ifdef OCTOPUS
 void slab_stat(struct tbuf *buf);
+/* modules append own memory usage to `show slab' */
+extern void (*slab_stat_hook)(struct tbuf *buf);
 void slab_stat_report(void (*report)(char const * name, int len, double value));
 #endif
 void slab_total_stat(uint64_t *bytes_used, uint64_t *items);
 void slab_cache_stat(struct slab_cache *cache, uint64_t *bytes_used, uint64_t *items);
 struct slab_cache *slab_cache_of_ptr(const void *ptr);
+/* online defragmentation, items of evacuating slabs should be reallocated */
+int salloc_defrag_begin(double max_fill);
+bool salloc_evacuating(const void *ptr);
+int salloc_defrag_end(void);
 size_t salloc_usable_size(const void *ptr);
 
 #endif // _SALLOC_H_